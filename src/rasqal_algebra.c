@@ -1507,6 +1507,51 @@ rasqal_algebra_select_graph_pattern_to_algebra(rasqal_query* query,
 }
 
 
+/*
+ * rasqal_algebra_service_graph_pattern_variables:
+ * @query: query
+ * @inner_gp: graph pattern inside the SERVICE
+ *
+ * INTERNAL - Get the named variables a SERVICE graph pattern may bind
+ *
+ * Return value: new sequence of #rasqal_variable or NULL if none or
+ * the variables use map has not been built
+ */
+static raptor_sequence*
+rasqal_algebra_service_graph_pattern_variables(rasqal_query* query,
+                                               rasqal_graph_pattern* inner_gp)
+{
+  raptor_sequence* vars_seq = NULL;
+  int size;
+  int i;
+
+  if(!query->variables_use_map)
+    return NULL;
+
+  size = rasqal_variables_table_get_named_variables_count(query->vars_table);
+  for(i = 0; i < size; i++) {
+    rasqal_variable* v = rasqal_variables_table_get(query->vars_table, i);
+
+    if(!rasqal_graph_pattern_variable_bound_below(inner_gp, v))
+      continue;
+
+    if(!vars_seq) {
+      vars_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                     (raptor_data_print_handler)rasqal_variable_print);
+      if(!vars_seq)
+        return NULL;
+    }
+
+    if(raptor_sequence_push(vars_seq, rasqal_new_variable_from_variable(v))) {
+      raptor_free_sequence(vars_seq);
+      return NULL;
+    }
+  }
+
+  return vars_seq;
+}
+
+
 static rasqal_algebra_node*
 rasqal_algebra_service_graph_pattern_to_algebra(rasqal_query* query,
                                                 rasqal_graph_pattern* gp)
@@ -1549,6 +1594,10 @@ rasqal_algebra_service_graph_pattern_to_algebra(rasqal_query* query,
     goto fail;
   }
 
+  /* Variables the remote pattern binds; used for SERVICE bind joins */
+  node->vars_seq = rasqal_algebra_service_graph_pattern_variables(query,
+                                                                  inner_gp);
+
   return node;
 
   fail:
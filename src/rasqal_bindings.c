@@ -92,7 +92,7 @@ rasqal_new_bindings_from_bindings(rasqal_bindings* bindings)
   if(!bindings)
     return NULL;
   
-  bindings->usage++;
+  RASQAL_USAGE_INCREMENT(&bindings->usage);
 
   return bindings;
 }
@@ -203,7 +203,7 @@ rasqal_free_bindings(rasqal_bindings* bindings)
   if(!bindings)
     return;
   
-  if(--bindings->usage)
+  if(RASQAL_USAGE_DECREMENT(&bindings->usage))
     return;
   
   raptor_free_sequence(bindings->variables);
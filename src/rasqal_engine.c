@@ -62,6 +62,7 @@ static const char* const rasqal_engine_error_labels[RASQAL_ENGINE_ERROR_LAST+2]=
   "ok",
   "FAILED",
   "finished",
+  "memory limit",
   "unknown"
 };
 
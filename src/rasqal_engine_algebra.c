@@ -47,11 +47,11 @@ typedef struct {
   rasqal_query* query;
   rasqal_query_results* query_results;
 
-  /* query algebra representation of query */
-  rasqal_algebra_node* algebra_node;
+  /* execution plan of the query (shared with query) */
+  rasqal_query_plan* plan;
 
-  /* number of nodes in #algebra_node tree */
-  int nodes_count;
+  /* parameter values joined with the query graph pattern (or NULL) */
+  rasqal_bindings* parameters;
 
   /* rowsource that provides the result rows */
   rasqal_rowsource* rowsource;
@@ -106,6 +106,12 @@ rasqal_algebra_filter_algebra_node_to_rowsource(rasqal_engine_algebra_data* exec
   if(!rs || *error_p)
     return NULL;
 
+  /* a FILTER over a BGP is evaluated by the scan, per morsel when
+   * the scan is parallel */
+  if(node->node1 && node->node1->op == RASQAL_ALGEBRA_OPERATOR_BGP &&
+     !rasqal_triples_rowsource_add_filter(rs, node->expr))
+    return rs;
+
   return rasqal_new_filter_rowsource(query->world, query, rs, node->expr);
 }
 
@@ -169,28 +175,71 @@ rasqal_algebra_project_algebra_node_to_rowsource(rasqal_engine_algebra_data* exe
 }
 
 
+/*
+ * rasqal_algebra_join_to_rowsource:
+ * @execution_data: execution data
+ * @node: JOIN or LEFTJOIN algebra node
+ * @join_type: join type
+ * @error_p: error pointer
+ *
+ * INTERNAL - Create the rowsource for a join or left join node
+ *
+ * A join with a SERVICE on the right becomes a bind join when
+ * #RASQAL_FEATURE_SERVICE_BIND_JOIN is set, otherwise a nested loop
+ * join.
+ *
+ * Return value: new rowsource or NULL on failure
+ */
 static rasqal_rowsource*
-rasqal_algebra_leftjoin_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
-                                                  rasqal_algebra_node* node,
-                                                  rasqal_engine_error *error_p)
+rasqal_algebra_join_to_rowsource(rasqal_engine_algebra_data* execution_data,
+                                 rasqal_algebra_node* node,
+                                 rasqal_join_type join_type,
+                                 rasqal_engine_error *error_p)
 {
   rasqal_query *query = execution_data->query;
+  rasqal_algebra_node* right = node->node2;
   rasqal_rowsource *left_rs;
   rasqal_rowsource *right_rs;
+  int batch_size;
 
   left_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node1,
                                              error_p);
   if(!left_rs || *error_p)
     return NULL;
 
-  right_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node2,
+  batch_size = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SERVICE_BIND_JOIN)];
+  if(batch_size > 0 && right->op == RASQAL_ALGEBRA_OPERATOR_SERVICE &&
+     right->vars_seq) {
+    unsigned int flags = (right->flags & RASQAL_ENGINE_BITFLAG_SILENT);
+
+    /* left_rs becomes owned by the bind join */
+    return rasqal_new_service_bindjoin_rowsource(query->world, query, left_rs,
+                                                 right->service_uri,
+                                                 right->query_string,
+                                                 right->data_graphs,
+                                                 right->vars_seq,
+                                                 flags, join_type,
+                                                 node->expr, batch_size);
+  }
+
+  right_rs = rasqal_algebra_node_to_rowsource(execution_data, right,
                                               error_p);
   if(!right_rs || *error_p) {
     rasqal_free_rowsource(left_rs);
     return NULL;
   }
 
-  return rasqal_new_join_rowsource(query->world, query, left_rs, right_rs, RASQAL_JOIN_TYPE_LEFT, node->expr);
+  return rasqal_new_join_rowsource(query->world, query, left_rs, right_rs, join_type, node->expr);
+}
+
+
+static rasqal_rowsource*
+rasqal_algebra_leftjoin_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
+                                                  rasqal_algebra_node* node,
+                                                  rasqal_engine_error *error_p)
+{
+  return rasqal_algebra_join_to_rowsource(execution_data, node,
+                                          RASQAL_JOIN_TYPE_LEFT, error_p);
 }
 
 
@@ -199,23 +248,8 @@ rasqal_algebra_join_algebra_node_to_rowsource(rasqal_engine_algebra_data* execut
                                               rasqal_algebra_node* node,
                                               rasqal_engine_error *error_p)
 {
-  rasqal_query *query = execution_data->query;
-  rasqal_rowsource *left_rs;
-  rasqal_rowsource *right_rs;
-
-  left_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node1,
-                                             error_p);
-  if(!left_rs || *error_p)
-    return NULL;
-
-  right_rs = rasqal_algebra_node_to_rowsource(execution_data, node->node2,
-                                              error_p);
-  if(!right_rs || *error_p) {
-    rasqal_free_rowsource(left_rs);
-    return NULL;
-  }
-
-  return rasqal_new_join_rowsource(query->world, query, left_rs, right_rs, RASQAL_JOIN_TYPE_NATURAL, node->expr);
+  return rasqal_algebra_join_to_rowsource(execution_data, node,
+                                          RASQAL_JOIN_TYPE_NATURAL, error_p);
 }
 
 
@@ -329,9 +363,6 @@ eval(D(G), Graph(IRI,P)) = the empty multiset
                                             error_p);
     } else {
       /* case #2 - IRI is not a graph name in D - return empty rowsource */
-      rasqal_free_algebra_node(node->node1);
-      node->node1 = NULL;
-      
       rs = rasqal_new_empty_rowsource(query->world, query);
     }
 
@@ -558,6 +589,24 @@ rasqal_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
       break;
   }
 
+  /* join the parameter values with the query graph pattern */
+  if(rs && execution_data->parameters &&
+     node == execution_data->plan->pattern_node) {
+    rasqal_query *query = execution_data->query;
+    rasqal_bindings* bindings;
+    rasqal_rowsource* parameters_rs;
+
+    bindings = rasqal_new_bindings_from_bindings(execution_data->parameters);
+    parameters_rs = rasqal_new_bindings_rowsource(query->world, query,
+                                                  bindings);
+    if(!parameters_rs) {
+      rasqal_free_rowsource(rs);
+      rs = NULL;
+    } else
+      rs = rasqal_new_join_rowsource(query->world, query, rs, parameters_rs,
+                                     RASQAL_JOIN_TYPE_NATURAL, NULL);
+  }
+
   if(!rs)
     *error_p = RASQAL_ENGINE_FAILED;
   
@@ -566,102 +615,174 @@ rasqal_algebra_node_to_rowsource(rasqal_engine_algebra_data* execution_data,
 
 
 
-static int
-rasqal_query_engine_algebra_execute_init(void* ex_data,
-                                         rasqal_query* query,
-                                         rasqal_query_results* query_results,
-                                         int flags,
-                                         rasqal_engine_error *error_p)
+/*
+ * rasqal_free_query_plan:
+ * @plan: query plan
+ *
+ * INTERNAL - Destructor - release a reference to a query plan
+ */
+void
+rasqal_free_query_plan(rasqal_query_plan* plan)
 {
-  rasqal_engine_algebra_data* execution_data;
-  rasqal_engine_error error;
-  int rc = 0;
+  if(!plan)
+    return;
+
+  if(RASQAL_USAGE_DECREMENT(&plan->usage))
+    return;
+
+  if(plan->node)
+    rasqal_free_algebra_node(plan->node);
+
+  RASQAL_FREE(rasqal_query_plan, plan);
+}
+
+
+/*
+ * rasqal_query_engine_algebra_new_plan:
+ * @query: query
+ *
+ * INTERNAL - Build the algebra execution plan for a query
+ *
+ * Return value: new plan or NULL on failure
+ */
+static rasqal_query_plan*
+rasqal_query_engine_algebra_new_plan(rasqal_query* query)
+{
+  rasqal_query_plan* plan;
   rasqal_projection* projection;
   rasqal_solution_modifier* modifier;
   rasqal_algebra_node* node;
   rasqal_algebra_aggregate* ae;
   
-  execution_data = (rasqal_engine_algebra_data*)ex_data;
-
-  /* initialise the execution_data fields */
-  execution_data->query = query;
-  execution_data->query_results = query_results;
-
-  if(!execution_data->triples_source) {
-    execution_data->triples_source = rasqal_new_triples_source(execution_data->query);
-    if(!execution_data->triples_source) {
-      *error_p = RASQAL_ENGINE_FAILED;
-      return 1;
-    }
-  }
-
   projection = rasqal_query_get_projection(query);
   modifier = query->modifier;
 
   node = rasqal_algebra_query_to_algebra(query);
   if(!node)
-    return 1;
+    return NULL;
+
+  plan = RASQAL_CALLOC(rasqal_query_plan*, 1, sizeof(*plan));
+  if(!plan) {
+    rasqal_free_algebra_node(node);
+    return NULL;
+  }
+  plan->usage = 1;
+  plan->pattern_node = node;
 
   node = rasqal_algebra_query_add_group_by(query, node, modifier);
   if(!node)
-    return 1;
+    goto failed;
 
   ae = rasqal_algebra_query_prepare_aggregates(query, node, projection,
                                                modifier);
   if(!ae)
-    return 1;
+    goto failed;
 
   if(ae) {
     node = rasqal_algebra_query_add_aggregation(query, ae, node);
     ae = NULL;
     if(!node)
-      return 1;
+      goto failed;
   }
 
   node = rasqal_algebra_query_add_having(query, node, modifier);
   if(!node)
-    return 1;
+    goto failed;
 
   if(query->verb == RASQAL_QUERY_VERB_SELECT) {
     node = rasqal_algebra_query_add_projection(query, node, projection);
     if(!node)
-      return 1;
+      goto failed;
   } else if(query->verb == RASQAL_QUERY_VERB_CONSTRUCT) {
     node = rasqal_algebra_query_add_construct_projection(query, node);
     if(!node)
-      return 1;
+      goto failed;
   }
 
   node = rasqal_algebra_query_add_orderby(query, node, projection, modifier);
   if(!node)
-    return 1;
+    goto failed;
 
   node = rasqal_algebra_query_add_distinct(query, node, projection);
   if(!node)
-    return 1;
+    goto failed;
 
-
-  execution_data->algebra_node = node;
+  plan->node = node;
 
   /* count final number of nodes */
-  execution_data->nodes_count = 0; 
-  rasqal_algebra_node_visit(query,
-                            execution_data->algebra_node,
+  plan->nodes_count = 0; 
+  rasqal_algebra_node_visit(query, plan->node,
                             rasqal_engine_algebra_count_nodes,
-                            &execution_data->nodes_count);
-  
+                            &plan->nodes_count);
   
 #ifdef RASQAL_DEBUG
   RASQAL_DEBUG1("algebra result: \n");
   rasqal_algebra_node_print(node, DEBUG_FH);
   fputc('\n', DEBUG_FH);
 #endif
-  RASQAL_DEBUG2("algebra nodes: %d\n", execution_data->nodes_count);
+  RASQAL_DEBUG2("algebra nodes: %d\n", plan->nodes_count);
+
+  return plan;
+
+  failed:
+  /* the add functions free the node on failure */
+  RASQAL_FREE(rasqal_query_plan, plan);
+  return NULL;
+}
+
+
+static int
+rasqal_query_engine_algebra_execute_init(void* ex_data,
+                                         rasqal_query* query,
+                                         rasqal_query_results* query_results,
+                                         int flags,
+                                         rasqal_engine_error *error_p)
+{
+  rasqal_engine_algebra_data* execution_data;
+  rasqal_engine_error error;
+  int rc = 0;
+  
+  execution_data = (rasqal_engine_algebra_data*)ex_data;
+
+  /* initialise the execution_data fields */
+  execution_data->query = query;
+  execution_data->query_results = query_results;
+
+  if(!execution_data->triples_source) {
+    execution_data->triples_source = rasqal_new_triples_source(execution_data->query);
+    if(!execution_data->triples_source) {
+      *error_p = RASQAL_ENGINE_FAILED;
+      return 1;
+    }
+  }
+
+  /* Use the plan kept from an earlier execution or build and keep one */
+  if(!query->plan) {
+    query->plan = rasqal_query_engine_algebra_new_plan(query);
+    if(!query->plan)
+      return 1;
+  }
+  execution_data->plan = query->plan;
+  RASQAL_USAGE_INCREMENT(&execution_data->plan->usage);
+
+  execution_data->parameters = rasqal_query_new_parameters_bindings(query);
 
   error = RASQAL_ENGINE_OK;
   execution_data->rowsource = rasqal_algebra_node_to_rowsource(execution_data,
-                                                               node,
+                                                               execution_data->plan->node,
                                                                &error);
+  if(execution_data->rowsource) {
+    int max_requests;
+
+    rasqal_rowsource_set_evaluation_context(execution_data->rowsource,
+                                            rasqal_query_results_get_evaluation_context(query_results));
+
+    /* Fetch independent SERVICE patterns at the same time */
+    max_requests = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_SERVICE_REQUESTS)];
+    if(max_requests > 0)
+      rasqal_rowsource_start_services(execution_data->rowsource,
+                                      max_requests);
+  }
 #ifdef RASQAL_DEBUG
   RASQAL_DEBUG1("rowsource (query plan) result: \n");
   if(execution_data->rowsource)
@@ -688,7 +809,13 @@ rasqal_query_engine_algebra_get_all_rows(void* ex_data,
 
   if(execution_data->rowsource) {
     seq = rasqal_rowsource_read_all_rows(execution_data->rowsource);
-    if(!seq)
+    if(rasqal_evaluation_context_memory_exceeded(execution_data->rowsource->eval_context)) {
+      if(seq) {
+        raptor_free_sequence(seq);
+        seq = NULL;
+      }
+      *error_p = RASQAL_ENGINE_MEMORY_LIMIT;
+    } else if(!seq)
       *error_p = RASQAL_ENGINE_FAILED;
   } else
     *error_p = RASQAL_ENGINE_FAILED;
@@ -708,8 +835,12 @@ rasqal_query_engine_algebra_get_row(void* ex_data,
 
   if(execution_data->rowsource) {
     row = rasqal_rowsource_read_row(execution_data->rowsource);
-    if(!row)
-      *error_p = RASQAL_ENGINE_FINISHED;
+    if(!row) {
+      if(rasqal_evaluation_context_memory_exceeded(execution_data->rowsource->eval_context))
+        *error_p = RASQAL_ENGINE_MEMORY_LIMIT;
+      else
+        *error_p = RASQAL_ENGINE_FINISHED;
+    }
   } else
     *error_p = RASQAL_ENGINE_FAILED;
 
@@ -726,14 +857,18 @@ rasqal_query_engine_algebra_execute_finish(void* ex_data,
   execution_data = (rasqal_engine_algebra_data*)ex_data;
 
   if(execution_data) {
-    if(execution_data->algebra_node)
-      rasqal_free_algebra_node(execution_data->algebra_node);
-
     if(execution_data->triples_source)
       rasqal_free_triples_source(execution_data->triples_source);
 
     if(execution_data->rowsource)
       rasqal_free_rowsource(execution_data->rowsource);
+
+    /* after the rowsources which may share parts of the plan */
+    if(execution_data->plan)
+      rasqal_free_query_plan(execution_data->plan);
+
+    if(execution_data->parameters)
+      rasqal_free_bindings(execution_data->parameters);
   }
 
   return 0;
@@ -747,6 +882,17 @@ rasqal_query_engine_algebra_finish_factory(rasqal_query_execution_factory* facto
 }
 
 
+static rasqal_rowsource*
+rasqal_query_engine_algebra_get_rowsource(void* ex_data)
+{
+  rasqal_engine_algebra_data* execution_data;
+
+  execution_data = (rasqal_engine_algebra_data*)ex_data;
+
+  return execution_data->rowsource;
+}
+
+
 const rasqal_query_execution_factory rasqal_query_engine_algebra =
 {
   /* .name=                */ "rasqal query algebra query engine",
@@ -755,5 +901,6 @@ const rasqal_query_execution_factory rasqal_query_engine_algebra =
   /* .get_all_rows=        */ rasqal_query_engine_algebra_get_all_rows,
   /* .get_row=             */ rasqal_query_engine_algebra_get_row,
   /* .execute_finish=      */ rasqal_query_engine_algebra_execute_finish,
-  /* .finish_factory=      */ rasqal_query_engine_algebra_finish_factory
+  /* .finish_factory=      */ rasqal_query_engine_algebra_finish_factory,
+  /* .get_rowsource=       */ rasqal_query_engine_algebra_get_rowsource
 };
@@ -211,16 +211,19 @@ rasqal_engine_rowsort_map_to_sequence(rasqal_map* map, raptor_sequence* seq)
 
 /**
  * rasqal_engine_rowsort_calculate_order_values:
- * @query: query object
+ * @eval_context: evaluation context
  * @order_seq: order conditions sequence
  * @row: row
  *
  * INTERNAL - Calculate the order condition values for a row
  *
+ * The row values are bound in @eval_context before evaluating the
+ * order conditions.
+ *
  * Return value: non-0 on failure 
  */
 int
-rasqal_engine_rowsort_calculate_order_values(rasqal_query* query,
+rasqal_engine_rowsort_calculate_order_values(rasqal_evaluation_context* eval_context,
                                              raptor_sequence* order_seq,
                                              rasqal_row* row)
 {
@@ -228,6 +231,9 @@ rasqal_engine_rowsort_calculate_order_values(rasqal_query* query,
   
   if(!row->order_size)
     return 1;
+
+  if(rasqal_row_bind_variables(row, eval_context))
+    return 1;
   
   for(i = 0; i < row->order_size; i++) {
     rasqal_expression* e;
@@ -235,7 +241,7 @@ rasqal_engine_rowsort_calculate_order_values(rasqal_query* query,
     int error = 0;
     
     e = (rasqal_expression*)raptor_sequence_get_at(order_seq, i);
-    l = rasqal_expression_evaluate2(e, query->eval_context, &error);
+    l = rasqal_expression_evaluate2(e, eval_context, &error);
 
     if(row->order_values[i])
       rasqal_free_literal(row->order_values[i]);
@@ -243,10 +249,557 @@ rasqal_engine_rowsort_calculate_order_values(rasqal_query* query,
     if(error)
       row->order_values[i] = NULL;
     else {
-      row->order_values[i] = rasqal_new_literal_from_literal(rasqal_literal_value(l));
+      row->order_values[i] = rasqal_new_literal_from_literal(rasqal_evaluation_context_literal_value(eval_context, l));
       rasqal_free_literal(l);
     }
   }
   
   return 0;
 }
+
+
+/* smallest number of rows worth sorting on the task pool */
+#define RASQAL_ENGINE_ROWSORT_PARALLEL_MIN_ROWS 4096
+
+
+typedef struct
+{
+  rowsort_compare_data* rcd;
+
+  /* rows to sort or merge from */
+  rasqal_row** src;
+
+  /* scratch rows to merge into */
+  rasqal_row** dst;
+
+  /* sort src[start..end) or merge src[start..middle) and src[middle..end) */
+  int start;
+  int middle;
+  int end;
+} rasqal_rowsort_task;
+
+
+/*
+ * rasqal_engine_rowsort_rows_compare_in_place:
+ * @rows: array of rows
+ * @count: number of rows
+ *
+ * INTERNAL - Check every order condition column holds values of one type
+ *
+ * Such values can be compared with rasqal_literal_compare_same_type()
+ * which is safe to call from several threads.
+ *
+ * Return value: non-0 if the rows can be sorted in place
+ */
+static int
+rasqal_engine_rowsort_rows_compare_in_place(rasqal_row** rows, int count)
+{
+  int order_size = rows[0]->order_size;
+  int col;
+
+  for(col = 0; col < order_size; col++) {
+    rasqal_literal_type type = RASQAL_LITERAL_UNKNOWN;
+    int i;
+
+    for(i = 0; i < count; i++) {
+      rasqal_literal* l = rows[i]->order_values[col];
+
+      if(!l)
+        continue;
+
+      if(l->type == RASQAL_LITERAL_VARIABLE ||
+         l->type == RASQAL_LITERAL_UNKNOWN)
+        return 0;
+
+      if(type == RASQAL_LITERAL_UNKNOWN)
+        type = l->type;
+      else if(l->type != type)
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/*
+ * rasqal_engine_rowsort_row_compare_in_place:
+ * @rcd: comparison data
+ * @row_a: first row
+ * @row_b: second row
+ *
+ * INTERNAL - Compare two rows as rasqal_engine_rowsort_row_compare()
+ *
+ * Only for rows accepted by rasqal_engine_rowsort_rows_compare_in_place()
+ * and without distinct.
+ *
+ * Return value: <0, 0 or >1 comparison
+ */
+static int
+rasqal_engine_rowsort_row_compare_in_place(rowsort_compare_data* rcd,
+                                           rasqal_row* row_a,
+                                           rasqal_row* row_b)
+{
+  int result = 0;
+  int i;
+
+  for(i = 0; i < row_a->order_size; i++) {
+    rasqal_literal* literal_a = row_a->order_values[i];
+    rasqal_literal* literal_b = row_b->order_values[i];
+    rasqal_expression* e;
+    int error = 0;
+
+    /* NULLs order first */
+    if(!literal_a || !literal_b) {
+      if(literal_a || literal_b)
+        result = (!literal_a) ? -1 : 1;
+      break;
+    }
+
+    result = rasqal_literal_compare_same_type(literal_a, literal_b,
+                                              rcd->compare_flags | RASQAL_COMPARE_URI,
+                                              &error);
+    if(error) {
+      result = 0;
+      break;
+    }
+
+    if(!result)
+      continue;
+
+    e = (rasqal_expression*)raptor_sequence_get_at(rcd->order_conditions_sequence, i);
+    if(e && e->op == RASQAL_EXPR_ORDER_COND_DESC)
+      result = -result;
+    break;
+  }
+
+  /* still equal?  make sort stable by using the original order */
+  if(!result)
+    result = row_a->offset - row_b->offset;
+
+  return result;
+}
+
+
+static void
+rasqal_engine_rowsort_merge(rowsort_compare_data* rcd,
+                            rasqal_row** src, rasqal_row** dst,
+                            int start, int middle, int end)
+{
+  int i = start;
+  int j = middle;
+  int k = start;
+
+  while(i < middle && j < end) {
+    if(rasqal_engine_rowsort_row_compare_in_place(rcd, src[i], src[j]) <= 0)
+      dst[k++] = src[i++];
+    else
+      dst[k++] = src[j++];
+  }
+
+  while(i < middle)
+    dst[k++] = src[i++];
+  while(j < end)
+    dst[k++] = src[j++];
+}
+
+
+static int
+rasqal_engine_rowsort_sort_task(void* user_data)
+{
+  rasqal_rowsort_task* task = (rasqal_rowsort_task*)user_data;
+  rasqal_row** src = task->src;
+  rasqal_row** dst = task->dst;
+  int width;
+
+  /* bottom-up merge sort bouncing between src and dst */
+  for(width = 1; width < task->end - task->start; width *= 2) {
+    rasqal_row** tmp;
+    int lo;
+
+    for(lo = task->start; lo < task->end; lo += 2 * width) {
+      int middle = lo + width;
+      int end = lo + 2 * width;
+
+      if(middle > task->end)
+        middle = task->end;
+      if(end > task->end)
+        end = task->end;
+
+      rasqal_engine_rowsort_merge(task->rcd, src, dst, lo, middle, end);
+    }
+
+    tmp = src; src = dst; dst = tmp;
+  }
+
+  if(src != task->src)
+    memcpy(task->src + task->start, src + task->start,
+           RASQAL_GOOD_CAST(size_t, task->end - task->start) * sizeof(rasqal_row*));
+
+  return 0;
+}
+
+
+static int
+rasqal_engine_rowsort_merge_task(void* user_data)
+{
+  rasqal_rowsort_task* task = (rasqal_rowsort_task*)user_data;
+
+  rasqal_engine_rowsort_merge(task->rcd, task->src, task->dst,
+                              task->start, task->middle, task->end);
+  return 0;
+}
+
+
+/**
+ * rasqal_engine_rowsort_sort_rows:
+ * @query: query
+ * @rows: array of rows with order values calculated
+ * @count: number of rows
+ * @compare_flags: comparison flags
+ * @order_conditions_sequence: order conditions
+ *
+ * INTERNAL - Sort an array of rows in parallel on the query task pool
+ *
+ * The array is split into one chunk per part of
+ * rasqal_query_get_parallelism(); the chunks are merge sorted as
+ * tasks and then merged pairwise, giving the same order as a rowsort
+ * map without distinct.  This is only done for large arrays whose
+ * order values can be compared without promotion, since promoting
+ * literals allocates and changes unlocked reference counts.
+ *
+ * Return value: 0 if @rows was sorted, non-0 if it was left unchanged
+ */
+int
+rasqal_engine_rowsort_sort_rows(rasqal_query* query,
+                                rasqal_row** rows, int count,
+                                int compare_flags,
+                                raptor_sequence* order_conditions_sequence)
+{
+  rasqal_task_group* group = NULL;
+  rasqal_rowsort_task* tasks = NULL;
+  rasqal_row** scratch = NULL;
+  rasqal_row** src = rows;
+  rasqal_row** dst;
+  rowsort_compare_data rcd;
+  int parts;
+  int chunk;
+  int width;
+  int i;
+  int rc = 1;
+
+  parts = rasqal_query_get_parallelism(query);
+  if(parts < 2 || count < RASQAL_ENGINE_ROWSORT_PARALLEL_MIN_ROWS)
+    return 1;
+
+  if(!(compare_flags & RASQAL_COMPARE_XQUERY) ||
+     (compare_flags & RASQAL_COMPARE_RDF))
+    return 1;
+
+  if(!rasqal_engine_rowsort_rows_compare_in_place(rows, count))
+    return 1;
+
+  rcd.is_distinct = 0;
+  rcd.compare_flags = compare_flags;
+  rcd.order_conditions_sequence = order_conditions_sequence;
+
+  scratch = RASQAL_MALLOC(rasqal_row**,
+                          RASQAL_GOOD_CAST(size_t, count) * sizeof(rasqal_row*));
+  tasks = RASQAL_CALLOC(rasqal_rowsort_task*, RASQAL_GOOD_CAST(size_t, parts),
+                        sizeof(*tasks));
+  group = rasqal_new_task_group(rasqal_query_get_task_pool(query));
+  if(!scratch || !tasks || !group)
+    goto tidy;
+
+  chunk = (count + parts - 1) / parts;
+  dst = scratch;
+
+  /* sort each chunk in place */
+  for(i = 0; i < parts; i++) {
+    rasqal_rowsort_task* task = &tasks[i];
+
+    task->rcd = &rcd;
+    task->src = rows;
+    task->dst = scratch;
+    task->start = i * chunk;
+    task->end = task->start + chunk;
+    if(task->start > count)
+      task->start = count;
+    if(task->end > count)
+      task->end = count;
+
+    rasqal_task_group_submit(group, rasqal_engine_rowsort_sort_task, task);
+  }
+
+  if(rasqal_task_group_wait(group))
+    goto tidy;
+
+  /* merge pairs of sorted runs, doubling the run width each pass */
+  for(width = chunk; width < count; width *= 2) {
+    rasqal_row** tmp;
+    int lo;
+
+    for(i = 0, lo = 0; lo < count; i++, lo += 2 * width) {
+      rasqal_rowsort_task* task = &tasks[i];
+
+      task->src = src;
+      task->dst = dst;
+      task->start = lo;
+      task->middle = lo + width;
+      task->end = lo + 2 * width;
+      if(task->middle > count)
+        task->middle = count;
+      if(task->end > count)
+        task->end = count;
+
+      rasqal_task_group_submit(group, rasqal_engine_rowsort_merge_task, task);
+    }
+
+    if(rasqal_task_group_wait(group))
+      goto tidy;
+
+    tmp = src; src = dst; dst = tmp;
+  }
+
+  rc = 0;
+
+  tidy:
+  /* src always holds every row, whether or not the sort finished */
+  if(src != rows)
+    memcpy(rows, src, RASQAL_GOOD_CAST(size_t, count) * sizeof(rasqal_row*));
+
+  if(group)
+    rasqal_free_task_group(group);
+  if(tasks)
+    RASQAL_FREE(rasqal_rowsort_task*, tasks);
+  if(scratch)
+    RASQAL_FREE(rasqal_row**, scratch);
+
+  return rc;
+}
+
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+#define SORT_TEST_ROWS_COUNT (RASQAL_ENGINE_ROWSORT_PARALLEL_MIN_ROWS + 1000)
+
+/* every this many rows has an unbound (NULL) first key */
+#define SORT_TEST_NULL_EVERY 11
+
+
+static raptor_sequence*
+sort_test_new_order_seq(rasqal_world* world)
+{
+  raptor_sequence* seq;
+  rasqal_op ops[2] = { RASQAL_EXPR_ORDER_COND_ASC, RASQAL_EXPR_ORDER_COND_DESC };
+  int i;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression,
+                            (raptor_data_print_handler)rasqal_expression_print);
+  if(!seq)
+    return NULL;
+
+  /* only the operator of an order condition is used when comparing */
+  for(i = 0; i < 2; i++) {
+    rasqal_literal* l;
+    rasqal_expression* e = NULL;
+
+    l = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, i);
+    if(l)
+      e = rasqal_new_literal_expression(world, l);
+    if(e)
+      e = rasqal_new_1op_expression(world, ops[i], e);
+    if(!e || raptor_sequence_push(seq, e)) {
+      raptor_free_sequence(seq);
+      return NULL;
+    }
+  }
+
+  return seq;
+}
+
+
+/*
+ * Sort rows with duplicate keys, NULLs and a DESC condition using
+ * world #RASQAL_FEATURE_THREADS @threads, falling back to a rowsort
+ * map as the sort rowsource does.  Stores the sorted row offsets in
+ * @offsets and returns the number of failures.
+ */
+static int
+sort_test_run(const char* program, rasqal_world* world, int threads,
+              int* offsets)
+{
+  rasqal_query* query = NULL;
+  raptor_sequence* order_seq = NULL;
+  raptor_sequence* seq = NULL;
+  rasqal_map* map = NULL;
+  rasqal_row** rows = NULL;
+  int compare_flags = RASQAL_COMPARE_XQUERY;
+  int count = 0;
+  int failures = 0;
+  int rc;
+  int i;
+
+  if(rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, threads)) {
+    fprintf(stderr, "%s: setting %d threads failed\n", program, threads);
+    return 1;
+  }
+
+  query = rasqal_new_query(world, "sparql", NULL);
+  order_seq = sort_test_new_order_seq(world);
+  rows = RASQAL_CALLOC(rasqal_row**, SORT_TEST_ROWS_COUNT, sizeof(rasqal_row*));
+  if(!query || !order_seq || !rows) {
+    fprintf(stderr, "%s: allocation failed\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(count = 0; count < SORT_TEST_ROWS_COUNT; count++) {
+    rasqal_row* row;
+
+    row = rasqal_new_row_for_size(world, 1);
+    if(!row || rasqal_row_set_order_size(row, 2)) {
+      if(row)
+        rasqal_free_row(row);
+      fprintf(stderr, "%s: row allocation failed\n", program);
+      failures++;
+      goto tidy;
+    }
+    row->offset = count;
+    row->values[0] = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER,
+                                                count);
+    if(count % SORT_TEST_NULL_EVERY)
+      row->order_values[0] = rasqal_new_integer_literal(world,
+                                                        RASQAL_LITERAL_INTEGER,
+                                                        count % 37);
+    row->order_values[1] = rasqal_new_integer_literal(world,
+                                                      RASQAL_LITERAL_INTEGER,
+                                                      (count * 7919) % 101);
+    rows[count] = row;
+  }
+
+  rc = rasqal_engine_rowsort_sort_rows(query, rows, count, compare_flags,
+                                       order_seq);
+  if(threads > 1 && rc) {
+    fprintf(stderr, "%s: %d threads: rows were not sorted in parallel\n",
+            program, threads);
+    failures++;
+  } else if(threads <= 1 && !rc) {
+    fprintf(stderr, "%s: %d threads: rows were sorted in parallel\n",
+            program, threads);
+    failures++;
+  }
+
+  if(!rc) {
+    for(i = 0; i < count; i++)
+      offsets[i] = rows[i]->offset;
+  } else {
+    map = rasqal_engine_new_rowsort_map(0, compare_flags, order_seq);
+    seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                              (raptor_data_print_handler)rasqal_row_print);
+    if(!map || !seq) {
+      fprintf(stderr, "%s: allocation failed\n", program);
+      failures++;
+      goto tidy;
+    }
+
+    for(i = 0; i < count; i++)
+      rasqal_engine_rowsort_map_add_row(map, rasqal_new_row_from_row(rows[i]));
+    rasqal_engine_rowsort_map_to_sequence(map, seq);
+
+    if(raptor_sequence_size(seq) != count) {
+      fprintf(stderr, "%s: %d threads: map sorted %d rows expected %d\n",
+              program, threads, raptor_sequence_size(seq), count);
+      failures++;
+      goto tidy;
+    }
+
+    for(i = 0; i < count; i++) {
+      rasqal_row* row = (rasqal_row*)raptor_sequence_get_at(seq, i);
+      offsets[i] = row->offset;
+    }
+  }
+
+  tidy:
+  if(seq)
+    raptor_free_sequence(seq);
+  if(map)
+    rasqal_free_map(map);
+  if(rows) {
+    for(i = 0; i < count; i++)
+      rasqal_free_row(rows[i]);
+    RASQAL_FREE(rasqal_row**, rows);
+  }
+  if(order_seq)
+    raptor_free_sequence(order_seq);
+  if(query)
+    rasqal_free_query(query);
+
+  rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 0);
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world* world;
+  int* serial_offsets;
+  int* parallel_offsets;
+  int failures = 0;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  serial_offsets = RASQAL_CALLOC(int*, SORT_TEST_ROWS_COUNT, sizeof(int));
+  parallel_offsets = RASQAL_CALLOC(int*, SORT_TEST_ROWS_COUNT, sizeof(int));
+  if(!serial_offsets || !parallel_offsets) {
+    fprintf(stderr, "%s: allocation failed\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  failures += sort_test_run(program, world, 0, serial_offsets);
+  failures += sort_test_run(program, world, 4, parallel_offsets);
+  if(failures)
+    goto tidy;
+
+  /* NULL keys order first */
+  if(serial_offsets[0] % SORT_TEST_NULL_EVERY) {
+    fprintf(stderr, "%s: first sorted row %d does not have a NULL key\n",
+            program, serial_offsets[0]);
+    failures++;
+  }
+
+  for(i = 0; i < SORT_TEST_ROWS_COUNT; i++) {
+    if(serial_offsets[i] != parallel_offsets[i]) {
+      fprintf(stderr,
+              "%s: sorted row %d is offset %d in parallel, expected %d\n",
+              program, i, parallel_offsets[i], serial_offsets[i]);
+      failures++;
+      break;
+    }
+  }
+
+  tidy:
+  if(serial_offsets)
+    RASQAL_FREE(int*, serial_offsets);
+  if(parallel_offsets)
+    RASQAL_FREE(int*, parallel_offsets);
+
+  rasqal_free_world(world);
+
+  return failures;
+}
+#endif /* STANDALONE */
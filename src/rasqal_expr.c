@@ -803,7 +803,7 @@ rasqal_new_expression_from_expression(rasqal_expression* e)
   if(!e)
     return NULL;
 
-  e->usage++;
+  RASQAL_USAGE_INCREMENT(&e->usage);
   return e;
 }
 
@@ -821,7 +821,7 @@ rasqal_free_expression(rasqal_expression* e)
   if(!e)
     return;
   
-  if(--e->usage)
+  if(RASQAL_USAGE_DECREMENT(&e->usage))
     return;
 
   rasqal_expression_clear(e);
@@ -1891,7 +1891,7 @@ rasqal_expression_copy_expression_sequence(raptor_sequence* exprs_seq)
 
 /**
  * rasqal_expression_sequence_evaluate:
- * @query: query
+ * @eval_context: evaluation context
  * @exprs_seq: sequence of #rasqal_expression to evaluate
  * @ignore_errors: non-0 to ignore errors in evaluation
  * @error_p: OUT: pointer to error flag (or NULL)
@@ -1909,7 +1909,7 @@ rasqal_expression_copy_expression_sequence(raptor_sequence* exprs_seq)
  * Return value: sequence of literals or NULL on failure
  */
 raptor_sequence*
-rasqal_expression_sequence_evaluate(rasqal_query* query,
+rasqal_expression_sequence_evaluate(rasqal_evaluation_context* eval_context,
                                     raptor_sequence* exprs_seq,
                                     int ignore_errors,
                                     int* error_p)
@@ -1918,7 +1918,7 @@ rasqal_expression_sequence_evaluate(rasqal_query* query,
   int i;
   raptor_sequence* literal_seq = NULL;
   
-  if(!query || !exprs_seq) {
+  if(!eval_context || !exprs_seq) {
     if(error_p)
       *error_p = 1;
     return NULL;
@@ -1940,7 +1940,7 @@ rasqal_expression_sequence_evaluate(rasqal_query* query,
     int error = 0;
     
     e = (rasqal_expression*)raptor_sequence_get_at(exprs_seq, i);
-    l = rasqal_expression_evaluate2(e, query->eval_context, &error);
+    l = rasqal_expression_evaluate2(e, eval_context, &error);
     if(error) {
       if(ignore_errors)
         continue;
@@ -2365,7 +2365,8 @@ rasqal_new_evaluation_context(rasqal_world* world,
   
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  eval_context = RASQAL_CALLOC(rasqal_evaluation_context*, 1, sizeof(*eval_context));
+  eval_context = RASQAL_CALLOC(rasqal_evaluation_context*, 1,
+                               sizeof(rasqal_evaluation_context_storage));
   if(!eval_context)
     return NULL;
   
@@ -2402,6 +2403,9 @@ rasqal_free_evaluation_context(rasqal_evaluation_context* eval_context)
   if(eval_context->random)
     rasqal_free_random(eval_context->random);
 
+  if(RASQAL_EVALUATION_CONTEXT_FRAME(eval_context))
+    rasqal_free_binding_frame(RASQAL_EVALUATION_CONTEXT_FRAME(eval_context));
+
   RASQAL_FREE(rasqal_evaluation_context*, eval_context);
 }
 
@@ -2451,6 +2455,87 @@ rasqal_evaluation_context_set_rand_seed(rasqal_evaluation_context* eval_context,
 }
 
 
+/*
+ * rasqal_evaluation_context_get_value:
+ * @eval_context: #rasqal_evaluation_context object
+ * @v: variable
+ *
+ * INTERNAL - Get the value of a variable in an evaluation context
+ *
+ * The value is taken from the binding frame of the context if the
+ * variable has been set there, otherwise from the variable itself.
+ *
+ * Return value: shared pointer to the value or NULL if unbound
+ */
+rasqal_literal*
+rasqal_evaluation_context_get_value(rasqal_evaluation_context* eval_context,
+                                    rasqal_variable* v)
+{
+  if(eval_context && RASQAL_EVALUATION_CONTEXT_FRAME(eval_context)) {
+    rasqal_literal* l;
+    int is_set = 0;
+
+    l = rasqal_binding_frame_get_value(RASQAL_EVALUATION_CONTEXT_FRAME(eval_context),
+                                       v, &is_set);
+    if(is_set)
+      return l;
+  }
+
+  return v->value;
+}
+
+
+/*
+ * rasqal_evaluation_context_set_value:
+ * @eval_context: #rasqal_evaluation_context object (or NULL)
+ * @v: variable
+ * @l: value (or NULL)
+ *
+ * INTERNAL - Set the value of a variable in an evaluation context
+ *
+ * The value is written to the binding frame of the context if there
+ * is one, otherwise to the variable with rasqal_variable_set_value().
+ * The value @l becomes owned by the frame or variable.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_evaluation_context_set_value(rasqal_evaluation_context* eval_context,
+                                    rasqal_variable* v, rasqal_literal* l)
+{
+  if(eval_context && RASQAL_EVALUATION_CONTEXT_FRAME(eval_context))
+    return rasqal_binding_frame_set_value(RASQAL_EVALUATION_CONTEXT_FRAME(eval_context),
+                                          v, l);
+
+  rasqal_variable_set_value(v, l);
+  return 0;
+}
+
+
+/*
+ * rasqal_evaluation_context_literal_value:
+ * @eval_context: #rasqal_evaluation_context object (or NULL)
+ * @l: literal
+ *
+ * INTERNAL - Get the value of a literal, following variables through the evaluation context
+ *
+ * As rasqal_literal_value() but variable values are found with
+ * rasqal_evaluation_context_get_value().
+ *
+ * Return value: shared pointer to the value or NULL if has no value
+ */
+rasqal_literal*
+rasqal_evaluation_context_literal_value(rasqal_evaluation_context* eval_context,
+                                        rasqal_literal* l)
+{
+  while(l && l->type == RASQAL_LITERAL_VARIABLE)
+    l = rasqal_evaluation_context_get_value(eval_context,
+                                            l->value.variable);
+
+  return l;
+}
+
+
 #endif /* not STANDALONE */
 
 
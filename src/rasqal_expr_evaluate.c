@@ -314,7 +314,8 @@ rasqal_expression_evaluate_istype(rasqal_expression *e,
   if(v) {
     rasqal_free_literal(l1);
 
-    l1 = v->value; /* don't need v after this */
+    /* don't need v after this */
+    l1 = rasqal_evaluation_context_get_value(eval_context, v);
 
     free_literal = 0;
     if(!l1)
@@ -380,7 +381,8 @@ rasqal_expression_evaluate_bound(rasqal_expression *e,
   if(!v)
     goto failed;
   
-  return rasqal_new_boolean_literal(world, (v->value != NULL));
+  return rasqal_new_boolean_literal(world,
+                                    (rasqal_evaluation_context_get_value(eval_context, v) != NULL));
 
   failed:
   if(error_p)
@@ -668,7 +670,8 @@ rasqal_expression_evaluate_lang(rasqal_expression *e,
   if(v) {
     rasqal_free_literal(l1);
 
-    l1 = v->value; /* don't need v after this */
+    /* don't need v after this */
+    l1 = rasqal_evaluation_context_get_value(eval_context, v);
 
     free_literal = 0;
     if(!l1)
@@ -738,7 +741,8 @@ rasqal_expression_evaluate_datatype(rasqal_expression *e,
   if(v) {
     rasqal_free_literal(l1);
 
-    l1 = v->value; /* don't need v after this */
+    /* don't need v after this */
+    l1 = rasqal_evaluation_context_get_value(eval_context, v);
 
     free_literal = 0;
     if(!l1)
@@ -1378,7 +1382,7 @@ rasqal_expression_evaluate2(rasqal_expression* e,
        * removes variables from expressions the first time they are seen.
        * (FLATTEN_LITERAL)
        */
-      result = rasqal_new_literal_from_literal(rasqal_literal_value(e->literal));
+      result = rasqal_new_literal_from_literal(rasqal_evaluation_context_literal_value(eval_context, e->literal));
       break;
 
     case RASQAL_EXPR_FUNCTION:
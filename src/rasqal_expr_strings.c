@@ -315,6 +315,10 @@ rasqal_literals_sparql11_compatible(rasqal_literal *l1, rasqal_literal *l2)
   const char *lang2;
   raptor_uri* xsd_string_uri;
   
+  /* pairs of simple literals: no datatype or language to check */
+  if(!l1->datatype && !l2->datatype && !l1->language && !l2->language)
+    return 1;
+
   xsd_string_uri = rasqal_xsd_datatype_type_to_uri(l1->world, 
                                                    RASQAL_LITERAL_XSD_STRING);
 
@@ -341,9 +345,9 @@ rasqal_literals_sparql11_compatible(rasqal_literal *l1, rasqal_literal *l2)
   if(!lang1 && !lang2)
     return 1;
 
-  /* pairs of plain literals with identical language tags #3 */
+  /* pairs of plain literals with identical (interned) language tags #3 */
   if(lang1 && lang2)
-    return !strcmp(lang1, lang2);
+    return lang1 == lang2;
 
   /* pairs of a plain literal with language tag (arg1) and a simple
    * literal or xsd:string typed literal [with no language tag] (arg2) #5, #6
@@ -405,9 +409,8 @@ rasqal_expression_evaluate_str_prefix_suffix(rasqal_expression *e,
     } else if(e->op == RASQAL_EXPR_STRENDS) {
       b = !memcmp(s1 + len1 - len2, s2, len2);
     } else { /* RASQAL_EXPR_CONTAINS */
-      /* b = (strnstr(RASQAL_GOOD_CAST(const char*, s1), RASQAL_GOOD_CAST(const char*, s2), len2) != NULL); */
-      b = (strstr(RASQAL_GOOD_CAST(const char*, s1),
-                  RASQAL_GOOD_CAST(const char*, s2)) != NULL);
+      b = (rasqal_memmem(RASQAL_GOOD_CAST(const char*, s1), len1,
+                         RASQAL_GOOD_CAST(const char*, s2), len2) != NULL);
     }
   }
   
@@ -986,6 +989,8 @@ rasqal_expression_evaluate_replace(rasqal_expression *e,
   char* result_s = NULL;
   size_t result_len = 0;
   rasqal_literal* result = NULL;
+  char* new_lang = NULL;
+  raptor_uri* dt_uri = NULL;
 
   l1 = rasqal_expression_evaluate2(e->arg1, eval_context, error_p);
   if(*error_p || !l1)
@@ -1032,11 +1037,23 @@ rasqal_expression_evaluate_replace(rasqal_expression *e,
   if(!result_s)
     goto failed;
 
+  if(l1->language) {
+    size_t len = strlen(l1->language);
+    new_lang = RASQAL_MALLOC(char*, len + 1);
+    if(!new_lang) {
+      RASQAL_FREE(char*, result_s);
+      goto failed;
+    }
+    memcpy(new_lang, l1->language, len + 1);
+  }
+
+  dt_uri = l1->datatype;
+  if(dt_uri)
+    dt_uri = raptor_uri_copy(dt_uri);
+
   result = rasqal_new_string_literal(world, 
                                      RASQAL_GOOD_CAST(const unsigned char*, result_s),
-                                     l1->language, l1->datatype, NULL);
-  l1->language = NULL;
-  l1->datatype = NULL;
+                                     new_lang, dt_uri, NULL);
 
   rasqal_free_literal(l1);
   rasqal_free_literal(l2);
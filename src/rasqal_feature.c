@@ -49,7 +49,7 @@ static const struct
   rasqal_feature feature;
   /* flag bits
    *  1=query feature
-   *  2=unused
+   *  2=world feature
    *  4=string value (else int)
    */
   int flags;
@@ -57,7 +57,13 @@ static const struct
   const char *label;
 } rasqal_features_list [RASQAL_FEATURE_LAST + 1]= {
   { RASQAL_FEATURE_NO_NET,    1,  "noNet",    "Deny network requests." } ,
-  { RASQAL_FEATURE_RAND_SEED, 1,  "randSeed", "Set rand() seed." }
+  { RASQAL_FEATURE_RAND_SEED, 1,  "randSeed", "Set rand() seed." },
+  { RASQAL_FEATURE_THREADS,   3,  "threads",  "Number of worker threads." },
+  { RASQAL_FEATURE_TIMEOUT,   1,  "timeout",  "Query execution time limit in milliseconds." },
+  { RASQAL_FEATURE_MEMORY_LIMIT, 1, "memoryLimit", "Query execution memory limit in kilobytes." },
+  { RASQAL_FEATURE_PROFILE,   1,  "profile",  "Time each query execution operator." },
+  { RASQAL_FEATURE_SERVICE_BIND_JOIN, 1, "serviceBindJoin", "Rows per SERVICE bind join request." },
+  { RASQAL_FEATURE_SERVICE_REQUESTS, 1, "serviceRequests", "Concurrent requests per SERVICE endpoint." }
 };
 
 
@@ -41,6 +41,15 @@
 #include "rasqal_internal.h"
 
 
+#ifndef FILE_READ_BUF_SIZE
+#ifdef BUFSIZ
+#define FILE_READ_BUF_SIZE BUFSIZ
+#else
+#define FILE_READ_BUF_SIZE 1024
+#endif
+#endif
+
+
 static void
 rasqal_iostream_write_json_boolean(raptor_iostream* iostr, 
                                    const char* name, int json_bool)
@@ -253,6 +262,978 @@ rasqal_query_results_write_json1(rasqal_query_results_formatter* formatter,
 }
 
 
+/*
+ * SPARQL JSON results reader
+ *
+ * The JSON is tokenized in a single pass as it is read from the
+ * iostream without building a document tree.  When the head
+ * variables come before the results, as they do from the writer
+ * above and from most endpoints, each object in the bindings array
+ * is turned into a row only when the row is read.  Otherwise the
+ * rows are read into a sequence with the variables added as they
+ * are seen.
+ */
+
+typedef enum {
+  /* before the bindings array */
+  JSON_STATE_start,
+  /* reading the bindings array a row at a time */
+  JSON_STATE_bindings,
+  /* all rows read */
+  JSON_STATE_done
+} rasqal_json_read_state;
+
+
+/* value returned when parsing stops at the start of the bindings */
+#define JSON_PARSE_SUSPEND 2
+
+
+typedef struct
+{
+  rasqal_world* world;
+  rasqal_rowsource* rowsource;
+
+  int failed;
+
+  /* Input fields */
+  raptor_uri* base_uri;
+  raptor_iostream* iostr;
+
+  /* JSON tokenizing */
+  unsigned char buffer[FILE_READ_BUF_SIZE]; /* iostream read buffer */
+  size_t buffer_pos;
+  size_t buffer_len;
+  int eof;
+  char* string; /* last string token */
+  size_t string_len;
+  size_t string_size;
+
+  /* SPARQL JSON Results parsing */
+  rasqal_json_read_state state;
+  int variables_known; /* non-0 when the head vars have been read */
+  int first_binding; /* non-0 before the first row of the bindings array */
+  int offset; /* current result row number */
+
+  /* rows read before the head vars */
+  raptor_sequence* results_sequence;
+
+  /* Variables table allocated for variables in the result set */
+  rasqal_variables_table* vars_table;
+
+  unsigned int flags;
+} rasqal_rowsource_json_context;
+
+
+static int rasqal_rowsource_json_parse_results(rasqal_rowsource_json_context* con, int first);
+
+
+/* Return the next byte without consuming it or -1 at the end */
+static int
+rasqal_rowsource_json_peek(rasqal_rowsource_json_context* con)
+{
+  if(con->buffer_pos == con->buffer_len) {
+    int read_len;
+
+    if(con->eof)
+      return -1;
+
+    read_len = raptor_iostream_read_bytes(con->buffer, 1, FILE_READ_BUF_SIZE,
+                                          con->iostr);
+    con->buffer_pos = 0;
+    /* a short read is not the end of a streamed response */
+    if(read_len <= 0) {
+      con->buffer_len = 0;
+      con->eof = 1;
+      return -1;
+    }
+    con->buffer_len = RASQAL_GOOD_CAST(size_t, read_len);
+  }
+
+  return con->buffer[con->buffer_pos];
+}
+
+
+/* Return the next byte that is not white space without consuming it */
+static int
+rasqal_rowsource_json_peek_token(rasqal_rowsource_json_context* con)
+{
+  int c;
+
+  while(1) {
+    c = rasqal_rowsource_json_peek(con);
+    if(c != ' ' && c != '\t' && c != '\n' && c != '\r')
+      return c;
+    con->buffer_pos++;
+  }
+}
+
+
+static int
+rasqal_rowsource_json_expect(rasqal_rowsource_json_context* con, int expected)
+{
+  int c = rasqal_rowsource_json_peek_token(con);
+
+  if(c != expected) {
+    if(c < 0)
+      rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "JSON results ended when expecting '%c'",
+                              expected);
+    else
+      rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "JSON results has '%c' when expecting '%c'",
+                              c, expected);
+    con->failed++;
+    return 1;
+  }
+
+  con->buffer_pos++;
+  return 0;
+}
+
+
+static int
+rasqal_rowsource_json_string_append(rasqal_rowsource_json_context* con,
+                                    const unsigned char* bytes, size_t len)
+{
+  if(con->string_len + len + 1 > con->string_size) {
+    size_t new_size = con->string_size ? con->string_size * 2 : 64;
+    char* new_string;
+
+    while(new_size < con->string_len + len + 1)
+      new_size *= 2;
+
+    new_string = RASQAL_MALLOC(char*, new_size);
+    if(!new_string)
+      return 1;
+    if(con->string_len)
+      memcpy(new_string, con->string, con->string_len);
+    if(con->string)
+      RASQAL_FREE(char*, con->string);
+    con->string = new_string;
+    con->string_size = new_size;
+  }
+
+  memcpy(con->string + con->string_len, bytes, len);
+  con->string_len += len;
+  con->string[con->string_len] = '\0';
+
+  return 0;
+}
+
+
+/* Read 4 hex digits of a \u escape or return -1 */
+static long
+rasqal_rowsource_json_read_hex4(rasqal_rowsource_json_context* con)
+{
+  long value = 0;
+  int i;
+
+  for(i = 0; i < 4; i++) {
+    int c = rasqal_rowsource_json_peek(con);
+
+    if(c >= '0' && c <= '9')
+      c -= '0';
+    else if(c >= 'a' && c <= 'f')
+      c -= 'a' - 10;
+    else if(c >= 'A' && c <= 'F')
+      c -= 'A' - 10;
+    else
+      return -1;
+
+    con->buffer_pos++;
+    value = (value << 4) | c;
+  }
+
+  return value;
+}
+
+
+/*
+ * rasqal_rowsource_json_read_string:
+ * @con: JSON reader context
+ *
+ * INTERNAL - Read a string token into con->string decoding escapes to UTF-8
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_rowsource_json_read_string(rasqal_rowsource_json_context* con)
+{
+  if(rasqal_rowsource_json_expect(con, '"'))
+    return 1;
+
+  con->string_len = 0;
+  if(rasqal_rowsource_json_string_append(con, NULL, 0))
+    goto failed;
+
+  while(1) {
+    size_t start = con->buffer_pos;
+    int c;
+
+    /* copy runs of plain bytes straight from the read buffer */
+    while(con->buffer_pos < con->buffer_len) {
+      c = con->buffer[con->buffer_pos];
+      if(c == '"' || c == '\\' || c < 0x20)
+        break;
+      con->buffer_pos++;
+    }
+    if(con->buffer_pos > start &&
+       rasqal_rowsource_json_string_append(con, con->buffer + start,
+                                           con->buffer_pos - start))
+      goto failed;
+
+    c = rasqal_rowsource_json_peek(con);
+    if(c < 0 || (c < 0x20 && c != '"' && c != '\\'))
+      goto failed;
+    if(c != '"' && c != '\\')
+      /* the read buffer was refilled */
+      continue;
+
+    con->buffer_pos++;
+    if(c == '"')
+      break;
+
+    /* escape */
+    c = rasqal_rowsource_json_peek(con);
+    if(c < 0)
+      goto failed;
+    con->buffer_pos++;
+
+    if(c == 'u') {
+      unsigned char utf8[6];
+      long unichar = rasqal_rowsource_json_read_hex4(con);
+      int utf8_len;
+
+      if(unichar >= 0xD800 && unichar <= 0xDBFF) {
+        long low;
+
+        /* surrogate pair */
+        if(rasqal_rowsource_json_peek(con) != '\\')
+          goto failed;
+        con->buffer_pos++;
+        if(rasqal_rowsource_json_peek(con) != 'u')
+          goto failed;
+        con->buffer_pos++;
+        low = rasqal_rowsource_json_read_hex4(con);
+        if(low < 0xDC00 || low > 0xDFFF)
+          goto failed;
+        unichar = 0x10000 + ((unichar - 0xD800) << 10) + (low - 0xDC00);
+      } else if(unichar < 0 || (unichar >= 0xDC00 && unichar <= 0xDFFF))
+        goto failed;
+
+      utf8_len = raptor_unicode_utf8_string_put_char(RASQAL_GOOD_CAST(raptor_unichar, unichar), utf8, sizeof(utf8));
+      if(utf8_len <= 0 ||
+         rasqal_rowsource_json_string_append(con, utf8,
+                                             RASQAL_GOOD_CAST(size_t, utf8_len)))
+        goto failed;
+    } else {
+      unsigned char byte;
+
+      switch(c) {
+        case '"': case '\\': case '/':
+          byte = RASQAL_GOOD_CAST(unsigned char, c);
+          break;
+        case 'b':
+          byte = '\b';
+          break;
+        case 'f':
+          byte = '\f';
+          break;
+        case 'n':
+          byte = '\n';
+          break;
+        case 'r':
+          byte = '\r';
+          break;
+        case 't':
+          byte = '\t';
+          break;
+        default:
+          goto failed;
+      }
+      if(rasqal_rowsource_json_string_append(con, &byte, 1))
+        goto failed;
+    }
+  }
+
+  return 0;
+
+  failed:
+  rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                          "JSON results has a bad string");
+  con->failed++;
+  return 1;
+}
+
+
+/* Copy the last string token to a new string */
+static unsigned char*
+rasqal_rowsource_json_copy_string(rasqal_rowsource_json_context* con)
+{
+  unsigned char* copy;
+
+  copy = RASQAL_MALLOC(unsigned char*, con->string_len + 1);
+  if(copy)
+    memcpy(copy, con->string, con->string_len + 1);
+
+  return copy;
+}
+
+
+/*
+ * rasqal_rowsource_json_skip_value:
+ * @con: JSON reader context
+ *
+ * INTERNAL - Skip over a JSON value of any type
+ *
+ * Nested arrays and objects are skipped by counting the depth.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_rowsource_json_skip_value(rasqal_rowsource_json_context* con)
+{
+  int depth = 0;
+
+  do {
+    int c = rasqal_rowsource_json_peek_token(con);
+
+    if(c < 0) {
+      rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "JSON results ended in a value");
+      con->failed++;
+      return 1;
+    }
+
+    if(c == '"') {
+      if(rasqal_rowsource_json_read_string(con))
+        return 1;
+    } else if(c == '{' || c == '[') {
+      depth++;
+      con->buffer_pos++;
+    } else if(c == '}' || c == ']') {
+      if(!depth) {
+        con->failed++;
+        return 1;
+      }
+      depth--;
+      con->buffer_pos++;
+    } else if(c == ',' || c == ':') {
+      if(!depth) {
+        con->failed++;
+        return 1;
+      }
+      con->buffer_pos++;
+    } else {
+      /* number, true, false or null */
+      while(c >= 0 && c != ',' && c != '}' && c != ']' && c != ' ' &&
+            c != '\t' && c != '\n' && c != '\r') {
+        con->buffer_pos++;
+        c = rasqal_rowsource_json_peek(con);
+      }
+    }
+  } while(depth);
+
+  return 0;
+}
+
+
+/*
+ * rasqal_rowsource_json_next_member:
+ * @con: JSON reader context
+ * @first_p: pointer to flag set before the first member of an object
+ *
+ * INTERNAL - Read the name of the next object member into con->string
+ *
+ * The opening '{' must have been read.
+ *
+ * Return value: 1 if a member was read, 0 at the end of the object or <0 on failure
+ */
+static int
+rasqal_rowsource_json_next_member(rasqal_rowsource_json_context* con,
+                                  int* first_p)
+{
+  if(rasqal_rowsource_json_peek_token(con) == '}') {
+    con->buffer_pos++;
+    return 0;
+  }
+
+  if(!*first_p && rasqal_rowsource_json_expect(con, ','))
+    return -1;
+  *first_p = 0;
+
+  if(rasqal_rowsource_json_read_string(con) ||
+     rasqal_rowsource_json_expect(con, ':'))
+    return -1;
+
+  return 1;
+}
+
+
+/* Read the head object adding the vars to the rowsource */
+static int
+rasqal_rowsource_json_parse_head(rasqal_rowsource_json_context* con)
+{
+  int first = 1;
+  int rc;
+
+  if(rasqal_rowsource_json_expect(con, '{'))
+    return 1;
+
+  while((rc = rasqal_rowsource_json_next_member(con, &first)) > 0) {
+    int first_var = 1;
+
+    if(strcmp(con->string, "vars")) {
+      if(rasqal_rowsource_json_skip_value(con))
+        return 1;
+      continue;
+    }
+
+    if(rasqal_rowsource_json_expect(con, '['))
+      return 1;
+
+    while(rasqal_rowsource_json_peek_token(con) != ']') {
+      unsigned char* var_name;
+      rasqal_variable* v;
+
+      if(!first_var && rasqal_rowsource_json_expect(con, ','))
+        return 1;
+      first_var = 0;
+
+      if(rasqal_rowsource_json_read_string(con))
+        return 1;
+
+      var_name = rasqal_rowsource_json_copy_string(con);
+      if(!var_name)
+        return 1;
+
+      v = rasqal_variables_table_add(con->vars_table,
+                                     RASQAL_VARIABLE_TYPE_NORMAL,
+                                     var_name, NULL);
+      if(v) {
+        rasqal_rowsource_add_variable(con->rowsource, v);
+        /* above function takes a reference to v */
+        rasqal_free_variable(v);
+      }
+    }
+    con->buffer_pos++;
+  }
+
+  if(rc < 0)
+    return 1;
+
+  con->variables_known = 1;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_rowsource_json_parse_term:
+ * @con: JSON reader context
+ *
+ * INTERNAL - Read an RDF term object into a new literal
+ *
+ * Return value: new literal or NULL on failure
+ */
+static rasqal_literal*
+rasqal_rowsource_json_parse_term(rasqal_rowsource_json_context* con)
+{
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(con->world);
+  rasqal_literal* l = NULL;
+  unsigned char* type = NULL;
+  unsigned char* value = NULL;
+  unsigned char* language = NULL;
+  unsigned char* datatype = NULL;
+  int first = 1;
+  int rc;
+
+  if(rasqal_rowsource_json_expect(con, '{'))
+    return NULL;
+
+  while((rc = rasqal_rowsource_json_next_member(con, &first)) > 0) {
+    unsigned char** field = NULL;
+
+    if(!strcmp(con->string, "type"))
+      field = &type;
+    else if(!strcmp(con->string, "value"))
+      field = &value;
+    else if(!strcmp(con->string, "xml:lang"))
+      field = &language;
+    else if(!strcmp(con->string, "datatype"))
+      field = &datatype;
+
+    if(!field || *field) {
+      if(rasqal_rowsource_json_skip_value(con))
+        goto tidy;
+      continue;
+    }
+
+    if(rasqal_rowsource_json_read_string(con))
+      goto tidy;
+
+    *field = rasqal_rowsource_json_copy_string(con);
+    if(!*field)
+      goto tidy;
+  }
+
+  if(rc < 0)
+    goto tidy;
+
+  if(!type || !value) {
+    rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "JSON results binding has no type or value");
+    con->failed++;
+    goto tidy;
+  }
+
+  if(!strcmp(RASQAL_GOOD_CAST(const char*, type), "uri")) {
+    raptor_uri* uri;
+
+    uri = raptor_new_uri(raptor_world_ptr, value);
+    if(uri)
+      l = rasqal_new_uri_literal(con->world, uri);
+  } else if(!strcmp(RASQAL_GOOD_CAST(const char*, type), "bnode")) {
+    l = rasqal_new_simple_literal(con->world, RASQAL_LITERAL_BLANK, value);
+    value = NULL;
+  } else if(!strcmp(RASQAL_GOOD_CAST(const char*, type), "literal") ||
+            !strcmp(RASQAL_GOOD_CAST(const char*, type), "typed-literal")) {
+    raptor_uri* datatype_uri = NULL;
+
+    if(datatype)
+      datatype_uri = raptor_new_uri(raptor_world_ptr, datatype);
+    l = rasqal_new_string_literal_node(con->world, value,
+                                       RASQAL_GOOD_CAST(const char*, language),
+                                       datatype_uri);
+    value = NULL;
+    language = NULL;
+  } else {
+    rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "JSON results binding has unknown type %s",
+                            type);
+  }
+
+  if(!l)
+    con->failed++;
+
+  tidy:
+  if(type)
+    RASQAL_FREE(char*, type);
+  if(value)
+    RASQAL_FREE(char*, value);
+  if(language)
+    RASQAL_FREE(char*, language);
+  if(datatype)
+    RASQAL_FREE(char*, datatype);
+
+  return l;
+}
+
+
+/*
+ * rasqal_rowsource_json_parse_binding:
+ * @con: JSON reader context
+ *
+ * INTERNAL - Read one object of the bindings array into a new row
+ *
+ * Before the head vars are known, variables not seen before are
+ * added to the rowsource.  Afterwards, bindings of variables not
+ * in the head are ignored.
+ *
+ * Return value: new row or NULL on failure
+ */
+static rasqal_row*
+rasqal_rowsource_json_parse_binding(rasqal_rowsource_json_context* con)
+{
+  rasqal_row* row;
+  int first = 1;
+  int rc;
+
+  if(rasqal_rowsource_json_expect(con, '{'))
+    return NULL;
+
+  row = rasqal_new_row(con->rowsource);
+  if(!row) {
+    con->failed++;
+    return NULL;
+  }
+  row->offset = con->offset++;
+
+  while((rc = rasqal_rowsource_json_next_member(con, &first)) > 0) {
+    int offset;
+    rasqal_literal* l;
+
+    offset = rasqal_rowsource_get_variable_offset_by_name(con->rowsource,
+                                                          RASQAL_GOOD_CAST(const unsigned char*, con->string));
+    if(offset < 0 && !con->variables_known) {
+      unsigned char* var_name;
+      rasqal_variable* v;
+
+      var_name = rasqal_rowsource_json_copy_string(con);
+      if(!var_name)
+        break;
+
+      v = rasqal_variables_table_add(con->vars_table,
+                                     RASQAL_VARIABLE_TYPE_NORMAL,
+                                     var_name, NULL);
+      if(!v)
+        break;
+      offset = rasqal_rowsource_add_variable(con->rowsource, v);
+      rasqal_free_variable(v);
+
+      if(offset < 0 || rasqal_row_expand_size(row, con->rowsource->size))
+        break;
+    }
+
+    if(offset < 0) {
+      if(rasqal_rowsource_json_skip_value(con))
+        break;
+      continue;
+    }
+
+    l = rasqal_rowsource_json_parse_term(con);
+    if(!l)
+      break;
+
+    rasqal_row_set_value_at(row, offset, l);
+    rasqal_free_literal(l);
+  }
+
+  if(rc) {
+    con->failed++;
+    rasqal_free_row(row);
+    return NULL;
+  }
+
+  return row;
+}
+
+
+/*
+ * rasqal_rowsource_json_parse_bindings:
+ * @con: JSON reader context
+ *
+ * INTERNAL - Read the bindings array into the results sequence
+ *
+ * Used when the rows come before the head vars.  The opening '['
+ * must have been read.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_rowsource_json_parse_bindings(rasqal_rowsource_json_context* con)
+{
+  int first = 1;
+
+  while(rasqal_rowsource_json_peek_token(con) != ']') {
+    rasqal_row* row;
+
+    if(!first && rasqal_rowsource_json_expect(con, ','))
+      return 1;
+    first = 0;
+
+    row = rasqal_rowsource_json_parse_binding(con);
+    if(!row)
+      return 1;
+
+    raptor_sequence_push(con->results_sequence, row);
+  }
+  con->buffer_pos++;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_rowsource_json_parse_results:
+ * @con: JSON reader context
+ * @first: non-0 before the first member of the results object
+ *
+ * INTERNAL - Read members of the results object
+ *
+ * Return value: 0 at the end of the object, JSON_PARSE_SUSPEND at the
+ * start of bindings that can be read a row at a time or non-0 on failure
+ */
+static int
+rasqal_rowsource_json_parse_results(rasqal_rowsource_json_context* con,
+                                    int first)
+{
+  int rc;
+
+  while((rc = rasqal_rowsource_json_next_member(con, &first)) > 0) {
+    if(strcmp(con->string, "bindings") || con->state != JSON_STATE_start) {
+      if(rasqal_rowsource_json_skip_value(con))
+        return 1;
+      continue;
+    }
+
+    if(rasqal_rowsource_json_expect(con, '['))
+      return 1;
+
+    if(con->variables_known) {
+      con->state = JSON_STATE_bindings;
+      con->first_binding = 1;
+      return JSON_PARSE_SUSPEND;
+    }
+
+    if(rasqal_rowsource_json_parse_bindings(con))
+      return 1;
+  }
+
+  return rc < 0;
+}
+
+
+/*
+ * rasqal_rowsource_json_parse_top:
+ * @con: JSON reader context
+ * @first: non-0 before the first member of the top level object
+ *
+ * INTERNAL - Read members of the top level object
+ *
+ * A "boolean" member is an error since only variable bindings
+ * results can be read.
+ *
+ * Return value: 0 at the end of the object, JSON_PARSE_SUSPEND at the
+ * start of bindings that can be read a row at a time or non-0 on failure
+ */
+static int
+rasqal_rowsource_json_parse_top(rasqal_rowsource_json_context* con, int first)
+{
+  int rc;
+
+  while((rc = rasqal_rowsource_json_next_member(con, &first)) > 0) {
+    if(!strcmp(con->string, "head") && !con->variables_known) {
+      if(rasqal_rowsource_json_parse_head(con))
+        return 1;
+    } else if(!strcmp(con->string, "results") &&
+              con->state == JSON_STATE_start) {
+      if(rasqal_rowsource_json_expect(con, '{'))
+        return 1;
+      rc = rasqal_rowsource_json_parse_results(con, 1);
+      if(rc)
+        return rc;
+    } else if(!strcmp(con->string, "boolean")) {
+      /* a rowsource can only return variable bindings */
+      rasqal_log_error_simple(con->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Cannot read SPARQL JSON boolean results");
+      con->failed++;
+      return 1;
+    } else {
+      if(rasqal_rowsource_json_skip_value(con))
+        return 1;
+    }
+  }
+
+  return rc < 0;
+}
+
+
+/* Read up to the first row */
+static void
+rasqal_rowsource_json_process(rasqal_rowsource_json_context* con)
+{
+  rasqal_row* row;
+  int rc;
+  int i;
+
+  if(con->state != JSON_STATE_start)
+    return;
+
+  if(rasqal_rowsource_json_expect(con, '{')) {
+    con->state = JSON_STATE_done;
+    return;
+  }
+
+  rc = rasqal_rowsource_json_parse_top(con, 1);
+  if(rc == JSON_PARSE_SUSPEND)
+    return;
+
+  if(rc)
+    con->failed++;
+  con->state = JSON_STATE_done;
+
+  /* rows read before all the variables were seen */
+  for(i = 0;
+      (row = (rasqal_row*)raptor_sequence_get_at(con->results_sequence, i));
+      i++) {
+    if(row->size < con->rowsource->size)
+      rasqal_row_expand_size(row, con->rowsource->size);
+  }
+}
+
+
+static int
+rasqal_rowsource_json_init(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_rowsource_json_context* con;
+
+  con = (rasqal_rowsource_json_context*)user_data;
+
+  con->rowsource = rowsource;
+  con->state = JSON_STATE_start;
+
+  return 0;
+}
+
+
+static int
+rasqal_rowsource_json_finish(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_rowsource_json_context* con;
+
+  con = (rasqal_rowsource_json_context*)user_data;
+
+  if(con->base_uri)
+    raptor_free_uri(con->base_uri);
+
+  if(con->string)
+    RASQAL_FREE(char*, con->string);
+
+  if(con->results_sequence)
+    raptor_free_sequence(con->results_sequence);
+
+  if(con->vars_table)
+    rasqal_free_variables_table(con->vars_table);
+
+  if(con->flags) {
+    if(con->iostr)
+      raptor_free_iostream(con->iostr);
+  }
+
+  RASQAL_FREE(rasqal_rowsource_json_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_rowsource_json_ensure_variables(rasqal_rowsource* rowsource,
+                                       void *user_data)
+{
+  rasqal_rowsource_json_context* con;
+
+  con = (rasqal_rowsource_json_context*)user_data;
+
+  rasqal_rowsource_json_process(con);
+
+  return con->failed;
+}
+
+
+static rasqal_row*
+rasqal_rowsource_json_read_row(rasqal_rowsource* rowsource,
+                               void *user_data)
+{
+  rasqal_rowsource_json_context* con;
+  rasqal_row* row = NULL;
+
+  con = (rasqal_rowsource_json_context*)user_data;
+
+  rasqal_rowsource_json_process(con);
+
+  if(con->failed)
+    return NULL;
+
+  if(con->state == JSON_STATE_bindings) {
+    if(rasqal_rowsource_json_peek_token(con) == ']') {
+      /* read the rest of the document after the last row */
+      con->buffer_pos++;
+      con->state = JSON_STATE_done;
+      if(rasqal_rowsource_json_parse_results(con, 0) ||
+         rasqal_rowsource_json_parse_top(con, 0))
+        con->failed++;
+      return NULL;
+    }
+
+    if(!con->first_binding && rasqal_rowsource_json_expect(con, ','))
+      return NULL;
+    con->first_binding = 0;
+
+    return rasqal_rowsource_json_parse_binding(con);
+  }
+
+  if(raptor_sequence_size(con->results_sequence) > 0) {
+    RASQAL_DEBUG1("getting row from stored sequence\n");
+    row = (rasqal_row*)raptor_sequence_unshift(con->results_sequence);
+  }
+
+  return row;
+}
+
+
+static const rasqal_rowsource_handler rasqal_rowsource_json_handler = {
+  /* .version = */ 1,
+  "SPARQL JSON",
+  /* .init = */ rasqal_rowsource_json_init,
+  /* .finish = */ rasqal_rowsource_json_finish,
+  /* .ensure_variables = */ rasqal_rowsource_json_ensure_variables,
+  /* .read_row = */ rasqal_rowsource_json_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ NULL,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ NULL,
+  /* .set_origin = */ NULL,
+};
+
+
+/*
+ * rasqal_query_results_get_rowsource_json:
+ * @world: rasqal world object
+ * @iostr: #raptor_iostream to read the query results from
+ * @base_uri: #raptor_uri base URI of the input format
+ *
+ * INTERNAL - Read SPARQL JSON query results format from an iostream
+ * in a format returning a rowsource.
+ *
+ * Return value: a new rasqal_rowsource or NULL on failure
+ **/
+static rasqal_rowsource*
+rasqal_query_results_get_rowsource_json(rasqal_query_results_formatter* formatter,
+                                        rasqal_world *world,
+                                        rasqal_variables_table* vars_table,
+                                        raptor_iostream *iostr,
+                                        raptor_uri *base_uri,
+                                        unsigned int flags)
+{
+  rasqal_rowsource_json_context* con;
+
+  con = RASQAL_CALLOC(rasqal_rowsource_json_context*, 1, sizeof(*con));
+  if(!con)
+    return NULL;
+
+  con->world = world;
+  con->base_uri = base_uri ? raptor_uri_copy(base_uri) : NULL;
+  con->iostr = iostr;
+  con->flags = flags;
+
+  con->results_sequence = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row, (raptor_data_print_handler)rasqal_row_print);
+
+  con->vars_table = rasqal_new_variables_table_from_variables_table(vars_table);
+
+  return rasqal_new_rowsource_from_handler(world, NULL,
+                                           con,
+                                           &rasqal_rowsource_json_handler,
+                                           con->vars_table,
+                                           0);
+}
+
+
+static int
+rasqal_query_results_json_recognise_syntax(rasqal_query_results_format_factory* factory,
+                                           const unsigned char *buffer,
+                                           size_t len,
+                                           const unsigned char *identifier,
+                                           const unsigned char *suffix,
+                                           const char *mime_type)
+{
+  if(suffix && !strcmp(RASQAL_GOOD_CAST(const char*, suffix), "srj"))
+    return 8;
+
+  return 0;
+}
+
+
 static const char* const json_names[] = { "json", NULL};
 
 static const char* const json_uri_strings[] = {
@@ -289,7 +1270,8 @@ rasqal_query_results_json_register_factory(rasqal_query_results_format_factory *
   factory->desc.flags = 0;
   
   factory->write         = rasqal_query_results_write_json1;
-  factory->get_rowsource = NULL;
+  factory->get_rowsource = rasqal_query_results_get_rowsource_json;
+  factory->recognise_syntax = rasqal_query_results_json_recognise_syntax;
 
   return rc;
 }
@@ -301,3 +1283,348 @@ rasqal_init_result_format_json(rasqal_world* world)
   return !rasqal_world_register_query_results_format_factory(world,
                                                              &rasqal_query_results_json_register_factory);
 }
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+typedef struct {
+  const char* label;
+  const char* json;
+  /* expected rows as written by json_test_write_row() */
+  const char* expected;
+  int expect_failure;
+} json_read_test;
+
+static const json_read_test json_read_tests[] = {
+  { "head before results",
+    "{\"head\": {\"vars\": [\"s\", \"o\", \"n\"], \"link\": [\"http://example.org/info\"]},\n"
+    " \"results\": {\"ordered\": false, \"bindings\": [\n"
+    "  {\"s\": {\"type\": \"uri\", \"value\": \"http://example.org/a\"},\n"
+    "   \"o\": {\"type\": \"literal\", \"value\": \"chat\", \"xml:lang\": \"fr\"},\n"
+    "   \"n\": {\"type\": \"typed-literal\", \"value\": \"1\", \"datatype\": \"http://www.w3.org/2001/XMLSchema#integer\"}},\n"
+    "  {\"s\": {\"type\": \"bnode\", \"value\": \"b1\"},\n"
+    "   \"o\": {\"type\": \"literal\", \"value\": \"t\\tq\\\"\\\\\\/ \\u00e9 \\uD83D\\uDE00\"}},\n"
+    "  {}\n"
+    " ]}}\n",
+    "s=<http://example.org/a> o=\"chat\"@fr n=\"1\"^^<http://www.w3.org/2001/XMLSchema#integer>\n"
+    "s=_:b1 o=\"t\tq\"\\/ \xC3\xA9 \xF0\x9F\x98\x80\" n=-\n"
+    "s=- o=- n=-\n",
+    0 },
+  { "results before head",
+    "{\"results\": {\"bindings\": [\n"
+    "  {\"s\": {\"type\": \"uri\", \"value\": \"http://example.org/a\"}},\n"
+    "  {\"o\": {\"type\": \"literal\", \"value\": \"x\"}, \"s\": {\"type\": \"bnode\", \"value\": \"b1\"}}\n"
+    " ]},\n"
+    " \"head\": {\"vars\": [\"s\", \"o\"]}}",
+    "s=<http://example.org/a> o=-\n"
+    "s=_:b1 o=\"x\"\n",
+    0 },
+  { "empty bindings",
+    "{\"head\": {\"vars\": [\"x\"]}, \"results\": {\"bindings\": []}}",
+    "",
+    0 },
+  { "empty bindings before head",
+    "{\"results\": {\"bindings\": [ ]}, \"head\": {\"vars\": [\"x\"]}}",
+    "",
+    0 },
+  { "bad escape",
+    "{\"head\": {\"vars\": [\"x\"]}, \"results\": {\"bindings\": [\n"
+    "  {\"x\": {\"type\": \"literal\", \"value\": \"a\\qb\"}}]}}",
+    "",
+    1 },
+  { "high surrogate without low surrogate",
+    "{\"head\": {\"vars\": [\"x\"]}, \"results\": {\"bindings\": [\n"
+    "  {\"x\": {\"type\": \"literal\", \"value\": \"\\uD83Dx\"}}]}}",
+    "",
+    1 },
+  { "low surrogate alone",
+    "{\"head\": {\"vars\": [\"x\"]}, \"results\": {\"bindings\": [\n"
+    "  {\"x\": {\"type\": \"literal\", \"value\": \"\\uDE00\"}}]}}",
+    "",
+    1 },
+  { "boolean",
+    "{\"head\": {}, \"boolean\": true}",
+    "",
+    1 },
+  { "truncated",
+    "{\"head\": {\"vars\": [\"x\"]}, \"results\": {\"bindings\": [\n"
+    "  {\"x\": {\"type\": \"uri\", \"value\": \"http://example.org/a\"}}",
+    "x=<http://example.org/a>\n",
+    1 },
+  { NULL, NULL, NULL, 0 }
+};
+
+
+/* iostream reading one byte at a time like a slowly arriving response */
+typedef struct {
+  const char* string;
+  size_t length;
+  size_t offset;
+} json_test_trickle;
+
+static int
+json_test_trickle_read_bytes(void *user_data, void *ptr, size_t size,
+                             size_t nmemb)
+{
+  json_test_trickle* trickle = (json_test_trickle*)user_data;
+
+  if(trickle->offset >= trickle->length || !nmemb || size != 1)
+    return 0;
+
+  *(char*)ptr = trickle->string[trickle->offset++];
+  return 1;
+}
+
+static int
+json_test_trickle_read_eof(void *user_data)
+{
+  json_test_trickle* trickle = (json_test_trickle*)user_data;
+
+  return trickle->offset >= trickle->length;
+}
+
+static const raptor_iostream_handler json_test_trickle_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ NULL,
+  /* .write_byte  = */ NULL,
+  /* .write_bytes = */ NULL,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ json_test_trickle_read_bytes,
+  /* .read_eof    = */ json_test_trickle_read_eof
+};
+
+
+/* append "name=value" for each variable of @row to @sb */
+static void
+json_test_write_row(rasqal_rowsource* rowsource, rasqal_row* row,
+                    raptor_stringbuffer* sb)
+{
+  int i;
+
+  for(i = 0; i < row->size; i++) {
+    rasqal_variable* v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
+    rasqal_literal* l = row->values[i];
+
+    if(i)
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, " "), 1, 1);
+    raptor_stringbuffer_append_string(sb, v->name, 1);
+    raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "="), 1, 1);
+
+    if(!l)
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "-"), 1, 1);
+    else if(l->type == RASQAL_LITERAL_URI) {
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "<"), 1, 1);
+      raptor_stringbuffer_append_string(sb, raptor_uri_as_string(l->value.uri), 1);
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, ">"), 1, 1);
+    } else if(l->type == RASQAL_LITERAL_BLANK) {
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "_:"), 2, 1);
+      raptor_stringbuffer_append_string(sb, l->string, 1);
+    } else {
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "\""), 1, 1);
+      raptor_stringbuffer_append_counted_string(sb, l->string, l->string_len, 1);
+      raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "\""), 1, 1);
+      if(l->language) {
+        raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "@"), 1, 1);
+        raptor_stringbuffer_append_string(sb, RASQAL_GOOD_CAST(const unsigned char*, l->language), 1);
+      }
+      if(l->datatype) {
+        raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "^^<"), 3, 1);
+        raptor_stringbuffer_append_string(sb, raptor_uri_as_string(l->datatype), 1);
+        raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, ">"), 1, 1);
+      }
+    }
+  }
+  raptor_stringbuffer_append_counted_string(sb, RASQAL_GOOD_CAST(const unsigned char*, "\n"), 1, 1);
+}
+
+
+/*
+ * Read @json with the JSON reader either from a string or one byte
+ * at a time and check the rows and whether it failed.
+ */
+static int
+json_test_read(const char* program, rasqal_world* world, const char* label,
+               const char* json, const char* expected, int expect_failure,
+               int trickle)
+{
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(world);
+  rasqal_variables_table* vt;
+  raptor_iostream* iostr;
+  rasqal_rowsource* rowsource;
+  rasqal_rowsource_json_context* con;
+  raptor_stringbuffer* sb;
+  json_test_trickle trickle_data;
+  const char* result;
+  rasqal_row* row;
+  int failures = 0;
+  int failed;
+
+  vt = rasqal_new_variables_table(world);
+  sb = raptor_new_stringbuffer();
+  if(trickle) {
+    trickle_data.string = json;
+    trickle_data.length = strlen(json);
+    trickle_data.offset = 0;
+    iostr = raptor_new_iostream_from_handler(raptor_world_ptr, &trickle_data,
+                                             &json_test_trickle_handler);
+  } else
+    iostr = raptor_new_iostream_from_string(raptor_world_ptr,
+                                            RASQAL_GOOD_CAST(void*, json),
+                                            strlen(json));
+  if(!vt || !sb || !iostr) {
+    fprintf(stderr, "%s: %s: test setup FAILED\n", program, label);
+    return 1;
+  }
+
+  /* Takes ownership of iostr with flags = 1 */
+  rowsource = rasqal_query_results_get_rowsource_json(NULL, world, vt, iostr,
+                                                      NULL, /* flags */ 1);
+  if(!rowsource) {
+    fprintf(stderr, "%s: %s: creating JSON rowsource FAILED\n", program,
+            label);
+    raptor_free_stringbuffer(sb);
+    rasqal_free_variables_table(vt);
+    return 1;
+  }
+  con = (rasqal_rowsource_json_context*)rowsource->user_data;
+
+  rasqal_rowsource_ensure_variables(rowsource);
+  while((row = rasqal_rowsource_read_row(rowsource))) {
+    json_test_write_row(rowsource, row, sb);
+    rasqal_free_row(row);
+  }
+  failed = (con->failed != 0);
+
+  result = RASQAL_GOOD_CAST(const char*, raptor_stringbuffer_as_string(sb));
+  if(!result)
+    result = "";
+
+  if(strcmp(result, expected)) {
+    fprintf(stderr, "%s: %s%s: read rows\n%s\nexpected\n%s\n", program,
+            label, trickle ? " (one byte reads)" : "", result, expected);
+    failures++;
+  }
+
+  if(failed != expect_failure) {
+    fprintf(stderr, "%s: %s%s: reading %s\n", program,
+            label, trickle ? " (one byte reads)" : "",
+            failed ? "FAILED" : "succeeded when a failure was expected");
+    failures++;
+  }
+
+  rasqal_free_rowsource(rowsource);
+  raptor_free_stringbuffer(sb);
+  rasqal_free_variables_table(vt);
+
+  return failures;
+}
+
+
+#define LONG_VALUE_ROWS 3
+
+/*
+ * Make a document with values longer than the read buffer, with
+ * escapes landing on either side of buffer refills, and the rows
+ * expected from it.
+ */
+static int
+json_test_make_long(char** json_p, char** expected_p)
+{
+  const char* head = "{\"head\": {\"vars\": [\"v\"]}, \"results\": {\"bindings\": [";
+  const char* row_start = "{\"v\": {\"type\": \"literal\", \"value\": \"";
+  const char* row_end = "\"}}";
+  size_t value_len = (FILE_READ_BUF_SIZE * 2) + 3;
+  size_t json_size;
+  size_t expected_size;
+  char* json;
+  char* expected;
+  char* p;
+  char* q;
+  int i;
+
+  json_size = strlen(head) + LONG_VALUE_ROWS * (strlen(row_start) + value_len + 12 + strlen(row_end) + 1) + 4;
+  expected_size = LONG_VALUE_ROWS * (value_len + 12) + 1;
+  json = RASQAL_MALLOC(char*, json_size);
+  expected = RASQAL_MALLOC(char*, expected_size);
+  if(!json || !expected) {
+    if(json)
+      RASQAL_FREE(char*, json);
+    if(expected)
+      RASQAL_FREE(char*, expected);
+    return 1;
+  }
+
+  p = json;
+  q = expected;
+  p += sprintf(p, "%s", head);
+  for(i = 0; i < LONG_VALUE_ROWS; i++) {
+    if(i)
+      *p++ = ',';
+    p += sprintf(p, "%s", row_start);
+    /* shift the escape by a byte on every row */
+    memset(p, 'a', value_len + RASQAL_GOOD_CAST(size_t, i));
+    p += value_len + RASQAL_GOOD_CAST(size_t, i);
+    p += sprintf(p, "\\u00e9\\n%s", row_end);
+
+    q += sprintf(q, "v=\"");
+    memset(q, 'a', value_len + RASQAL_GOOD_CAST(size_t, i));
+    q += value_len + RASQAL_GOOD_CAST(size_t, i);
+    q += sprintf(q, "\xC3\xA9\n\"\n");
+  }
+  strcpy(p, "]}}");
+
+  *json_p = json;
+  *expected_p = expected;
+
+  return 0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world* world;
+  char* json = NULL;
+  char* expected = NULL;
+  int failures = 0;
+  int trickle;
+  int i;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  for(trickle = 0; trickle < 2; trickle++) {
+    for(i = 0; json_read_tests[i].label; i++) {
+      const json_read_test* t = &json_read_tests[i];
+
+      failures += json_test_read(program, world, t->label, t->json,
+                                 t->expected, t->expect_failure, trickle);
+    }
+  }
+
+  if(json_test_make_long(&json, &expected)) {
+    fprintf(stderr, "%s: making long values document FAILED\n", program);
+    failures++;
+  } else {
+    for(trickle = 0; trickle < 2; trickle++)
+      failures += json_test_read(program, world, "long values", json,
+                                 expected, 0, trickle);
+    RASQAL_FREE(char*, json);
+    RASQAL_FREE(char*, expected);
+  }
+
+  rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #endif
 #include <stdarg.h>
+#include <ctype.h>
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -124,6 +125,43 @@ rasqal_new_world(void)
     return NULL;
   
   world->warning_level = RASQAL_WARNING_LEVEL_DEFAULT;
+
+#ifdef HAVE_PTHREAD_H
+  if(pthread_mutex_init(&world->query_cache_lock, NULL)) {
+    RASQAL_FREE(rasqal_world, world);
+    return NULL;
+  }
+  if(pthread_mutex_init(&world->results_cache_lock, NULL)) {
+    pthread_mutex_destroy(&world->query_cache_lock);
+    RASQAL_FREE(rasqal_world, world);
+    return NULL;
+  }
+  if(pthread_mutex_init(&world->service_cache_lock, NULL)) {
+    pthread_mutex_destroy(&world->query_cache_lock);
+    pthread_mutex_destroy(&world->results_cache_lock);
+    RASQAL_FREE(rasqal_world, world);
+    return NULL;
+  }
+#endif
+
+  if(rasqal_intern_table_init(&world->languages)) {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_destroy(&world->query_cache_lock);
+    pthread_mutex_destroy(&world->results_cache_lock);
+    pthread_mutex_destroy(&world->service_cache_lock);
+#endif
+    RASQAL_FREE(rasqal_world, world);
+    return NULL;
+  }
+
+  if(rasqal_object_pool_init(&world->literals_pool, sizeof(rasqal_literal_storage),
+                             RASQAL_OBJECT_POOL_SIZE) ||
+     rasqal_object_pool_init(&world->rows_pool, sizeof(rasqal_row),
+                             RASQAL_OBJECT_POOL_SIZE)) {
+    rasqal_free_world(world);
+    return NULL;
+  }
+
   return world;
 }
 
@@ -227,6 +265,17 @@ rasqal_free_world(rasqal_world* world)
   if(!world)
     return;
   
+  /* no queries can be running */
+  if(world->task_pool)
+    rasqal_free_task_pool(world->task_pool);
+
+  /* cached queries refer to the world factories */
+  rasqal_query_cache_finish(world);
+
+  rasqal_query_results_cache_finish(world);
+
+  rasqal_service_cache_finish(world);
+
   rasqal_finish_result_formats(world);
   rasqal_finish_query_results();
 
@@ -243,6 +292,17 @@ rasqal_free_world(rasqal_world* world)
   if(world->raptor_world_ptr && world->raptor_world_allocated_here)
     raptor_free_world(world->raptor_world_ptr);
 
+  rasqal_object_pool_finish(&world->rows_pool);
+  rasqal_object_pool_finish(&world->literals_pool);
+
+  rasqal_intern_table_finish(&world->languages);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&world->query_cache_lock);
+  pthread_mutex_destroy(&world->results_cache_lock);
+  pthread_mutex_destroy(&world->service_cache_lock);
+#endif
+
   RASQAL_FREE(rasqal_world, world);
 }
 
@@ -698,6 +758,484 @@ rasqal_basename(const char *name)
 }
 
 
+/*
+ * rasqal_object_pool_init:
+ * @pool: object pool
+ * @object_size: size of objects in the pool
+ * @capacity: maximum number of freed objects to keep (or 0 to not pool)
+ *
+ * INTERNAL - Initialise a pool of fixed size objects
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_object_pool_init(rasqal_object_pool* pool, size_t object_size,
+                        int capacity)
+{
+  pool->object_size = object_size;
+  pool->capacity = capacity;
+  pool->size = 0;
+  pool->objects = NULL;
+
+  if(capacity > 0) {
+    pool->objects = RASQAL_CALLOC(void**, RASQAL_GOOD_CAST(size_t, capacity),
+                                  sizeof(void*));
+    if(!pool->objects)
+      return 1;
+
+#ifdef HAVE_PTHREAD_H
+    if(pthread_mutex_init(&pool->lock, NULL)) {
+      RASQAL_FREE(void**, pool->objects);
+      pool->objects = NULL;
+      return 1;
+    }
+#endif
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_object_pool_finish:
+ * @pool: object pool
+ *
+ * INTERNAL - Free all objects kept in a pool and the pool resources
+ */
+void
+rasqal_object_pool_finish(rasqal_object_pool* pool)
+{
+  if(!pool->objects)
+    return;
+  
+  while(pool->size > 0)
+    RASQAL_FREE(void*, pool->objects[--pool->size]);
+
+  RASQAL_FREE(void**, pool->objects);
+  pool->objects = NULL;
+  pool->capacity = 0;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&pool->lock);
+#endif
+}
+
+
+/*
+ * rasqal_object_pool_calloc:
+ * @pool: object pool
+ *
+ * INTERNAL - Get a zeroed object from the pool, allocating if it is empty
+ *
+ * Return value: new object or NULL on failure
+ */
+void*
+rasqal_object_pool_calloc(rasqal_object_pool* pool)
+{
+  void* object = NULL;
+  
+  if(!pool->objects)
+    return RASQAL_CALLOC(void*, 1, pool->object_size);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&pool->lock);
+#endif
+  if(pool->size > 0)
+    object = pool->objects[--pool->size];
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&pool->lock);
+#endif
+
+  if(object) {
+    memset(object, '\0', pool->object_size);
+    return object;
+  }
+
+  return RASQAL_CALLOC(void*, 1, pool->object_size);
+}
+
+
+/*
+ * rasqal_object_pool_free:
+ * @pool: object pool
+ * @object: object
+ *
+ * INTERNAL - Return an object to the pool, freeing it if the pool is full
+ */
+void
+rasqal_object_pool_free(rasqal_object_pool* pool, void* object)
+{
+  if(pool->objects) {
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&pool->lock);
+#endif
+    if(pool->size < pool->capacity) {
+      pool->objects[pool->size++] = object;
+      object = NULL;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&pool->lock);
+#endif
+  }
+
+  if(object)
+    RASQAL_FREE(void*, object);
+}
+
+
+/*
+ * rasqal_intern_table_init:
+ * @table: intern table
+ *
+ * INTERNAL - Initialise an empty intern table
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_intern_table_init(rasqal_intern_table* table)
+{
+  table->capacity = 0;
+  table->size = 0;
+  table->entries = NULL;
+
+#ifdef HAVE_PTHREAD_H
+  if(pthread_mutex_init(&table->lock, NULL))
+    return 1;
+#endif
+
+  return 0;
+}
+
+
+/*
+ * rasqal_intern_table_finish:
+ * @table: intern table
+ *
+ * INTERNAL - Free all interned strings and the table resources
+ */
+void
+rasqal_intern_table_finish(rasqal_intern_table* table)
+{
+  size_t i;
+
+  if(table->entries) {
+    for(i = 0; i < table->capacity; i++) {
+      if(table->entries[i].string)
+        RASQAL_FREE(char*, table->entries[i].string);
+    }
+
+    RASQAL_FREE(rasqal_intern_entry*, table->entries);
+    table->entries = NULL;
+  }
+  table->capacity = 0;
+  table->size = 0;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_destroy(&table->lock);
+#endif
+}
+
+
+/*
+ * rasqal_string_hash:
+ * @string: string
+ * @len: length of @string
+ *
+ * INTERNAL - Hash a counted string for the world hash tables
+ *
+ * Return value: hash value
+ */
+size_t
+rasqal_string_hash(const char* string, size_t len)
+{
+  /* FNV-1a */
+  size_t hash = 2166136261U;
+  size_t i;
+  
+  for(i = 0; i < len; i++) {
+    hash ^= RASQAL_GOOD_CAST(unsigned char, string[i]);
+    hash *= 16777619U;
+  }
+
+  return hash;
+}
+
+
+static int
+rasqal_intern_table_grow(rasqal_intern_table* table)
+{
+  size_t new_capacity = table->capacity ? table->capacity * 2 : 16;
+  rasqal_intern_entry* new_entries;
+  size_t i;
+
+  new_entries = RASQAL_CALLOC(rasqal_intern_entry*, new_capacity,
+                              sizeof(rasqal_intern_entry));
+  if(!new_entries)
+    return 1;
+
+  for(i = 0; i < table->capacity; i++) {
+    rasqal_intern_entry* entry = &table->entries[i];
+    size_t slot;
+    
+    if(!entry->string)
+      continue;
+
+    slot = entry->hash & (new_capacity - 1);
+    while(new_entries[slot].string)
+      slot = (slot + 1) & (new_capacity - 1);
+    new_entries[slot] = *entry;
+  }
+
+  if(table->entries)
+    RASQAL_FREE(rasqal_intern_entry*, table->entries);
+  table->entries = new_entries;
+  table->capacity = new_capacity;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_intern_table_add:
+ * @table: intern table
+ * @string: string (need not be NUL terminated)
+ * @len: length of @string
+ *
+ * INTERNAL - Get the shared copy of a counted string, adding it if missing
+ *
+ * The caller must call rasqal_intern_table_release() on the result
+ * when it is no longer used.
+ *
+ * Return value: shared string owned by @table or NULL on failure
+ */
+const char*
+rasqal_intern_table_add(rasqal_intern_table* table, const char* string,
+                        size_t len)
+{
+  size_t hash;
+  size_t slot;
+  char* copy = NULL;
+
+  hash = rasqal_string_hash(string, len);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&table->lock);
+#endif
+
+  /* keep the table at most half full so probe sequences stay short */
+  if((table->size + 1) * 2 > table->capacity) {
+    if(rasqal_intern_table_grow(table))
+      goto unlock;
+  }
+
+  slot = hash & (table->capacity - 1);
+  while(table->entries[slot].string) {
+    rasqal_intern_entry* entry = &table->entries[slot];
+
+    if(entry->hash == hash && !strncmp(entry->string, string, len) &&
+       !entry->string[len]) {
+      entry->usage++;
+      copy = entry->string;
+      goto unlock;
+    }
+    
+    slot = (slot + 1) & (table->capacity - 1);
+  }
+
+  copy = RASQAL_MALLOC(char*, len + 1);
+  if(!copy)
+    goto unlock;
+  memcpy(copy, string, len);
+  copy[len] = '\0';
+
+  table->entries[slot].string = copy;
+  table->entries[slot].hash = hash;
+  table->entries[slot].usage = 1;
+  table->size++;
+
+  unlock:
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&table->lock);
+#endif
+
+  return copy;
+}
+
+
+/*
+ * rasqal_intern_table_release:
+ * @table: intern table
+ * @string: shared string returned by rasqal_intern_table_add()
+ *
+ * INTERNAL - Release one use of an interned string, freeing it after the last
+ */
+void
+rasqal_intern_table_release(rasqal_intern_table* table, const char* string)
+{
+  size_t mask;
+  size_t hole;
+  size_t slot;
+
+  if(!string)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&table->lock);
+#endif
+
+  if(!table->capacity)
+    goto unlock;
+  
+  mask = table->capacity - 1;
+  hole = rasqal_string_hash(string, strlen(string)) & mask;
+  while(table->entries[hole].string != string) {
+    if(!table->entries[hole].string)
+      /* not in the table */
+      goto unlock;
+    hole = (hole + 1) & mask;
+  }
+
+  if(--table->entries[hole].usage)
+    goto unlock;
+
+  RASQAL_FREE(char*, table->entries[hole].string);
+  table->entries[hole].string = NULL;
+  table->size--;
+
+  /* shift later entries of the probe sequence back into the hole so
+   * lookups never stop early at an empty slot */
+  slot = hole;
+  while(1) {
+    size_t home;
+
+    slot = (slot + 1) & mask;
+    if(!table->entries[slot].string)
+      break;
+
+    home = table->entries[slot].hash & mask;
+    /* move the entry unless its home slot lies cyclically in (hole, slot] */
+    if(hole <= slot ? (home <= hole || home > slot)
+                    : (home <= hole && home > slot)) {
+      table->entries[hole] = table->entries[slot];
+      table->entries[slot].string = NULL;
+      hole = slot;
+    }
+  }
+
+  unlock:
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&table->lock);
+#endif
+  return;
+}
+
+
+/*
+ * rasqal_world_intern_language:
+ * @world: world
+ * @language: language tag
+ *
+ * INTERNAL - Get the shared lowercased copy of a language tag
+ *
+ * Language tags compare case-insensitively so they are lowercased
+ * before interning; two literal languages are then equal exactly
+ * when their pointers are.  The result must be released with
+ * rasqal_world_release_language().
+ *
+ * Return value: shared language tag owned by @world or NULL on failure
+ */
+const char*
+rasqal_world_intern_language(rasqal_world* world, const char* language)
+{
+  char buffer[64];
+  char* lower = buffer;
+  size_t len = strlen(language);
+  const char* interned;
+  size_t i;
+
+  if(len >= sizeof(buffer)) {
+    lower = RASQAL_MALLOC(char*, len + 1);
+    if(!lower)
+      return NULL;
+  }
+
+  for(i = 0; i < len; i++) {
+    char c = language[i];
+    if(isupper(RASQAL_GOOD_CAST(int, c)))
+      c = RASQAL_GOOD_CAST(char, tolower(RASQAL_GOOD_CAST(int, c)));
+    lower[i] = c;
+  }
+
+  interned = rasqal_intern_table_add(&world->languages, lower, len);
+
+  if(lower != buffer)
+    RASQAL_FREE(char*, lower);
+
+  return interned;
+}
+
+
+/*
+ * rasqal_world_release_language:
+ * @world: world
+ * @language: language tag returned by rasqal_world_intern_language()
+ *
+ * INTERNAL - Release a shared language tag
+ */
+void
+rasqal_world_release_language(rasqal_world* world, const char* language)
+{
+  rasqal_intern_table_release(&world->languages, language);
+}
+
+
+/*
+ * rasqal_memmem:
+ * @haystack: string to search
+ * @haystack_len: length of @haystack
+ * @needle: string to find
+ * @needle_len: length of @needle
+ *
+ * INTERNAL - Find a counted byte string inside another
+ *
+ * Uses memchr() to skip to candidates for the first byte of @needle
+ * and memcmp() to check the rest; neither string needs to be NUL
+ * terminated.  An empty @needle matches at the start of @haystack.
+ *
+ * Return value: pointer to first match in @haystack or NULL if not found
+ */
+const char*
+rasqal_memmem(const char* haystack, size_t haystack_len,
+              const char* needle, size_t needle_len)
+{
+  const char* p = haystack;
+  const char* last;
+  
+  if(!needle_len)
+    return haystack;
+
+  if(needle_len > haystack_len)
+    return NULL;
+
+  /* last position a match can start at */
+  last = haystack + (haystack_len - needle_len);
+
+  while(p <= last) {
+    p = RASQAL_GOOD_CAST(const char*, memchr(p, needle[0],
+                                             RASQAL_GOOD_CAST(size_t, last - p) + 1));
+    if(!p)
+      break;
+
+    if(!memcmp(p + 1, needle + 1, needle_len - 1))
+      return p;
+
+    p++;
+  }
+
+  return NULL;
+}
+
+
 const raptor_unichar rasqal_unicode_max_codepoint = 0x10FFFF;
 
 /**
@@ -1103,6 +1641,719 @@ rasqal_world_set_warning_level(rasqal_world* world,
 }
 
 
+/*
+ * rasqal_query_cache_entry:
+ * @key: normalized query key
+ * @hash: hash of @key
+ * @query: prepared query (one reference owned by the cache)
+ * @next: next entry in the same hash bucket
+ * @older: next less recently used entry
+ * @newer: next more recently used entry
+ *
+ * INTERNAL - An entry in the world prepared query cache
+ */
+typedef struct rasqal_query_cache_entry_s {
+  char* key;
+  size_t hash;
+  rasqal_query* query;
+  struct rasqal_query_cache_entry_s* next;
+  struct rasqal_query_cache_entry_s* older;
+  struct rasqal_query_cache_entry_s* newer;
+} rasqal_query_cache_entry;
+
+
+static void
+rasqal_free_query_cache_entry(rasqal_query_cache_entry* entry)
+{
+  if(entry->key)
+    RASQAL_FREE(char*, entry->key);
+
+  if(entry->query)
+    rasqal_free_query(entry->query);
+
+  RASQAL_FREE(rasqal_query_cache_entry, entry);
+}
+
+
+/*
+ * rasqal_query_cache_normalize_key:
+ * @name: query language name or NULL
+ * @query_string: query string
+ * @base_uri: base URI or NULL
+ *
+ * INTERNAL - Make the cache key for a query string
+ *
+ * Runs of whitespace are collapsed to a single space and comments
+ * are removed outside of string literals and IRIs so that queries
+ * differing only in layout share an entry.  The contents of strings
+ * are never changed.
+ *
+ * Return value: new key string or NULL on failure
+ */
+static char*
+rasqal_query_cache_normalize_key(const char* name,
+                                 const unsigned char* query_string,
+                                 raptor_uri* base_uri)
+{
+  const unsigned char* base_string = NULL;
+  size_t name_len;
+  size_t base_len = 0;
+  size_t query_len;
+  char* key;
+  char* p;
+  const unsigned char* s;
+  int in_iri = 0;
+  int pending_space = 0;
+
+  if(!name)
+    name = "";
+  name_len = strlen(name);
+  if(base_uri)
+    base_string = raptor_uri_as_counted_string(base_uri, &base_len);
+  query_len = strlen(RASQAL_GOOD_CAST(const char*, query_string));
+
+  key = RASQAL_MALLOC(char*, name_len + base_len + query_len + 3);
+  if(!key)
+    return NULL;
+
+  p = key;
+  memcpy(p, name, name_len);
+  p += name_len;
+  *p++ = '\n';
+  if(base_len) {
+    memcpy(p, base_string, base_len);
+    p += base_len;
+  }
+  *p++ = '\n';
+
+  for(s = query_string; *s; s++) {
+    unsigned char c = *s;
+
+    if(in_iri) {
+      /* IRIREF cannot contain whitespace or quotes so these end it;
+       * a '<' comparison operator is handled the same way */
+      if(c == '>') {
+        *p++ = RASQAL_GOOD_CAST(char, c);
+        in_iri = 0;
+        continue;
+      }
+      if(!isspace(c) && c != '"' && c != '\'') {
+        *p++ = RASQAL_GOOD_CAST(char, c);
+        continue;
+      }
+      in_iri = 0;
+    }
+
+    if(isspace(c)) {
+      pending_space = 1;
+      continue;
+    }
+
+    if(c == '#') {
+      /* comment to end of line */
+      while(s[1] && s[1] != '\n' && s[1] != '\r')
+        s++;
+      pending_space = 1;
+      continue;
+    }
+
+    if(pending_space && p[-1] != '\n')
+      *p++ = ' ';
+    pending_space = 0;
+
+    if(c == '<') {
+      in_iri = 1;
+      *p++ = RASQAL_GOOD_CAST(char, c);
+      continue;
+    }
+
+    if(c == '"' || c == '\'') {
+      /* copy the string literal unchanged, including long strings */
+      unsigned char quote = c;
+      int long_string = (s[1] == quote && s[2] == quote);
+      int quotes = long_string ? 3 : 1;
+      int i;
+
+      for(i = 0; i < quotes; i++)
+        *p++ = RASQAL_GOOD_CAST(char, *s++);
+
+      while(*s) {
+        if(*s == '\\' && s[1]) {
+          *p++ = RASQAL_GOOD_CAST(char, *s++);
+          *p++ = RASQAL_GOOD_CAST(char, *s++);
+          continue;
+        }
+        if(*s == quote &&
+           (!long_string || (s[1] == quote && s[2] == quote)))
+          break;
+        *p++ = RASQAL_GOOD_CAST(char, *s++);
+      }
+
+      for(i = 0; i < quotes && *s; i++)
+        *p++ = RASQAL_GOOD_CAST(char, *s++);
+
+      /* step back so the loop increment moves past the string */
+      s--;
+      continue;
+    }
+
+    *p++ = RASQAL_GOOD_CAST(char, c);
+  }
+  *p = '\0';
+
+  return key;
+}
+
+
+/* remove an entry from the recently used list */
+static void
+rasqal_query_cache_unlink(rasqal_world* world, rasqal_query_cache_entry* entry)
+{
+  if(entry->older)
+    entry->older->newer = entry->newer;
+  else
+    world->query_cache_oldest = entry->newer;
+
+  if(entry->newer)
+    entry->newer->older = entry->older;
+  else
+    world->query_cache_newest = entry->older;
+
+  entry->older = entry->newer = NULL;
+}
+
+
+/* add an entry to the recently used list as the newest */
+static void
+rasqal_query_cache_link_newest(rasqal_world* world,
+                               rasqal_query_cache_entry* entry)
+{
+  entry->older = world->query_cache_newest;
+  entry->newer = NULL;
+  if(world->query_cache_newest)
+    world->query_cache_newest->newer = entry;
+  else
+    world->query_cache_oldest = entry;
+  world->query_cache_newest = entry;
+}
+
+
+/* remove an entry from the cache and free it */
+static void
+rasqal_query_cache_remove(rasqal_world* world, rasqal_query_cache_entry* entry)
+{
+  rasqal_query_cache_entry** entry_p;
+
+  entry_p = &world->query_cache[entry->hash & RASQAL_GOOD_CAST(size_t, world->query_cache_buckets - 1)];
+  while(*entry_p != entry)
+    entry_p = &(*entry_p)->next;
+  *entry_p = entry->next;
+
+  rasqal_query_cache_unlink(world, entry);
+  world->query_cache_count--;
+
+  rasqal_free_query_cache_entry(entry);
+}
+
+
+/*
+ * rasqal_query_cache_trim:
+ * @world: world
+ * @size: maximum number of entries to keep
+ *
+ * INTERNAL - Remove least recently used cache entries down to @size
+ *
+ * Must be called with the query cache locked.
+ */
+static void
+rasqal_query_cache_trim(rasqal_world* world, int size)
+{
+  while(world->query_cache_count > size && world->query_cache_oldest)
+    rasqal_query_cache_remove(world, world->query_cache_oldest);
+}
+
+
+/*
+ * rasqal_query_cache_resize:
+ * @world: world
+ * @size: maximum number of entries
+ *
+ * INTERNAL - Size the query cache hash table for @size entries
+ *
+ * Must be called with the query cache locked and at most @size entries.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_query_cache_resize(rasqal_world* world, int size)
+{
+  rasqal_query_cache_entry** buckets = NULL;
+  int buckets_count = 0;
+  int i;
+
+  if(size > 0) {
+    /* a power of 2 at least as large as the maximum number of entries */
+    buckets_count = 8;
+    while(buckets_count < size)
+      buckets_count *= 2;
+
+    if(buckets_count == world->query_cache_buckets)
+      return 0;
+
+    buckets = RASQAL_CALLOC(rasqal_query_cache_entry**,
+                            RASQAL_GOOD_CAST(size_t, buckets_count),
+                            sizeof(rasqal_query_cache_entry*));
+    if(!buckets)
+      return 1;
+  }
+
+  for(i = 0; i < world->query_cache_buckets; i++) {
+    rasqal_query_cache_entry* entry = world->query_cache[i];
+
+    while(entry) {
+      rasqal_query_cache_entry* next = entry->next;
+      size_t slot = entry->hash & RASQAL_GOOD_CAST(size_t, buckets_count - 1);
+
+      entry->next = buckets[slot];
+      buckets[slot] = entry;
+      entry = next;
+    }
+  }
+
+  if(world->query_cache)
+    RASQAL_FREE(rasqal_query_cache_entry**, world->query_cache);
+  world->query_cache = buckets;
+  world->query_cache_buckets = buckets_count;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_cache_finish:
+ * @world: world
+ *
+ * INTERNAL - Free all cached queries
+ */
+void
+rasqal_query_cache_finish(rasqal_world* world)
+{
+  rasqal_query_cache_trim(world, 0);
+  rasqal_query_cache_resize(world, 0);
+}
+
+
+/**
+ * rasqal_world_set_query_cache_size:
+ * @world: world
+ * @size: maximum number of cached queries or 0 to disable
+ *
+ * Set the size of the world prepared query cache
+ *
+ * The cache is used by rasqal_world_get_prepared_query() and is
+ * disabled by default.  Reducing the size removes the least
+ * recently used entries.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_world_set_query_cache_size(rasqal_world* world, int size)
+{
+  int rc;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  if(size < 0)
+    return 1;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->query_cache_lock);
+#endif
+  rasqal_query_cache_trim(world, size);
+  rc = rasqal_query_cache_resize(world, size);
+  if(!rc)
+    world->query_cache_size = size;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->query_cache_lock);
+#endif
+
+  return rc;
+}
+
+
+/*
+ * rasqal_query_cache_entry_is_free:
+ * @entry: query cache entry
+ *
+ * INTERNAL - Check only the cache holds the query of an entry
+ *
+ * Callers release cached queries with rasqal_free_query() without
+ * the cache lock; its atomic decrement happens after any change the
+ * caller made, so a usage of 1 read here means the caller is done.
+ * Only the cache can free the query and it does so with the cache
+ * locked.  Must be called with the query cache locked.
+ *
+ * Return value: non-0 if the query may be handed out
+ */
+static int
+rasqal_query_cache_entry_is_free(rasqal_query_cache_entry* entry)
+{
+#ifdef RASQAL_ATOMIC_USAGE
+  return __sync_add_and_fetch(&entry->query->usage, 0) == 1;
+#else
+  return entry->query->usage == 1;
+#endif
+}
+
+
+/* find the entry for @key; must be called with the query cache locked */
+static rasqal_query_cache_entry*
+rasqal_query_cache_find(rasqal_world* world, const char* key, size_t hash)
+{
+  rasqal_query_cache_entry* entry;
+
+  if(!world->query_cache)
+    return NULL;
+
+  for(entry = world->query_cache[hash & RASQAL_GOOD_CAST(size_t, world->query_cache_buckets - 1)];
+      entry;
+      entry = entry->next) {
+    if(entry->hash == hash && !strcmp(entry->key, key))
+      return entry;
+  }
+
+  return NULL;
+}
+
+
+/**
+ * rasqal_world_get_prepared_query:
+ * @world: world
+ * @name: query language name (or NULL for default)
+ * @query_string: query string
+ * @base_uri: base URI of query string (or NULL)
+ *
+ * Get a prepared query for a query string, using the world query cache
+ *
+ * When the cache is enabled with rasqal_world_set_query_cache_size(),
+ * a query string that differs from an earlier one only in whitespace
+ * and comments returns the earlier query, already parsed and with its
+ * execution plan built, once its previous caller has freed it.
+ *
+ * Each caller gets a query that no other caller holds so it may be
+ * changed freely.  Parameters set by an earlier caller are cleared.
+ * A cached query that a caller changed in any other way (such as
+ * its data graphs, limit or features) is not handed out again; the
+ * query string is prepared once more instead.
+ *
+ * Return value: a prepared #rasqal_query to be freed with
+ * rasqal_free_query() or NULL on failure
+ */
+rasqal_query*
+rasqal_world_get_prepared_query(rasqal_world* world, const char* name,
+                                const unsigned char* query_string,
+                                raptor_uri* base_uri)
+{
+  rasqal_query* query = NULL;
+  rasqal_query_cache_entry* entry;
+  char* key = NULL;
+  size_t hash = 0;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_string, char*, NULL);
+
+  if(world->query_cache_size > 0) {
+    key = rasqal_query_cache_normalize_key(name, query_string, base_uri);
+    if(!key)
+      return NULL;
+    hash = rasqal_string_hash(key, strlen(key));
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock(&world->query_cache_lock);
+#endif
+    entry = rasqal_query_cache_find(world, key, hash);
+    if(entry && rasqal_query_cache_entry_is_free(entry)) {
+      if(entry->query->modified)
+        rasqal_query_cache_remove(world, entry);
+      else {
+        query = entry->query;
+        RASQAL_USAGE_INCREMENT(&query->usage);
+        rasqal_query_cache_unlink(world, entry);
+        rasqal_query_cache_link_newest(world, entry);
+        world->query_cache_hits++;
+      }
+    }
+    if(!query)
+      world->query_cache_misses++;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock(&world->query_cache_lock);
+#endif
+
+    if(query) {
+      RASQAL_FREE(char*, key);
+      rasqal_query_clear_parameters(query);
+      return query;
+    }
+  }
+
+  /* prepare outside the lock */
+  query = rasqal_new_query(world, name, NULL);
+  if(!query || rasqal_query_prepare(query, query_string, base_uri)) {
+    if(query)
+      rasqal_free_query(query);
+    if(key)
+      RASQAL_FREE(char*, key);
+    return NULL;
+  }
+
+  if(!key)
+    return query;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->query_cache_lock);
+#endif
+  /* failing to cache is not an error for the caller; a query whose
+   * key is cached but held by another caller is not cached */
+  if(world->query_cache_size > 0 && world->query_cache &&
+     !rasqal_query_cache_find(world, key, hash)) {
+    rasqal_query_cache_trim(world, world->query_cache_size - 1);
+
+    entry = RASQAL_CALLOC(rasqal_query_cache_entry*, 1, sizeof(*entry));
+    if(entry) {
+      size_t slot = hash & RASQAL_GOOD_CAST(size_t, world->query_cache_buckets - 1);
+
+      entry->key = key;
+      entry->hash = hash;
+      entry->query = query;
+      entry->next = world->query_cache[slot];
+      world->query_cache[slot] = entry;
+      rasqal_query_cache_link_newest(world, entry);
+      world->query_cache_count++;
+
+      /* changes made while parsing are part of the prepared query */
+      query->modified = 0;
+      RASQAL_USAGE_INCREMENT(&query->usage);
+      key = NULL;
+    }
+  }
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->query_cache_lock);
+#endif
+
+  if(key)
+    RASQAL_FREE(char*, key);
+
+  return query;
+}
+
+
+/**
+ * rasqal_world_get_query_cache_stats:
+ * @world: world
+ * @hits_p: pointer to store cache hits count (or NULL)
+ * @misses_p: pointer to store cache misses count (or NULL)
+ *
+ * Get the world prepared query cache lookup counters
+ */
+void
+rasqal_world_get_query_cache_stats(rasqal_world* world,
+                                   unsigned long* hits_p,
+                                   unsigned long* misses_p)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN(world, rasqal_world);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->query_cache_lock);
+#endif
+  if(hits_p)
+    *hits_p = world->query_cache_hits;
+  if(misses_p)
+    *misses_p = world->query_cache_misses;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->query_cache_lock);
+#endif
+}
+
+
+/**
+ * rasqal_world_set_results_cache_size:
+ * @world: world
+ * @size: maximum bytes of cached result rows or 0 to disable
+ *
+ * Set the memory budget of the world query results cache
+ *
+ * When enabled, the result rows of bindings queries are kept and
+ * executing the same query string again over the same data graphs
+ * and parameter values replays the rows without evaluating the
+ * query.  Rows that are not stored anyway are copied to the cache
+ * as they are read and only cached once all rows have been read.  Least recently used results are removed to stay within
+ * @size.  Use rasqal_world_set_dataset_version() when the data
+ * changes.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_world_set_results_cache_size(rasqal_world* world, size_t size)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->results_cache_lock);
+#endif
+  world->results_cache_size = size;
+  rasqal_query_results_cache_trim(world, size);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->results_cache_lock);
+#endif
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_set_service_cache:
+ * @world: world
+ * @size: maximum bytes of cached SERVICE responses or 0 to disable
+ * @ttl: seconds a cached response is used for or 0 for no expiry
+ *
+ * Set the memory budget and lifetime of the world SERVICE response cache
+ *
+ * When enabled, the decoded rows of SERVICE responses are kept and
+ * a request for the same endpoint, query, dataset and result format
+ * made within @ttl seconds reads the rows without contacting the
+ * endpoint.  Least recently used responses are removed to stay
+ * within @size.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_world_set_service_cache(rasqal_world* world, size_t size, int ttl)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  if(ttl < 0)
+    return 1;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->service_cache_lock);
+#endif
+  world->service_cache_size = size;
+  world->service_cache_ttl = ttl;
+  rasqal_service_cache_trim(world, size);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->service_cache_lock);
+#endif
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_set_dataset_version:
+ * @world: world
+ * @version: version of the data queried
+ *
+ * Set the version of the data that queries are run over
+ *
+ * Changing the version removes all cached query results.
+ */
+void
+rasqal_world_set_dataset_version(rasqal_world* world, unsigned long version)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN(world, rasqal_world);
+
+  if(world->dataset_version == version)
+    return;
+
+  world->dataset_version = version;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->results_cache_lock);
+#endif
+  rasqal_query_results_cache_trim(world, 0);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->results_cache_lock);
+#endif
+}
+
+
+/**
+ * rasqal_world_set_feature:
+ * @world: world
+ * @feature: feature to set from enumerated #rasqal_feature values
+ * @value: integer feature value (0 or larger)
+ *
+ * Set a world feature
+ *
+ * The only world feature is #RASQAL_FEATURE_THREADS which sets the
+ * number of worker threads shared by all queries.  It must not be
+ * changed while queries are being executed.
+ *
+ * Return value: non-0 on failure or if the feature is not a world feature
+ */
+int
+rasqal_world_set_feature(rasqal_world* world, rasqal_feature feature,
+                         int value)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, 1);
+
+  switch(feature) {
+    case RASQAL_FEATURE_THREADS:
+      if(value < 0)
+        return 1;
+
+      if(world->task_pool) {
+        rasqal_free_task_pool(world->task_pool);
+        world->task_pool = NULL;
+      }
+
+      /* the pool is made here so that queries only ever read it */
+      if(value > 0) {
+        world->task_pool = rasqal_new_task_pool(world, value);
+        if(!world->task_pool) {
+          world->features[RASQAL_GOOD_CAST(int, feature)] = 0;
+          return 1;
+        }
+      }
+
+      world->features[RASQAL_GOOD_CAST(int, feature)] = value;
+      break;
+
+    case RASQAL_FEATURE_NO_NET:
+    case RASQAL_FEATURE_RAND_SEED:
+    default:
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/**
+ * rasqal_world_get_feature:
+ * @world: world
+ * @feature: feature to get value
+ *
+ * Get a world feature
+ *
+ * Return value: feature value or < 0 if the feature is not a world feature
+ */
+int
+rasqal_world_get_feature(rasqal_world* world, rasqal_feature feature)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, -1);
+
+  switch(feature) {
+    case RASQAL_FEATURE_THREADS:
+      return world->features[RASQAL_GOOD_CAST(int, feature)];
+
+    case RASQAL_FEATURE_NO_NET:
+    case RASQAL_FEATURE_RAND_SEED:
+    default:
+      return -1;
+  }
+}
+
+
 /**
  * rasqal_free_memory:
  * @ptr: memory pointer
@@ -33,6 +33,23 @@ typedef __int16 int16_t;
 #include <stdint.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* Reference counts of objects that worker threads share, such as
+ * literals held by a triples source.  RASQAL_ATOMIC_USAGE is defined
+ * when they are changed atomically.
+ */
+#if defined(HAVE_PTHREAD_H) && defined(__GNUC__)
+#define RASQAL_ATOMIC_USAGE 1
+#define RASQAL_USAGE_INCREMENT(usage_p) __sync_add_and_fetch(usage_p, 1)
+#define RASQAL_USAGE_DECREMENT(usage_p) __sync_sub_and_fetch(usage_p, 1)
+#else
+#define RASQAL_USAGE_INCREMENT(usage_p) (++(*(usage_p)))
+#define RASQAL_USAGE_DECREMENT(usage_p) (--(*(usage_p)))
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #define RASQAL_EXTERN_C extern "C"
@@ -551,6 +568,19 @@ struct rasqal_query_s {
 
   /* Variable projection (or NULL when invalid such as for ASK) */
   rasqal_projection* projection;
+
+  /* INTERNAL execution plan kept between executions (or NULL) */
+  struct rasqal_query_plan_s* plan;
+
+  /* INTERNAL parameters: sequence of shared #rasqal_variable and
+   * sequence of their #rasqal_literal values (NULL value if unbound)
+   */
+  raptor_sequence* parameter_variables;
+  raptor_sequence* parameter_values;
+
+  /* INTERNAL non-0 if changed by a caller after it was prepared for
+   * the world prepared query cache so it cannot be handed out again */
+  int modified;
 };
 
 
@@ -596,6 +626,9 @@ typedef struct rasqal_rowsource_s rasqal_rowsource;
  * A row of values from a query result, usually generated by a rowsource
  */
 struct rasqal_row_s {
+  /* world this row was allocated from */
+  rasqal_world* world;
+
   /* reference count */
   int usage;
 
@@ -619,6 +652,42 @@ struct rasqal_row_s {
 };
 
 
+/*
+ * RASQAL_ROW_BATCH_SIZE:
+ *
+ * Default number of rows in a #rasqal_row_batch
+ */
+#define RASQAL_ROW_BATCH_SIZE 256
+
+/*
+ * rasqal_row_batch:
+ * @world: world
+ * @size: number of columns (variables)
+ * @capacity: maximum number of rows
+ * @count: number of rows currently held
+ * @values: column-major values; row R of column C is at [C * @capacity + R]
+ * @offsets: row offsets (sequence numbers) for each row
+ * @group_ids: group IDs for each row
+ *
+ * INTERNAL - fixed size block of rows stored by column
+ *
+ * Each non-NULL value holds one reference to a literal.
+ */
+typedef struct {
+  rasqal_world* world;
+  int size;
+  int capacity;
+  int count;
+  rasqal_literal** values;
+  int* offsets;
+  int* group_ids;
+} rasqal_row_batch;
+
+/* Get the array of @capacity values for column @column of a batch */
+#define RASQAL_ROW_BATCH_COLUMN(batch, column) \
+  (&(batch)->values[(column) * (batch)->capacity])
+
+
 typedef struct rasqal_map_s rasqal_map;
 
 /**
@@ -681,12 +750,15 @@ rasqal_rowsource* rasqal_new_slice_rowsource(rasqal_world *world, rasqal_query *
 
 /* rasqal_rowsource_service.c */
 rasqal_rowsource* rasqal_new_service_rowsource(rasqal_world *world, rasqal_query* query, raptor_uri* service_uri, const unsigned char* query_string, raptor_sequence* data_graphs, unsigned int rs_flags);
+rasqal_rowsource* rasqal_new_service_bindjoin_rowsource(rasqal_world *world, rasqal_query* query, rasqal_rowsource* left, raptor_uri* service_uri, const unsigned char* query_string, raptor_sequence* data_graphs, raptor_sequence* service_vars, unsigned int rs_flags, rasqal_join_type join_type, rasqal_expression* expr, int batch_size);
+int rasqal_rowsource_start_services(rasqal_rowsource* rowsource, int max_requests);
   
 /* rasqal_rowsource_sort.c */
 rasqal_rowsource* rasqal_new_sort_rowsource(rasqal_world *world, rasqal_query *query, rasqal_rowsource *rowsource, raptor_sequence* order_seq, int distinct);
 
 /* rasqal_rowsource_triples.c */
 rasqal_rowsource* rasqal_new_triples_rowsource(rasqal_world *world, rasqal_query* query, rasqal_triples_source* triples_source, raptor_sequence* triples, int start_column, int end_column);
+int rasqal_triples_rowsource_add_filter(rasqal_rowsource* rowsource, rasqal_expression* expr);
 
 /* rasqal_rowsource_union.c */
 rasqal_rowsource* rasqal_new_union_rowsource(rasqal_world *world, rasqal_query* query, rasqal_rowsource* left, rasqal_rowsource* right);
@@ -729,6 +801,11 @@ typedef int (*rasqal_rowsource_ensure_variables_func) (rasqal_rowsource* rowsour
  *
  * Handler function for returning the next result row
  *
+ * The returned row is owned by the caller.  A rowsource that only
+ * renumbers, filters or rearranges the rows of an inner rowsource
+ * should return the inner row itself, modified in place when it is
+ * not shared (usage 1), rather than building a copy.
+ *
  * Return value: a query result row or NULL if exhausted
  */
 typedef rasqal_row* (*rasqal_rowsource_read_row_func) (rasqal_rowsource* rowsource, void *user_data);
@@ -795,6 +872,30 @@ typedef rasqal_rowsource* (*rasqal_rowsource_get_inner_rowsource_func) (rasqal_r
 typedef int (*rasqal_rowsource_set_origin_func) (rasqal_rowsource* rowsource, void *user_data, rasqal_literal *origin);
 
 
+/**
+ * rasqal_rowsource_read_batch_func
+ * @user_data: user data
+ * @batch: empty batch to fill with up to @batch->capacity rows
+ *
+ * Handler function for returning the next rows as a column batch
+ *
+ * Return value: number of rows added, 0 if exhausted or <0 on failure
+ */
+typedef int (*rasqal_rowsource_read_batch_func) (rasqal_rowsource* rowsource, void *user_data, rasqal_row_batch* batch);
+
+
+/**
+ * rasqal_rowsource_set_limit_hint_func
+ * @user_data: user data
+ * @limit: maximum number of rows that will be read
+ *
+ * Handler function for passing a row limit hint on to inner rowsources
+ *
+ * Return value: non-0 on failure
+ */
+typedef int (*rasqal_rowsource_set_limit_hint_func) (rasqal_rowsource* rowsource, void *user_data, int limit);
+
+
 /**
  * rasqal_rowsource_handler:
  * @version: API version - 1
@@ -808,8 +909,13 @@ typedef int (*rasqal_rowsource_set_origin_func) (rasqal_rowsource* rowsource, vo
  * @set_requirements: set requirements flag handler - optional (V1)
  * @get_inner_rowsource: get inner rowsource handler - optional if has no inner rowsources (V1)
  * @set_origin: set origin (GRAPH) handler - optional (V1)
+ * @read_batch: read batch of rows handler - optional (V2)
+ * @set_limit_hint: pass row limit hint to inner rowsources handler - optional (V2)
  *
  * Row Source implementation factory handler structure.
+ *
+ * If @read_batch is not given, rasqal_rowsource_read_batch() builds
+ * batches from @read_row or @read_all_rows.
  * 
  */
 typedef struct {
@@ -825,6 +931,9 @@ typedef struct {
   rasqal_rowsource_set_requirements_func     set_requirements;
   rasqal_rowsource_get_inner_rowsource_func  get_inner_rowsource;
   rasqal_rowsource_set_origin_func           set_origin;
+  /* API V2 methods */
+  rasqal_rowsource_read_batch_func           read_batch;
+  rasqal_rowsource_set_limit_hint_func       set_limit_hint;
 } rasqal_rowsource_handler;
 
 
@@ -879,6 +988,16 @@ typedef struct {
  * @rows_sequence: stored sequence of rows for use by rasqal_rowsource_read_row() (or NULL)
  * @offset: size of @rows_sequence
  * @generate_group: non-0 to generate a group (ID 0) around all the returned rows, if there is no grouping returned.
+ * @limit_hint: maximum number of rows the consumer will read or <0 if not known
+ * @eval_context: evaluation context for expressions and variable bindings
+ * @memory_size: memory of @rows_sequence charged to the execution
+ * @profile: non-0 to time reads for #RASQAL_FEATURE_PROFILE
+ * @reading: non-0 while a read is being counted and timed
+ * @rows_out: number of rows returned over all resets
+ * @time_usec: time spent reading rows including inner rowsources in microseconds (if @profile)
+ * @memory_used: memory currently charged to the execution by this rowsource
+ * @memory_peak: maximum of @memory_used
+ * @algorithm: name of the algorithm chosen by the handler (or NULL)
  *
  * Rasqal Row Source class providing a sequence of rows of values similar to a SQL table.
  *
@@ -940,6 +1059,26 @@ struct rasqal_rowsource_s
   int offset;
 
   unsigned int generate_group : 1;
+
+  int limit_hint;
+
+  rasqal_evaluation_context* eval_context;
+
+  size_t memory_size;
+
+  unsigned int profile : 1;
+
+  unsigned int reading : 1;
+
+  int rows_out;
+
+  unsigned long time_usec;
+
+  size_t memory_used;
+
+  size_t memory_peak;
+
+  const char* algorithm;
 };
 
 
@@ -964,6 +1103,13 @@ void rasqal_rowsource_print(rasqal_rowsource* rs, FILE* fh);
 int rasqal_rowsource_ensure_variables(rasqal_rowsource *rowsource);
 int rasqal_rowsource_set_origin(rasqal_rowsource* rowsource, rasqal_literal *literal);
 int rasqal_rowsource_request_grouping(rasqal_rowsource* rowsource);
+int rasqal_rowsource_read_batch(rasqal_rowsource* rowsource, rasqal_row_batch* batch);
+int rasqal_rowsource_set_limit_hint(rasqal_rowsource* rowsource, int limit);
+void rasqal_rowsource_set_evaluation_context(rasqal_rowsource* rowsource, rasqal_evaluation_context* eval_context);
+int rasqal_rowsource_charge_memory(rasqal_rowsource* rowsource, size_t size);
+void rasqal_rowsource_release_memory(rasqal_rowsource* rowsource, size_t size);
+int rasqal_rowsource_write_explain_text(rasqal_rowsource* rowsource, raptor_iostream* iostr);
+int rasqal_rowsource_write_explain_json(rasqal_rowsource* rowsource, raptor_iostream* iostr);
 
 
 typedef struct rasqal_query_results_format_factory_s rasqal_query_results_format_factory;
@@ -1085,6 +1231,78 @@ typedef enum {
 } rasqal_warning_level;
 
 
+/*
+ * RASQAL_OBJECT_POOL_SIZE:
+ *
+ * Maximum number of freed objects kept for reuse in a #rasqal_object_pool.
+ *
+ * Pooling is disabled when a memory debugger is in use so that it
+ * sees every allocation and free.
+ */
+#if defined(RASQAL_MEMORY_SIGN) || defined(RASQAL_MEMORY_DEBUG_DMALLOC)
+#define RASQAL_OBJECT_POOL_SIZE 0
+#else
+#define RASQAL_OBJECT_POOL_SIZE 1024
+#endif
+
+/*
+ * rasqal_object_pool:
+ * @object_size: size of each object
+ * @capacity: maximum number of free objects kept
+ * @size: number of free objects in @objects
+ * @objects: stack of free objects
+ * @lock: lock for @size and @objects; objects are allocated and freed
+ *   by worker, async execution and SERVICE fetch threads too
+ *
+ * INTERNAL - free list of fixed size objects owned by a #rasqal_world
+ */
+typedef struct {
+  size_t object_size;
+  int capacity;
+  int size;
+  void** objects;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+} rasqal_object_pool;
+
+/*
+ * rasqal_intern_entry:
+ * @string: interned string or NULL for an empty slot
+ * @hash: hash of @string
+ * @usage: number of users of @string
+ *
+ * INTERNAL - slot in a #rasqal_intern_table
+ */
+typedef struct {
+  char* string;
+  size_t hash;
+  unsigned int usage;
+} rasqal_intern_entry;
+
+/*
+ * rasqal_intern_table:
+ * @capacity: number of slots in @entries (a power of 2 or 0)
+ * @size: number of strings stored
+ * @entries: open addressed hash table of interned strings
+ * @lock: mutex protecting the table
+ *
+ * INTERNAL - set of unique reference counted strings owned by a #rasqal_world
+ *
+ * Equal strings added to the table return the same shared pointer
+ * so they can be compared by address.  Each add must be balanced by
+ * a release; a string is freed when its last user releases it.
+ */
+typedef struct {
+  size_t capacity;
+  size_t size;
+  rasqal_intern_entry* entries;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t lock;
+#endif
+} rasqal_intern_table;
+
+
 rasqal_query_language_factory* rasqal_query_language_register_factory(rasqal_world *world, int (*factory) (rasqal_query_language_factory*));
 rasqal_query_language_factory* rasqal_get_query_language_factory (rasqal_world*, const char* name, const unsigned char* uri);
 void rasqal_log_error_simple(rasqal_world* world, raptor_log_level level, raptor_locator* locator, const char* message, ...) RASQAL_PRINTF_FORMAT(4, 5);
@@ -1094,6 +1312,19 @@ void rasqal_world_simple_error(void* user_data /* world */, const char *message,
 void rasqal_log_warning_simple(rasqal_world* world, rasqal_warning_level warn_level, raptor_locator* locator, const char* message, ...) RASQAL_PRINTF_FORMAT(4, 5);
 
 const char* rasqal_basename(const char* name);
+int rasqal_object_pool_init(rasqal_object_pool* pool, size_t object_size, int capacity);
+void rasqal_object_pool_finish(rasqal_object_pool* pool);
+void* rasqal_object_pool_calloc(rasqal_object_pool* pool);
+void rasqal_object_pool_free(rasqal_object_pool* pool, void* object);
+int rasqal_intern_table_init(rasqal_intern_table* table);
+void rasqal_intern_table_finish(rasqal_intern_table* table);
+const char* rasqal_intern_table_add(rasqal_intern_table* table, const char* string, size_t len);
+void rasqal_intern_table_release(rasqal_intern_table* table, const char* string);
+const char* rasqal_world_intern_language(rasqal_world* world, const char* language);
+void rasqal_world_release_language(rasqal_world* world, const char* language);
+void rasqal_query_cache_finish(rasqal_world* world);
+const char* rasqal_memmem(const char* haystack, size_t haystack_len, const char* needle, size_t needle_len);
+size_t rasqal_string_hash(const char* string, size_t len);
 unsigned char* rasqal_world_default_generate_bnodeid_handler(void *user_data, unsigned char *user_bnodeid);
 
 extern const raptor_unichar rasqal_unicode_max_codepoint;
@@ -1148,6 +1379,28 @@ rasqal_literal* rasqal_new_string_literal_node(rasqal_world*, const unsigned cha
 int rasqal_literal_as_boolean(rasqal_literal* literal, int* error_p);
 int rasqal_literal_as_integer(rasqal_literal* l, int* error_p);
 double rasqal_literal_as_double(rasqal_literal* l, int* error_p);
+
+/*
+ * rasqal_literal_storage:
+ * @literal: literal
+ * @inline_string: storage for short lexical forms of integer, double
+ *   and float literals; @literal string may point into it
+ *
+ * INTERNAL - memory allocated for a #rasqal_literal
+ *
+ * Fields used only inside the library are kept after the public
+ * struct rasqal_literal_s so that its size and layout stay the same.
+ * Every literal is allocated by the world literal pool with this size.
+ */
+#define RASQAL_LITERAL_INLINE_STRING_SIZE 24
+
+typedef struct {
+  rasqal_literal literal;
+  unsigned char inline_string[RASQAL_LITERAL_INLINE_STRING_SIZE];
+} rasqal_literal_storage;
+
+unsigned int rasqal_literal_hash(rasqal_literal* l);
+unsigned int rasqal_literal_value_hash(rasqal_literal* l);
 raptor_uri* rasqal_literal_as_uri(rasqal_literal* l);
 int rasqal_literal_string_to_native(rasqal_literal *l, int flags);
 int rasqal_literal_has_qname(rasqal_literal* l);
@@ -1166,9 +1419,45 @@ int rasqal_expression_is_aggregate(rasqal_expression* e);
 int rasqal_expression_convert_aggregate_to_variable(rasqal_expression* e_in, rasqal_variable* v, rasqal_expression** e_out);
 int rasqal_expression_mentions_aggregate(rasqal_expression* e);
 
+typedef struct rasqal_binding_frame_s rasqal_binding_frame;
+typedef struct rasqal_execution_control_s rasqal_execution_control;
+
+/*
+ * rasqal_evaluation_context_storage:
+ * @context: evaluation context
+ * @frame: variable bindings written by expressions in one query
+ *   execution or NULL to use the values in the #rasqal_variable objects
+ * @control: cancellation, deadline and memory accounting of a query
+ *   execution or NULL
+ * @countdown: calls to rasqal_evaluation_context_is_interrupted() left
+ *   before the clock is read again
+ *
+ * INTERNAL - memory allocated for a #rasqal_evaluation_context
+ *
+ * Fields used only inside the library are kept after the public
+ * struct so that its size and layout stay the same.  Every context is
+ * allocated by rasqal_new_evaluation_context() with this size.
+ */
+typedef struct {
+  rasqal_evaluation_context context;
+  rasqal_binding_frame* frame;
+  rasqal_execution_control* control;
+  int countdown;
+} rasqal_evaluation_context_storage;
+
+#define RASQAL_EVALUATION_CONTEXT_FRAME(eval_context) \
+  (((rasqal_evaluation_context_storage*)(eval_context))->frame)
+#define RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context) \
+  (((rasqal_evaluation_context_storage*)(eval_context))->control)
+#define RASQAL_EVALUATION_CONTEXT_COUNTDOWN(eval_context) \
+  (((rasqal_evaluation_context_storage*)(eval_context))->countdown)
+
 raptor_sequence* rasqal_expression_copy_expression_sequence(raptor_sequence* exprs_seq);
 int rasqal_literal_sequence_compare(int compare_flags, raptor_sequence* values_a, raptor_sequence* values_b);
-raptor_sequence* rasqal_expression_sequence_evaluate(rasqal_query* query, raptor_sequence* exprs_seq, int ignore_errors, int* error_p);
+raptor_sequence* rasqal_expression_sequence_evaluate(rasqal_evaluation_context* eval_context, raptor_sequence* exprs_seq, int ignore_errors, int* error_p);
+rasqal_literal* rasqal_evaluation_context_get_value(rasqal_evaluation_context* eval_context, rasqal_variable* v);
+int rasqal_evaluation_context_set_value(rasqal_evaluation_context* eval_context, rasqal_variable* v, rasqal_literal* l);
+rasqal_literal* rasqal_evaluation_context_literal_value(rasqal_evaluation_context* eval_context, rasqal_literal* l);
 int rasqal_literal_sequence_equals(raptor_sequence* values_a, raptor_sequence* values_b);
 
 
@@ -1283,6 +1572,7 @@ void rasqal_expression_write(rasqal_expression* e, raptor_iostream* iostr);
 int rasqal_literal_write_turtle(rasqal_literal* l, raptor_iostream* iostr);
 int rasqal_literal_array_equals(rasqal_literal** values_a, rasqal_literal** values_b, int size);
 int rasqal_literal_array_compare(rasqal_literal** values_a, rasqal_literal** values_b, raptor_sequence* exprs_seq, int size, int compare_flags);
+int rasqal_literal_compare_same_type(rasqal_literal* l1, rasqal_literal* l2, int flags, int *error_p);
 rasqal_map* rasqal_new_literal_sequence_sort_map(int is_distinct, int compare_flags);
 int rasqal_literal_sequence_sort_map_add_literal_sequence(rasqal_map* map, raptor_sequence* literals_sequence);
 raptor_sequence* rasqal_new_literal_sequence_of_sequence_from_data(rasqal_world* world, const char* const row_data[], int width);
@@ -1312,6 +1602,11 @@ rasqal_variable* rasqal_query_get_variable_by_offset(rasqal_query* query, int id
 const rasqal_query_execution_factory* rasqal_query_get_engine_by_name(const char* name);
 int rasqal_query_variable_is_bound(rasqal_query* query, rasqal_variable* v);
 rasqal_triple_parts rasqal_query_variable_bound_in_triple(rasqal_query* query, rasqal_variable* v, int column);
+int rasqal_query_variable_needed_outside_triples(rasqal_query* query, rasqal_variable* v, int start_column, int end_column);
+rasqal_evaluation_context* rasqal_query_new_execution_context(rasqal_query* query);
+void rasqal_query_invalidate_plan(rasqal_query* query);
+rasqal_bindings* rasqal_query_new_parameters_bindings(rasqal_query* query);
+rasqal_literal* rasqal_query_get_parameter_binding(rasqal_query* query, rasqal_variable* v);
 int rasqal_query_store_select_query(rasqal_query* query, rasqal_projection* projection, raptor_sequence* data_graphs, rasqal_graph_pattern* where_gp, rasqal_solution_modifier* modifier);
 int rasqal_query_reset_select_query(rasqal_query* query);
 rasqal_projection* rasqal_query_get_projection(rasqal_query* query);
@@ -1327,12 +1622,22 @@ int rasqal_query_check_limit_offset(rasqal_query* query, int result_offset);
 void rasqal_query_results_remove_query_reference(rasqal_query_results* query_results);
 rasqal_variables_table* rasqal_query_results_get_variables_table(rasqal_query_results* query_results);
 rasqal_row* rasqal_query_results_get_current_row(rasqal_query_results* query_results);
+rasqal_evaluation_context* rasqal_query_results_get_evaluation_context(rasqal_query_results* query_results);
+void rasqal_query_results_cache_trim(rasqal_world* world, size_t size);
+void rasqal_query_results_cache_finish(rasqal_world* world);
 rasqal_world* rasqal_query_results_get_world(rasqal_query_results* query_results);
 int rasqal_query_results_sort(rasqal_query_results* query_result, raptor_data_compare_handler compare);
+int rasqal_query_results_execute_async(rasqal_query_results* query_results, const rasqal_query_execution_factory* engine, rasqal_query_results_ready_handler handler, void* user_data);
+int rasqal_evaluation_context_is_interrupted(rasqal_evaluation_context* eval_context);
+int rasqal_evaluation_context_is_interrupted_count(rasqal_evaluation_context* eval_context, int* countdown_p);
+int rasqal_evaluation_context_charge_memory(rasqal_evaluation_context* eval_context, size_t size);
+void rasqal_evaluation_context_release_memory(rasqal_evaluation_context* eval_context, size_t size);
+int rasqal_evaluation_context_memory_exceeded(rasqal_evaluation_context* eval_context);
 
 
 /* rasqal_query_write.c */
 int rasqal_query_write_sparql_20060406_graph_pattern(rasqal_graph_pattern* gp, raptor_iostream *iostr,raptor_uri* base_uri);
+int rasqal_query_write_sparql_20060406_values(rasqal_bindings* bindings, raptor_iostream *iostr);
 int rasqal_query_write_sparql_20060406(raptor_iostream *iostr, rasqal_query* query, raptor_uri *base_uri);
 
 /* rasqal_result_formats.c */
@@ -1372,9 +1677,17 @@ int rasqal_row_to_nodes(rasqal_row* row);
 void rasqal_row_set_values_from_variables_table(rasqal_row* row, rasqal_variables_table* vars_table);
 int rasqal_row_set_order_size(rasqal_row *row, int order_size);
 int rasqal_row_expand_size(rasqal_row *row, int size);
-int rasqal_row_bind_variables(rasqal_row* row, rasqal_variables_table* vars_table);
+int rasqal_row_remap_values(rasqal_row* row, const int* map, int size, rasqal_literal** scratch);
+int rasqal_row_bind_variables(rasqal_row* row, rasqal_evaluation_context* eval_context);
 raptor_sequence* rasqal_row_sequence_copy(raptor_sequence *seq);
+size_t rasqal_row_get_memory_size(rasqal_row* row);
+size_t rasqal_row_sequence_get_memory_size(raptor_sequence* seq);
 int rasqal_row_compare(const void *a, const void *b);
+rasqal_row_batch* rasqal_new_row_batch(rasqal_world* world, int size, int capacity);
+void rasqal_free_row_batch(rasqal_row_batch* batch);
+void rasqal_row_batch_clear(rasqal_row_batch* batch);
+int rasqal_row_batch_add_row(rasqal_row_batch* batch, rasqal_row* row);
+rasqal_row* rasqal_row_batch_get_row(rasqal_row_batch* batch, int index);
 
 /* rasqal_row_compatible.c */
 rasqal_row_compatible* rasqal_new_row_compatible(rasqal_variables_table* vt, rasqal_rowsource *first_rowsource, rasqal_rowsource *second_rowsource);
@@ -1389,6 +1702,32 @@ void rasqal_free_triples_source(rasqal_triples_source *rts);
 int rasqal_triples_source_triple_present(rasqal_triples_source *rts, rasqal_triple *t);
 int rasqal_triples_source_support_feature(rasqal_triples_source *rts, rasqal_triples_source_feature feature);
 
+/* rasqal_task.c */
+typedef struct rasqal_task_pool_s rasqal_task_pool;
+typedef struct rasqal_task_group_s rasqal_task_group;
+
+/*
+ * rasqal_task_handler:
+ * @user_data: task data
+ *
+ * INTERNAL - Function run as a task in a #rasqal_task_pool
+ *
+ * Return value: non-0 on failure
+ */
+typedef int (*rasqal_task_handler)(void* user_data);
+
+rasqal_task_pool* rasqal_new_task_pool(rasqal_world* world, int threads);
+void rasqal_free_task_pool(rasqal_task_pool* pool);
+int rasqal_task_pool_get_threads(rasqal_task_pool* pool);
+rasqal_task_group* rasqal_new_task_group(rasqal_task_pool* pool);
+void rasqal_free_task_group(rasqal_task_group* group);
+int rasqal_task_group_submit(rasqal_task_group* group, rasqal_task_handler handler, void* user_data);
+int rasqal_task_group_wait(rasqal_task_group* group);
+int rasqal_task_group_is_done(rasqal_task_group* group);
+rasqal_task_pool* rasqal_world_get_task_pool(rasqal_world* world);
+rasqal_task_pool* rasqal_query_get_task_pool(rasqal_query* query);
+int rasqal_query_get_parallelism(rasqal_query* query);
+
 rasqal_triples_match* rasqal_new_triples_match(rasqal_query* query, rasqal_triples_source* triples_source, rasqal_triple_meta *m, rasqal_triple *t);
 rasqal_triple_parts rasqal_triples_match_bind_match(struct rasqal_triples_match_s* rtm, rasqal_variable *bindings[4],rasqal_triple_parts parts);
 void rasqal_triples_match_next_match(struct rasqal_triples_match_s* rtm);
@@ -1405,8 +1744,23 @@ const char* rasqal_xsd_datatype_label(rasqal_literal_type native_type);
 int rasqal_xsd_is_datatype_uri(rasqal_world*, raptor_uri* uri);
 
 int rasqal_xsd_datatype_is_numeric(rasqal_literal_type type);
+/*
+ * Buffer sizes (excluding NUL) needed to format:
+ *   4:  8 bit decimal integers (xsd:byte)  "-128" to "127"
+ *   6: 16 bit decimal integers (xsd:short) "-32768" to "32767" 
+ *  11: 32 bit decimal integers (xsd:int)   "-2147483648" to "2147483647"
+ *  20: 64 bit decimal integers (xsd:long)  "-9223372036854775808" to "9223372036854775807"
+ * (the lexical form may have leading 0s in non-canonical representations)
+ *
+ * and doubles formatted as %1.14E then canonicalized.
+ */
+#define RASQAL_XSD_INTEGER_BUFFER_SIZE 20
+#define RASQAL_XSD_DOUBLE_BUFFER_SIZE 20
+
+size_t rasqal_xsd_format_integer_buffer(int i, unsigned char* buffer, size_t size);
 unsigned char* rasqal_xsd_format_integer(int i, size_t *len_p);
 unsigned char* rasqal_xsd_format_float(float f, size_t *len_p);
+size_t rasqal_xsd_format_double_buffer(double d, unsigned char* buf);
 unsigned char* rasqal_xsd_format_double(double d, size_t *len_p);
 rasqal_literal_type rasqal_xsd_datatype_parent_type(rasqal_literal_type type);
 
@@ -1466,6 +1820,67 @@ struct rasqal_world_s {
   unsigned int now_set : 1;
 
   rasqal_warning_level warning_level;
+
+  /* free lists of #rasqal_literal and #rasqal_row objects for reuse */
+  rasqal_object_pool literals_pool;
+  rasqal_object_pool rows_pool;
+
+  /* interned lowercased language tags shared by literals */
+  rasqal_intern_table languages;
+
+  /* prepared query cache: maximum entries (0 = disabled), hash
+   * table of #rasqal_query_cache_entry, number of entries and
+   * buckets, least and most recently used entries, lookup counters
+   * and lock */
+  int query_cache_size;
+  struct rasqal_query_cache_entry_s** query_cache;
+  int query_cache_count;
+  int query_cache_buckets;
+  struct rasqal_query_cache_entry_s* query_cache_oldest;
+  struct rasqal_query_cache_entry_s* query_cache_newest;
+  unsigned long query_cache_hits;
+  unsigned long query_cache_misses;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t query_cache_lock;
+#endif
+
+  /* query results cache: byte budget (0 = disabled), bytes used,
+   * hash table of #rasqal_results_cache_entry, number of entries and
+   * buckets, least and most recently used entries, version of the
+   * dataset and lock */
+  size_t results_cache_size;
+  size_t results_cache_used;
+  struct rasqal_results_cache_entry_s** results_cache;
+  int results_cache_count;
+  int results_cache_buckets;
+  struct rasqal_results_cache_entry_s* results_cache_oldest;
+  struct rasqal_results_cache_entry_s* results_cache_newest;
+  unsigned long dataset_version;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t results_cache_lock;
+#endif
+
+  /* SERVICE response cache: byte budget (0 = disabled), bytes used,
+   * seconds entries live (0 = no expiry), hash table of
+   * #rasqal_service_cache_entry, number of entries and buckets, least
+   * and most recently used entries and lock */
+  size_t service_cache_size;
+  size_t service_cache_used;
+  int service_cache_ttl;
+  struct rasqal_service_cache_entry_s** service_cache;
+  int service_cache_count;
+  int service_cache_buckets;
+  struct rasqal_service_cache_entry_s* service_cache_oldest;
+  struct rasqal_service_cache_entry_s* service_cache_newest;
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_t service_cache_lock;
+#endif
+
+  /* world feature values */
+  int features[RASQAL_FEATURE_LAST+1];
+
+  /* worker threads shared by all queries; created when the feature is set */
+  struct rasqal_task_pool_s* task_pool;
 };
 
 
@@ -1678,12 +2093,17 @@ raptor_sequence* rasqal_variables_table_get_anonymous_variables_sequence(rasqal_
 const unsigned char** rasqal_variables_table_get_names(rasqal_variables_table* vt);
 raptor_sequence* rasqal_variable_copy_variable_sequence(raptor_sequence* vars_seq);
 int rasqal_variables_write(raptor_sequence* seq, raptor_iostream* iostr);
+rasqal_binding_frame* rasqal_new_binding_frame(rasqal_world* world);
+void rasqal_free_binding_frame(rasqal_binding_frame* frame);
+rasqal_literal* rasqal_binding_frame_get_value(rasqal_binding_frame* frame, rasqal_variable* v, int* is_set_p);
+int rasqal_binding_frame_set_value(rasqal_binding_frame* frame, rasqal_variable* v, rasqal_literal* l);
 
 /**
  * rasqal_engine_error:
  * @RASQAL_ENGINE_OK:
  * @RASQAL_ENGINE_FAILED:
  * @RASQAL_ENGINE_FINISHED:
+ * @RASQAL_ENGINE_MEMORY_LIMIT: stopped at the query memory limit
  *
  * Execution engine errors.
  *
@@ -1692,7 +2112,8 @@ typedef enum {
   RASQAL_ENGINE_OK,
   RASQAL_ENGINE_FAILED,
   RASQAL_ENGINE_FINISHED,
-  RASQAL_ENGINE_ERROR_LAST = RASQAL_ENGINE_FINISHED
+  RASQAL_ENGINE_MEMORY_LIMIT,
+  RASQAL_ENGINE_ERROR_LAST = RASQAL_ENGINE_MEMORY_LIMIT
 } rasqal_engine_error;
 
 
@@ -1748,6 +2169,14 @@ struct rasqal_query_execution_factory_s {
   /* finish the query execution factory */
   void (*finish_factory)(rasqal_query_execution_factory* factory);
 
+  /*
+   * @ex_data: execution data
+   *
+   * Get the rowsource tree of the execution (shared) or NULL if there
+   * is none.  Optional.
+   */
+  rasqal_rowsource* (*get_rowsource)(void* ex_data);
+
 };
 
 
@@ -1762,11 +2191,34 @@ const char* rasqal_engine_error_as_string(rasqal_engine_error error);
 rasqal_map* rasqal_engine_new_rowsort_map(int is_distinct, int compare_flags, raptor_sequence* order_conditions_sequence);
 int rasqal_engine_rowsort_map_add_row(rasqal_map* map, rasqal_row* row);
 raptor_sequence* rasqal_engine_rowsort_map_to_sequence(rasqal_map* map, raptor_sequence* seq);
-int rasqal_engine_rowsort_calculate_order_values(rasqal_query* query, raptor_sequence* order_seq, rasqal_row* row);
+int rasqal_engine_rowsort_calculate_order_values(rasqal_evaluation_context* eval_context, raptor_sequence* order_seq, rasqal_row* row);
+int rasqal_engine_rowsort_sort_rows(rasqal_query* query, rasqal_row** rows, int count, int compare_flags, raptor_sequence* order_conditions_sequence);
 
 
 /* rasqal_engine_algebra.c */
 
+/*
+ * rasqal_query_plan:
+ * @usage: reference count
+ * @node: algebra of the query with solution modifiers applied
+ * @pattern_node: node in @node for the query graph pattern (shared)
+ * @nodes_count: number of nodes in @node
+ *
+ * INTERNAL - An execution plan of a prepared query
+ *
+ * The plan is built by the first execution, kept in the query and
+ * shared by later executions that each make their own rowsources
+ * from it.
+ */
+typedef struct rasqal_query_plan_s {
+  int usage;
+  rasqal_algebra_node* node;
+  rasqal_algebra_node* pattern_node;
+  int nodes_count;
+} rasqal_query_plan;
+
+void rasqal_free_query_plan(rasqal_query_plan* plan);
+
 /* New query engine based on executing over query algebra */
 extern const rasqal_query_execution_factory rasqal_query_engine_algebra;
 
@@ -1775,6 +2227,9 @@ raptor_iostream* rasqal_new_iostream_from_stringbuffer(raptor_world *raptor_worl
 
 /* rasqal_service.c */
 rasqal_rowsource* rasqal_service_execute_as_rowsource(rasqal_service* svc, rasqal_variables_table* vars_table);
+int rasqal_service_start_services(raptor_sequence* services, int max_requests);
+void rasqal_service_cache_trim(rasqal_world* world, size_t size);
+void rasqal_service_cache_finish(rasqal_world* world);
 
 /* rasqal_triples_source.c */
 void rasqal_triples_source_error_handler(rasqal_query* rdf_query, raptor_locator* locator, const char* message);
@@ -1806,6 +2261,25 @@ int rasqal_projection_add_variable(rasqal_projection* projection, rasqal_variabl
 
 
 /* rasqal_regex.c */
+/*
+ * rasqal_regex_literal_type:
+ * @RASQAL_REGEX_LITERAL_NONE: pattern needs a regex engine
+ * @RASQAL_REGEX_LITERAL_SUBSTRING: literal appears anywhere
+ * @RASQAL_REGEX_LITERAL_PREFIX: literal anchored at start (^lit)
+ * @RASQAL_REGEX_LITERAL_SUFFIX: literal anchored at end (lit$)
+ * @RASQAL_REGEX_LITERAL_EXACT: literal anchored at both ends (^lit$)
+ *
+ * INTERNAL - kinds of regex pattern that reduce to a literal string match
+ */
+typedef enum {
+  RASQAL_REGEX_LITERAL_NONE,
+  RASQAL_REGEX_LITERAL_SUBSTRING,
+  RASQAL_REGEX_LITERAL_PREFIX,
+  RASQAL_REGEX_LITERAL_SUFFIX,
+  RASQAL_REGEX_LITERAL_EXACT
+} rasqal_regex_literal_type;
+
+rasqal_regex_literal_type rasqal_regex_get_literal(const char* pattern, const char* regex_flags, char* buffer, size_t* len_p);
 int rasqal_regex_match(rasqal_world* world, raptor_locator* locator, const char* pattern, const char* regex_flags, const char* subject, size_t subject_len);
 
 /* rasqal_service.c */
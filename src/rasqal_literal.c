@@ -75,6 +75,53 @@ static rasqal_literal_type rasqal_literal_promote_numerics(rasqal_literal* l1, r
 static int rasqal_literal_set_typed_value(rasqal_literal* l, rasqal_literal_type type, const unsigned char* string, int canonicalize);
 
 
+/*
+ * rasqal_literal_inline_string:
+ * @l: literal
+ *
+ * INTERNAL - Get the inline string buffer of a literal
+ *
+ * Return value: buffer of RASQAL_LITERAL_INLINE_STRING_SIZE bytes
+ */
+static unsigned char*
+rasqal_literal_inline_string(rasqal_literal* l)
+{
+  return ((rasqal_literal_storage*)l)->inline_string;
+}
+
+
+/*
+ * rasqal_literal_free_string:
+ * @l: literal
+ *
+ * INTERNAL - Free the lexical form of a literal unless it is held in
+ * the literal's inline string buffer.
+ */
+static void
+rasqal_literal_free_string(rasqal_literal* l)
+{
+  if(l->string && l->string != rasqal_literal_inline_string(l))
+    RASQAL_FREE(char*, l->string);
+  l->string = NULL;
+}
+
+
+/*
+ * rasqal_new_literal_object:
+ * @world: rasqal world object
+ *
+ * INTERNAL - Get a zeroed literal object from the world literal pool
+ *
+ * Return value: literal object or NULL on failure
+ */
+static rasqal_literal*
+rasqal_new_literal_object(rasqal_world* world)
+{
+  return RASQAL_GOOD_CAST(rasqal_literal*,
+                          rasqal_object_pool_calloc(&world->literals_pool));
+}
+
+
 /**
  * rasqal_new_integer_literal:
  * @world: rasqal world object
@@ -97,7 +144,7 @@ rasqal_new_integer_literal(rasqal_world* world, rasqal_literal_type type,
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  l  = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l  = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -109,13 +156,12 @@ rasqal_new_integer_literal(rasqal_world* world, rasqal_literal_type type,
        l->string = integer ? RASQAL_XSD_BOOLEAN_TRUE : RASQAL_XSD_BOOLEAN_FALSE;
        l->string_len = integer ? RASQAL_XSD_BOOLEAN_TRUE_LEN : RASQAL_XSD_BOOLEAN_FALSE_LEN;
     } else  {
-      size_t slen = 0;      
-      l->string = rasqal_xsd_format_integer(integer, &slen);
+      size_t slen;
+      slen = rasqal_xsd_format_integer_buffer(integer,
+                                              rasqal_literal_inline_string(l),
+                                              RASQAL_LITERAL_INLINE_STRING_SIZE);
+      l->string = rasqal_literal_inline_string(l);
       l->string_len = RASQAL_BAD_CAST(unsigned int, slen);
-      if(!l->string) {
-        rasqal_free_literal(l);
-        return NULL;
-      }
     }
     dt_uri = rasqal_xsd_datatype_type_to_uri(world, l->type);
     if(!dt_uri) {
@@ -193,7 +239,7 @@ rasqal_new_typed_literal(rasqal_world* world, rasqal_literal_type type,
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(!l)
     return NULL;
 
@@ -238,7 +284,7 @@ rasqal_new_floating_literal(rasqal_world *world,
   if(type != RASQAL_LITERAL_FLOAT && type != RASQAL_LITERAL_DOUBLE)
     return NULL;
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     size_t slen = 0;
     l->valid = 1;
@@ -246,12 +292,9 @@ rasqal_new_floating_literal(rasqal_world *world,
     l->world = world;
     l->type = type;
     l->value.floating = d;
-    l->string = rasqal_xsd_format_double(d, &slen);
+    slen = rasqal_xsd_format_double_buffer(d, rasqal_literal_inline_string(l));
+    l->string = rasqal_literal_inline_string(l);
     l->string_len = RASQAL_BAD_CAST(unsigned int, slen);
-    if(!l->string) {
-      rasqal_free_literal(l);
-      return NULL;
-    }
     dt_uri = rasqal_xsd_datatype_type_to_uri(world, l->type);
     if(!dt_uri) {
       rasqal_free_literal(l);
@@ -318,7 +361,7 @@ rasqal_new_uri_literal(rasqal_world* world, raptor_uri *uri)
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -357,7 +400,7 @@ rasqal_new_pattern_literal(rasqal_world* world,
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(pattern, char*, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -415,7 +458,7 @@ rasqal_new_decimal_literal_from_decimal(rasqal_world* world,
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
   /* string and decimal NULLness are checked below */
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(!l)
     return NULL;
   
@@ -537,7 +580,7 @@ rasqal_new_datetime_literal_from_datetime(rasqal_world* world,
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(dt, rasqal_xsd_datetime, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(!l)
     goto failed;
   
@@ -606,14 +649,13 @@ retype:
   }
             
   if(l->language) {
-    RASQAL_FREE(char*, l->language);
+    rasqal_world_release_language(l->world, l->language);
     l->language = NULL;
   }
   l->type = type;
 
   if(string && l->type != RASQAL_LITERAL_DECIMAL) {
-    if(l->string)
-      RASQAL_FREE(char*, l->string);
+    rasqal_literal_free_string(l);
 
     l->string_len = RASQAL_BAD_CAST(unsigned int, strlen(RASQAL_GOOD_CAST(const char*, string)));
     l->string = RASQAL_MALLOC(unsigned char*, l->string_len + 1);
@@ -668,8 +710,7 @@ retype:
         (void)sscanf(RASQAL_GOOD_CAST(char*, l->string), "%lf", &d);
         l->value.floating = d;
         if(canonicalize) {
-          if(l->string)
-            RASQAL_FREE(char*, l->string);
+          rasqal_literal_free_string(l);
           l->string = rasqal_xsd_format_double(d, &slen);
           l->string_len = RASQAL_BAD_CAST(unsigned int, slen);
         }
@@ -700,8 +741,8 @@ retype:
         l->value.decimal = new_d;
 
         /* old l->string is now invalid and MAY need to be freed */
-        if(l->string && original_type != RASQAL_LITERAL_DECIMAL)
-          RASQAL_FREE(char*, l->string);
+        if(original_type != RASQAL_LITERAL_DECIMAL)
+          rasqal_literal_free_string(l);
 
         /* new l->string is owned by l->value.decimal and will be
          * freed on literal destruction
@@ -723,7 +764,7 @@ retype:
       /* Free passed in string */
       if(l->string != RASQAL_XSD_BOOLEAN_TRUE &&
          l->string != RASQAL_XSD_BOOLEAN_FALSE)
-        RASQAL_FREE(char*, l->string);
+        rasqal_literal_free_string(l);
       /* and replace with a static string */
       l->string = i ? RASQAL_XSD_BOOLEAN_TRUE : RASQAL_XSD_BOOLEAN_FALSE;
       l->string_len = i ? RASQAL_XSD_BOOLEAN_TRUE_LEN : RASQAL_XSD_BOOLEAN_FALSE_LEN;
@@ -744,10 +785,10 @@ retype:
 
       l->value.date = rasqal_new_xsd_date(l->world, RASQAL_GOOD_CAST(const char*, l->string));
       if(!l->value.date) {
-        RASQAL_FREE(char*, l->string);
+        rasqal_literal_free_string(l);
         return 1;
       }
-      RASQAL_FREE(char*, l->string);
+      rasqal_literal_free_string(l);
       l->string = RASQAL_GOOD_CAST(unsigned char*, rasqal_xsd_date_to_counted_string(l->value.date, &slen));
       l->string_len = RASQAL_BAD_CAST(unsigned int, slen);
       if(!l->string)
@@ -765,10 +806,10 @@ retype:
       l->value.datetime = rasqal_new_xsd_datetime(l->world,
                                                   RASQAL_GOOD_CAST(const char*, l->string));
       if(!l->value.datetime) {
-        RASQAL_FREE(char*, l->string);
+        rasqal_literal_free_string(l);
         return 1;
       }
-      RASQAL_FREE(char*, l->string);
+      rasqal_literal_free_string(l);
       l->string = RASQAL_GOOD_CAST(unsigned char*, rasqal_xsd_datetime_to_counted_string(l->value.datetime, &slen));
       l->string_len = RASQAL_BAD_CAST(unsigned int, slen);
       if(!l->string)
@@ -824,8 +865,12 @@ rasqal_literal_string_to_native(rasqal_literal *l, int flags)
   /* RDF literal with no datatype (plain literal) */
   if(!l->datatype)
     return 0;
-  
-  native_type = rasqal_xsd_datatype_uri_to_type(l->world, l->datatype);
+
+  /* already native - comparisons must not rewrite a shared literal */
+  if(l->type != RASQAL_LITERAL_STRING)
+    return 0;
+
+  native_type =rasqal_xsd_datatype_uri_to_type(l->world, l->datatype);
   /* plain literal - nothing to do */
   if(native_type == RASQAL_LITERAL_STRING)
     return 0;
@@ -891,7 +936,7 @@ rasqal_new_string_literal_common(rasqal_world* world,
   int native_type_promotion = (flags & 1);
   int canonicalize = (flags & 2) >> 1;
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     rasqal_literal_type datatype_type = RASQAL_LITERAL_STRING;
 
@@ -909,19 +954,15 @@ rasqal_new_string_literal_common(rasqal_world* world,
     l->string = string;
     l->string_len = RASQAL_BAD_CAST(unsigned int, strlen(RASQAL_GOOD_CAST(const char*, string)));
     if(language) {
-      /* Normalize language to lowercase on construction */
-      size_t lang_len = strlen(language);
-      unsigned int i;
-
-      l->language = RASQAL_MALLOC(char*, lang_len + 1);
-      for(i = 0; i < lang_len; i++) {
-        char c = language[i];
-        if(isupper(RASQAL_GOOD_CAST(int, c)))
-          c = tolower(RASQAL_GOOD_CAST(int, c));
-        l->language[i] = c;
-      }
-      l->language[i] = '\0';
+      /* Normalize language to lowercase and share it across literals */
+      l->language = RASQAL_BAD_CAST(char*, rasqal_world_intern_language(world, language));
       RASQAL_FREE(char*, language);
+      if(!l->language) {
+        if(datatype_qname)
+          RASQAL_FREE(char*, datatype_qname);
+        rasqal_free_literal(l);
+        return NULL;
+      }
     }
     l->datatype = datatype;
     l->flags = datatype_qname;
@@ -1035,7 +1076,7 @@ rasqal_new_simple_literal(rasqal_world* world,
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(string, char*, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -1067,7 +1108,7 @@ rasqal_new_boolean_literal(rasqal_world* world, int value)
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -1106,7 +1147,7 @@ rasqal_new_variable_literal(rasqal_world* world, rasqal_variable *variable)
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(world, rasqal_world, NULL);
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(variable, rasqal_variable, NULL);
 
-  l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*l));
+  l = rasqal_new_literal_object(world);
   if(l) {
     l->valid = 1;
     l->usage = 1;
@@ -1134,7 +1175,7 @@ rasqal_new_literal_from_literal(rasqal_literal* l)
   if(!l)
     return NULL;
   
-  l->usage++;
+  RASQAL_USAGE_INCREMENT(&l->usage);
   return l;
 }
 
@@ -1152,9 +1193,12 @@ rasqal_free_literal(rasqal_literal* l)
   if(!l)
     return;
   
-  if(--l->usage)
+  if(RASQAL_USAGE_DECREMENT(&l->usage))
     return;
   
+  if(l->language)
+    rasqal_world_release_language(l->world, l->language);
+
   switch(l->type) {
     case RASQAL_LITERAL_URI:
       if(l->value.uri)
@@ -1170,10 +1214,7 @@ rasqal_free_literal(rasqal_literal* l)
     case RASQAL_LITERAL_FLOAT:
     case RASQAL_LITERAL_UDT:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      if(l->string)
-        RASQAL_FREE(char*, l->string);
-      if(l->language)
-        RASQAL_FREE(char*, l->language);
+      rasqal_literal_free_string(l);
       if(l->datatype)
         raptor_free_uri(l->datatype);
       if(l->type == RASQAL_LITERAL_STRING ||
@@ -1184,8 +1225,7 @@ rasqal_free_literal(rasqal_literal* l)
       break;
 
     case RASQAL_LITERAL_DATE:
-      if(l->string)
-        RASQAL_FREE(char*, l->string);
+      rasqal_literal_free_string(l);
       if(l->datatype)
         raptor_free_uri(l->datatype);
       if(l->value.date)
@@ -1193,8 +1233,7 @@ rasqal_free_literal(rasqal_literal* l)
       break;
 
     case RASQAL_LITERAL_DATETIME:
-      if(l->string)
-        RASQAL_FREE(char*, l->string);
+      rasqal_literal_free_string(l);
       if(l->datatype)
         raptor_free_uri(l->datatype);
       if(l->value.datetime)
@@ -1224,7 +1263,11 @@ rasqal_free_literal(rasqal_literal* l)
     default:
       RASQAL_FATAL2("Unknown literal type %d", l->type);
   }
-  RASQAL_FREE(rasqal_literal, l);
+
+  if(l->world)
+    rasqal_object_pool_free(&l->world->literals_pool, l);
+  else
+    RASQAL_FREE(rasqal_literal, l);
 }
 
 
@@ -2203,7 +2246,10 @@ rasqal_literal_string_compare(rasqal_literal* l1, rasqal_literal* l2,
   if(rc)
     return rc;
       
-  if(l1->language && l2->language)
+  if(l1->language == l2->language)
+    /* same interned language or neither has one */
+    rc = 0;
+  else if(l1->language && l2->language)
     /* both have a language */
     rc = strcmp(RASQAL_GOOD_CAST(const char*, l1->language),
                 RASQAL_GOOD_CAST(const char*, l2->language));
@@ -2303,6 +2349,98 @@ rasqal_literal_rdql_promote_calculate(rasqal_literal* l1, rasqal_literal* l2)
 
 
 
+/*
+ * rasqal_literal_compare_values:
+ * @l1: first literal
+ * @l2: second literal
+ * @type: type to compare both literals as
+ * @flags: comparison flags
+ * @error_p: pointer to error
+ *
+ * INTERNAL - Compare two literal values already promoted to @type
+ *
+ * Does not allocate or change any reference counts.
+ *
+ * Return value: <0, 0, or >0
+ */
+static int
+rasqal_literal_compare_values(rasqal_literal* l1, rasqal_literal* l2,
+                              rasqal_literal_type type, int flags,
+                              int *error_p)
+{
+  int result = 0;
+  double d = 0;
+
+  switch(type) {
+    case RASQAL_LITERAL_URI:
+      if(flags & RASQAL_COMPARE_URI)
+        result = raptor_uri_compare(l1->value.uri,
+                                    l2->value.uri);
+      else {
+        if(error_p)
+          *error_p = 1;
+        result = 0;
+      }
+      break;
+
+    case RASQAL_LITERAL_STRING:
+    case RASQAL_LITERAL_UDT:
+      result = rasqal_literal_string_compare(l1, l2,
+                                             flags);
+      break;
+      
+    case RASQAL_LITERAL_BLANK:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_XSD_STRING:
+      if(flags & RASQAL_COMPARE_NOCASE)
+        result = rasqal_strcasecmp(RASQAL_GOOD_CAST(const char*, l1->string),
+                                   RASQAL_GOOD_CAST(const char*, l2->string));
+      else
+        result = strcmp(RASQAL_GOOD_CAST(const char*, l1->string),
+                        RASQAL_GOOD_CAST(const char*, l2->string));
+      break;
+
+    case RASQAL_LITERAL_DATE:
+      result = rasqal_xsd_date_compare(l1->value.date,
+                                       l2->value.date,
+                                       error_p);
+      break;
+
+    case RASQAL_LITERAL_DATETIME:
+      result = rasqal_xsd_datetime_compare2(l1->value.datetime,
+                                            l2->value.datetime,
+                                            error_p);
+      break;
+
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+      result = l1->value.integer - l2->value.integer;
+      break;
+
+    case RASQAL_LITERAL_DOUBLE:
+    case RASQAL_LITERAL_FLOAT:
+      d = l1->value.floating - l2->value.floating;
+      result = (d > 0.0) ? 1: (d < 0.0) ? -1 : 0;
+      break;
+      
+    case RASQAL_LITERAL_DECIMAL:
+      result = rasqal_xsd_decimal_compare(l1->value.decimal,
+                                        l2->value.decimal);
+      break;
+
+    case RASQAL_LITERAL_UNKNOWN:
+    case RASQAL_LITERAL_VARIABLE:
+    default:
+      RASQAL_FATAL2("Literal type %d cannot be compared", type);
+      result = 0; /* keep some compilers happy */
+  }
+
+  return result;
+}
+
+
 /**
  * rasqal_literal_compare:
  * @l1: #rasqal_literal first literal
@@ -2340,7 +2478,6 @@ rasqal_literal_compare(rasqal_literal* l1, rasqal_literal* l2, int flags,
   rasqal_literal_type type; /* target promotion type */
   int i;
   int result = 0;
-  double d = 0;
   int promotion = 0;
   
   if(error_p)
@@ -2458,72 +2595,8 @@ rasqal_literal_compare(rasqal_literal* l1, rasqal_literal* l2, int flags,
   }
 
 
-  switch(type) {
-    case RASQAL_LITERAL_URI:
-      if(flags & RASQAL_COMPARE_URI)
-        result = raptor_uri_compare(new_lits[0]->value.uri,
-                                    new_lits[1]->value.uri);
-      else {
-        if(error_p)
-          *error_p = 1;
-        result = 0;
-        goto done;
-      }
-      break;
-
-    case RASQAL_LITERAL_STRING:
-    case RASQAL_LITERAL_UDT:
-      result = rasqal_literal_string_compare(new_lits[0], new_lits[1],
-                                             flags);
-      break;
-      
-    case RASQAL_LITERAL_BLANK:
-    case RASQAL_LITERAL_PATTERN:
-    case RASQAL_LITERAL_QNAME:
-    case RASQAL_LITERAL_XSD_STRING:
-      if(flags & RASQAL_COMPARE_NOCASE)
-        result = rasqal_strcasecmp(RASQAL_GOOD_CAST(const char*, new_lits[0]->string),
-                                   RASQAL_GOOD_CAST(const char*, new_lits[1]->string));
-      else
-        result = strcmp(RASQAL_GOOD_CAST(const char*, new_lits[0]->string),
-                        RASQAL_GOOD_CAST(const char*, new_lits[1]->string));
-      break;
-
-    case RASQAL_LITERAL_DATE:
-      result = rasqal_xsd_date_compare(new_lits[0]->value.date,
-                                       new_lits[1]->value.date,
-                                       error_p);
-      break;
-
-    case RASQAL_LITERAL_DATETIME:
-      result = rasqal_xsd_datetime_compare2(new_lits[0]->value.datetime,
-                                            new_lits[1]->value.datetime,
-                                            error_p);
-      break;
-
-    case RASQAL_LITERAL_INTEGER:
-    case RASQAL_LITERAL_BOOLEAN:
-    case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      result = new_lits[0]->value.integer - new_lits[1]->value.integer;
-      break;
-
-    case RASQAL_LITERAL_DOUBLE:
-    case RASQAL_LITERAL_FLOAT:
-      d = new_lits[0]->value.floating - new_lits[1]->value.floating;
-      result = (d > 0.0) ? 1: (d < 0.0) ? -1 : 0;
-      break;
-      
-    case RASQAL_LITERAL_DECIMAL:
-      result = rasqal_xsd_decimal_compare(new_lits[0]->value.decimal,
-                                        new_lits[1]->value.decimal);
-      break;
-
-    case RASQAL_LITERAL_UNKNOWN:
-    case RASQAL_LITERAL_VARIABLE:
-    default:
-      RASQAL_FATAL2("Literal type %d cannot be compared", type);
-      result = 0; /* keep some compilers happy */
-  }
+  result = rasqal_literal_compare_values(new_lits[0], new_lits[1], type,
+                                         flags, error_p);
 
   done:
   if(promotion) {
@@ -2537,6 +2610,40 @@ rasqal_literal_compare(rasqal_literal* l1, rasqal_literal* l2, int flags,
 }
 
 
+/*
+ * rasqal_literal_compare_same_type:
+ * @l1: first literal
+ * @l2: second literal of the same type as @l1
+ * @flags: comparison flags
+ * @error_p: pointer to error
+ *
+ * INTERNAL - Compare two literal values of the same type without promotion
+ *
+ * Gives the same result as rasqal_literal_compare() with
+ * RASQAL_COMPARE_XQUERY but never allocates or changes reference
+ * counts, so it may be called from several threads on shared
+ * literals.  The literals must not be variables.
+ *
+ * Return value: <0, 0, or >0
+ */
+int
+rasqal_literal_compare_same_type(rasqal_literal* l1, rasqal_literal* l2,
+                                 int flags, int *error_p)
+{
+  if(error_p)
+    *error_p = 0;
+
+  /* cannot compare UDTs */
+  if(l1->type != l2->type || l1->type == RASQAL_LITERAL_UDT) {
+    if(error_p)
+      *error_p = 1;
+    return 0;
+  }
+
+  return rasqal_literal_compare_values(l1, l2, l1->type, flags, error_p);
+}
+
+
 /*
  * rasqal_literal_string_equals_flags:
  * @l1: #rasqal_literal first literal
@@ -2579,7 +2686,8 @@ rasqal_literal_string_equals_flags(rasqal_literal* l1, rasqal_literal* l2,
     /* if either is NULL, the comparison fails */
     if(!l1->language || !l2->language)
       return 0;
-    if(rasqal_strcasecmp(l1->language,l2->language))
+    /* interned and lowercased so equal tags share a pointer */
+    if(l1->language != l2->language)
       return 0;
   }
 
@@ -2939,8 +3047,8 @@ rasqal_literal_expand_qname(void *user_data, rasqal_literal *l)
       RASQAL_FREE(char*, l->flags);
       l->flags = NULL;
 
-      if(l->language && uri) {
-        RASQAL_FREE(char*, l->language);
+      if(uri && l->language) {
+        rasqal_world_release_language(l->world, l->language);
         l->language = NULL;
       }
 
@@ -2948,7 +3056,7 @@ rasqal_literal_expand_qname(void *user_data, rasqal_literal *l)
         rasqal_free_literal(l);
         return 1;
       }
-    }
+      }
   }
   return 0;
 }
@@ -3014,7 +3122,7 @@ rasqal_literal_as_node(rasqal_literal* l)
     case RASQAL_LITERAL_DATETIME:
     case RASQAL_LITERAL_UDT:
     case RASQAL_LITERAL_INTEGER_SUBTYPE:
-      new_l = RASQAL_CALLOC(rasqal_literal*, 1, sizeof(*new_l));
+      new_l = rasqal_new_literal_object(l->world);
       if(new_l) {
         new_l->valid = 1;
         new_l->usage = 1;
@@ -3337,6 +3445,268 @@ rasqal_literal_value(rasqal_literal* l)
 }
 
 
+/* 32 bit FNV-1a hash parameters */
+#define RASQAL_HASH_FNV_OFFSET_BASIS 2166136261U
+#define RASQAL_HASH_FNV_PRIME        16777619U
+
+static unsigned int
+rasqal_hash_bytes(unsigned int hash, const unsigned char* p, size_t len)
+{
+  while(len--) {
+    hash ^= *p++;
+    hash *= RASQAL_HASH_FNV_PRIME;
+  }
+
+  return hash;
+}
+
+
+static unsigned int
+rasqal_hash_string(unsigned int hash, const unsigned char* p, size_t len)
+{
+  /* include the length so that adjacent strings hash apart */
+  hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &len),
+                           sizeof(len));
+  if(p)
+    hash = rasqal_hash_bytes(hash, p, len);
+
+  return hash;
+}
+
+
+static unsigned int
+rasqal_hash_language(unsigned int hash, const char* language)
+{
+  /* languages are compared case-insensitively */
+  for(; language && *language; language++) {
+    hash ^= RASQAL_GOOD_CAST(unsigned char, tolower(RASQAL_GOOD_CAST(unsigned char, *language)));
+    hash *= RASQAL_HASH_FNV_PRIME;
+  }
+  /* terminate so that no language and an empty one differ from
+   * the following data */
+  hash ^= 0xff;
+  hash *= RASQAL_HASH_FNV_PRIME;
+
+  return hash;
+}
+
+
+static unsigned int
+rasqal_hash_uri(unsigned int hash, raptor_uri* uri)
+{
+  const unsigned char* str = NULL;
+  size_t len = 0;
+
+  if(uri)
+    str = raptor_uri_as_counted_string(uri, &len);
+
+  return rasqal_hash_string(hash, str, len);
+}
+
+
+/*
+ * rasqal_literal_compute_term_hash:
+ * @l: #rasqal_literal object that is not a variable
+ *
+ * INTERNAL - Compute the hash of a literal as an RDF term
+ *
+ * Return value: hash value
+ */
+static unsigned int
+rasqal_literal_compute_term_hash(rasqal_literal* l)
+{
+  unsigned int hash = RASQAL_HASH_FNV_OFFSET_BASIS;
+  rasqal_literal_type type;
+
+  type = rasqal_literal_get_rdf_term_type(l);
+  hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &type),
+                           sizeof(type));
+
+  if(type == RASQAL_LITERAL_URI)
+    hash = rasqal_hash_uri(hash, l->value.uri);
+  else {
+    hash = rasqal_hash_string(hash, l->string, l->string_len);
+    if(type == RASQAL_LITERAL_STRING) {
+      hash = rasqal_hash_language(hash, l->language);
+      hash = rasqal_hash_uri(hash, l->datatype);
+    }
+  }
+
+  return hash;
+}
+
+
+/*
+ * rasqal_literal_compute_value_hash:
+ * @l: #rasqal_literal object that is not a variable
+ *
+ * INTERNAL - Compute the hash of a literal value
+ *
+ * Return value: hash value
+ */
+static unsigned int
+rasqal_literal_compute_value_hash(rasqal_literal* l)
+{
+  unsigned int hash = RASQAL_HASH_FNV_OFFSET_BASIS;
+  unsigned char tag;
+
+  if(rasqal_xsd_datatype_is_numeric(l->type)) {
+    int error = 0;
+    double d = rasqal_literal_as_double(l, &error);
+
+    tag = 'N';
+    hash = rasqal_hash_bytes(hash, &tag, 1);
+    if(d == floor(d) && fabs(d) < 9007199254740992.0 /* 2^53 */) {
+      /* integral values hash the same whatever their numeric type */
+      long long i = RASQAL_GOOD_CAST(long long, d);
+      hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &i),
+                               sizeof(i));
+    } else
+      hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &d),
+                               sizeof(d));
+    return hash;
+  }
+
+  switch(l->type) {
+    case RASQAL_LITERAL_URI:
+      tag = 'U';
+      hash = rasqal_hash_bytes(hash, &tag, 1);
+      hash = rasqal_hash_uri(hash, l->value.uri);
+      break;
+
+    case RASQAL_LITERAL_DATE:
+    case RASQAL_LITERAL_DATETIME:
+      if(1) {
+        time_t t;
+        int microseconds = 0;
+
+        if(l->type == RASQAL_LITERAL_DATE)
+          t = l->value.date->time_on_timeline;
+        else {
+          t = l->value.datetime->time_on_timeline;
+          microseconds = l->value.datetime->microseconds;
+        }
+        tag = 'D';
+        hash = rasqal_hash_bytes(hash, &tag, 1);
+        hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &t),
+                                 sizeof(t));
+        hash = rasqal_hash_bytes(hash, RASQAL_GOOD_CAST(const unsigned char*, &microseconds),
+                                 sizeof(microseconds));
+      }
+      break;
+
+    case RASQAL_LITERAL_STRING:
+      if(l->datatype) {
+        /* a datatyped literal kept in lexical form */
+        tag = 'T';
+        hash = rasqal_hash_bytes(hash, &tag, 1);
+        hash = rasqal_hash_string(hash, l->string, l->string_len);
+        hash = rasqal_hash_uri(hash, l->datatype);
+        break;
+      }
+      /* FALLTHROUGH */
+    case RASQAL_LITERAL_XSD_STRING:
+    case RASQAL_LITERAL_UDT:
+      /* simple and xsd:string literals are equal values so the
+       * datatype is not included */
+      tag = 'L';
+      hash = rasqal_hash_bytes(hash, &tag, 1);
+      hash = rasqal_hash_string(hash, l->string, l->string_len);
+      hash = rasqal_hash_language(hash, l->language);
+      break;
+
+    case RASQAL_LITERAL_BLANK:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_UNKNOWN:
+    default:
+      tag = RASQAL_GOOD_CAST(unsigned char, l->type);
+      hash = rasqal_hash_bytes(hash, &tag, 1);
+      hash = rasqal_hash_string(hash, l->string, l->string_len);
+      break;
+  }
+
+  return hash;
+}
+
+
+/*
+ * rasqal_literal_hash:
+ * @l: #rasqal_literal object
+ *
+ * INTERNAL - Get a hash value for a literal as an RDF term
+ *
+ * The hash is consistent with rasqal_literal_equals_flags() using
+ * #RASQAL_COMPARE_RDF: literals that are equal RDF terms have the same
+ * hash.  Variables are hashed by their current value.
+ *
+ * Return value: hash value (0 for a NULL or unbound literal)
+ */
+unsigned int
+rasqal_literal_hash(rasqal_literal* l)
+{
+  l = rasqal_literal_value(l);
+  if(!l)
+    return 0;
+
+  return rasqal_literal_compute_term_hash(l);
+}
+
+
+/*
+ * rasqal_literal_value_hash:
+ * @l: #rasqal_literal object
+ *
+ * INTERNAL - Get a hash value for a literal value
+ *
+ * The hash is consistent with rasqal_literal_equals_flags() using
+ * #RASQAL_COMPARE_XQUERY for exactly equal values: numerics (and
+ * booleans) of any type with the same value such as 1, 1.0 and 1.0e0
+ * hash the same,
+ * as do simple literals and xsd:string literals with the same lexical
+ * form and dates and dateTimes at the same instant.  Doubles are
+ * compared approximately by rasqal_literal_equals_flags() so values
+ * that differ only in the last bits may hash differently.
+ *
+ * The hash is computed when asked from the normalised value.
+ * Datatyped literals kept in their lexical form, such as those made
+ * by rasqal_literal_as_node(), are hashed as a temporary copy
+ * promoted to their native type so that @l is never modified.
+ *
+ * Return value: hash value (0 for a NULL or unbound literal)
+ */
+unsigned int
+rasqal_literal_value_hash(rasqal_literal* l)
+{
+  rasqal_literal* native;
+  unsigned char* string;
+  unsigned int hash;
+
+  l = rasqal_literal_value(l);
+  if(!l)
+    return 0;
+
+  if(l->type != RASQAL_LITERAL_STRING || !l->datatype)
+    return rasqal_literal_compute_value_hash(l);
+
+  string = RASQAL_MALLOC(unsigned char*, l->string_len + 1);
+  if(!string)
+    return rasqal_literal_compute_value_hash(l);
+  memcpy(string, l->string, l->string_len + 1);
+
+  native = rasqal_new_string_literal(l->world, string, NULL,
+                                     raptor_uri_copy(l->datatype), NULL);
+  if(!native)
+    /* not a valid lexical form for the datatype */
+    return rasqal_literal_compute_value_hash(l);
+
+  hash = rasqal_literal_compute_value_hash(native);
+  rasqal_free_literal(native);
+
+  return hash;
+}
+
+
 int
 rasqal_literal_is_numeric(rasqal_literal* literal)
 {
@@ -4838,6 +5208,156 @@ static const struct {
 };
 
 
+static unsigned char*
+copy_string(const char* str)
+{
+  size_t len = strlen(str);
+  unsigned char* s = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(s)
+    memcpy(s, str, len + 1);
+  return s;
+}
+
+
+static int
+test_literal_hashes(rasqal_world* world, const char* program)
+{
+  int failures = 0;
+  raptor_uri* xsd_string_uri;
+  rasqal_literal* i1;
+  rasqal_literal* i2;
+  rasqal_literal* d1;
+  rasqal_literal* f1;
+  rasqal_literal* s1;
+  rasqal_literal* s2;
+  rasqal_literal* en1;
+  rasqal_literal* en2;
+
+  xsd_string_uri = rasqal_xsd_datatype_type_to_uri(world,
+                                                   RASQAL_LITERAL_XSD_STRING);
+
+  i1 = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, 1);
+  i2 = rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, 2);
+  d1 = rasqal_new_decimal_literal(world, (const unsigned char*)"1.0");
+  f1 = rasqal_new_double_literal(world, 1.0);
+  s1 = rasqal_new_string_literal(world, copy_string("abc"), NULL, NULL, NULL);
+  s2 = rasqal_new_string_literal(world, copy_string("abc"), NULL,
+                                 raptor_uri_copy(xsd_string_uri), NULL);
+  en1 = rasqal_new_string_literal(world, copy_string("abc"),
+                                  (const char*)copy_string("en"), NULL, NULL);
+  en2 = rasqal_new_string_literal(world, copy_string("abc"),
+                                  (const char*)copy_string("EN"), NULL, NULL);
+
+  if(!i1 || !i2 || !d1 || !f1 || !s1 || !s2 || !en1 || !en2) {
+    fprintf(DEBUG_FH, "%s: failed to create hash test literals\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(rasqal_literal_value_hash(i1) != rasqal_literal_value_hash(d1) ||
+     rasqal_literal_value_hash(i1) != rasqal_literal_value_hash(f1)) {
+    fprintf(DEBUG_FH, "%s: equal numeric values have different value hashes\n",
+            program);
+    failures++;
+  }
+
+  if(rasqal_literal_value_hash(i1) == rasqal_literal_value_hash(i2) ||
+     rasqal_literal_hash(i1) == rasqal_literal_hash(i2)) {
+    fprintf(DEBUG_FH, "%s: different integers have the same hash\n", program);
+    failures++;
+  }
+
+  if(rasqal_literal_value_hash(s1) != rasqal_literal_value_hash(s2)) {
+    fprintf(DEBUG_FH, "%s: simple and xsd:string literals have different value hashes\n",
+            program);
+    failures++;
+  }
+
+  if(rasqal_literal_hash(en1) != rasqal_literal_hash(en2)) {
+    fprintf(DEBUG_FH, "%s: language tags differing in case have different term hashes\n",
+            program);
+    failures++;
+  }
+
+  if(en1->language != en2->language || strcmp(en1->language, "en")) {
+    fprintf(DEBUG_FH, "%s: language tags were not interned lowercase\n",
+            program);
+    failures++;
+  }
+
+  /* a promoted string and a datatyped literal kept in lexical form
+   * hash the same as the native value, and hashing leaves the lexical
+   * form unchanged */
+  if(1) {
+    raptor_uri* xsd_integer_uri;
+    rasqal_literal* promoted;
+    rasqal_literal* lexical;
+
+    xsd_integer_uri = rasqal_xsd_datatype_type_to_uri(world,
+                                                      RASQAL_LITERAL_INTEGER);
+    promoted = rasqal_new_string_literal(world, copy_string("1"), NULL,
+                                         raptor_uri_copy(xsd_integer_uri),
+                                         NULL);
+    if(!promoted ||
+       rasqal_literal_hash(promoted) != rasqal_literal_hash(i1) ||
+       rasqal_literal_value_hash(promoted) != rasqal_literal_value_hash(i1)) {
+      fprintf(DEBUG_FH, "%s: promoted integer string has different hashes\n",
+              program);
+      failures++;
+    }
+    if(promoted)
+      rasqal_free_literal(promoted);
+
+    lexical = rasqal_literal_as_node(i1);
+    if(!lexical || lexical->type != RASQAL_LITERAL_STRING ||
+       rasqal_literal_hash(lexical) != rasqal_literal_hash(i1) ||
+       rasqal_literal_value_hash(lexical) != rasqal_literal_value_hash(d1) ||
+       lexical->type != RASQAL_LITERAL_STRING) {
+      fprintf(DEBUG_FH, "%s: lexical form integer has different hashes\n",
+              program);
+      failures++;
+    }
+    if(lexical)
+      rasqal_free_literal(lexical);
+  }
+
+  /* an interned language is freed with the last literal using it */
+  if(1) {
+    size_t languages_size;
+
+    rasqal_free_literal(en1);
+    en1 = NULL;
+    languages_size = world->languages.size;
+    rasqal_free_literal(en2);
+    en2 = NULL;
+    if(world->languages.size != languages_size - 1) {
+      fprintf(DEBUG_FH, "%s: language tag was not released\n", program);
+      failures++;
+    }
+  }
+
+  tidy:
+  if(i1)
+    rasqal_free_literal(i1);
+  if(i2)
+    rasqal_free_literal(i2);
+  if(d1)
+    rasqal_free_literal(d1);
+  if(f1)
+    rasqal_free_literal(f1);
+  if(s1)
+    rasqal_free_literal(s1);
+  if(s2)
+    rasqal_free_literal(s2);
+  if(en1)
+    rasqal_free_literal(en1);
+  if(en2)
+    rasqal_free_literal(en2);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -4920,6 +5440,8 @@ main(int argc, char *argv[])
     }
   }
   
+  fprintf(stderr, "%s: Testing literal hashes\n", program);
+  failures += test_literal_hashes(world, program);
 
   tidy:
   rasqal_free_world(world);
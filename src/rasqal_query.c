@@ -178,12 +178,17 @@ rasqal_free_query(rasqal_query* query)
   if(!query)
     return;
   
-  if(--query->usage)
+  /* a query held by the world query cache may be released here by
+   * one thread while another checks its usage with the cache locked */
+  if(RASQAL_USAGE_DECREMENT(&query->usage))
     return;
   
   if(query->factory)
     query->factory->terminate(query);
 
+  if(query->plan)
+    rasqal_free_query_plan(query->plan);
+
   if(query->eval_context)
     rasqal_free_evaluation_context(query->eval_context);
 
@@ -231,6 +236,8 @@ rasqal_free_query(rasqal_query* query)
   if(query->query_results_formatter_name)
     RASQAL_FREE(char*, query->query_results_formatter_name);
 
+  rasqal_query_clear_parameters(query);
+
   /* Do this last since most everything above could refer to a variable */
   if(query->vars_table)
     rasqal_free_variables_table(query->vars_table);
@@ -307,11 +314,18 @@ rasqal_query_set_feature(rasqal_query* query, rasqal_feature feature, int value)
   switch(feature) {
     case RASQAL_FEATURE_NO_NET:
     case RASQAL_FEATURE_RAND_SEED:
+    case RASQAL_FEATURE_THREADS:
+    case RASQAL_FEATURE_TIMEOUT:
+    case RASQAL_FEATURE_MEMORY_LIMIT:
+    case RASQAL_FEATURE_PROFILE:
+    case RASQAL_FEATURE_SERVICE_BIND_JOIN:
+    case RASQAL_FEATURE_SERVICE_REQUESTS:
 
       if(feature == RASQAL_FEATURE_RAND_SEED)
         query->user_set_rand = 1;
       
       query->features[RASQAL_GOOD_CAST(int, feature)] = value;
+      query->modified = 1;
       break;
       
     default:
@@ -375,9 +389,18 @@ rasqal_query_get_feature(rasqal_query *query, rasqal_feature feature)
   switch(feature) {
     case RASQAL_FEATURE_NO_NET:
     case RASQAL_FEATURE_RAND_SEED:
+    case RASQAL_FEATURE_PROFILE:
       result = (query->features[RASQAL_GOOD_CAST(int, feature)] != 0);
       break;
 
+    case RASQAL_FEATURE_THREADS:
+    case RASQAL_FEATURE_TIMEOUT:
+    case RASQAL_FEATURE_MEMORY_LIMIT:
+    case RASQAL_FEATURE_SERVICE_BIND_JOIN:
+    case RASQAL_FEATURE_SERVICE_REQUESTS:
+      result = query->features[RASQAL_GOOD_CAST(int, feature)];
+      break;
+
     default:
       break;
   }
@@ -465,6 +488,8 @@ rasqal_query_set_distinct(rasqal_query* query, int distinct_mode)
       return;
   }
   query->projection->distinct = distinct_mode;
+
+  rasqal_query_invalidate_plan(query);
 }
 
 
@@ -499,6 +524,7 @@ rasqal_query_set_explain(rasqal_query* query, int is_explain)
   RASQAL_ASSERT_OBJECT_POINTER_RETURN(query, rasqal_query);
 
   query->explain = (is_explain != 0) ? 1 : 0;
+  query->modified = 1;
 }
 
 
@@ -542,6 +568,8 @@ rasqal_query_set_limit(rasqal_query* query, int limit)
 
   if(query->modifier)
     query->modifier->limit = limit;
+
+  rasqal_query_invalidate_plan(query);
 }
 
 
@@ -585,6 +613,8 @@ rasqal_query_set_offset(rasqal_query* query, int offset)
 
   if(query->modifier)
     query->modifier->offset = offset;
+
+  rasqal_query_invalidate_plan(query);
 }
 
 
@@ -605,6 +635,8 @@ rasqal_query_add_data_graph(rasqal_query* query, rasqal_data_graph* data_graph)
 
   if(raptor_sequence_push(query->data_graphs, (void*)data_graph))
     return 1;
+
+  rasqal_query_invalidate_plan(query);
   return 0;
 }
 
@@ -633,6 +665,8 @@ rasqal_query_add_data_graphs(rasqal_query* query,
   rc = raptor_sequence_join(query->data_graphs, data_graphs);
   raptor_free_sequence(data_graphs);
 
+  rasqal_query_invalidate_plan(query);
+
   return rc;
 }
 
@@ -909,6 +943,7 @@ rasqal_query_set_variable2(rasqal_query* query,
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, char*, 1);
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(value, rasqal_literal, 1);
 
+  query->modified = 1;
   return rasqal_variables_table_set(query->vars_table, type, name, value);
 }
 
@@ -941,6 +976,250 @@ rasqal_query_set_variable(rasqal_query* query, const unsigned char *name,
 }
 #endif
 
+
+/**
+ * rasqal_query_set_parameter:
+ * @query: #rasqal_query query object
+ * @name: variable name
+ * @value: #rasqal_literal value to bind or NULL to leave it unbound
+ *
+ * Bind a named variable of a prepared query to a value for the following executions.
+ *
+ * Parameters allow a query to be prepared once and executed many
+ * times with different values for some variables.  Each execution
+ * uses the values set when rasqal_query_execute() is called and
+ * behaves as if the query graph pattern was joined with a VALUES
+ * block of one row holding the parameter values.  The execution plan
+ * of the query is kept between executions and is not rebuilt when
+ * only parameter values change.
+ *
+ * The variable must be a named variable in the prepared query.  The
+ * @value becomes owned by the query.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_query_set_parameter(rasqal_query* query, const unsigned char *name,
+                           rasqal_literal* value)
+{
+  rasqal_variable* v;
+  int size;
+  int i;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(name, char*, 1);
+
+  v = rasqal_variables_table_get_by_name(query->vars_table,
+                                         RASQAL_VARIABLE_TYPE_NORMAL, name);
+  if(!v)
+    goto failed;
+
+  if(!query->parameter_variables) {
+    query->parameter_variables = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                                     (raptor_data_print_handler)rasqal_variable_print);
+    query->parameter_values = raptor_new_sequence((raptor_data_free_handler)rasqal_free_literal,
+                                                  (raptor_data_print_handler)rasqal_literal_print);
+    if(!query->parameter_variables || !query->parameter_values) {
+      rasqal_query_clear_parameters(query);
+      goto failed;
+    }
+  }
+
+  size = raptor_sequence_size(query->parameter_variables);
+  for(i = 0; i < size; i++) {
+    if(raptor_sequence_get_at(query->parameter_variables, i) == v)
+      break;
+  }
+
+  if(i == size) {
+    if(raptor_sequence_push(query->parameter_variables,
+                            rasqal_new_variable_from_variable(v)))
+      goto failed;
+  }
+
+  /* value becomes owned by the sequence even on failure */
+  return raptor_sequence_set_at(query->parameter_values, i, value);
+
+  failed:
+  if(value)
+    rasqal_free_literal(value);
+  return 1;
+}
+
+
+/**
+ * rasqal_query_clear_parameters:
+ * @query: #rasqal_query query object
+ *
+ * Remove all parameter values set with rasqal_query_set_parameter().
+ **/
+void
+rasqal_query_clear_parameters(rasqal_query* query)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN(query, rasqal_query);
+
+  if(query->parameter_values) {
+    raptor_free_sequence(query->parameter_values);
+    query->parameter_values = NULL;
+  }
+
+  if(query->parameter_variables) {
+    raptor_free_sequence(query->parameter_variables);
+    query->parameter_variables = NULL;
+  }
+}
+
+
+/*
+ * rasqal_query_new_parameters_bindings:
+ * @query: #rasqal_query query object
+ *
+ * INTERNAL - Make a VALUES bindings of one row with the current parameter values
+ *
+ * The bindings are a copy so later changes to the parameters do not
+ * alter an execution that has started.
+ *
+ * Return value: new bindings or NULL if there are no parameters or on failure
+ */
+rasqal_bindings*
+rasqal_query_new_parameters_bindings(rasqal_query* query)
+{
+  raptor_sequence* vars_seq = NULL;
+  raptor_sequence* rows_seq = NULL;
+  rasqal_row* row;
+  int size;
+  int i;
+
+  if(!query->parameter_variables)
+    return NULL;
+
+  size = raptor_sequence_size(query->parameter_variables);
+  if(!size)
+    return NULL;
+
+  vars_seq = rasqal_variable_copy_variable_sequence(query->parameter_variables);
+  if(!vars_seq)
+    return NULL;
+
+  rows_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                 (raptor_data_print_handler)rasqal_row_print);
+  if(!rows_seq)
+    goto failed;
+
+  row = rasqal_new_row_for_size(query->world, size);
+  if(!row)
+    goto failed;
+
+  for(i = 0; i < size; i++) {
+    rasqal_literal* l;
+
+    l = (rasqal_literal*)raptor_sequence_get_at(query->parameter_values, i);
+    if(l)
+      row->values[i] = rasqal_new_literal_from_literal(l);
+  }
+
+  if(raptor_sequence_push(rows_seq, row))
+    goto failed;
+
+  return rasqal_new_bindings(query, vars_seq, rows_seq);
+
+  failed:
+  if(rows_seq)
+    raptor_free_sequence(rows_seq);
+  raptor_free_sequence(vars_seq);
+  return NULL;
+}
+
+
+/*
+ * rasqal_query_get_parameter_binding:
+ * @query: #rasqal_query query object
+ * @v: variable
+ *
+ * INTERNAL - Get the value triple patterns can match a parameter variable with
+ *
+ * Parameter values are joined with the whole query graph pattern.
+ * When that graph pattern is only a join of basic graph patterns
+ * (with GROUP, GRAPH and FILTER) every triple pattern mentioning the
+ * parameter must match its value so the value can be given to the
+ * triples source instead of being bound by it.  Other operators such
+ * as OPTIONAL, UNION or MINUS may keep rows where the variable is
+ * unbound so the parameter is then only applied by the join.
+ *
+ * Return value: shared value or NULL if @v cannot be bound in triple patterns
+ */
+rasqal_literal*
+rasqal_query_get_parameter_binding(rasqal_query* query, rasqal_variable* v)
+{
+  rasqal_literal* value = NULL;
+  int size;
+  int i;
+
+  if(!query->parameter_variables)
+    return NULL;
+
+  size = raptor_sequence_size(query->parameter_variables);
+  for(i = 0; i < size; i++) {
+    if(raptor_sequence_get_at(query->parameter_variables, i) == v) {
+      value = (rasqal_literal*)raptor_sequence_get_at(query->parameter_values,
+                                                      i);
+      break;
+    }
+  }
+  if(!value)
+    return NULL;
+
+  for(i = 0; i < query->graph_pattern_count; i++) {
+    rasqal_graph_pattern* gp;
+
+    gp = (rasqal_graph_pattern*)raptor_sequence_get_at(query->graph_patterns_sequence,
+                                                       i);
+    if(!gp)
+      return NULL;
+
+    switch(gp->op) {
+      case RASQAL_GRAPH_PATTERN_OPERATOR_BASIC:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_GROUP:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_GRAPH:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_FILTER:
+        break;
+
+      case RASQAL_GRAPH_PATTERN_OPERATOR_OPTIONAL:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_UNION:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_LET:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_SELECT:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_SERVICE:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_MINUS:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_VALUES:
+      case RASQAL_GRAPH_PATTERN_OPERATOR_UNKNOWN:
+      default:
+        return NULL;
+    }
+  }
+
+  return value;
+}
+
+
+/*
+ * rasqal_query_invalidate_plan:
+ * @query: #rasqal_query query object
+ *
+ * INTERNAL - Discard the kept execution plan after the query is changed
+ *
+ * Executions that are running keep their own reference to the plan.
+ */
+void
+rasqal_query_invalidate_plan(rasqal_query* query)
+{
+  query->modified = 1;
+
+  if(query->plan) {
+    rasqal_free_query_plan(query->plan);
+    query->plan = NULL;
+  }
+}
+
 /**
  * rasqal_query_get_triple_sequence:
  * @query: #rasqal_query query object
@@ -1206,6 +1485,25 @@ rasqal_query_get_construct_triple(rasqal_query* query, int idx)
 
 
 
+/*
+ * rasqal_query_get_rand_seed:
+ * @query: the #rasqal_query object
+ *
+ * INTERNAL - Get a random seed either from the user or system sources
+ *
+ * Return value: seed
+ */
+static unsigned int
+rasqal_query_get_rand_seed(rasqal_query* query)
+{
+  if(query->user_set_rand)
+    /* it is ok to truncate here for the purposes of getting a seed */
+    return RASQAL_GOOD_CAST(unsigned int, query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_RAND_SEED)]);
+
+  return rasqal_random_get_system_seed(query->world);
+}
+
+
 /**
  * rasqal_query_prepare:
  * @query: the #rasqal_query object
@@ -1285,18 +1583,8 @@ rasqal_query_prepare(rasqal_query* query,
   rasqal_evaluation_context_set_base_uri(query->eval_context, query->base_uri);
 
   /* set random seed */
-  if(1) {
-    unsigned int seed;
-
-    /* get seed either from user or system sources */
-    if(query->user_set_rand)
-      /* it is ok to truncate here for the purposes of getting a seed */
-      seed = RASQAL_GOOD_CAST(unsigned int, query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_RAND_SEED)]);
-    else
-      seed = rasqal_random_get_system_seed(query->world);
-    
-    rasqal_evaluation_context_set_rand_seed(query->eval_context, seed);
-  }
+  rasqal_evaluation_context_set_rand_seed(query->eval_context,
+                                          rasqal_query_get_rand_seed(query));
   
 
   rc = query->factory->prepare(query);
@@ -1405,6 +1693,66 @@ rasqal_query_execute(rasqal_query* query)
 }
 
 
+/**
+ * rasqal_query_execute_async:
+ * @query: the #rasqal_query object
+ * @handler: handler to call when the results are ready (or NULL)
+ * @user_data: user data for @handler
+ *
+ * Start executing a query without waiting for the results
+ *
+ * The query is executed on the world worker pool set with
+ * rasqal_world_set_feature() #RASQAL_FEATURE_THREADS.  When the
+ * execution has finished, failed or was cancelled, @handler is
+ * called, possibly from a worker thread, and
+ * rasqal_query_results_poll() returns non-0.  Until then only
+ * rasqal_query_results_poll(), rasqal_query_results_wait() and
+ * rasqal_query_results_cancel() may be used on the returned results
+ * and the query and its world must not be used by other threads.
+ *
+ * Without worker threads the query is executed and @handler called
+ * before returning.
+ *
+ * return value: a #rasqal_query_results structure or NULL on failure.
+ **/
+rasqal_query_results*
+rasqal_query_execute_async(rasqal_query* query,
+                           rasqal_query_results_ready_handler handler,
+                           void *user_data)
+{
+  rasqal_query_results *query_results = NULL;
+  rasqal_query_results_type type;
+  
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, NULL);
+
+  if(query->failed)
+    return NULL;
+
+  type = rasqal_query_get_result_type(query);
+  if(type == RASQAL_QUERY_RESULTS_UNKNOWN)
+    return NULL;
+  
+  query_results = rasqal_new_query_results(query->world, query, type,
+                                           query->vars_table);
+  if(!query_results)
+    return NULL;
+
+  if(rasqal_query_add_query_result(query, query_results)) {
+    rasqal_free_query_results(query_results);
+    return NULL;
+  }
+
+  if(rasqal_query_results_execute_async(query_results,
+                                        rasqal_query_get_engine_by_name(NULL),
+                                        handler, user_data)) {
+    rasqal_free_query_results(query_results);
+    query_results = NULL;
+  }
+
+  return query_results;
+}
+
+
 static const char* const rasqal_query_verb_labels[RASQAL_QUERY_VERB_LAST+1] = {
   "Unknown",
   "SELECT",
@@ -1571,7 +1919,7 @@ rasqal_query_add_query_result(rasqal_query* query,
      as the free handler which calls rasqal_free_query() decrementing
      query->usage */
   
-  query->usage++;
+  RASQAL_USAGE_INCREMENT(&query->usage);
 
   return raptor_sequence_push(query->results, query_results);
 }
@@ -1635,6 +1983,7 @@ rasqal_query_set_user_data(rasqal_query* query, void *user_data)
   RASQAL_ASSERT_OBJECT_POINTER_RETURN(query, rasqal_query);
 
   query->user_data = user_data;
+  query->modified = 1;
 }
 
 
@@ -1697,6 +2046,8 @@ rasqal_query_set_wildcard(rasqal_query* query, int wildcard)
       return;
   }
   query->projection->wildcard = wildcard;
+
+  rasqal_query_invalidate_plan(query);
 }
 
 
@@ -2027,6 +2378,7 @@ rasqal_query_set_base_uri(rasqal_query* query, raptor_uri* base_uri)
     raptor_free_uri(query->base_uri);
   query->base_uri = base_uri;
   query->locator.uri = base_uri;
+  query->modified = 1;
 }
 
 
@@ -2056,6 +2408,7 @@ rasqal_query_set_store_results(rasqal_query* query, int store_results)
     return 1;
 
   query->store_results = store_results;
+  query->modified = 1;
 
   return 0;
 }
@@ -2269,6 +2622,148 @@ rasqal_query_variable_bound_in_triple(rasqal_query* query,
 }
 
 
+/*
+ * rasqal_query_variable_needed_outside_triples:
+ * @query: #rasqal_query query object
+ * @v: variable
+ * @start_column: first triple column
+ * @end_column: last triple column
+ * 
+ * INTERNAL - Test if a variable value is needed outside a range of triples
+ *
+ * The variable is needed if it is mentioned or bound by the query
+ * verb (projection), GROUP BY, HAVING, ORDER BY or VALUES, by any
+ * graph pattern other than a basic graph pattern or by a triple
+ * outside the range.  Variables only mentioned in the range of
+ * triples are needed to match them but not by anything consuming the
+ * rows.
+ *
+ * The DELETE, INSERT and UPDATE verbs do not record the variables of
+ * their templates in the use map so every variable is needed for them.
+ * Parameter variables are always needed since their values are
+ * joined with the rows of the whole query graph pattern.
+ *
+ * Return value: non-0 if the variable is needed or the use maps are not built
+ */
+int
+rasqal_query_variable_needed_outside_triples(rasqal_query* query,
+                                             rasqal_variable* v,
+                                             int start_column,
+                                             int end_column)
+{
+  int width;
+  int row_index;
+  int column;
+  int triples_count;
+  
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
+  
+  if(!query->variables_use_map || !query->triples_use_map)
+    return 1;
+
+  if(query->verb == RASQAL_QUERY_VERB_DELETE ||
+     query->verb == RASQAL_QUERY_VERB_INSERT ||
+     query->verb == RASQAL_QUERY_VERB_UPDATE)
+    return 1;
+
+  if(query->parameter_variables) {
+    int size = raptor_sequence_size(query->parameter_variables);
+    int i;
+
+    for(i = 0; i < size; i++) {
+      if(raptor_sequence_get_at(query->parameter_variables, i) == v)
+        return 1;
+    }
+  }
+
+  width = rasqal_variables_table_get_total_variables_count(query->vars_table);
+
+  /* query structures: verbs, GROUP BY, HAVING, ORDER BY, VALUES */
+  for(row_index = 0; row_index <= RASQAL_VAR_USE_MAP_OFFSET_LAST; row_index++) {
+    if(query->variables_use_map[row_index * width + v->offset] &
+       (RASQAL_VAR_USE_MENTIONED_HERE | RASQAL_VAR_USE_BOUND_HERE))
+      return 1;
+  }
+
+  /* graph patterns; triples in BGPs are checked below */
+  for(row_index = 0; row_index < query->graph_pattern_count; row_index++) {
+    rasqal_graph_pattern* gp;
+    unsigned short flags;
+
+    gp = (rasqal_graph_pattern*)raptor_sequence_get_at(query->graph_patterns_sequence,
+                                                       row_index);
+    if(!gp)
+      return 1;
+
+    if(gp->op == RASQAL_GRAPH_PATTERN_OPERATOR_BASIC)
+      continue;
+
+    flags = query->variables_use_map[(gp->gp_index + RASQAL_VAR_USE_MAP_OFFSET_LAST + 1) * width + v->offset];
+    if(flags & (RASQAL_VAR_USE_MENTIONED_HERE | RASQAL_VAR_USE_BOUND_HERE))
+      return 1;
+  }
+
+  /* other triple patterns */
+  triples_count = raptor_sequence_size(query->triples);
+  for(column = 0; column < triples_count; column++) {
+    if(column >= start_column && column <= end_column)
+      continue;
+    
+    if(query->triples_use_map[column * width + v->offset] &
+       (RASQAL_TRIPLES_USE_MASK | RASQAL_TRIPLES_BOUND_MASK))
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_new_execution_context:
+ * @query: #rasqal_query query object
+ *
+ * INTERNAL - Create an evaluation context for one execution of a prepared query
+ *
+ * The context has the comparison flags and base URI of the query, its
+ * own random number generator and a binding frame that holds the
+ * variable values written by expressions during the execution, so
+ * that executions of the same query do not share those bindings.
+ *
+ * Triple patterns are matched on copies of their variables made by
+ * each triples rowsource, so executions of one query that have been
+ * started may be read at the same time from different threads.
+ *
+ * Return value: new evaluation context or NULL on failure
+ */
+rasqal_evaluation_context*
+rasqal_query_new_execution_context(rasqal_query* query)
+{
+  rasqal_evaluation_context* eval_context;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, NULL);
+
+  eval_context = rasqal_new_evaluation_context(query->world, &query->locator,
+                                               query->compare_flags);
+  if(!eval_context)
+    return NULL;
+
+  if(rasqal_evaluation_context_set_base_uri(eval_context, query->base_uri) ||
+     rasqal_evaluation_context_set_rand_seed(eval_context,
+                                             rasqal_query_get_rand_seed(query)))
+    goto failed;
+
+  RASQAL_EVALUATION_CONTEXT_FRAME(eval_context) = rasqal_new_binding_frame(query->world);
+  if(!RASQAL_EVALUATION_CONTEXT_FRAME(eval_context))
+    goto failed;
+
+  return eval_context;
+
+  failed:
+  rasqal_free_evaluation_context(eval_context);
+  return NULL;
+}
+
+
 /**
  * rasqal_query_get_result_type:
  * @query: #rasqal_query query object
@@ -2411,6 +2906,8 @@ rasqal_query_set_projection(rasqal_query* query, rasqal_projection* projection)
 {
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
 
+  rasqal_query_invalidate_plan(query);
+
   if(query->projection)
     rasqal_free_projection(query->projection);
 
@@ -2435,6 +2932,8 @@ rasqal_query_set_modifier(rasqal_query* query,
 {
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query, rasqal_query, 1);
 
+  rasqal_query_invalidate_plan(query);
+
   if(query->modifier)
     rasqal_free_solution_modifier(query->modifier);
 
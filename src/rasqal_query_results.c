@@ -98,6 +98,51 @@
 
 static int rasqal_query_results_execute_and_store_results(rasqal_query_results* query_results);
 static void rasqal_query_results_update_bindings(rasqal_query_results* query_results);
+static char* rasqal_query_results_cache_key(rasqal_query_results* query_results);
+static int rasqal_query_results_cache_lookup(rasqal_query_results* query_results, const char* key);
+static void rasqal_query_results_cache_add(rasqal_world* world, char* key, raptor_sequence* rows);
+static void rasqal_query_results_cache_tee_row(rasqal_query_results* query_results, rasqal_row* row);
+static void rasqal_query_results_cache_tee_end(rasqal_query_results* query_results);
+static raptor_sequence* rasqal_results_cache_copy_rows(raptor_sequence* rows);
+static int rasqal_query_results_check_interrupted(rasqal_query_results* query_results);
+
+
+/*
+ * rasqal_execution_control:
+ *
+ * INTERNAL - Cancellation and deadline of one query execution
+ *
+ * Shared with the rowsources of the execution through
+ * #rasqal_evaluation_context field control.  Rowsources evaluated on
+ * worker threads may share it through their own evaluation contexts,
+ * so the memory accounting is atomic when the usage counts are.
+ */
+struct rasqal_execution_control_s {
+  /* non-0 when the execution is cancelled or past the deadline.
+   * volatile since rasqal_query_results_cancel() may set it from
+   * another thread or a signal handler
+   */
+  volatile int cancelled;
+
+  /* non-0 if the execution was stopped at the deadline */
+  int timed_out;
+
+  /* non-0 if there is a deadline */
+  int have_deadline;
+
+  /* time at which the execution stops */
+  struct timeval deadline;
+
+  /* estimated bytes of rows held by the execution now and at most */
+  size_t memory_used;
+  size_t memory_peak;
+
+  /* maximum of @memory_used or 0 for no limit */
+  size_t memory_limit;
+
+  /* non-0 if the execution was stopped at @memory_limit */
+  int memory_exceeded;
+};
 
 
 /*
@@ -155,7 +200,34 @@ struct rasqal_query_results_s {
 
   /* Variables table for variables in result rows */
   rasqal_variables_table* vars_table;
+
+  /* Evaluation context with the variable bindings of this execution */
+  rasqal_evaluation_context* eval_context;
+
+  /* Cancellation and deadline of this execution */
+  rasqal_execution_control control;
+
+  /* Task group running an asynchronous execution or NULL */
+  rasqal_task_group* async_group;
+
+  /* Handler called when an asynchronous execution is done (or NULL) */
+  rasqal_query_results_ready_handler ready_handler;
+  void* ready_user_data;
+
+  /* results cache key while rows read lazily are being copied to
+   * the results cache, the rows copied so far and their size */
+  char* cache_key;
+  raptor_sequence* cache_rows;
+  size_t cache_rows_size;
 };
+
+
+#ifndef HAVE_GETTIMEOFDAY
+#define gettimeofday(x,y) rasqal_gettimeofday(x,y)
+#endif
+
+/* calls to rasqal_evaluation_context_is_interrupted() between clock reads */
+#define RASQAL_EXECUTION_CONTROL_CLOCK_INTERVAL 256
     
 
 int
@@ -224,6 +296,88 @@ rasqal_new_query_results(rasqal_world* world,
 }
 
 
+/*
+ * rasqal_query_results_start_control:
+ * @query_results: query results
+ *
+ * INTERNAL - Set the deadline of an execution and share its control with the rowsources
+ *
+ * The deadline is #RASQAL_FEATURE_TIMEOUT milliseconds from now and
+ * the memory limit is #RASQAL_FEATURE_MEMORY_LIMIT kilobytes.  A
+ * cancellation made before the execution started is kept.
+ */
+static void
+rasqal_query_results_start_control(rasqal_query_results* query_results)
+{
+  rasqal_execution_control* control = &query_results->control;
+  rasqal_query* query = query_results->query;
+  int timeout;
+  int memory_limit;
+
+  timeout = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_TIMEOUT)];
+  memory_limit = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_MEMORY_LIMIT)];
+
+  control->timed_out = 0;
+  control->have_deadline = 0;
+  RASQAL_EVALUATION_CONTEXT_COUNTDOWN(query_results->eval_context) = 0;
+  control->memory_used = 0;
+  control->memory_peak = 0;
+  control->memory_exceeded = 0;
+  control->memory_limit = 0;
+  if(memory_limit > 0)
+    control->memory_limit = RASQAL_GOOD_CAST(size_t, memory_limit) * 1024;
+
+  if(timeout > 0 && !gettimeofday(&control->deadline, NULL)) {
+    control->deadline.tv_sec += timeout / 1000;
+    control->deadline.tv_usec += (timeout % 1000) * 1000;
+    if(control->deadline.tv_usec >= 1000000) {
+      control->deadline.tv_sec++;
+      control->deadline.tv_usec -= 1000000;
+    }
+    control->have_deadline = 1;
+  }
+
+  RASQAL_EVALUATION_CONTEXT_CONTROL(query_results->eval_context) = control;
+}
+
+
+/*
+ * rasqal_query_results_check_interrupted:
+ * @query_results: query results
+ *
+ * INTERNAL - Fail the results if the execution was cancelled or timed out
+ *
+ * Return value: non-0 if the execution was interrupted
+ */
+static int
+rasqal_query_results_check_interrupted(rasqal_query_results* query_results)
+{
+  rasqal_query* query = query_results->query;
+
+  if(!query_results->control.cancelled)
+    return 0;
+
+  if(!query_results->failed) {
+    raptor_locator* locator = query ? &query->locator : NULL;
+
+    query_results->failed = 1;
+    if(query_results->control.memory_exceeded)
+      rasqal_log_error_simple(query_results->world, RAPTOR_LOG_LEVEL_ERROR,
+                              locator,
+                              "Query execution memory limit of %lu bytes exceeded",
+                              RASQAL_GOOD_CAST(unsigned long, query_results->control.memory_limit));
+    else
+      rasqal_log_error_simple(query_results->world, RAPTOR_LOG_LEVEL_ERROR,
+                              locator,
+                              query_results->control.timed_out ?
+                              "Query execution timed out" :
+                              "Query execution cancelled");
+  }
+
+  return 1;
+}
+
+
 /**
  * rasqal_query_results_execute_with_engine:
  * @query_results: the #rasqal_query_results object
@@ -242,6 +396,7 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
   int rc = 0;
   size_t ex_data_size;
   rasqal_query* query;
+  char* cache_key = NULL;
   
 
   RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
@@ -272,6 +427,29 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
 
   /* Update the current datetime once per query execution */
   rasqal_world_reset_now(query->world);
+
+  query_results->eval_context = rasqal_query_new_execution_context(query);
+  if(!query_results->eval_context)
+    return 1;
+
+  rasqal_query_results_start_control(query_results);
+
+  /* Replay stored rows from the world results cache if present */
+  cache_key = rasqal_query_results_cache_key(query_results);
+  if(cache_key) {
+    if(!rasqal_query_results_cache_lookup(query_results, cache_key)) {
+      RASQAL_FREE(char*, cache_key);
+      query_results->store_results = 1;
+      rasqal_query_results_rewind(query_results);
+      return 0;
+    }
+
+    /* rows read lazily are copied to the cache as they are read */
+    if(!query_results->store_results) {
+      query_results->cache_key = cache_key;
+      cache_key = NULL;
+    }
+  }
   
   if(query_results->execution_factory->execute_init) {
     rasqal_engine_error execution_error = RASQAL_ENGINE_OK;
@@ -282,7 +460,10 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
 
     rc = query_results->execution_factory->execute_init(query_results->execution_data, query, query_results, execution_flags, &execution_error);
 
-    if(rc || execution_error != RASQAL_ENGINE_OK) {
+    if(rc || execution_error != RASQAL_ENGINE_OK ||
+       rasqal_query_results_check_interrupted(query_results)) {
+      if(cache_key)
+        RASQAL_FREE(char*, cache_key);
       query_results->failed = 1;
       return 1;
     }
@@ -297,6 +478,14 @@ rasqal_query_results_execute_with_engine(rasqal_query_results* query_results,
   if(query_results->store_results)
     rc = rasqal_query_results_execute_and_store_results(query_results);
 
+  if(cache_key) {
+    if(!rc && query_results->results_sequence)
+      rasqal_query_results_cache_add(query_results->world, cache_key,
+                                     rasqal_results_cache_copy_rows(query_results->results_sequence));
+    else
+      RASQAL_FREE(char*, cache_key);
+  }
+
   return rc;
 }
 
@@ -318,6 +507,12 @@ rasqal_free_query_results(rasqal_query_results* query_results)
 
   query = query_results->query;
 
+  if(query_results->async_group) {
+    /* stop an asynchronous execution and wait for it to end */
+    query_results->control.cancelled = 1;
+    rasqal_free_task_group(query_results->async_group);
+  }
+
   if(query_results->executed) {
     if(query_results->execution_factory->execute_finish) {
       rasqal_engine_error execution_error = RASQAL_ENGINE_OK;
@@ -330,12 +525,22 @@ rasqal_free_query_results(rasqal_query_results* query_results)
   if(query_results->execution_data)
     RASQAL_FREE(rasqal_engine_execution_data, query_results->execution_data);
 
+  if(query_results->eval_context)
+    rasqal_free_evaluation_context(query_results->eval_context);
+
   if(query_results->row)
     rasqal_free_row(query_results->row);
 
   if(query_results->results_sequence)
     raptor_free_sequence(query_results->results_sequence);
 
+  /* rows not read to the end are not cached */
+  if(query_results->cache_key)
+    RASQAL_FREE(char*, query_results->cache_key);
+
+  if(query_results->cache_rows)
+    raptor_free_sequence(query_results->cache_rows);
+
   /* free terms owned by static query_results->result_triple */
   raptor_free_statement(&query_results->result_triple);
 
@@ -658,6 +863,9 @@ rasqal_query_results_ensure_have_row_internal(rasqal_query_results* query_result
       if(execution_error != RASQAL_ENGINE_OK)
         break;
 
+      if(query_results->cache_key && query_results->row)
+        rasqal_query_results_cache_tee_row(query_results, query_results->row);
+
       query_results->result_count++;
       
       check = rasqal_query_check_limit_offset(query_results->query,
@@ -684,19 +892,39 @@ rasqal_query_results_ensure_have_row_internal(rasqal_query_results* query_result
       break;
 
     } /* end while */
-    
+
+    /* the rows read so far are all the rows in the result range */
+    if(query_results->cache_key && !query_results->row)
+      rasqal_query_results_cache_tee_end(query_results);
   }
   
   if(query_results->row) {
     rasqal_row_to_nodes(query_results->row);
     query_results->size = query_results->row->size;
-  } else
+  } else if(!rasqal_query_results_check_interrupted(query_results))
     query_results->finished = 1;
 
   return (query_results->row == NULL);
 }
 
 
+/**
+ * rasqal_query_results_get_evaluation_context:
+ * @query_results: query results object
+ *
+ * INTERNAL - Get the evaluation context of the query execution
+ *
+ * Return value: shared evaluation context or NULL if not executed
+ */
+rasqal_evaluation_context*
+rasqal_query_results_get_evaluation_context(rasqal_query_results* query_results)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, NULL);
+
+  return query_results->eval_context;
+}
+
+
 /**
  * rasqal_query_results_get_current_row:
  * @query_results: query results object
@@ -899,6 +1127,379 @@ rasqal_query_results_rewind(rasqal_query_results* query_results)
 }
 
 
+/*
+ * rasqal_query_results_async_task:
+ * @user_data: query results
+ *
+ * INTERNAL - Task running an asynchronous query execution
+ *
+ * Return value: non-0 if the execution failed
+ */
+static int
+rasqal_query_results_async_task(void* user_data)
+{
+  rasqal_query_results* query_results = (rasqal_query_results*)user_data;
+
+  if(rasqal_query_results_execute_with_engine(query_results,
+                                              query_results->execution_factory,
+                                              query_results->query->store_results))
+    query_results->failed = 1;
+  else if(rasqal_query_results_is_bindings(query_results))
+    /* have the first row ready */
+    rasqal_query_results_finished(query_results);
+
+  if(query_results->ready_handler)
+    query_results->ready_handler(query_results, query_results->ready_user_data);
+
+  return query_results->failed;
+}
+
+
+/**
+ * rasqal_query_results_execute_async:
+ * @query_results: the #rasqal_query_results object
+ * @engine: execution factory
+ * @handler: handler to call when the execution is done (or NULL)
+ * @user_data: user data for @handler
+ *
+ * INTERNAL - Start executing a prepared query on the query task pool
+ *
+ * Without a task pool the query is executed before returning.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_query_results_execute_async(rasqal_query_results* query_results,
+                                   const rasqal_query_execution_factory* engine,
+                                   rasqal_query_results_ready_handler handler,
+                                   void* user_data)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+
+  query_results->execution_factory = engine;
+  query_results->ready_handler = handler;
+  query_results->ready_user_data = user_data;
+
+  query_results->async_group = rasqal_new_task_group(rasqal_query_get_task_pool(query_results->query));
+  if(!query_results->async_group)
+    return 1;
+
+  return rasqal_task_group_submit(query_results->async_group,
+                                  rasqal_query_results_async_task,
+                                  query_results);
+}
+
+
+/**
+ * rasqal_query_results_poll:
+ * @query_results: #rasqal_query_results query_results
+ *
+ * Check if an asynchronous query execution is done
+ *
+ * When this returns non-0, the execution started with
+ * rasqal_query_execute_async() has finished, failed or was
+ * cancelled and the other query results methods may be used.
+ *
+ * Return value: non-0 if the results are ready
+ **/
+int
+rasqal_query_results_poll(rasqal_query_results* query_results)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+
+  if(!query_results->async_group)
+    return 1;
+
+  return rasqal_task_group_is_done(query_results->async_group);
+}
+
+
+/**
+ * rasqal_query_results_wait:
+ * @query_results: #rasqal_query_results query_results
+ *
+ * Wait for an asynchronous query execution to be done
+ *
+ * Return value: non-0 if the query execution failed or was cancelled
+ **/
+int
+rasqal_query_results_wait(rasqal_query_results* query_results)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+
+  if(query_results->async_group)
+    rasqal_task_group_wait(query_results->async_group);
+
+  return query_results->failed;
+}
+
+
+/**
+ * rasqal_query_results_cancel:
+ * @query_results: #rasqal_query_results query_results
+ *
+ * Cancel the query execution producing the results
+ *
+ * This may be called from another thread or a signal handler while
+ * the results are being evaluated.  The rowsources stop at their next
+ * check and the results then fail with a "Query execution cancelled"
+ * error.
+ *
+ * Return value: non-0 on failure
+ **/
+int
+rasqal_query_results_cancel(rasqal_query_results* query_results)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+
+  query_results->control.cancelled = 1;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_evaluation_context_is_interrupted:
+ * @eval_context: evaluation context
+ *
+ * INTERNAL - Check if the query execution of a context should stop
+ *
+ * Cheap enough to call for every row: the clock is only read every
+ * #RASQAL_EXECUTION_CONTROL_CLOCK_INTERVAL calls.
+ *
+ * Return value: non-0 if the execution was cancelled or is past its deadline
+ */
+int
+rasqal_evaluation_context_is_interrupted(rasqal_evaluation_context* eval_context)
+{
+  if(!eval_context || !RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context))
+    return 0;
+
+  return rasqal_evaluation_context_is_interrupted_count(eval_context,
+                                                        &RASQAL_EVALUATION_CONTEXT_COUNTDOWN(eval_context));
+}
+
+
+/*
+ * rasqal_evaluation_context_is_interrupted_count:
+ * @eval_context: evaluation context
+ * @countdown_p: calls left before the next clock read
+ *
+ * INTERNAL - Check if the query execution of a context should stop from another thread
+ *
+ * As rasqal_evaluation_context_is_interrupted() but with a clock
+ * countdown owned by the caller, so that worker threads evaluating
+ * part of the execution do not share it.
+ *
+ * Return value: non-0 if the execution was cancelled or is past its deadline
+ */
+int
+rasqal_evaluation_context_is_interrupted_count(rasqal_evaluation_context* eval_context,
+                                               int* countdown_p)
+{
+  rasqal_execution_control* control;
+  struct timeval now;
+
+  if(!eval_context || !RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context))
+    return 0;
+
+  control = RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context);
+  if(control->cancelled)
+    return 1;
+
+  if(!control->have_deadline || --(*countdown_p) > 0)
+    return 0;
+
+  *countdown_p = RASQAL_EXECUTION_CONTROL_CLOCK_INTERVAL;
+  if(gettimeofday(&now, NULL))
+    return 0;
+
+  if(now.tv_sec > control->deadline.tv_sec ||
+     (now.tv_sec == control->deadline.tv_sec &&
+      now.tv_usec >= control->deadline.tv_usec)) {
+    control->timed_out = 1;
+    control->cancelled = 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_evaluation_context_charge_memory:
+ * @eval_context: evaluation context
+ * @size: bytes now held by the execution
+ *
+ * INTERNAL - Account memory held by a query execution against its limit
+ *
+ * Going over the #RASQAL_FEATURE_MEMORY_LIMIT interrupts the
+ * execution so that the rowsources stop and the results fail.
+ *
+ * Return value: non-0 if the memory limit is exceeded
+ */
+int
+rasqal_evaluation_context_charge_memory(rasqal_evaluation_context* eval_context,
+                                        size_t size)
+{
+  rasqal_execution_control* control;
+  size_t used;
+
+  if(!eval_context || !RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context))
+    return 0;
+
+  control = RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context);
+#ifdef RASQAL_ATOMIC_USAGE
+  used = __sync_add_and_fetch(&control->memory_used, size);
+  while(1) {
+    size_t peak = control->memory_peak;
+    if(used <= peak ||
+       __sync_bool_compare_and_swap(&control->memory_peak, peak, used))
+      break;
+  }
+#else
+  control->memory_used += size;
+  used = control->memory_used;
+  if(used > control->memory_peak)
+    control->memory_peak = used;
+#endif
+
+  if(control->memory_limit && used > control->memory_limit) {
+    control->memory_exceeded = 1;
+    control->cancelled = 1;
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_evaluation_context_release_memory:
+ * @eval_context: evaluation context
+ * @size: bytes no longer held
+ *
+ * INTERNAL - Return memory charged by rasqal_evaluation_context_charge_memory()
+ */
+void
+rasqal_evaluation_context_release_memory(rasqal_evaluation_context* eval_context,
+                                         size_t size)
+{
+  rasqal_execution_control* control;
+
+  if(!eval_context || !RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context))
+    return;
+
+  control = RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context);
+#ifdef RASQAL_ATOMIC_USAGE
+  while(1) {
+    size_t used = control->memory_used;
+    size_t released = (size > used) ? used : size;
+    if(__sync_bool_compare_and_swap(&control->memory_used, used,
+                                    used - released))
+      break;
+  }
+#else
+  if(size > control->memory_used)
+    size = control->memory_used;
+  control->memory_used -= size;
+#endif
+}
+
+
+/*
+ * rasqal_evaluation_context_memory_exceeded:
+ * @eval_context: evaluation context
+ *
+ * INTERNAL - Check if a query execution was stopped at its memory limit
+ *
+ * Return value: non-0 if the memory limit was exceeded
+ */
+int
+rasqal_evaluation_context_memory_exceeded(rasqal_evaluation_context* eval_context)
+{
+  if(!eval_context || !RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context))
+    return 0;
+
+  return RASQAL_EVALUATION_CONTEXT_CONTROL(eval_context)->memory_exceeded;
+}
+
+
+/**
+ * rasqal_query_results_get_memory_peak:
+ * @query_results: #rasqal_query_results query_results
+ *
+ * Get the peak memory held by the query execution
+ *
+ * This is an estimate of the largest number of bytes of rows held at
+ * once by sorting, grouping, distinct, saved rows and stored results
+ * which is the amount compared to #RASQAL_FEATURE_MEMORY_LIMIT.
+ *
+ * Return value: peak size in bytes
+ **/
+size_t
+rasqal_query_results_get_memory_peak(rasqal_query_results* query_results)
+{
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 0);
+
+  return query_results->control.memory_peak;
+}
+
+
+/**
+ * rasqal_query_results_explain:
+ * @query_results: #rasqal_query_results query_results
+ * @iostr: #raptor_iostream to write the plan to
+ * @format_name: plan format "text" (or NULL) or "json"
+ *
+ * Write the query execution plan with per-operator statistics
+ *
+ * The plan is the tree of operators (rowsources) of the query
+ * execution.  Each operator gives the rows read from its inputs, the
+ * rows it returned, the peak memory of the rows it held and the
+ * algorithm it chose where there is a choice, such as for joins and
+ * sorting.  Operator times are given when the query was executed
+ * with #RASQAL_FEATURE_PROFILE set and include the time spent in the
+ * operator inputs.
+ *
+ * Called before any results are read this writes the plan; called
+ * after all the results are read it writes the statistics of the
+ * whole execution.  It must not be called while an asynchronous
+ * execution is running.
+ *
+ * Return value: non-0 on failure or if the results have no execution plan such as results read from a syntax or replayed from the world results cache
+ **/
+int
+rasqal_query_results_explain(rasqal_query_results* query_results,
+                             raptor_iostream* iostr,
+                             const char* format_name)
+{
+  rasqal_rowsource* rowsource = NULL;
+
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(query_results, rasqal_query_results, 1);
+  RASQAL_ASSERT_OBJECT_POINTER_RETURN_VALUE(iostr, raptor_iostream, 1);
+
+  if(query_results->async_group &&
+     !rasqal_task_group_is_done(query_results->async_group))
+    return 1;
+
+  if(query_results->executed && query_results->execution_data &&
+     query_results->execution_factory->get_rowsource)
+    rowsource = query_results->execution_factory->get_rowsource(query_results->execution_data);
+
+  if(!rowsource)
+    return 1;
+
+  if(!format_name || !strcmp(format_name, "text"))
+    return rasqal_rowsource_write_explain_text(rowsource, iostr);
+
+  if(!strcmp(format_name, "json"))
+    return rasqal_rowsource_write_explain_json(rowsource, iostr);
+
+  return 1;
+}
+
+
 /**
  * rasqal_query_results_get_bindings:
  * @query_results: #rasqal_query_results query_results
@@ -1505,6 +2106,17 @@ rasqal_query_results_execute_and_store_results(rasqal_query_results* query_resul
       query_results->failed = 1;
   }
 
+  /* the stored rows are held until the results are freed */
+  if(seq && query_results->eval_context)
+    rasqal_evaluation_context_charge_memory(query_results->eval_context,
+                                            rasqal_row_sequence_get_memory_size(seq));
+
+  /* rows read before an interruption are incomplete */
+  if(rasqal_query_results_check_interrupted(query_results) && seq) {
+    raptor_free_sequence(seq);
+    seq = NULL;
+  }
+
   query_results->results_sequence = seq;
 
   if(!seq) {
@@ -1516,6 +2128,559 @@ rasqal_query_results_execute_and_store_results(rasqal_query_results* query_resul
 }
 
 
+/*
+ * rasqal_results_cache_entry:
+ * @key: cache key from rasqal_query_results_cache_key()
+ * @hash: hash of @key
+ * @rows: sequence of stored #rasqal_row owned by the entry
+ * @size: estimated size of @key and @rows in bytes
+ * @next: next entry in the same hash bucket
+ * @older: next less recently used entry
+ * @newer: next more recently used entry
+ *
+ * INTERNAL - An entry in the world query results cache
+ */
+typedef struct rasqal_results_cache_entry_s {
+  char* key;
+  size_t hash;
+  raptor_sequence* rows;
+  size_t size;
+  struct rasqal_results_cache_entry_s* next;
+  struct rasqal_results_cache_entry_s* older;
+  struct rasqal_results_cache_entry_s* newer;
+} rasqal_results_cache_entry;
+
+
+static void
+rasqal_free_results_cache_entry(rasqal_results_cache_entry* entry)
+{
+  if(entry->key)
+    RASQAL_FREE(char*, entry->key);
+
+  if(entry->rows)
+    raptor_free_sequence(entry->rows);
+
+  RASQAL_FREE(rasqal_results_cache_entry, entry);
+}
+
+
+/*
+ * rasqal_results_cache_copy_row:
+ * @row: row
+ *
+ * INTERNAL - Copy a row into a new row object not tied to a rowsource
+ *
+ * Reading results changes the current row in place, so the cache
+ * never shares row objects with a #rasqal_query_results.  The values
+ * are shared.
+ *
+ * Return value: new row or NULL on failure
+ */
+static rasqal_row*
+rasqal_results_cache_copy_row(rasqal_row* row)
+{
+  rasqal_row* nrow;
+  int i;
+
+  nrow = rasqal_new_row_for_size(row->world, row->size);
+  if(!nrow)
+    return NULL;
+
+  for(i = 0; i < row->size; i++)
+    nrow->values[i] = rasqal_new_literal_from_literal(row->values[i]);
+  nrow->offset = row->offset;
+
+  return nrow;
+}
+
+
+/* copy a sequence of rows with rasqal_results_cache_copy_row() */
+static raptor_sequence*
+rasqal_results_cache_copy_rows(raptor_sequence* rows)
+{
+  raptor_sequence* seq;
+  rasqal_row* row;
+  int i;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                            (raptor_data_print_handler)rasqal_row_print);
+  if(!seq)
+    return NULL;
+
+  for(i = 0; (row = (rasqal_row*)raptor_sequence_get_at(rows, i)); i++) {
+    if(raptor_sequence_push(seq, rasqal_results_cache_copy_row(row))) {
+      raptor_free_sequence(seq);
+      return NULL;
+    }
+  }
+
+  return seq;
+}
+
+
+/*
+ * rasqal_query_results_cache_key:
+ * @query_results: query results
+ *
+ * INTERNAL - Make the results cache key for executing a query
+ *
+ * The key is the query language and string plus everything else that
+ * changes the result rows: the LIMIT, OFFSET and DISTINCT set with
+ * the API, the query features, base URI, the identity of each data
+ * graph and any parameter values.  Only bindings queries given
+ * as a query string over data graphs loaded from URIs are cached.
+ *
+ * Return value: new key or NULL if not cacheable or the cache is disabled
+ */
+static char*
+rasqal_query_results_cache_key(rasqal_query_results* query_results)
+{
+  rasqal_query* query = query_results->query;
+  rasqal_world* world = query_results->world;
+  raptor_iostream* iostr;
+  rasqal_data_graph* dg;
+  rasqal_variable* v;
+  void* string = NULL;
+  size_t length;
+  char* key;
+  int i;
+
+  if(!world->results_cache_size || !query->query_string ||
+     query_results->type != RASQAL_QUERY_RESULTS_BINDINGS)
+    return NULL;
+
+  if(query->data_graphs) {
+    for(i = 0;
+        (dg = (rasqal_data_graph*)raptor_sequence_get_at(query->data_graphs, i));
+        i++) {
+      /* the contents of a stream have no identity */
+      if(!dg->uri)
+        return NULL;
+    }
+  }
+
+  iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                        &string, &length,
+                                        rasqal_alloc_memory);
+  if(!iostr)
+    return NULL;
+
+  raptor_iostream_string_write(rasqal_query_get_name(query), iostr);
+  raptor_iostream_write_byte('\n', iostr);
+  raptor_iostream_string_write(query->query_string, iostr);
+  raptor_iostream_write_byte('\n', iostr);
+  raptor_iostream_decimal_write(rasqal_query_get_limit(query), iostr);
+  raptor_iostream_write_byte(' ', iostr);
+  raptor_iostream_decimal_write(rasqal_query_get_offset(query), iostr);
+  raptor_iostream_write_byte(' ', iostr);
+  raptor_iostream_decimal_write(rasqal_query_get_distinct(query), iostr);
+  raptor_iostream_write_byte('\n', iostr);
+  for(i = 0; i <= RASQAL_FEATURE_LAST; i++) {
+    raptor_iostream_decimal_write(query->features[i], iostr);
+    raptor_iostream_write_byte(' ', iostr);
+  }
+  raptor_iostream_write_byte('\n', iostr);
+  if(query->base_uri)
+    raptor_iostream_string_write(raptor_uri_as_string(query->base_uri), iostr);
+  raptor_iostream_write_byte('\n', iostr);
+
+  if(query->data_graphs) {
+    for(i = 0;
+        (dg = (rasqal_data_graph*)raptor_sequence_get_at(query->data_graphs, i));
+        i++) {
+      raptor_iostream_decimal_write(dg->flags, iostr);
+      raptor_iostream_write_byte(' ', iostr);
+      raptor_iostream_string_write(raptor_uri_as_string(dg->uri), iostr);
+      if(dg->name_uri) {
+        raptor_iostream_write_byte(' ', iostr);
+        raptor_iostream_string_write(raptor_uri_as_string(dg->name_uri),
+                                     iostr);
+      }
+      raptor_iostream_write_byte('\n', iostr);
+    }
+  }
+
+  if(query->parameter_variables) {
+    for(i = 0;
+        (v = (rasqal_variable*)raptor_sequence_get_at(query->parameter_variables, i));
+        i++) {
+      rasqal_literal* value;
+
+      value = (rasqal_literal*)raptor_sequence_get_at(query->parameter_values,
+                                                      i);
+      raptor_iostream_string_write(v->name, iostr);
+      raptor_iostream_write_byte('=', iostr);
+      if(value)
+        rasqal_literal_write(value, iostr);
+      raptor_iostream_write_byte('\n', iostr);
+    }
+  }
+
+  /* string is written when the iostream is freed */
+  raptor_free_iostream(iostr);
+  if(!string)
+    return NULL;
+
+  key = RASQAL_MALLOC(char*, length + 1);
+  if(key) {
+    memcpy(key, string, length);
+    key[length] = '\0';
+  }
+  rasqal_free_memory(string);
+
+  return key;
+}
+
+
+/* remove an entry from the recently used list */
+static void
+rasqal_query_results_cache_unlink(rasqal_world* world,
+                                  rasqal_results_cache_entry* entry)
+{
+  if(entry->older)
+    entry->older->newer = entry->newer;
+  else
+    world->results_cache_oldest = entry->newer;
+
+  if(entry->newer)
+    entry->newer->older = entry->older;
+  else
+    world->results_cache_newest = entry->older;
+
+  entry->older = entry->newer = NULL;
+}
+
+
+/* add an entry to the recently used list as the newest */
+static void
+rasqal_query_results_cache_link_newest(rasqal_world* world,
+                                       rasqal_results_cache_entry* entry)
+{
+  entry->older = world->results_cache_newest;
+  entry->newer = NULL;
+  if(world->results_cache_newest)
+    world->results_cache_newest->newer = entry;
+  else
+    world->results_cache_oldest = entry;
+  world->results_cache_newest = entry;
+}
+
+
+/* remove an entry from the cache and free it */
+static void
+rasqal_query_results_cache_remove(rasqal_world* world,
+                                  rasqal_results_cache_entry* entry)
+{
+  rasqal_results_cache_entry** entry_p;
+
+  entry_p = &world->results_cache[entry->hash & RASQAL_GOOD_CAST(size_t, world->results_cache_buckets - 1)];
+  while(*entry_p != entry)
+    entry_p = &(*entry_p)->next;
+  *entry_p = entry->next;
+
+  rasqal_query_results_cache_unlink(world, entry);
+  world->results_cache_count--;
+  world->results_cache_used -= entry->size;
+
+  rasqal_free_results_cache_entry(entry);
+}
+
+
+/*
+ * rasqal_query_results_cache_grow:
+ * @world: world
+ *
+ * INTERNAL - Make room in the results cache hash table for one more entry
+ *
+ * The table doubles when it holds as many entries as buckets.  Must
+ * be called with the results cache locked.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_query_results_cache_grow(rasqal_world* world)
+{
+  rasqal_results_cache_entry** buckets;
+  int buckets_count;
+  int i;
+
+  if(world->results_cache_count < world->results_cache_buckets)
+    return 0;
+
+  buckets_count = world->results_cache_buckets ? world->results_cache_buckets * 2 : 8;
+  buckets = RASQAL_CALLOC(rasqal_results_cache_entry**,
+                          RASQAL_GOOD_CAST(size_t, buckets_count),
+                          sizeof(rasqal_results_cache_entry*));
+  if(!buckets)
+    /* a full table still works with longer chains */
+    return !world->results_cache_buckets;
+
+  for(i = 0; i < world->results_cache_buckets; i++) {
+    rasqal_results_cache_entry* entry = world->results_cache[i];
+
+    while(entry) {
+      rasqal_results_cache_entry* next = entry->next;
+      size_t slot = entry->hash & RASQAL_GOOD_CAST(size_t, buckets_count - 1);
+
+      entry->next = buckets[slot];
+      buckets[slot] = entry;
+      entry = next;
+    }
+  }
+
+  if(world->results_cache)
+    RASQAL_FREE(rasqal_results_cache_entry**, world->results_cache);
+  world->results_cache = buckets;
+  world->results_cache_buckets = buckets_count;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_query_results_cache_trim:
+ * @world: world
+ * @size: maximum bytes of stored rows to keep
+ *
+ * INTERNAL - Remove least recently used results cache entries down to @size
+ *
+ * Must be called with the results cache locked.
+ */
+void
+rasqal_query_results_cache_trim(rasqal_world* world, size_t size)
+{
+  while(world->results_cache_used > size && world->results_cache_oldest)
+    rasqal_query_results_cache_remove(world, world->results_cache_oldest);
+}
+
+
+/*
+ * rasqal_query_results_cache_finish:
+ * @world: world
+ *
+ * INTERNAL - Free all cached query results
+ */
+void
+rasqal_query_results_cache_finish(rasqal_world* world)
+{
+  /* remove entries of 0 bytes too */
+  while(world->results_cache_oldest)
+    rasqal_query_results_cache_remove(world, world->results_cache_oldest);
+
+  if(world->results_cache) {
+    RASQAL_FREE(rasqal_results_cache_entry**, world->results_cache);
+    world->results_cache = NULL;
+  }
+  world->results_cache_buckets = 0;
+}
+
+
+/*
+ * rasqal_query_results_cache_find:
+ * @world: world
+ * @key: cache key
+ * @hash: hash of @key
+ *
+ * INTERNAL - Find a results cache entry and mark it most recently used
+ *
+ * Must be called with the results cache locked.
+ *
+ * Return value: shared entry or NULL if not found
+ */
+static rasqal_results_cache_entry*
+rasqal_query_results_cache_find(rasqal_world* world, const char* key,
+                                size_t hash)
+{
+  rasqal_results_cache_entry* entry;
+
+  if(!world->results_cache)
+    return NULL;
+
+  for(entry = world->results_cache[hash & RASQAL_GOOD_CAST(size_t, world->results_cache_buckets - 1)];
+      entry;
+      entry = entry->next) {
+    if(entry->hash == hash && !strcmp(entry->key, key))
+      break;
+  }
+
+  if(!entry)
+    return NULL;
+
+  rasqal_query_results_cache_unlink(world, entry);
+  rasqal_query_results_cache_link_newest(world, entry);
+
+  return entry;
+}
+
+
+/*
+ * rasqal_query_results_cache_lookup:
+ * @query_results: query results
+ * @key: cache key
+ *
+ * INTERNAL - Set the stored rows of a query results from the results cache
+ *
+ * The results get their own copies of the cached rows.
+ *
+ * Return value: non-0 if not found or on failure
+ */
+static int
+rasqal_query_results_cache_lookup(rasqal_query_results* query_results,
+                                  const char* key)
+{
+  rasqal_world* world = query_results->world;
+  rasqal_results_cache_entry* entry;
+  size_t hash = rasqal_string_hash(key, strlen(key));
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->results_cache_lock);
+#endif
+  entry = rasqal_query_results_cache_find(world, key, hash);
+  if(entry)
+    query_results->results_sequence = rasqal_results_cache_copy_rows(entry->rows);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->results_cache_lock);
+#endif
+
+  return !query_results->results_sequence;
+}
+
+
+/*
+ * rasqal_query_results_cache_add:
+ * @world: world
+ * @key: cache key (ownership taken)
+ * @rows: sequence of rows from rasqal_results_cache_copy_row() (ownership taken) or NULL
+ *
+ * INTERNAL - Add result rows to the results cache
+ *
+ * Failing to add the rows is not an error for the caller.
+ */
+static void
+rasqal_query_results_cache_add(rasqal_world* world, char* key,
+                               raptor_sequence* rows)
+{
+  rasqal_results_cache_entry* entry;
+  size_t key_len = strlen(key);
+  size_t slot;
+
+  entry = RASQAL_CALLOC(rasqal_results_cache_entry*, 1, sizeof(*entry));
+  if(!entry) {
+    RASQAL_FREE(char*, key);
+    if(rows)
+      raptor_free_sequence(rows);
+    return;
+  }
+  entry->key = key;
+  entry->hash = rasqal_string_hash(key, key_len);
+  entry->rows = rows;
+  if(!rows) {
+    rasqal_free_results_cache_entry(entry);
+    return;
+  }
+
+  entry->size = key_len + rasqal_row_sequence_get_memory_size(entry->rows);
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->results_cache_lock);
+#endif
+
+  /* too large, already cached by another execution or no table */
+  if(entry->size > world->results_cache_size ||
+     rasqal_query_results_cache_find(world, key, entry->hash) ||
+     rasqal_query_results_cache_grow(world)) {
+    rasqal_free_results_cache_entry(entry);
+    goto unlock;
+  }
+
+  rasqal_query_results_cache_trim(world,
+                                  world->results_cache_size - entry->size);
+
+  slot = entry->hash & RASQAL_GOOD_CAST(size_t, world->results_cache_buckets - 1);
+  entry->next = world->results_cache[slot];
+  world->results_cache[slot] = entry;
+  rasqal_query_results_cache_link_newest(world, entry);
+  world->results_cache_count++;
+  world->results_cache_used += entry->size;
+
+  unlock:
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->results_cache_lock);
+#endif
+}
+
+
+/*
+ * rasqal_query_results_cache_tee_row:
+ * @query_results: query results read lazily
+ * @row: row read from the execution engine
+ *
+ * INTERNAL - Copy a lazily read row for adding to the results cache
+ *
+ * Rows are no longer copied once they exceed the cache budget.
+ */
+static void
+rasqal_query_results_cache_tee_row(rasqal_query_results* query_results,
+                                   rasqal_row* row)
+{
+  if(!query_results->cache_rows) {
+    query_results->cache_rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row, (raptor_data_print_handler)rasqal_row_print);
+    if(!query_results->cache_rows)
+      goto give_up;
+  }
+
+  query_results->cache_rows_size += rasqal_row_get_memory_size(row);
+  if(query_results->cache_rows_size > query_results->world->results_cache_size)
+    goto give_up;
+
+  if(raptor_sequence_push(query_results->cache_rows,
+                          rasqal_results_cache_copy_row(row)))
+    goto give_up;
+
+  return;
+
+  give_up:
+  RASQAL_FREE(char*, query_results->cache_key);
+  query_results->cache_key = NULL;
+  if(query_results->cache_rows) {
+    raptor_free_sequence(query_results->cache_rows);
+    query_results->cache_rows = NULL;
+  }
+}
+
+
+/*
+ * rasqal_query_results_cache_tee_end:
+ * @query_results: query results read lazily
+ *
+ * INTERNAL - Add the lazily read rows to the results cache when reading ends
+ *
+ * Rows of a failed or interrupted execution are not cached.
+ */
+static void
+rasqal_query_results_cache_tee_end(rasqal_query_results* query_results)
+{
+  char* key = query_results->cache_key;
+  raptor_sequence* rows = query_results->cache_rows;
+
+  query_results->cache_key = NULL;
+  query_results->cache_rows = NULL;
+
+  if(query_results->failed ||
+     rasqal_query_results_check_interrupted(query_results)) {
+    RASQAL_FREE(char*, key);
+    if(rows)
+      raptor_free_sequence(rows);
+    return;
+  }
+
+  if(!rows)
+    rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row, (raptor_data_print_handler)rasqal_row_print);
+
+  rasqal_query_results_cache_add(query_results->world, key, rows);
+}
+
+
 static void
 rasqal_query_results_update_bindings(rasqal_query_results* query_results)
 {
@@ -54,6 +54,35 @@
 
 #define EXPECTED_RESULTS_COUNT 1
 
+/* Cross product of every triple of the data with itself this many
+ * times: 3^12 rows for the 3 triple test data
+ */
+#define CROSS_PRODUCT_PATTERNS 12
+
+/* Triple patterns of the query read by two threads at once: 3^4 rows */
+#define CONCURRENT_PATTERNS 4
+
+/* Triple patterns of the sorted query run with a memory limit: 3^4 rows */
+#define SORTED_PATTERNS 4
+
+/* Memory limit in kilobytes that the sorted query rows go over */
+#define SORTED_MEMORY_LIMIT 1
+
+/* Sorted left join of every triple with the names of its subject:
+ * 3 rows from the 3 triple test data that all have the same subject
+ */
+#define EXPLAIN_QUERY_FORMAT "PREFIX foaf: <http://xmlns.com/foaf/0.1/> \
+         SELECT ?s ?o ?name \
+         FROM <%s> \
+         WHERE \
+         { ?s ?p ?o OPTIONAL { ?s foaf:name ?name } } \
+         ORDER BY ?o"
+
+#define EXPLAIN_RESULTS_COUNT 3
+
+#define RDF_TYPE_URI_STRING "http://www.w3.org/1999/02/22-rdf-syntax-ns#type"
+#define FOAF_NAME_URI_STRING "http://xmlns.com/foaf/0.1/name"
+
 
 #ifdef NO_QUERY_LANGUAGE
 int
@@ -64,6 +93,769 @@ main(int argc, char **argv) {
 }
 #else
 
+/* one more prototype */
+int main(int argc, char **argv);
+
+
+/* Execute @query and count the result rows; returns <0 on failure */
+static int
+count_results(rasqal_query* query)
+{
+  rasqal_query_results *results;
+  int count = 0;
+
+  results = rasqal_query_execute(query);
+  if(!results)
+    return -1;
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_query_results_next(results);
+    count++;
+  }
+  rasqal_free_query_results(results);
+
+  return count;
+}
+
+
+/*
+ * Set the unprojected variable $x that is only used in the basic
+ * graph pattern as a parameter and check that it restricts the
+ * matches, that executing never binds the query variable and that
+ * after clearing the parameters the next execution is unconstrained.
+ */
+static int
+test_parameters(const char* program, rasqal_world* world, rasqal_query* query)
+{
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(world);
+  rasqal_variable* x;
+  rasqal_literal* value;
+  int count;
+  int failures = 0;
+
+  x = rasqal_variables_table_get_by_name(query->vars_table,
+                                         RASQAL_VARIABLE_TYPE_NORMAL,
+                                         RASQAL_GOOD_CAST(const unsigned char*, "x"));
+  if(!x) {
+    fprintf(stderr, "%s: query has no variable x\n", program);
+    return 1;
+  }
+
+  value = rasqal_new_uri_literal(world,
+                                 raptor_new_uri(raptor_world_ptr,
+                                                RASQAL_GOOD_CAST(const unsigned char*, RDF_TYPE_URI_STRING)));
+  if(rasqal_query_set_parameter(query, RASQAL_GOOD_CAST(const unsigned char*, "x"), value)) {
+    fprintf(stderr, "%s: setting parameter x FAILED\n", program);
+    return 1;
+  }
+
+  count = count_results(query);
+  if(count != EXPECTED_RESULTS_COUNT) {
+    fprintf(stderr,
+            "%s: query with x=rdf:type returned %d results, expected %d\n",
+            program, count, EXPECTED_RESULTS_COUNT);
+    failures++;
+  }
+
+  value = rasqal_new_uri_literal(world,
+                                 raptor_new_uri(raptor_world_ptr,
+                                                RASQAL_GOOD_CAST(const unsigned char*, FOAF_NAME_URI_STRING)));
+  if(rasqal_query_set_parameter(query, RASQAL_GOOD_CAST(const unsigned char*, "x"), value)) {
+    fprintf(stderr, "%s: setting parameter x FAILED\n", program);
+    return 1;
+  }
+
+  count = count_results(query);
+  if(count) {
+    fprintf(stderr,
+            "%s: query with x=foaf:name returned %d results, expected 0\n",
+            program, count);
+    failures++;
+  }
+
+  if(x->value) {
+    fprintf(stderr, "%s: executing with parameter x bound the query variable\n",
+            program);
+    failures++;
+  }
+
+  rasqal_query_clear_parameters(query);
+
+  count = count_results(query);
+  if(count != EXPECTED_RESULTS_COUNT) {
+    fprintf(stderr,
+            "%s: query without parameters returned %d results, expected %d\n",
+            program, count, EXPECTED_RESULTS_COUNT);
+    failures++;
+  }
+
+  return failures;
+}
+
+
+/*
+ * Execute @query with the results cache enabled until a result is
+ * replayed from the cache and check replayed rows match, then read a
+ * replay while another replay of the same entry is freed.
+ */
+static int
+test_results_cache(const char* program, rasqal_world* world,
+                   rasqal_query* query)
+{
+  rasqal_query_results* results;
+  int count;
+  int failures = 0;
+
+  rasqal_world_set_results_cache_size(world, 1024 * 1024);
+
+  /* first execution stores the rows and the second replays them */
+  count = count_results(query);
+  if(count != EXPECTED_RESULTS_COUNT) {
+    fprintf(stderr, "%s: cached query returned %d results, expected %d\n",
+            program, count, EXPECTED_RESULTS_COUNT);
+    failures++;
+  }
+
+  results = rasqal_query_execute(query);
+  count = count_results(query);
+  if(count != EXPECTED_RESULTS_COUNT) {
+    fprintf(stderr, "%s: replayed query returned %d results, expected %d\n",
+            program, count, EXPECTED_RESULTS_COUNT);
+    failures++;
+  }
+
+  count = 0;
+  if(results) {
+    while(!rasqal_query_results_finished(results)) {
+      rasqal_query_results_next(results);
+      count++;
+    }
+    rasqal_free_query_results(results);
+  }
+  if(count != EXPECTED_RESULTS_COUNT) {
+    fprintf(stderr,
+            "%s: replay read after another replay returned %d results, expected %d\n",
+            program, count, EXPECTED_RESULTS_COUNT);
+    failures++;
+  }
+
+  rasqal_world_set_results_cache_size(world, 0);
+
+  return failures;
+}
+
+
+/* Log handler recording the last error message */
+static char last_error[256];
+
+static void
+test_log_handler(void *user_data, raptor_log_message *message)
+{
+  if(message->level < RAPTOR_LOG_LEVEL_ERROR || !message->text)
+    return;
+
+  strncpy(last_error, message->text, sizeof(last_error) - 1);
+  last_error[sizeof(last_error) - 1] = '\0';
+}
+
+
+/*
+ * Prepare a query over the data file matching @patterns unrelated
+ * triple patterns, so that the number of rows grows as the data size
+ * to the power of @patterns.  With @aggregate the rows are counted
+ * while executing rather than while reading the results.
+ */
+static rasqal_query*
+new_cross_product_query(rasqal_world* world, const unsigned char* data_string,
+                        raptor_uri* base_uri, int patterns, int aggregate)
+{
+  rasqal_query* query;
+  unsigned char* query_string;
+  char* p;
+  int i;
+  int rc;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query)
+    return NULL;
+
+  query_string = RASQAL_MALLOC(unsigned char*, strlen(RASQAL_GOOD_CAST(const char*, data_string)) + 80 + (patterns * 40));
+  if(!query_string) {
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  p = RASQAL_GOOD_CAST(char*, query_string);
+  p += sprintf(p, "SELECT %s FROM <%s> WHERE {",
+               aggregate ? "(COUNT(*) AS ?count)" : "*",
+               RASQAL_GOOD_CAST(const char*, data_string));
+  for(i = 0; i < patterns; i++)
+    p += sprintf(p, " ?s%d ?p%d ?o%d .", i, i, i);
+  strcpy(p, " }");
+
+  rc = rasqal_query_prepare(query, query_string, base_uri);
+  RASQAL_FREE(char*, query_string);
+  if(rc) {
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  return query;
+}
+
+
+/*
+ * Execute a large cross product with a 1ms time limit and check that
+ * reading the rows stops with a timed out failure.
+ */
+static int
+test_timeout(const char* program, rasqal_world* world,
+             const unsigned char* data_string, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  rasqal_query_results* results;
+  int count = 0;
+  int failures = 0;
+
+  query = new_cross_product_query(world, data_string, base_uri,
+                                  CROSS_PRODUCT_PATTERNS, 0);
+  if(!query) {
+    fprintf(stderr, "%s: preparing cross product query FAILED\n", program);
+    return 1;
+  }
+
+  rasqal_query_set_feature(query, RASQAL_FEATURE_TIMEOUT, 1);
+
+  last_error[0] = '\0';
+  results = rasqal_query_execute(query);
+  if(results) {
+    while(!rasqal_query_results_finished(results)) {
+      rasqal_query_results_next(results);
+      count++;
+    }
+    rasqal_free_query_results(results);
+  }
+
+  if(!strstr(last_error, "timed out")) {
+    fprintf(stderr,
+            "%s: query with a 1ms timeout returned %d rows without timing out\n",
+            program, count);
+    failures++;
+  }
+
+  rasqal_free_query(query);
+
+  return failures;
+}
+
+
+/*
+ * Prepare a query over the data file sorting the rows of @patterns
+ * unrelated triple patterns
+ */
+static rasqal_query*
+new_sorted_query(rasqal_world* world, const unsigned char* data_string,
+                 raptor_uri* base_uri, int patterns)
+{
+  rasqal_query* query;
+  unsigned char* query_string;
+  char* p;
+  int i;
+  int rc;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query)
+    return NULL;
+
+  query_string = RASQAL_MALLOC(unsigned char*, strlen(RASQAL_GOOD_CAST(const char*, data_string)) + 80 + (patterns * 40));
+  if(!query_string) {
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  p = RASQAL_GOOD_CAST(char*, query_string);
+  p += sprintf(p, "SELECT * FROM <%s> WHERE {",
+               RASQAL_GOOD_CAST(const char*, data_string));
+  for(i = 0; i < patterns; i++)
+    p += sprintf(p, " ?s%d ?p%d ?o%d .", i, i, i);
+  strcpy(p, " } ORDER BY DESC(?o0) ?s1");
+
+  rc = rasqal_query_prepare(query, query_string, base_uri);
+  RASQAL_FREE(char*, query_string);
+  if(rc) {
+    rasqal_free_query(query);
+    return NULL;
+  }
+
+  return query;
+}
+
+
+/* Last error returned by the engine of memory_test_engine */
+static rasqal_engine_error memory_test_error;
+
+/* Default engine recording the errors returned when getting rows */
+static rasqal_query_execution_factory memory_test_engine;
+
+static rasqal_row*
+memory_test_get_row(void* ex_data, rasqal_engine_error *error_p)
+{
+  rasqal_row* row;
+
+  row = rasqal_query_get_engine_by_name(NULL)->get_row(ex_data, error_p);
+  if(*error_p != RASQAL_ENGINE_OK)
+    memory_test_error = *error_p;
+
+  return row;
+}
+
+
+/*
+ * Execute a sorted query and check the peak memory held by the
+ * execution is recorded, then execute it again with a memory limit
+ * below that and check that the engine stops at the limit.
+ */
+static int
+test_memory_limit(const char* program, rasqal_world* world,
+                  const unsigned char* data_string, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  rasqal_query_results* results;
+  size_t peak = 0;
+  int count = 0;
+  int failures = 0;
+
+  query = new_sorted_query(world, data_string, base_uri, SORTED_PATTERNS);
+  if(!query) {
+    fprintf(stderr, "%s: preparing sorted query FAILED\n", program);
+    return 1;
+  }
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: sorted query execution FAILED\n", program);
+    failures++;
+    goto tidy;
+  }
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_query_results_next(results);
+    count++;
+  }
+  peak = rasqal_query_results_get_memory_peak(results);
+  rasqal_free_query_results(results);
+
+  if(!count || !peak) {
+    fprintf(stderr,
+            "%s: sorted query returned %d rows with a memory peak of %lu bytes\n",
+            program, count, RASQAL_GOOD_CAST(unsigned long, peak));
+    failures++;
+    goto tidy;
+  }
+
+  if(peak <= SORTED_MEMORY_LIMIT * 1024) {
+    fprintf(stderr,
+            "%s: sorted query memory peak of %lu bytes is within the %dKB limit\n",
+            program, RASQAL_GOOD_CAST(unsigned long, peak),
+            SORTED_MEMORY_LIMIT);
+    failures++;
+    goto tidy;
+  }
+
+  memory_test_engine = *rasqal_query_get_engine_by_name(NULL);
+  memory_test_engine.get_row = memory_test_get_row;
+  memory_test_error = RASQAL_ENGINE_OK;
+
+  rasqal_query_set_feature(query, RASQAL_FEATURE_MEMORY_LIMIT,
+                           SORTED_MEMORY_LIMIT);
+
+  last_error[0] = '\0';
+  count = 0;
+  results = rasqal_query_execute_with_engine(query, &memory_test_engine);
+  if(results) {
+    while(!rasqal_query_results_finished(results)) {
+      rasqal_query_results_next(results);
+      count++;
+    }
+    rasqal_free_query_results(results);
+  }
+
+  if(memory_test_error != RASQAL_ENGINE_MEMORY_LIMIT) {
+    fprintf(stderr,
+            "%s: sorted query with a %dKB memory limit returned engine error %d, expected %d\n",
+            program, SORTED_MEMORY_LIMIT, RASQAL_GOOD_CAST(int, memory_test_error),
+            RASQAL_GOOD_CAST(int, RASQAL_ENGINE_MEMORY_LIMIT));
+    failures++;
+  }
+
+  if(count || !strstr(last_error, "memory limit")) {
+    fprintf(stderr,
+            "%s: sorted query with a %dKB memory limit returned %d rows without failing\n",
+            program, SORTED_MEMORY_LIMIT, count);
+    failures++;
+  }
+
+  tidy:
+  rasqal_free_query(query);
+
+  return failures;
+}
+
+
+/*
+ * Check the operator in @plan starting with @operator_start has
+ * @expected before the following @end_marker
+ */
+static int
+test_explain_has(const char* program, const char* format_name,
+                 const char* plan, const char* operator_start,
+                 const char* expected, const char* end_marker)
+{
+  const char* start;
+  const char* end;
+  const char* found;
+
+  start = strstr(plan, operator_start);
+  if(!start) {
+    fprintf(stderr, "%s: %s plan has no operator %s\n%s", program,
+            format_name, operator_start, plan);
+    return 1;
+  }
+
+  end = strstr(start, end_marker);
+  found = strstr(start, expected);
+  if(!found || (end && found > end)) {
+    fprintf(stderr, "%s: %s plan operator %s does not have %s\n%s", program,
+            format_name, operator_start, expected, plan);
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Read all rows of a sorted join and check the operators with their
+ * rows in and out counts in the text and JSON explain plans
+ */
+static int
+test_explain(const char* program, rasqal_world* world,
+             const unsigned char* data_string, raptor_uri* base_uri)
+{
+  const char* format_names[2] = { "text", "json" };
+  rasqal_query* query;
+  rasqal_query_results* results = NULL;
+  unsigned char* query_string;
+  int count = 0;
+  int failures = 0;
+  int i;
+
+  query = rasqal_new_query(world, QUERY_LANGUAGE, NULL);
+  if(!query) {
+    fprintf(stderr, "%s: creating explain query FAILED\n", program);
+    return 1;
+  }
+
+  query_string = RASQAL_MALLOC(unsigned char*, strlen(RASQAL_GOOD_CAST(const char*, data_string)) + strlen(EXPLAIN_QUERY_FORMAT) + 1);
+  if(!query_string) {
+    rasqal_free_query(query);
+    return 1;
+  }
+  sprintf(RASQAL_GOOD_CAST(char*, query_string), EXPLAIN_QUERY_FORMAT,
+          data_string);
+
+  if(rasqal_query_prepare(query, query_string, base_uri)) {
+    fprintf(stderr, "%s: preparing explain query FAILED\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  results = rasqal_query_execute(query);
+  if(!results) {
+    fprintf(stderr, "%s: explain query execution FAILED\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  while(!rasqal_query_results_finished(results)) {
+    rasqal_query_results_next(results);
+    count++;
+  }
+  if(count != EXPLAIN_RESULTS_COUNT) {
+    fprintf(stderr, "%s: explain query returned %d results, expected %d\n",
+            program, count, EXPLAIN_RESULTS_COUNT);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < 2; i++) {
+    const char* format_name = format_names[i];
+    int is_json = !strcmp(format_name, "json");
+    raptor_iostream* iostr;
+    void* string = NULL;
+    size_t length;
+    const char* plan;
+    int rc;
+
+    iostr = raptor_new_iostream_to_string(world->raptor_world_ptr,
+                                          &string, &length,
+                                          rasqal_alloc_memory);
+    if(!iostr) {
+      failures++;
+      break;
+    }
+    rc = rasqal_query_results_explain(results, iostr, format_name);
+    raptor_free_iostream(iostr);
+
+    if(rc || !string) {
+      fprintf(stderr, "%s: writing %s explain plan FAILED\n", program,
+              format_name);
+      failures++;
+      if(string)
+        rasqal_free_memory(string);
+      continue;
+    }
+    plan = RASQAL_GOOD_CAST(const char*, string);
+
+    if(is_json) {
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"sort\"",
+                                   "\"algorithm\" : \"ordered map\"",
+                                   "\"inputs\"");
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"sort\"",
+                                   "\"rowsIn\" : 3,", "\"inputs\"");
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"sort\"",
+                                   "\"rowsOut\" : 3,", "\"inputs\"");
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"join\"",
+                                   "\"algorithm\" : \"nested loop left join\"",
+                                   "\"inputs\"");
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"join\"",
+                                   "\"rowsOut\" : 3,", "\"inputs\"");
+      /* the outer triple pattern reads every triple */
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"triple pattern\"",
+                                   "\"rowsIn\" : 0,", "\"inputs\"");
+      failures += test_explain_has(program, format_name, plan,
+                                   "\"operator\" : \"triple pattern\"",
+                                   "\"rowsOut\" : 3,", "\"inputs\"");
+      /* the top operator returns the results */
+      failures += test_explain_has(program, format_name, plan, "{",
+                                   "\"rowsOut\" : 3,", "\"inputs\"");
+    } else {
+      failures += test_explain_has(program, format_name, plan,
+                                   "sort [ordered map] (",
+                                   "(rows in 3, rows out 3,", "\n");
+      failures += test_explain_has(program, format_name, plan,
+                                   "join [nested loop left join] (",
+                                   ", rows out 3,", "\n");
+      /* the outer triple pattern reads every triple */
+      failures += test_explain_has(program, format_name, plan,
+                                   "triple pattern (",
+                                   "(rows in 0, rows out 3,", "\n");
+      /* the top operator returns the results */
+      failures += test_explain_has(program, format_name, plan, "",
+                                   ", rows out 3,", "\n");
+    }
+
+    rasqal_free_memory(string);
+  }
+
+  tidy:
+  if(results)
+    rasqal_free_query_results(results);
+  RASQAL_FREE(char*, query_string);
+  rasqal_free_query(query);
+
+  return failures;
+}
+
+
+/* Rows read from one execution and a hash of their values */
+typedef struct {
+  rasqal_query_results* results;
+  int count;
+  size_t hash;
+} test_read_state;
+
+
+/* Read all rows of the results in @user_data */
+static void*
+test_read_results(void* user_data)
+{
+  test_read_state* state = (test_read_state*)user_data;
+  rasqal_query_results* results = state->results;
+
+  while(!rasqal_query_results_finished(results)) {
+    int i;
+
+    for(i = 0; i < rasqal_query_results_get_bindings_count(results); i++) {
+      rasqal_literal* value = rasqal_query_results_get_binding_value(results, i);
+      const char* string = NULL;
+
+      if(value)
+        string = RASQAL_GOOD_CAST(const char*, rasqal_literal_as_string(value));
+      state->hash = state->hash * 31 +
+        (string ? rasqal_string_hash(string, strlen(string)) : 0);
+    }
+
+    rasqal_query_results_next(results);
+    state->count++;
+  }
+
+  return NULL;
+}
+
+
+/*
+ * Execute one prepared query twice, read both results at the same
+ * time from two threads and check each returns the rows of a
+ * sequential execution.
+ */
+static int
+test_concurrent_reads(const char* program, rasqal_world* world,
+                      const unsigned char* data_string, raptor_uri* base_uri)
+{
+#ifdef HAVE_PTHREAD_H
+  rasqal_query* query;
+  test_read_state expected;
+  test_read_state states[2];
+  pthread_t threads[2];
+  int started[2];
+  int failures = 0;
+  int i;
+
+  query = new_cross_product_query(world, data_string, base_uri,
+                                  CONCURRENT_PATTERNS, 0);
+  if(!query) {
+    fprintf(stderr, "%s: preparing cross product query FAILED\n", program);
+    return 1;
+  }
+
+  memset(&expected, '\0', sizeof(expected));
+  memset(states, '\0', sizeof(states));
+
+  expected.results = rasqal_query_execute(query);
+  if(!expected.results) {
+    fprintf(stderr, "%s: sequential query execution FAILED\n", program);
+    rasqal_free_query(query);
+    return 1;
+  }
+  test_read_results(&expected);
+  rasqal_free_query_results(expected.results);
+
+  for(i = 0; i < 2; i++) {
+    started[i] = 0;
+    states[i].results = rasqal_query_execute(query);
+    if(!states[i].results) {
+      fprintf(stderr, "%s: query execution %d FAILED\n", program, i + 1);
+      failures++;
+    }
+  }
+
+  for(i = 0; i < 2; i++) {
+    if(states[i].results &&
+       !pthread_create(&threads[i], NULL, test_read_results, &states[i]))
+      started[i] = 1;
+  }
+
+  for(i = 0; i < 2; i++) {
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    else if(states[i].results) {
+      fprintf(stderr, "%s: starting reader thread %d FAILED\n", program,
+              i + 1);
+      failures++;
+    }
+
+    if(started[i] &&
+       (states[i].count != expected.count || states[i].hash != expected.hash)) {
+      fprintf(stderr,
+              "%s: concurrent execution %d returned %d rows, expected the %d rows of a sequential execution\n",
+              program, i + 1, states[i].count, expected.count);
+      failures++;
+    }
+
+    if(states[i].results)
+      rasqal_free_query_results(states[i].results);
+  }
+
+  rasqal_free_query(query);
+
+  return failures;
+#else
+  fprintf(stderr, "%s: no threads, skipping concurrent reads test\n",
+          program);
+  return 0;
+#endif
+}
+
+
+/*
+ * Start a large counting cross product on the worker threads, cancel
+ * it while it runs and check that the results fail as cancelled.
+ */
+static int
+test_async_cancel(const char* program, rasqal_world* world,
+                  const unsigned char* data_string, raptor_uri* base_uri)
+{
+  rasqal_query* query;
+  rasqal_query_results* results;
+  int failures = 0;
+
+#ifndef HAVE_PTHREAD_H
+  fprintf(stderr, "%s: no worker threads, skipping async cancel test\n",
+          program);
+  return 0;
+#endif
+
+  if(rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 2)) {
+    fprintf(stderr, "%s: setting world threads FAILED\n", program);
+    return 1;
+  }
+
+  query = new_cross_product_query(world, data_string, base_uri,
+                                  CROSS_PRODUCT_PATTERNS + 2, 1);
+  if(!query) {
+    fprintf(stderr, "%s: preparing cross product query FAILED\n", program);
+    rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 0);
+    return 1;
+  }
+
+  last_error[0] = '\0';
+  results = rasqal_query_execute_async(query, NULL, NULL);
+  if(!results) {
+    fprintf(stderr, "%s: async query execution FAILED\n", program);
+    failures++;
+  } else {
+    rasqal_query_results_cancel(results);
+
+    if(!rasqal_query_results_wait(results)) {
+      fprintf(stderr, "%s: cancelled async query did not fail\n", program);
+      failures++;
+    } else if(!strstr(last_error, "cancelled")) {
+      fprintf(stderr, "%s: cancelled async query failed with '%s'\n",
+              program, last_error);
+      failures++;
+    }
+
+    if(!rasqal_query_results_poll(results)) {
+      fprintf(stderr, "%s: cancelled async query is not done\n", program);
+      failures++;
+    }
+
+    rasqal_free_query_results(results);
+  }
+
+  rasqal_free_query(query);
+  rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 0);
+
+  return failures;
+}
+
+
 int
 main(int argc, char **argv) {
   const char *program=rasqal_basename(argv[0]);
@@ -98,7 +890,6 @@ main(int argc, char **argv) {
   data_string = raptor_uri_filename_to_uri_string(data_file);
   query_string = RASQAL_MALLOC(unsigned char*, strlen(RASQAL_GOOD_CAST(const char*, data_string)) + strlen(query_format) + 1);
   sprintf(RASQAL_GOOD_CAST(char*, query_string), query_format, data_string);
-  raptor_free_memory(data_string);
   
   uri_string=raptor_uri_filename_to_uri_string("");
   base_uri = raptor_new_uri(world->raptor_world_ptr, uri_string);
@@ -196,8 +987,40 @@ main(int argc, char **argv) {
 
   rasqal_free_query_results(results);
 
+  printf("%s: executing query with parameters\n", program);
+  if(test_parameters(program, world, query))
+    return(1);
+
+  printf("%s: executing query with the results cache\n", program);
+  if(test_results_cache(program, world, query))
+    return(1);
+
   rasqal_free_query(query);
 
+  rasqal_world_set_log_handler(world, NULL, test_log_handler);
+
+  printf("%s: executing query with a timeout\n", program);
+  if(test_timeout(program, world, data_string, base_uri))
+    return(1);
+
+  printf("%s: executing sorted query with a memory limit\n", program);
+  if(test_memory_limit(program, world, data_string, base_uri))
+    return(1);
+
+  printf("%s: explaining an executed sorted join\n", program);
+  if(test_explain(program, world, data_string, base_uri))
+    return(1);
+
+  printf("%s: reading two executions of a query at once\n", program);
+  if(test_concurrent_reads(program, world, data_string, base_uri))
+    return(1);
+
+  printf("%s: cancelling an async query execution\n", program);
+  if(test_async_cancel(program, world, data_string, base_uri))
+    return(1);
+
+  raptor_free_memory(data_string);
+
   raptor_free_uri(base_uri);
 
   rasqal_free_world(world);
@@ -758,6 +758,8 @@ rasqal_query_write_sparql_values(sparql_writer_context* wc,
         rasqal_query_write_sparql_row(wc, iostr, row, 1);
         raptor_iostream_write_byte('\n', iostr);
       } else {
+        if(i > 0)
+          raptor_iostream_write_byte(' ', iostr);
         rasqal_query_write_sparql_row(wc, iostr, row, 0);
       }
     }
@@ -1062,6 +1064,42 @@ rasqal_query_write_sparql_20060406_graph_pattern(rasqal_graph_pattern* gp,
 }
 
 
+/*
+ * rasqal_query_write_sparql_20060406_values:
+ * @bindings: bindings to write
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Write a SPARQL 1.1 VALUES block for @bindings
+ *
+ * URIs are written absolute so the block can be appended to a query
+ * string sent to a remote SERVICE.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_query_write_sparql_20060406_values(rasqal_bindings* bindings,
+                                          raptor_iostream *iostr)
+{
+  rasqal_world* world = bindings->query->world;
+  sparql_writer_context wc;
+  int rc;
+
+  memset(&wc, '\0', sizeof(wc));
+  wc.world = world;
+  wc.base_uri = NULL;
+  wc.type_uri = raptor_new_uri_for_rdf_concept(world->raptor_world_ptr,
+                                               RASQAL_GOOD_CAST(const unsigned char*, "type"));
+  wc.nstack = raptor_new_namespaces(world->raptor_world_ptr, 1);
+
+  rc = rasqal_query_write_sparql_values(&wc, iostr, bindings, /* indent */ 0);
+
+  raptor_free_uri(wc.type_uri);
+  raptor_free_namespaces(wc.nstack);
+
+  return rc;
+}
+
+
 int
 rasqal_query_write_sparql_20060406(raptor_iostream *iostr,
                                    rasqal_query* query, raptor_uri *base_uri)
@@ -159,6 +159,11 @@ rasqal_raptor_support_feature(void *user_data,
     case RASQAL_TRIPLES_SOURCE_FEATURE_IOSTREAM_DATA_GRAPH:
       return 1;
       break;
+
+    case RASQAL_TRIPLES_SOURCE_FEATURE_CONCURRENT_MATCH:
+      /* the statements are only read while matching */
+      return 1;
+      break;
       
     default:
     case RASQAL_TRIPLES_SOURCE_FEATURE_NONE:
@@ -56,6 +56,143 @@
 #ifndef STANDALONE
 
 
+/*
+ * rasqal_regex_get_literal:
+ * @pattern: regex pattern
+ * @regex_flags: regex flags string (or NULL)
+ * @buffer: buffer to write literal string to - at least strlen(pattern)+1 bytes
+ * @len_p: pointer to store literal string length
+ *
+ * INTERNAL - Check if a regex pattern reduces to a literal string match
+ *
+ * A pattern is literal if it contains no regex metacharacters other
+ * than an optional leading '^' and trailing '$' anchor plus
+ * backslash-escaped punctuation.  Any flag other than 's' (which
+ * only affects '.') disables the literal match, except 'm' on an
+ * unanchored pattern.
+ *
+ * The unescaped literal is written to @buffer (NUL terminated) and
+ * the length to *@len_p.
+ *
+ * Return value: type of literal match or RASQAL_REGEX_LITERAL_NONE
+ */
+rasqal_regex_literal_type
+rasqal_regex_get_literal(const char* pattern, const char* regex_flags,
+                         char* buffer, size_t* len_p)
+{
+  const char *p = pattern;
+  char *q = buffer;
+  int anchor_start = 0;
+  int anchor_end = 0;
+  int flag_m = 0;
+
+  for(p = regex_flags; p && *p; p++) {
+    if(*p == 'm')
+      flag_m = 1;
+    else if(*p != 's')
+      return RASQAL_REGEX_LITERAL_NONE;
+  }
+
+  p = pattern;
+  if(*p == '^') {
+    anchor_start = 1;
+    p++;
+  }
+
+  while(*p) {
+    char c = *p;
+
+    if(c == '\\') {
+      c = p[1];
+      /* only escaped punctuation is a literal character; \d, \n etc are not */
+      if(!c || !ispunct(RASQAL_GOOD_CAST(unsigned char, c)))
+        return RASQAL_REGEX_LITERAL_NONE;
+      *q++ = c;
+      p += 2;
+      continue;
+    }
+
+    if(c == '$' && !p[1]) {
+      anchor_end = 1;
+      break;
+    }
+
+    if(strchr(".[]()*+?{}|^$", c))
+      return RASQAL_REGEX_LITERAL_NONE;
+
+    *q++ = c;
+    p++;
+  }
+  *q = '\0';
+
+  if(flag_m && (anchor_start || anchor_end))
+    return RASQAL_REGEX_LITERAL_NONE;
+
+  if(len_p)
+    *len_p = RASQAL_GOOD_CAST(size_t, q - buffer);
+
+  if(anchor_start)
+    return anchor_end ? RASQAL_REGEX_LITERAL_EXACT : RASQAL_REGEX_LITERAL_PREFIX;
+
+  return anchor_end ? RASQAL_REGEX_LITERAL_SUFFIX : RASQAL_REGEX_LITERAL_SUBSTRING;
+}
+
+
+/*
+ * rasqal_regex_literal_match:
+ * @type: literal match type
+ * @literal: literal string
+ * @literal_len: literal string length
+ * @subject: input string
+ * @subject_len: input string length
+ *
+ * INTERNAL - Match a literal against a string with byte comparisons
+ *
+ * Return value: 0 for no match, >0 for match
+ */
+static int
+rasqal_regex_literal_match(rasqal_regex_literal_type type,
+                           const char* literal, size_t literal_len,
+                           const char* subject, size_t subject_len)
+{
+#ifdef RASQAL_REGEX_PCRE
+  /* PCRE '$' also matches before a newline at the end of the subject */
+  if((type == RASQAL_REGEX_LITERAL_SUFFIX ||
+      type == RASQAL_REGEX_LITERAL_EXACT) &&
+     subject_len && subject[subject_len - 1] == '\n') {
+    if(rasqal_regex_literal_match(type, literal, literal_len,
+                                  subject, subject_len - 1))
+      return 1;
+  }
+#endif
+
+  switch(type) {
+    case RASQAL_REGEX_LITERAL_PREFIX:
+      return (subject_len >= literal_len &&
+              !memcmp(subject, literal, literal_len));
+
+    case RASQAL_REGEX_LITERAL_SUFFIX:
+      return (subject_len >= literal_len &&
+              !memcmp(subject + subject_len - literal_len, literal,
+                      literal_len));
+
+    case RASQAL_REGEX_LITERAL_EXACT:
+      return (subject_len == literal_len &&
+              !memcmp(subject, literal, literal_len));
+
+    case RASQAL_REGEX_LITERAL_SUBSTRING:
+      return (rasqal_memmem(subject, subject_len,
+                            literal, literal_len) != NULL);
+
+    case RASQAL_REGEX_LITERAL_NONE:
+    default:
+      break;
+  }
+
+  return 0;
+}
+
+
 /*
  * rasqal_regex_match:
  * @world: world
@@ -94,6 +231,26 @@ rasqal_regex_match(rasqal_world* world, raptor_locator* locator,
   int exec_options = 0;
 #endif
   int rc = 0;
+  char* literal;
+  size_t literal_len = 0;
+  rasqal_regex_literal_type literal_type;
+
+  /* Fast path: patterns that are plain literal strings, optionally
+   * anchored, are matched with byte comparisons without compiling
+   * a regex.
+   */
+  literal = RASQAL_MALLOC(char*, strlen(pattern) + 1);
+  if(!literal)
+    return -1;
+
+  literal_type = rasqal_regex_get_literal(pattern, regex_flags,
+                                          literal, &literal_len);
+  if(literal_type != RASQAL_REGEX_LITERAL_NONE)
+    rc = rasqal_regex_literal_match(literal_type, literal, literal_len,
+                                    subject, subject_len);
+  RASQAL_FREE(char*, literal);
+  if(literal_type != RASQAL_REGEX_LITERAL_NONE)
+    return rc;
 
   for(p = regex_flags; p && *p; p++)
     if(*p == 'i')
@@ -789,6 +946,38 @@ int main(int argc, char *argv[]);
 
 #define NTESTS 1
 
+static const struct {
+  const char* pattern;
+  const char* flags;
+  rasqal_regex_literal_type type;
+  const char* literal;
+  const char* subject;
+  int match;
+} literal_tests[] = {
+  { "^http://example\\.org/", NULL, RASQAL_REGEX_LITERAL_PREFIX,
+    "http://example.org/", "http://example.org/abc", 1 },
+  { "^http://example\\.org/", NULL, RASQAL_REGEX_LITERAL_PREFIX,
+    "http://example.org/", "https://example.org/abc", 0 },
+  { "\\.org$", "", RASQAL_REGEX_LITERAL_SUFFIX,
+    ".org", "example.org", 1 },
+  { "^abc$", "s", RASQAL_REGEX_LITERAL_EXACT,
+    "abc", "abcd", 0 },
+  { "bc", NULL, RASQAL_REGEX_LITERAL_SUBSTRING,
+    "bc", "abcd", 1 },
+  { "bc", "m", RASQAL_REGEX_LITERAL_SUBSTRING,
+    "bc", "acbd", 0 },
+  { "", NULL, RASQAL_REGEX_LITERAL_SUBSTRING,
+    "", "abcd", 1 },
+  { "^abc", "m", RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { "abc", "i", RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { "a.c", NULL, RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { "^http://example.org/", NULL, RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { "a\\dc", NULL, RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { "ab$c", NULL, RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 },
+  { NULL, NULL, RASQAL_REGEX_LITERAL_NONE, NULL, NULL, 0 }
+};
+
+
 int
 main(int argc, char *argv[])
 {
@@ -799,6 +988,7 @@ main(int argc, char *argv[])
   int test = 0;
 #endif
   int failures = 0;
+  int i;
   
   world = rasqal_new_world();
   if(!world || rasqal_world_open(world)) {
@@ -807,6 +997,47 @@ main(int argc, char *argv[])
     goto tidy;
   }
     
+  for(i = 0; literal_tests[i].pattern; i++) {
+    const char* pattern = literal_tests[i].pattern;
+    char buffer[64];
+    size_t len = 0;
+    rasqal_regex_literal_type type;
+
+    type = rasqal_regex_get_literal(pattern, literal_tests[i].flags,
+                                    buffer, &len);
+    if(type != literal_tests[i].type) {
+      fprintf(stderr,
+              "%s: Literal test %d pattern '%s' failed - expected type %d but got %d\n",
+              program, i, pattern, literal_tests[i].type, type);
+      failures++;
+      continue;
+    }
+
+    if(type == RASQAL_REGEX_LITERAL_NONE)
+      continue;
+
+    if(strcmp(buffer, literal_tests[i].literal) ||
+       len != strlen(literal_tests[i].literal)) {
+      fprintf(stderr,
+              "%s: Literal test %d pattern '%s' failed - expected literal '%s' but got '%s'\n",
+              program, i, pattern, literal_tests[i].literal, buffer);
+      failures++;
+      continue;
+    }
+
+    if(rasqal_regex_match(world, NULL, pattern, literal_tests[i].flags,
+                          literal_tests[i].subject,
+                          strlen(literal_tests[i].subject)) !=
+       literal_tests[i].match) {
+      fprintf(stderr,
+              "%s: Literal test %d pattern '%s' subject '%s' failed - expected match %d\n",
+              program, i, pattern, literal_tests[i].subject,
+              literal_tests[i].match);
+      failures++;
+    }
+  }
+
+
 #if defined(RASQAL_REGEX_POSIX) || defined(RASQAL_REGEX_NONE)
     fprintf(stderr,
             "%s: WARNING: Cannot only run regex tests with PCRE regexes\n",
@@ -48,10 +48,12 @@ rasqal_new_row_common(rasqal_world* world, int size, int order_size)
 {
   rasqal_row* row;
   
-  row = RASQAL_CALLOC(rasqal_row*, 1, sizeof(*row));
+  row = RASQAL_GOOD_CAST(rasqal_row*,
+                         rasqal_object_pool_calloc(&world->rows_pool));
   if(!row)
     return NULL;
 
+  row->world = world;
   row->usage = 1;
   row->size = size;
   row->order_size = order_size;
@@ -132,7 +134,7 @@ rasqal_new_row_for_size(rasqal_world* world, int size)
 rasqal_row*
 rasqal_new_row_from_row(rasqal_row* row)
 {
-  row->usage++;
+  RASQAL_USAGE_INCREMENT(&row->usage);
   return row;
 }
 
@@ -149,7 +151,7 @@ rasqal_free_row(rasqal_row* row)
   if(!row)
     return;
 
-  if(--row->usage)
+  if(RASQAL_USAGE_DECREMENT(&row->usage))
     return;
   
   if(row->values) {
@@ -169,7 +171,7 @@ rasqal_free_row(rasqal_row* row)
     RASQAL_FREE(array, row->order_values);
   }
 
-  RASQAL_FREE(rasqal_row, row);
+  rasqal_object_pool_free(&row->world->rows_pool, row);
 }
 
 
@@ -623,18 +625,80 @@ rasqal_row_expand_size(rasqal_row *row, int size)
 
 
 
+/**
+ * rasqal_row_remap_values:
+ * @row: unshared result row
+ * @map: array of @size input value offsets (or <0 for no value)
+ * @size: new row size
+ * @scratch: work array of @size literal pointers
+ *
+ * INTERNAL - Rearrange the values of a row in place
+ *
+ * Value i of the resulting row is old value @map[i] which is moved
+ * without copying; old values that are not mapped are released.  This
+ * lets a rowsource reuse an input row that it owns (row usage 1)
+ * instead of building a new one.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_row_remap_values(rasqal_row* row, const int* map, int size,
+                        rasqal_literal** scratch)
+{
+  int i;
+
+  if(row->usage != 1)
+    return 1;
+
+  /* grow first so that a failure leaves the row unchanged */
+  if(size > row->size) {
+    int old_size = row->size;
+    
+    if(rasqal_row_expand_size(row, size))
+      return 1;
+    row->size = old_size;
+  }
+
+  for(i = 0; i < size; i++) {
+    int offset = map[i];
+
+    scratch[i] = NULL;
+    if(offset >= 0 && offset < row->size) {
+      scratch[i] = row->values[offset];
+      row->values[offset] = NULL;
+    }
+  }
+
+  for(i = 0; i < row->size; i++) {
+    if(row->values[i]) {
+      rasqal_free_literal(row->values[i]);
+      row->values[i] = NULL;
+    }
+  }
+
+  if(size > 0)
+    memcpy(row->values, scratch, sizeof(rasqal_literal*) * size);
+  row->size = size;
+
+  return 0;
+}
+
+
 /**
  * rasqal_row_bind_variables:
  * @row: Result row
- * @vars_table: Variables table
+ * @eval_context: Evaluation context (or NULL)
  *
- * INTERNAL - Bind the variable table vars withvalues in the row
+ * INTERNAL - Bind the row variables with the values in the row
+ *
+ * The values are set in the binding frame of @eval_context, if there
+ * is one, otherwise in the variables.
  *
  * Return value: non-0 on failure
  */
 int
 rasqal_row_bind_variables(rasqal_row* row,
-                          rasqal_variables_table* vars_table)
+                          rasqal_evaluation_context* eval_context)
 {
   int i;
   
@@ -651,7 +715,8 @@ rasqal_row_bind_variables(rasqal_row* row,
       }
       
       /* it is OK to bind to NULL */
-      rasqal_variable_set_value(v, value);
+      if(rasqal_evaluation_context_set_value(eval_context, v, value))
+        return 1;
     }
   }
 
@@ -689,6 +754,58 @@ rasqal_row_sequence_copy(raptor_sequence *seq)
 }
 
 
+/*
+ * rasqal_row_get_memory_size:
+ * @row: row
+ *
+ * INTERNAL - Estimate the memory held by a row and its values
+ *
+ * Values shared with other rows are counted for each row.
+ *
+ * Return value: size in bytes
+ */
+size_t
+rasqal_row_get_memory_size(rasqal_row* row)
+{
+  size_t size;
+  int i;
+
+  size = sizeof(*row);
+  size += RASQAL_GOOD_CAST(size_t, row->size + row->order_size) *
+          sizeof(rasqal_literal*);
+
+  for(i = 0; i < row->size; i++) {
+    rasqal_literal* l = row->values[i];
+    if(l)
+      size += sizeof(*l) + l->string_len;
+  }
+
+  return size;
+}
+
+
+/*
+ * rasqal_row_sequence_get_memory_size:
+ * @seq: sequence of #rasqal_row
+ *
+ * INTERNAL - Estimate the memory held by a sequence of rows
+ *
+ * Return value: size in bytes
+ */
+size_t
+rasqal_row_sequence_get_memory_size(raptor_sequence* seq)
+{
+  rasqal_row* row;
+  size_t size = 0;
+  int i;
+
+  for(i = 0; (row = (rasqal_row*)raptor_sequence_get_at(seq, i)); i++)
+    size += rasqal_row_get_memory_size(row);
+
+  return size;
+}
+
+
 /**
  * rasqal_row_compare:
  * @a: pointer to address of first #row
@@ -727,3 +844,191 @@ rasqal_row_compare(const void *a, const void *b)
   
   return result;
 }
+
+
+/**
+ * rasqal_new_row_batch:
+ * @world: rasqal_world
+ * @size: number of columns
+ * @capacity: maximum number of rows (or <= 0 for the default)
+ *
+ * INTERNAL - Create a new empty column batch of rows
+ *
+ * Return value: new batch or NULL on failure
+ */
+rasqal_row_batch*
+rasqal_new_row_batch(rasqal_world* world, int size, int capacity)
+{
+  rasqal_row_batch* batch;
+  
+  if(size < 0)
+    size = 0;
+  if(capacity <= 0)
+    capacity = RASQAL_ROW_BATCH_SIZE;
+
+  batch = RASQAL_CALLOC(rasqal_row_batch*, 1, sizeof(*batch));
+  if(!batch)
+    return NULL;
+
+  batch->world = world;
+  batch->size = size;
+  batch->capacity = capacity;
+  batch->count = 0;
+
+  if(size > 0) {
+    batch->values = RASQAL_CALLOC(rasqal_literal**,
+                                  RASQAL_GOOD_CAST(size_t, size * capacity),
+                                  sizeof(rasqal_literal*));
+    if(!batch->values)
+      goto failed;
+  }
+
+  batch->offsets = RASQAL_CALLOC(int*, RASQAL_GOOD_CAST(size_t, capacity),
+                                 sizeof(int));
+  batch->group_ids = RASQAL_CALLOC(int*, RASQAL_GOOD_CAST(size_t, capacity),
+                                   sizeof(int));
+  if(!batch->offsets || !batch->group_ids)
+    goto failed;
+
+  return batch;
+
+  failed:
+  rasqal_free_row_batch(batch);
+  return NULL;
+}
+
+
+/**
+ * rasqal_free_row_batch:
+ * @batch: row batch
+ *
+ * INTERNAL - Destructor - Free a row batch and the values it holds
+ */
+void
+rasqal_free_row_batch(rasqal_row_batch* batch)
+{
+  if(!batch)
+    return;
+
+  rasqal_row_batch_clear(batch);
+
+  if(batch->values)
+    RASQAL_FREE(array, batch->values);
+  if(batch->offsets)
+    RASQAL_FREE(array, batch->offsets);
+  if(batch->group_ids)
+    RASQAL_FREE(array, batch->group_ids);
+
+  RASQAL_FREE(rasqal_row_batch, batch);
+}
+
+
+/**
+ * rasqal_row_batch_clear:
+ * @batch: row batch
+ *
+ * INTERNAL - Release all values in a batch and make it empty
+ */
+void
+rasqal_row_batch_clear(rasqal_row_batch* batch)
+{
+  int column;
+
+  for(column = 0; column < batch->size; column++) {
+    rasqal_literal** values = RASQAL_ROW_BATCH_COLUMN(batch, column);
+    int i;
+    
+    for(i = 0; i < batch->count; i++) {
+      if(values[i]) {
+        rasqal_free_literal(values[i]);
+        values[i] = NULL;
+      }
+    }
+  }
+
+  batch->count = 0;
+}
+
+
+/**
+ * rasqal_row_batch_add_row:
+ * @batch: row batch
+ * @row: row to add (ownership is taken)
+ *
+ * INTERNAL - Append a row to a batch
+ *
+ * The values are moved from @row into the batch columns when @row is
+ * not shared, otherwise they are copied.  Columns beyond the size of
+ * @row are left empty.
+ *
+ * Return value: non-0 if the batch is full (@row is not taken)
+ */
+int
+rasqal_row_batch_add_row(rasqal_row_batch* batch, rasqal_row* row)
+{
+  int index = batch->count;
+  int column;
+  int steal = (row->usage == 1);
+  
+  if(index >= batch->capacity)
+    return 1;
+
+  for(column = 0; column < batch->size; column++) {
+    rasqal_literal* value = NULL;
+
+    if(column < row->size && row->values[column]) {
+      if(steal) {
+        value = row->values[column];
+        row->values[column] = NULL;
+      } else
+        value = rasqal_new_literal_from_literal(row->values[column]);
+    }
+
+    RASQAL_ROW_BATCH_COLUMN(batch, column)[index] = value;
+  }
+
+  batch->offsets[index] = row->offset;
+  batch->group_ids[index] = row->group_id;
+  batch->count++;
+
+  rasqal_free_row(row);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_row_batch_get_row:
+ * @batch: row batch
+ * @index: row index in batch
+ *
+ * INTERNAL - Make a row from one row of a batch
+ *
+ * The values are copied so the batch is unchanged.
+ *
+ * Return value: new row or NULL on failure or if @index is out of range
+ */
+rasqal_row*
+rasqal_row_batch_get_row(rasqal_row_batch* batch, int index)
+{
+  rasqal_row* row;
+  int column;
+  
+  if(index < 0 || index >= batch->count)
+    return NULL;
+
+  row = rasqal_new_row_for_size(batch->world, batch->size);
+  if(!row)
+    return NULL;
+
+  for(column = 0; column < batch->size; column++) {
+    rasqal_literal* value = RASQAL_ROW_BATCH_COLUMN(batch, column)[index];
+    if(value)
+      row->values[column] = rasqal_new_literal_from_literal(value);
+  }
+
+  row->offset = batch->offsets[index];
+  row->group_id = batch->group_ids[index];
+
+  return row;
+}
@@ -44,6 +44,10 @@
 
 #ifndef STANDALONE
 
+#ifndef HAVE_GETTIMEOFDAY
+#define gettimeofday(x,y) rasqal_gettimeofday(x,y)
+#endif
+
 static void rasqal_rowsource_print_header(rasqal_rowsource* rowsource, FILE* fh);
 
 /**
@@ -71,7 +75,7 @@ rasqal_new_rowsource_from_handler(rasqal_world* world,
   if(!world || !handler)
     return NULL;
 
-  if(handler->version < 1 || handler->version > 1)
+  if(handler->version < 1 || handler->version > 2)
     return NULL;
 
   rowsource = RASQAL_CALLOC(rasqal_rowsource*, 1, sizeof(*rowsource));
@@ -90,6 +94,13 @@ rasqal_new_rowsource_from_handler(rasqal_world* world,
   rowsource->size = -1;
 
   rowsource->generate_group = 0;
+
+  rowsource->limit_hint = -1;
+
+  rowsource->eval_context = query ? query->eval_context : NULL;
+
+  if(query && query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_PROFILE)])
+    rowsource->profile = 1;
   
   if(vars_table)
     rowsource->vars_table = rasqal_new_variables_table_from_variables_table(vars_table);
@@ -113,6 +124,125 @@ rasqal_new_rowsource_from_handler(rasqal_world* world,
 }
 
 
+/*
+ * rasqal_rowsource_charge_saved_rows:
+ * @rowsource: rasqal rowsource
+ * @size: bytes of rows added to @rows_sequence
+ *
+ * INTERNAL - Account saved rows against the query execution memory limit
+ */
+static void
+rasqal_rowsource_charge_saved_rows(rasqal_rowsource* rowsource, size_t size)
+{
+  rowsource->memory_size += size;
+  rasqal_rowsource_charge_memory(rowsource, size);
+}
+
+
+/*
+ * rasqal_rowsource_release_saved_rows:
+ * @rowsource: rasqal rowsource
+ *
+ * INTERNAL - Return the memory of the saved rows when they are freed
+ */
+static void
+rasqal_rowsource_release_saved_rows(rasqal_rowsource* rowsource)
+{
+  rasqal_rowsource_release_memory(rowsource, rowsource->memory_size);
+  rowsource->memory_size = 0;
+}
+
+
+/**
+ * rasqal_rowsource_charge_memory:
+ * @rowsource: rasqal rowsource
+ * @size: bytes of rows now held by the rowsource
+ *
+ * INTERNAL - Account memory held by a rowsource against the query execution
+ *
+ * The rowsource keeps its own peak for rasqal_rowsource_write_explain_text().
+ *
+ * Return value: non-0 if the memory limit is exceeded
+ */
+int
+rasqal_rowsource_charge_memory(rasqal_rowsource* rowsource, size_t size)
+{
+  rowsource->memory_used += size;
+  if(rowsource->memory_used > rowsource->memory_peak)
+    rowsource->memory_peak = rowsource->memory_used;
+
+  return rasqal_evaluation_context_charge_memory(rowsource->eval_context,
+                                                 size);
+}
+
+
+/**
+ * rasqal_rowsource_release_memory:
+ * @rowsource: rasqal rowsource
+ * @size: bytes of rows no longer held by the rowsource
+ *
+ * INTERNAL - Return memory charged with rasqal_rowsource_charge_memory()
+ */
+void
+rasqal_rowsource_release_memory(rasqal_rowsource* rowsource, size_t size)
+{
+  /* handler finish methods are called without a rowsource if init fails */
+  if(!rowsource)
+    return;
+
+  if(size > rowsource->memory_used)
+    size = rowsource->memory_used;
+  rowsource->memory_used -= size;
+
+  rasqal_evaluation_context_release_memory(rowsource->eval_context, size);
+}
+
+
+/*
+ * rasqal_rowsource_start_reading:
+ * @rowsource: rasqal rowsource
+ * @start: time to set when the read is timed
+ *
+ * INTERNAL - Begin counting (and maybe timing) an outermost read
+ *
+ * Return value: non-0 if @start was set
+ */
+static int
+rasqal_rowsource_start_reading(rasqal_rowsource* rowsource,
+                               struct timeval* start)
+{
+  rowsource->reading = 1;
+
+  return rowsource->profile && !gettimeofday(start, NULL);
+}
+
+
+/*
+ * rasqal_rowsource_end_reading:
+ * @rowsource: rasqal rowsource
+ * @start: time the read started or NULL if not timed
+ * @rows: number of rows returned by the read
+ *
+ * INTERNAL - End a read begun with rasqal_rowsource_start_reading()
+ */
+static void
+rasqal_rowsource_end_reading(rasqal_rowsource* rowsource,
+                             struct timeval* start, int rows)
+{
+  struct timeval now;
+
+  rowsource->reading = 0;
+  rowsource->rows_out += rows;
+
+  if(start && !gettimeofday(&now, NULL)) {
+    long usec = (now.tv_sec - start->tv_sec) * 1000000L +
+                (now.tv_usec - start->tv_usec);
+    if(usec > 0)
+      rowsource->time_usec += RASQAL_GOOD_CAST(unsigned long, usec);
+  }
+}
+
+
 /**
  * rasqal_free_rowsource:
  * @rowsource: rowsource object
@@ -134,8 +264,10 @@ rasqal_free_rowsource(rasqal_rowsource *rowsource)
   if(rowsource->variables_sequence)
     raptor_free_sequence(rowsource->variables_sequence);
 
-  if(rowsource->rows_sequence)
+  if(rowsource->rows_sequence) {
     raptor_free_sequence(rowsource->rows_sequence);
+    rasqal_rowsource_release_saved_rows(rowsource);
+  }
 
   RASQAL_FREE(rasqal_rowsource, rowsource);
 }
@@ -211,24 +343,19 @@ rasqal_rowsource_ensure_variables(rasqal_rowsource *rowsource)
 }
 
 
-/**
- * rasqal_rowsource_read_row:
- * @rowsource: rasqal rowsource
- *
- * Read a query result row from the rowsource.
- *
- * If a row is returned, it is owned by the caller.
- *
- * Return value: row or NULL when no more rows are available
- **/
-rasqal_row*
-rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
+/* INTERNAL - read a row; see rasqal_rowsource_read_row() */
+static rasqal_row*
+rasqal_rowsource_read_row_internal(rasqal_rowsource *rowsource)
 {
   rasqal_row* row = NULL;
   
   if(!rowsource || rowsource->finished)
     return NULL;
 
+  /* cancelled or past the deadline: end here and the results fail */
+  if(rasqal_evaluation_context_is_interrupted(rowsource->eval_context))
+    return NULL;
+
   if(rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVED_ROWS) {
     /* return row from saved rows sequence at offset */
     row = (rasqal_row*)raptor_sequence_get_at(rowsource->rows_sequence,
@@ -261,6 +388,8 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
         }
         /* copy to save it away */
         row = rasqal_new_row_from_row(row);
+        rasqal_rowsource_charge_saved_rows(rowsource,
+                                           rasqal_row_get_memory_size(row));
         raptor_sequence_push(rowsource->rows_sequence, row);
       }
     } else {
@@ -268,10 +397,15 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
         raptor_sequence* seq;
         
         seq = rasqal_rowsource_read_all_rows(rowsource);
-        if(rowsource->rows_sequence)
+        if(rowsource->rows_sequence) {
           raptor_free_sequence(rowsource->rows_sequence);
+          rasqal_rowsource_release_saved_rows(rowsource);
+        }
         /* rows_sequence now owns all rows */
         rowsource->rows_sequence = seq;
+        if(seq)
+          rasqal_rowsource_charge_saved_rows(rowsource,
+                                             rasqal_row_sequence_get_memory_size(seq));
 
         rowsource->offset = 0;
       }
@@ -313,6 +447,35 @@ rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
 }
 
 
+/**
+ * rasqal_rowsource_read_row:
+ * @rowsource: rasqal rowsource
+ *
+ * Read a query result row from the rowsource.
+ *
+ * If a row is returned, it is owned by the caller.
+ *
+ * Return value: row or NULL when no more rows are available
+ **/
+rasqal_row*
+rasqal_rowsource_read_row(rasqal_rowsource *rowsource)
+{
+  struct timeval start;
+  int timed;
+  rasqal_row* row;
+
+  /* rows read inside another read of this rowsource are counted there */
+  if(!rowsource || rowsource->reading)
+    return rasqal_rowsource_read_row_internal(rowsource);
+
+  timed = rasqal_rowsource_start_reading(rowsource, &start);
+  row = rasqal_rowsource_read_row_internal(rowsource);
+  rasqal_rowsource_end_reading(rowsource, timed ? &start : NULL, row ? 1 : 0);
+
+  return row;
+}
+
+
 /**
  * rasqal_rowsource_get_row_count:
  * @rowsource: rasqal rowsource
@@ -331,19 +494,9 @@ rasqal_rowsource_get_rows_count(rasqal_rowsource *rowsource)
 }
 
 
-/**
- * rasqal_rowsource_read_all_rows:
- * @rowsource: rasqal rowsource
- *
- * Read all rows from a rowsource
- *
- * After calling this, the rowsource will be empty of rows and finished
- * and if a sequence is returned, it is owned by the caller.
- *
- * Return value: new sequence of all rows (may be size 0) or NULL on failure
- **/
-raptor_sequence*
-rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
+/* INTERNAL - read all rows; see rasqal_rowsource_read_all_rows() */
+static raptor_sequence*
+rasqal_rowsource_read_all_rows_internal(rasqal_rowsource *rowsource)
 {
   raptor_sequence* seq;
 
@@ -366,7 +519,9 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
   if(rasqal_rowsource_ensure_variables(rowsource))
     return NULL;
 
-  if(rowsource->handler->read_all_rows) {
+  if(rowsource->handler->read_all_rows &&
+     !(rowsource->limit_hint >= 0 && rowsource->handler->read_row &&
+       !(rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVE_ROWS))) {
     seq = rowsource->handler->read_all_rows(rowsource, rowsource->user_data);
     if(!seq) {
       seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
@@ -395,7 +550,15 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
     return NULL;
 
   while(1) {
-    rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+    rasqal_row* row;
+
+    /* stop at the limit hint unless every row must be saved for reset */
+    if(rowsource->limit_hint >= 0 &&
+       rowsource->count >= rowsource->limit_hint &&
+       !(rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVE_ROWS))
+      break;
+
+    row = rasqal_rowsource_read_row(rowsource);
     if(!row)
       break;
 
@@ -417,6 +580,9 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
                   raptor_sequence_size(new_seq));
     rowsource->rows_sequence = new_seq;
     rowsource->flags |= RASQAL_ROWSOURCE_FLAGS_SAVED_ROWS;
+    if(new_seq)
+      rasqal_rowsource_charge_saved_rows(rowsource,
+                                         rasqal_row_sequence_get_memory_size(new_seq));
   }
   
   RASQAL_DEBUG4("%s rowsource %p returning a sequence of %d rows\n",
@@ -426,6 +592,200 @@ rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
 }
 
 
+/**
+ * rasqal_rowsource_read_all_rows:
+ * @rowsource: rasqal rowsource
+ *
+ * Read all rows from a rowsource
+ *
+ * After calling this, the rowsource will be empty of rows and finished
+ * and if a sequence is returned, it is owned by the caller.
+ *
+ * Return value: new sequence of all rows (may be size 0) or NULL on failure
+ **/
+raptor_sequence*
+rasqal_rowsource_read_all_rows(rasqal_rowsource *rowsource)
+{
+  struct timeval start;
+  int timed;
+  raptor_sequence* seq;
+
+  if(!rowsource || rowsource->reading)
+    return rasqal_rowsource_read_all_rows_internal(rowsource);
+
+  timed = rasqal_rowsource_start_reading(rowsource, &start);
+  seq = rasqal_rowsource_read_all_rows_internal(rowsource);
+  rasqal_rowsource_end_reading(rowsource, timed ? &start : NULL,
+                               seq ? raptor_sequence_size(seq) : 0);
+
+  return seq;
+}
+
+
+/*
+ * rasqal_rowsource_read_batch_from_rows:
+ * @rowsource: rasqal rowsource
+ * @batch: empty row batch
+ * @max_rows: maximum number of rows to add
+ *
+ * INTERNAL - Fill a batch one row at a time with rasqal_rowsource_read_row()
+ *
+ * Return value: number of rows added
+ */
+static int
+rasqal_rowsource_read_batch_from_rows(rasqal_rowsource* rowsource,
+                                      rasqal_row_batch* batch,
+                                      int max_rows)
+{
+  while(batch->count < max_rows) {
+    rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+    if(!row)
+      break;
+
+    rasqal_row_batch_add_row(batch, row);
+  }
+
+  return batch->count;
+}
+
+
+/* INTERNAL - read a batch; see rasqal_rowsource_read_batch() */
+static int
+rasqal_rowsource_read_batch_internal(rasqal_rowsource* rowsource,
+                                     rasqal_row_batch* batch)
+{
+  int size;
+  int max_rows;
+  int count;
+  
+  if(!rowsource || !batch)
+    return -1;
+
+  rasqal_row_batch_clear(batch);
+
+  if(rowsource->finished ||
+     rasqal_evaluation_context_is_interrupted(rowsource->eval_context))
+    return 0;
+
+  if(rasqal_rowsource_ensure_variables(rowsource))
+    return -1;
+
+  size = rowsource->size < 0 ? 0 : rowsource->size;
+  if(batch->size != size)
+    return -1;
+
+  max_rows = batch->capacity;
+  if(rowsource->limit_hint >= 0 &&
+     !(rowsource->flags & RASQAL_ROWSOURCE_FLAGS_SAVE_ROWS)) {
+    /* never read a block past the rows the consumer needs */
+    max_rows = rowsource->limit_hint - rowsource->count;
+    if(max_rows <= 0)
+      return 0;
+    if(max_rows > batch->capacity)
+      max_rows = batch->capacity;
+  }
+
+  if(!rowsource->handler->read_batch || max_rows < batch->capacity ||
+     rowsource->flags & (RASQAL_ROWSOURCE_FLAGS_SAVE_ROWS |
+                         RASQAL_ROWSOURCE_FLAGS_SAVED_ROWS))
+    return rasqal_rowsource_read_batch_from_rows(rowsource, batch, max_rows);
+
+  count = rowsource->handler->read_batch(rowsource, rowsource->user_data,
+                                         batch);
+  if(count <= 0) {
+    rowsource->finished = 1;
+    return count;
+  }
+
+  rowsource->count += count;
+
+  /* Generate a group around all rows if there are no groups returned */
+  if(rowsource->generate_group) {
+    int i;
+    
+    for(i = 0; i < count; i++) {
+      if(batch->group_ids[i] < 0)
+        batch->group_ids[i] = 0;
+    }
+  }
+
+  RASQAL_DEBUG4("%s rowsource %p returned a batch of %d rows\n",
+                rowsource->handler->name, rowsource, count);
+
+  return count;
+}
+
+
+/**
+ * rasqal_rowsource_read_batch:
+ * @rowsource: rasqal rowsource
+ * @batch: row batch with the same number of columns as the rowsource
+ *
+ * INTERNAL - Read the next rows from the rowsource into a column batch
+ *
+ * Any rows already in @batch are released first.  The rowsource
+ * handler read_batch method is used if present and rows are not being
+ * saved for a reset, otherwise the batch is filled from single rows.
+ *
+ * Return value: number of rows read, 0 when no more rows are available or <0 on failure
+ */
+int
+rasqal_rowsource_read_batch(rasqal_rowsource* rowsource,
+                            rasqal_row_batch* batch)
+{
+  struct timeval start;
+  int timed;
+  int count;
+
+  if(!rowsource || !batch || rowsource->reading)
+    return rasqal_rowsource_read_batch_internal(rowsource, batch);
+
+  timed = rasqal_rowsource_start_reading(rowsource, &start);
+  count = rasqal_rowsource_read_batch_internal(rowsource, batch);
+  rasqal_rowsource_end_reading(rowsource, timed ? &start : NULL,
+                               count > 0 ? count : 0);
+
+  return count;
+}
+
+
+/**
+ * rasqal_rowsource_set_limit_hint:
+ * @rowsource: rasqal rowsource
+ * @limit: maximum number of rows that will be read or <0 for no limit
+ *
+ * INTERNAL - Tell a rowsource how many rows its consumer needs at most
+ *
+ * The hint is passed on to inner rowsources by handlers that return
+ * at most one row per inner row in order (such as projection, union
+ * and slice).  The eager reads then stop at the limit:
+ * rasqal_rowsource_read_all_rows() reads rows one at a time instead
+ * of calling a handler that computes all rows (such as the union of
+ * every branch or all triple matches) and rasqal_rowsource_read_batch()
+ * never fills a batch past the limit.  rasqal_rowsource_read_row() is
+ * not limited by the hint since its caller decides when to stop.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_rowsource_set_limit_hint(rasqal_rowsource* rowsource, int limit)
+{
+  if(!rowsource)
+    return 1;
+
+  if(limit < 0)
+    limit = -1;
+
+  rowsource->limit_hint = limit;
+
+  if(rowsource->handler->set_limit_hint)
+    return rowsource->handler->set_limit_hint(rowsource, rowsource->user_data,
+                                              limit);
+
+  return 0;
+}
+
+
 /**
  * rasqal_rowsource_get_size:
  * @rowsource: rasqal rowsource
@@ -697,6 +1057,37 @@ rasqal_rowsource_set_origin(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_rowsource_visitor_set_evaluation_context(rasqal_rowsource* rowsource,
+                                                void *user_data)
+{
+  rowsource->eval_context = (rasqal_evaluation_context*)user_data;
+  return 0;
+}
+
+
+/**
+ * rasqal_rowsource_set_evaluation_context:
+ * @rowsource: rasqal rowsource
+ * @eval_context: evaluation context
+ *
+ * INTERNAL - Set the evaluation context of a rowsource and its inner rowsources
+ *
+ * Rowsources evaluate expressions and bind variables in their
+ * evaluation context which is initially the one of the query.  A
+ * query execution sets its own context so that the bindings of
+ * executions of the same query are kept apart.
+ */
+void
+rasqal_rowsource_set_evaluation_context(rasqal_rowsource* rowsource,
+                                        rasqal_evaluation_context* eval_context)
+{
+  rasqal_rowsource_visit(rowsource,
+                         rasqal_rowsource_visitor_set_evaluation_context,
+                         eval_context);
+}
+
+
 static int
 rasqal_rowsource_visitor_set_requirements(rasqal_rowsource* rowsource,
                                           void *user_data)
@@ -827,6 +1218,218 @@ rasqal_rowsource_print(rasqal_rowsource *rowsource, FILE* fh)
 }
 
 
+/*
+ * rasqal_rowsource_get_rows_in:
+ * @rowsource: rasqal rowsource
+ *
+ * INTERNAL - Get the number of rows read from the inner rowsources
+ *
+ * Return value: sum of the rows returned by the inner rowsources
+ */
+static int
+rasqal_rowsource_get_rows_in(rasqal_rowsource* rowsource)
+{
+  rasqal_rowsource* inner_rowsource;
+  int offset;
+  int rows_in = 0;
+
+  for(offset = 0;
+      (inner_rowsource = rasqal_rowsource_get_inner_rowsource(rowsource, offset));
+      offset++)
+    rows_in += inner_rowsource->rows_out;
+
+  return rows_in;
+}
+
+
+/* Write time in microseconds as milliseconds with 3 decimal places */
+static void
+rasqal_rowsource_write_explain_time(rasqal_rowsource* rowsource,
+                                    raptor_iostream* iostr)
+{
+  char buffer[64];
+
+  sprintf(buffer, "%lu.%03lu", rowsource->time_usec / 1000,
+          rowsource->time_usec % 1000);
+  raptor_iostream_string_write(buffer, iostr);
+}
+
+
+static void
+rasqal_rowsource_write_explain_size(size_t size, raptor_iostream* iostr)
+{
+  char buffer[64];
+
+  sprintf(buffer, "%lu", RASQAL_GOOD_CAST(unsigned long, size));
+  raptor_iostream_string_write(buffer, iostr);
+}
+
+
+static int
+rasqal_rowsource_write_explain_text_internal(rasqal_rowsource* rowsource,
+                                             raptor_iostream* iostr,
+                                             int indent)
+{
+  rasqal_rowsource* inner_rowsource;
+  int offset;
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_string_write(rowsource->handler->name, iostr);
+  if(rowsource->algorithm) {
+    raptor_iostream_counted_string_write(" [", 2, iostr);
+    raptor_iostream_string_write(rowsource->algorithm, iostr);
+    raptor_iostream_write_byte(']', iostr);
+  }
+
+  raptor_iostream_counted_string_write(" (rows in ", 10, iostr);
+  raptor_iostream_decimal_write(rasqal_rowsource_get_rows_in(rowsource),
+                                iostr);
+  raptor_iostream_counted_string_write(", rows out ", 11, iostr);
+  raptor_iostream_decimal_write(rowsource->rows_out, iostr);
+  if(rowsource->profile) {
+    raptor_iostream_counted_string_write(", time ", 7, iostr);
+    rasqal_rowsource_write_explain_time(rowsource, iostr);
+    raptor_iostream_counted_string_write(" ms", 3, iostr);
+  }
+  raptor_iostream_counted_string_write(", memory peak ", 14, iostr);
+  rasqal_rowsource_write_explain_size(rowsource->memory_peak, iostr);
+  raptor_iostream_counted_string_write(" bytes)\n", 8, iostr);
+
+  for(offset = 0;
+      (inner_rowsource = rasqal_rowsource_get_inner_rowsource(rowsource, offset));
+      offset++)
+    rasqal_rowsource_write_explain_text_internal(inner_rowsource, iostr,
+                                                 indent + 2);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_rowsource_write_explain_text:
+ * @rowsource: rasqal rowsource
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Write a rowsource tree with its execution statistics as text
+ *
+ * One line is written per rowsource with the inner rowsources
+ * indented below it.  Times are only written when the rowsources
+ * were created with #RASQAL_FEATURE_PROFILE set and include the time
+ * spent in the inner rowsources.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_rowsource_write_explain_text(rasqal_rowsource* rowsource,
+                                    raptor_iostream* iostr)
+{
+  if(!rowsource || !iostr)
+    return 1;
+
+  return rasqal_rowsource_write_explain_text_internal(rowsource, iostr, 0);
+}
+
+
+static int
+rasqal_rowsource_write_explain_json_internal(rasqal_rowsource* rowsource,
+                                             raptor_iostream* iostr,
+                                             int indent)
+{
+  rasqal_rowsource* inner_rowsource;
+  int offset;
+
+  raptor_iostream_counted_string_write("{\n", 2, iostr);
+  indent += 2;
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_counted_string_write("\"operator\" : ", 13, iostr);
+  raptor_string_ntriples_write(RASQAL_GOOD_CAST(const unsigned char*, rowsource->handler->name),
+                               strlen(rowsource->handler->name), '"', iostr);
+  raptor_iostream_counted_string_write(",\n", 2, iostr);
+
+  if(rowsource->algorithm) {
+    rasqal_rowsource_write_indent(iostr, indent);
+    raptor_iostream_counted_string_write("\"algorithm\" : ", 14, iostr);
+    raptor_string_ntriples_write(RASQAL_GOOD_CAST(const unsigned char*, rowsource->algorithm),
+                                 strlen(rowsource->algorithm), '"', iostr);
+    raptor_iostream_counted_string_write(",\n", 2, iostr);
+  }
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_counted_string_write("\"rowsIn\" : ", 11, iostr);
+  raptor_iostream_decimal_write(rasqal_rowsource_get_rows_in(rowsource),
+                                iostr);
+  raptor_iostream_counted_string_write(",\n", 2, iostr);
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_counted_string_write("\"rowsOut\" : ", 12, iostr);
+  raptor_iostream_decimal_write(rowsource->rows_out, iostr);
+  raptor_iostream_counted_string_write(",\n", 2, iostr);
+
+  if(rowsource->profile) {
+    rasqal_rowsource_write_indent(iostr, indent);
+    raptor_iostream_counted_string_write("\"timeMs\" : ", 11, iostr);
+    rasqal_rowsource_write_explain_time(rowsource, iostr);
+    raptor_iostream_counted_string_write(",\n", 2, iostr);
+  }
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_counted_string_write("\"memoryPeak\" : ", 15, iostr);
+  rasqal_rowsource_write_explain_size(rowsource->memory_peak, iostr);
+  raptor_iostream_counted_string_write(",\n", 2, iostr);
+
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_counted_string_write("\"inputs\" : [", 12, iostr);
+  for(offset = 0;
+      (inner_rowsource = rasqal_rowsource_get_inner_rowsource(rowsource, offset));
+      offset++) {
+    raptor_iostream_counted_string_write(offset ? ",\n" : "\n", offset ? 2 : 1,
+                                         iostr);
+    rasqal_rowsource_write_indent(iostr, indent + 2);
+    rasqal_rowsource_write_explain_json_internal(inner_rowsource, iostr,
+                                                 indent + 2);
+  }
+  if(offset) {
+    raptor_iostream_write_byte('\n', iostr);
+    rasqal_rowsource_write_indent(iostr, indent);
+  }
+  raptor_iostream_counted_string_write("]\n", 2, iostr);
+
+  indent -= 2;
+  rasqal_rowsource_write_indent(iostr, indent);
+  raptor_iostream_write_byte('}', iostr);
+
+  return 0;
+}
+
+
+/**
+ * rasqal_rowsource_write_explain_json:
+ * @rowsource: rasqal rowsource
+ * @iostr: iostream to write to
+ *
+ * INTERNAL - Write a rowsource tree with its execution statistics as JSON
+ *
+ * Each rowsource is an object with the same statistics as
+ * rasqal_rowsource_write_explain_text() and an "inputs" array of the
+ * inner rowsources.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_rowsource_write_explain_json(rasqal_rowsource* rowsource,
+                                    raptor_iostream* iostr)
+{
+  if(!rowsource || !iostr)
+    return 1;
+
+  rasqal_rowsource_write_explain_json_internal(rowsource, iostr, 0);
+  raptor_iostream_write_byte('\n', iostr);
+
+  return 0;
+}
+
+
 #endif /* not STANDALONE */
 
 
@@ -608,7 +608,7 @@ rasqal_aggregation_rowsource_read_row(rasqal_rowsource* rowsource,
   
 
     /* Bind the values in the input row to the variables in the table */
-    rasqal_row_bind_variables(row, rowsource->query->vars_table);
+    rasqal_row_bind_variables(row, rowsource->eval_context);
 
     /* Evaluate the expressions giving a sequence of literals to 
      * run the aggregation step over.
@@ -635,7 +635,7 @@ rasqal_aggregation_rowsource_read_row(rasqal_rowsource* rowsource,
         /* SPARQL Aggregation uses ListEvalE() to evaluate - ignoring
          * errors and filtering out expressions that fail
          */
-        seq = rasqal_expression_sequence_evaluate(rowsource->query,
+        seq = rasqal_expression_sequence_evaluate(rowsource->eval_context,
                                                   expr_data->exprs_seq,
                                                   /* ignore_errors */ 1,
                                                   &error);
@@ -727,7 +727,7 @@ rasqal_aggregation_rowsource_read_row(rasqal_rowsource* rowsource,
       v = rasqal_rowsource_get_variable_by_offset(rowsource, offset);
       result = rasqal_new_literal_from_literal(result);
       /* it is OK to bind to NULL */
-      rasqal_variable_set_value(v, result);
+      rasqal_evaluation_context_set_value(rowsource->eval_context, v, result);
 
       rasqal_row_set_value_at(row, offset, result);
         
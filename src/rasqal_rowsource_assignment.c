@@ -97,7 +97,6 @@ rasqal_assignment_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
 static rasqal_row*
 rasqal_assignment_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 {
-  rasqal_query *query = rowsource->query;
   rasqal_assignment_rowsource_context *con;
   rasqal_literal* result = NULL;
   rasqal_row *row = NULL;
@@ -109,7 +108,7 @@ rasqal_assignment_rowsource_read_row(rasqal_rowsource* rowsource, void *user_dat
     return NULL;
   
   RASQAL_DEBUG1("evaluating assignment expression\n");
-  result = rasqal_expression_evaluate2(con->expr, query->eval_context,
+  result = rasqal_expression_evaluate2(con->expr, rowsource->eval_context,
                                        &error);
 #ifdef RASQAL_DEBUG
   RASQAL_DEBUG2("assignment %s expression result: ", con->var->name);
@@ -121,7 +120,8 @@ rasqal_assignment_rowsource_read_row(rasqal_rowsource* rowsource, void *user_dat
 #endif
 
   if(!error) {
-    rasqal_variable_set_value(con->var, result);
+    rasqal_evaluation_context_set_value(rowsource->eval_context, con->var,
+                                        result);
     row = rasqal_new_row_for_size(rowsource->world, rowsource->size);
     row->rowsource = rowsource;
     row->offset = con->offset++;
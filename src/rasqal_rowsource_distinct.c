@@ -55,6 +55,8 @@ typedef struct
   /* offset into results for current row */
   int offset;
   
+  /* memory of the rows in map charged to the query execution */
+  size_t memory_size;
 } rasqal_distinct_rowsource_context;
 
 
@@ -67,11 +69,14 @@ rasqal_distinct_rowsource_init_common(rasqal_rowsource* rowsource, void *user_da
   con = (rasqal_distinct_rowsource_context*)user_data;
   
   con->offset = 0;
+  con->memory_size = 0;
 
   con->map = rasqal_engine_new_rowsort_map(1, query->compare_flags, NULL);
   if(!con->map)
     return 1;
 
+  rowsource->algorithm = "ordered map";
+
   return 0;
 }
 
@@ -115,8 +120,10 @@ rasqal_distinct_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->rowsource)
     rasqal_free_rowsource(con->rowsource);
   
-  if(con->map)
+  if(con->map) {
     rasqal_free_map(con->map);
+    rasqal_rowsource_release_memory(rowsource, con->memory_size);
+  }
 
   RASQAL_FREE(rasqal_distinct_rowsource_context, con);
 
@@ -134,17 +141,22 @@ rasqal_distinct_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 
   while(1) {
     int result;
+    size_t size;
 
     row = rasqal_rowsource_read_row(con->rowsource);
     if(!row)
       break;
 
+    size = rasqal_row_get_memory_size(row);
     result = rasqal_engine_rowsort_map_add_row(con->map, row);
     RASQAL_DEBUG2("row is %s\n", result ? "not distinct" : "distinct");
 
-    if(!result)
-      /* row was distinct (not a duplicate) so return it */
+    if(!result) {
+      /* row was distinct (not a duplicate) so it is kept in the map */
+      con->memory_size += size;
+      rasqal_rowsource_charge_memory(rowsource, size);
       break;
+    }
   }
 
   if(row) {
@@ -165,8 +177,10 @@ rasqal_distinct_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 
   con = (rasqal_distinct_rowsource_context*)user_data;
 
-  if(con->map)
+  if(con->map) {
     rasqal_free_map(con->map);
+    rasqal_rowsource_release_memory(rowsource, con->memory_size);
+  }
 
   rc = rasqal_distinct_rowsource_init_common(rowsource, user_data);
   if(rc)
@@ -105,7 +105,6 @@ rasqal_filter_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
 static rasqal_row*
 rasqal_filter_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 {
-  rasqal_query *query = rowsource->query;
   rasqal_filter_rowsource_context *con;
   rasqal_row *row = NULL;
   
@@ -120,7 +119,9 @@ rasqal_filter_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     if(!row)
       break;
 
-    result = rasqal_expression_evaluate2(con->expr, query->eval_context,
+    rasqal_row_bind_variables(row, rowsource->eval_context);
+
+    result = rasqal_expression_evaluate2(con->expr, rowsource->eval_context,
                                          &error);
 #ifdef RASQAL_DEBUG
     RASQAL_DEBUG1("filter expression result: ");
@@ -150,19 +151,8 @@ rasqal_filter_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     rasqal_free_row(row); row = NULL;
   }
 
-  if(row) {
-    int i;
-    
-    for(i = 0; i < row->size; i++) {
-      rasqal_variable* v;
-      v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
-      if(row->values[i])
-        rasqal_free_literal(row->values[i]);
-      row->values[i] = rasqal_new_literal_from_literal(v->value);
-    }
-
+  if(row)
     row->offset = con->offset++;
-  }
   
   return row;
 }
@@ -93,7 +93,8 @@ typedef struct
 
 
 static int
-rasqal_graph_next_dg(rasqal_graph_rowsource_context *con) 
+rasqal_graph_next_dg(rasqal_rowsource* rowsource,
+                     rasqal_graph_rowsource_context *con) 
 {
   rasqal_query *query = con->rowsource->query;
   rasqal_data_graph *dg;
@@ -125,8 +126,8 @@ rasqal_graph_next_dg(rasqal_graph_rowsource_context *con)
     
     rasqal_rowsource_set_origin(con->rowsource, o);
 
-    /* this passes ownership of o to con->var */
-    rasqal_variable_set_value(con->var, o);
+    /* this passes ownership of o to the variable binding */
+    rasqal_evaluation_context_set_value(rowsource->eval_context, con->var, o);
       
     break;
   }
@@ -157,7 +158,7 @@ rasqal_graph_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
    * error). rasqal_graph_rowsource_read_row() will deal with
    * returning NULL for an empty result.
    */
-  rasqal_graph_next_dg(con);
+  rasqal_graph_next_dg(rowsource, con);
 
   return 0;
 }
@@ -172,7 +173,7 @@ rasqal_graph_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->rowsource)
     rasqal_free_rowsource(con->rowsource);
   
-  rasqal_variable_set_value(con->var, NULL);
+  rasqal_evaluation_context_set_value(rowsource->eval_context, con->var, NULL);
 
   RASQAL_FREE(rasqal_graph_rowsource_context, con);
 
@@ -204,6 +205,7 @@ rasqal_graph_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_graph_rowsource_context *con;
   rasqal_row* row = NULL;
+  rasqal_literal* graph_value;
 
   con = (rasqal_graph_rowsource_context*)user_data;
 
@@ -215,7 +217,7 @@ rasqal_graph_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     if(row)
       break;
     
-    if(rasqal_graph_next_dg(con)) {
+    if(rasqal_graph_next_dg(rowsource, con)) {
       con->finished = 1;
       break;
     }
@@ -225,8 +227,17 @@ rasqal_graph_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     }
   }
 
+  graph_value = rasqal_evaluation_context_get_value(rowsource->eval_context,
+                                                    con->var);
+
   /* If a row is returned, put the GRAPH variable value as first literal */
-  if(row) {
+  if(row && row->usage == 1 && !rasqal_row_expand_size(row, 1 + row->size)) {
+    /* input row is ours so shift its values up in place */
+    memmove(&row->values[1], &row->values[0],
+            sizeof(rasqal_literal*) * RASQAL_GOOD_CAST(size_t, row->size - 1));
+    row->values[0] = rasqal_new_literal_from_literal(graph_value);
+    row->rowsource = rowsource;
+  } else if(row) {
     rasqal_row* nrow;
     int i;
     
@@ -239,7 +250,7 @@ rasqal_graph_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
       nrow->offset = row->offset;
       
       /* Put GRAPH variable value (or NULL) first in result row */
-      nrow->values[0] = rasqal_new_literal_from_literal(con->var->value);
+      nrow->values[0] = rasqal_new_literal_from_literal(graph_value);
 
       /* Copy (size-1) remaining variables from input row */
       for(i = 0; i < row->size; i++)
@@ -263,7 +274,7 @@ rasqal_graph_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
   con->dg_offset = -1;
   con->offset = 0;
 
-  rasqal_graph_next_dg(con);
+  rasqal_graph_next_dg(rowsource, con);
   
   return rasqal_rowsource_reset(con->rowsource);
 }
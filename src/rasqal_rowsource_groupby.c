@@ -89,6 +89,9 @@ typedef struct
 
   /* output row offset */
   int offset;
+
+  /* memory of the rows in tree charged to the query execution */
+  size_t memory_size;
 } rasqal_groupby_rowsource_context;
 
 
@@ -194,6 +197,8 @@ rasqal_groupby_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   con->compare_flags = RASQAL_COMPARE_URI;
 
   con->offset = 0;
+
+  rowsource->algorithm = "AVL tree";
   return 0;
 }
 
@@ -210,8 +215,10 @@ rasqal_groupby_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->exprs_seq)
     raptor_free_sequence(con->exprs_seq);
   
-  if(con->tree)
+  if(con->tree) {
     raptor_free_avltree(con->tree);
+    rasqal_rowsource_release_memory(rowsource, con->memory_size);
+  }
   
   if(con->group_iterator)
     raptor_free_avltree_iterator(con->group_iterator);
@@ -276,14 +283,15 @@ rasqal_groupby_rowsource_process(rasqal_rowsource* rowsource,
     if(!row)
       break;
 
-    rasqal_row_bind_variables(row, rowsource->query->vars_table);
+    rasqal_row_bind_variables(row, rowsource->eval_context);
     
     if(con->exprs_seq) {
       raptor_sequence* literal_seq;
       rasqal_groupby_tree_node key;
       rasqal_groupby_tree_node* node;
+      size_t size;
       
-      literal_seq = rasqal_expression_sequence_evaluate(rowsource->query,
+      literal_seq = rasqal_expression_sequence_evaluate(rowsource->eval_context,
                                                         con->exprs_seq,
                                                         /* ignore_errors */ 0,
                                                         /* error_p */ NULL);
@@ -325,6 +333,10 @@ rasqal_groupby_rowsource_process(rasqal_rowsource* rowsource,
       
       row->group_id = node->group_id;
 
+      size = rasqal_row_get_memory_size(row);
+      con->memory_size += size;
+      rasqal_rowsource_charge_memory(rowsource, size);
+
       /* after this, node owns the row */
       raptor_sequence_push(node->rows, row);
 
@@ -375,6 +387,8 @@ rasqal_groupby_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 
         raptor_free_avltree(con->tree);
         con->tree = NULL;
+        rasqal_rowsource_release_memory(rowsource, con->memory_size);
+        con->memory_size = 0;
 
         /* row = NULL is already set */
         break;
@@ -385,7 +399,7 @@ rasqal_groupby_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
                                                    con->group_row_index++);
       if(row) {
         /* Bind the values in the input row to the variables in the table */
-        rasqal_row_bind_variables(row, rowsource->query->vars_table);
+        rasqal_row_bind_variables(row, rowsource->eval_context);
         break;
       }
 
@@ -120,7 +120,9 @@ rasqal_having_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     if(!row)
       break;
 
-    literal_seq  = rasqal_expression_sequence_evaluate(rowsource->query,
+    rasqal_row_bind_variables(row, rowsource->eval_context);
+
+    literal_seq  = rasqal_expression_sequence_evaluate(rowsource->eval_context,
                                                        con->exprs_seq,
                                                        /* ignore_errors */ 0,
                                                        &error);
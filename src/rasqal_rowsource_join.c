@@ -101,14 +101,16 @@ rasqal_join_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   con->state = JS_START;
   con->constant_join_condition = -1;
 
+  rowsource->algorithm = (con->join_type == RASQAL_JOIN_TYPE_LEFT) ?
+    "nested loop left join" : "nested loop join";
+
   /* If join condition is a constant - optimize it away */
   if(con->expr && rasqal_expression_is_constant(con->expr)) {
-    rasqal_query *query = rowsource->query;
     rasqal_literal* result;
     int bresult;
     int error = 0;
     
-    result = rasqal_expression_evaluate2(con->expr, query->eval_context,
+    result = rasqal_expression_evaluate2(con->expr, rowsource->eval_context,
                                          &error);
 
 #ifdef RASQAL_DEBUG
@@ -278,11 +280,19 @@ rasqal_join_rowsource_build_merged_row(rasqal_rowsource* rowsource,
   }
 
   if(right_row) {
+    /* the right row is consumed here so move its values if unshared */
+    int steal = (right_row->usage == 1);
+
     for(i = 0; i < right_row->size; i++) {
       rasqal_literal *l = right_row->values[i];
       int dest_i = con->right_map[i];
-      if(!row->values[dest_i])
-        row->values[dest_i] = rasqal_new_literal_from_literal(l);
+      if(!row->values[dest_i]) {
+        if(steal) {
+          row->values[dest_i] = l;
+          right_row->values[i] = NULL;
+        } else
+          row->values[dest_i] = rasqal_new_literal_from_literal(l);
+      }
     }
 
     rasqal_free_row(right_row);
@@ -306,7 +316,6 @@ rasqal_join_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_join_rowsource_context* con;
   rasqal_row* row = NULL;
-  rasqal_query *query = rowsource->query;
 
   con = (rasqal_join_rowsource_context*)user_data;
 
@@ -318,6 +327,12 @@ rasqal_join_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     int bresult = 1;
     int compatible = 1;
 
+    /* cancelled or past the deadline */
+    if(rasqal_evaluation_context_is_interrupted(rowsource->eval_context)) {
+      con->failed = 1;
+      return NULL;
+    }
+
     if(con->state == JS_START) {
       /* start / re-start left */
       if(con->left_row)
@@ -402,8 +417,13 @@ rasqal_join_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
       /* Check join expression if present */
       rasqal_literal *result;
       int error = 0;
+
+      /* evaluate over the values of both rows */
+      rasqal_row_bind_variables(con->left_row, rowsource->eval_context);
+      if(right_row)
+        rasqal_row_bind_variables(right_row, rowsource->eval_context);
       
-      result = rasqal_expression_evaluate2(con->expr, query->eval_context,
+      result = rasqal_expression_evaluate2(con->expr, rowsource->eval_context,
                                            &error);
 #ifdef RASQAL_DEBUG
       RASQAL_DEBUG1("join expression result: ");
@@ -496,7 +516,7 @@ rasqal_join_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     row->rowsource = rowsource;
     row->offset = con->offset++;
 
-    rasqal_row_bind_variables(row, rowsource->query->vars_table);
+    rasqal_row_bind_variables(row, rowsource->eval_context);
   }
   
   return row;
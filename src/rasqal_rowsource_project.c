@@ -57,6 +57,15 @@ typedef struct
   /* variables projection array: [output row var index]=input row var index */
   int* projection;
 
+  /* non-0 if any projected variable is computed from an expression */
+  int have_expressions;
+
+  /* work array of rowsource size values for projecting rows in place */
+  rasqal_literal** scratch;
+
+  /* batch of input rows for read_batch (or NULL) */
+  rasqal_row_batch* inner_batch;
+
 } rasqal_project_rowsource_context;
 
 
@@ -105,6 +114,16 @@ rasqal_project_rowsource_ensure_variables(rasqal_rowsource* rowsource,
 
     rasqal_rowsource_add_variable(rowsource, v);
     con->projection[i] = offset;
+    if(offset < 0 && v->expression)
+      con->have_expressions = 1;
+  }
+
+  if(rowsource->size > 0) {
+    con->scratch = RASQAL_CALLOC(rasqal_literal**,
+                                 RASQAL_GOOD_CAST(size_t, rowsource->size),
+                                 sizeof(rasqal_literal*));
+    if(!con->scratch)
+      return 1;
   }
 
   return 0;
@@ -126,6 +145,12 @@ rasqal_project_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->projection)
     RASQAL_FREE(int*, con->projection);
   
+  if(con->scratch)
+    RASQAL_FREE(array, con->scratch);
+
+  if(con->inner_batch)
+    rasqal_free_row_batch(con->inner_batch);
+
   RASQAL_FREE(rasqal_project_rowsource_context, con);
 
   return 0;
@@ -144,45 +169,60 @@ rasqal_project_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
   row = rasqal_rowsource_read_row(con->rowsource);
   if(row) {
     int i;
+
+    /* expressions are evaluated over the input row values */
+    if(con->have_expressions)
+      rasqal_row_bind_variables(row, rowsource->eval_context);
     
-    nrow = rasqal_new_row_for_size(rowsource->world, rowsource->size);
-    if(!nrow)
-      goto failed;
+    if(row->usage == 1 && con->scratch &&
+       !rasqal_row_remap_values(row, con->projection, rowsource->size,
+                                con->scratch)) {
+      /* input row is ours so project its values in place */
+      nrow = row;
+      row = NULL;
+      nrow->group_id = -1;
+    } else {
+      nrow = rasqal_new_row_for_size(rowsource->world, rowsource->size);
+      if(!nrow)
+        goto failed;
+      nrow->offset = row->offset;
+    }
 
     nrow->rowsource = rowsource;
-    nrow->offset = row->offset;
       
     for(i = 0; i < rowsource->size; i++) {
       int offset = con->projection[i];
-      if(offset >= 0)
-        nrow->values[i] = rasqal_new_literal_from_literal(row->values[offset]);
-      else {
+      if(offset >= 0) {
+        if(row)
+          nrow->values[i] = rasqal_new_literal_from_literal(row->values[offset]);
+      } else {
         rasqal_variable* v;
-        rasqal_query *query = rowsource->query;
         
         v = (rasqal_variable*)raptor_sequence_get_at(con->projection_variables, i);
         if(v && v->expression) {
+          rasqal_literal* result;
           int error = 0;
 
-          if(v->value)
-            rasqal_free_literal(v->value);
-          
-          v->value = rasqal_expression_evaluate2(v->expression,
-                                                 query->eval_context,
-                                                 &error);
+          result = rasqal_expression_evaluate2(v->expression,
+                                               rowsource->eval_context,
+                                               &error);
           if(error) {
             /* FIXME: Errors are ignored - check this */
 #if 0
             goto failed;
 #endif
           } else
-            nrow->values[i] = rasqal_new_literal_from_literal(v->value);
+            nrow->values[i] = rasqal_new_literal_from_literal(result);
 
+          /* it is OK to bind to NULL */
+          rasqal_evaluation_context_set_value(rowsource->eval_context, v,
+                                              result);
         }
       }
     }
 
-    rasqal_free_row(row);
+    if(row)
+      rasqal_free_row(row);
     row = nrow;
   }
   
@@ -198,6 +238,73 @@ rasqal_project_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 }
 
 
+static int
+rasqal_project_rowsource_read_batch(rasqal_rowsource* rowsource,
+                                    void *user_data,
+                                    rasqal_row_batch* batch)
+{
+  rasqal_project_rowsource_context *con;
+  rasqal_row_batch* inner;
+  int count;
+  int i;
+  
+  con = (rasqal_project_rowsource_context*)user_data;
+
+  if(con->have_expressions) {
+    /* expressions are evaluated against the current variable bindings
+     * so rows must be projected one at a time
+     */
+    while(batch->count < batch->capacity) {
+      rasqal_row* row = rasqal_project_rowsource_read_row(rowsource, user_data);
+      if(!row)
+        break;
+      rasqal_row_batch_add_row(batch, row);
+    }
+    return batch->count;
+  }
+
+  inner = con->inner_batch;
+  if(inner && inner->capacity != batch->capacity) {
+    rasqal_free_row_batch(inner);
+    inner = con->inner_batch = NULL;
+  }
+  if(!inner) {
+    int inner_size = rasqal_rowsource_get_size(con->rowsource);
+    inner = rasqal_new_row_batch(rowsource->world, inner_size, batch->capacity);
+    if(!inner)
+      return -1;
+    con->inner_batch = inner;
+  }
+
+  count = rasqal_rowsource_read_batch(con->rowsource, inner);
+  if(count <= 0)
+    return count;
+
+  /* move whole input columns to their output positions */
+  for(i = 0; i < rowsource->size; i++) {
+    int offset = con->projection[i];
+    if(offset >= 0) {
+      memcpy(RASQAL_ROW_BATCH_COLUMN(batch, i),
+             RASQAL_ROW_BATCH_COLUMN(inner, offset),
+             RASQAL_GOOD_CAST(size_t, count) * sizeof(rasqal_literal*));
+      memset(RASQAL_ROW_BATCH_COLUMN(inner, offset), '\0',
+             RASQAL_GOOD_CAST(size_t, count) * sizeof(rasqal_literal*));
+    }
+  }
+
+  memcpy(batch->offsets, inner->offsets,
+         RASQAL_GOOD_CAST(size_t, count) * sizeof(int));
+  for(i = 0; i < count; i++)
+    batch->group_ids[i] = -1;
+  batch->count = count;
+
+  /* release the values of columns that were not projected */
+  rasqal_row_batch_clear(inner);
+
+  return count;
+}
+
+
 static int
 rasqal_project_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 {
@@ -208,6 +315,18 @@ rasqal_project_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 }
 
 
+static int
+rasqal_project_rowsource_set_limit_hint(rasqal_rowsource* rowsource,
+                                        void *user_data, int limit)
+{
+  rasqal_project_rowsource_context *con;
+  con = (rasqal_project_rowsource_context*)user_data;
+
+  /* one output row per input row */
+  return rasqal_rowsource_set_limit_hint(con->rowsource, limit);
+}
+
+
 static rasqal_rowsource*
 rasqal_project_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
                                              void *user_data, int offset)
@@ -222,7 +341,7 @@ rasqal_project_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 
 
 static const rasqal_rowsource_handler rasqal_project_rowsource_handler = {
-  /* .version =          */ 1,
+  /* .version =          */ 2,
   "project",
   /* .init =             */ rasqal_project_rowsource_init,
   /* .finish =           */ rasqal_project_rowsource_finish,
@@ -233,6 +352,8 @@ static const rasqal_rowsource_handler rasqal_project_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_project_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .read_batch =       */ rasqal_project_rowsource_read_batch,
+  /* .set_limit_hint =   */ rasqal_project_rowsource_set_limit_hint,
 };
 
 
@@ -330,6 +451,7 @@ main(int argc, char *argv[])
   int i;
   raptor_sequence* vars_seq = NULL;
   raptor_sequence* projection_seq = NULL;
+  rasqal_row_batch* batch = NULL;
   
   world = rasqal_new_world(); rasqal_world_open(world);
   
@@ -434,7 +556,51 @@ main(int argc, char *argv[])
   rasqal_rowsource_print_row_sequence(rowsource, seq, DEBUG_FH);
 #endif
 
+  /* read the same rows again as column batches of 1 row */
+  rasqal_rowsource_reset(rowsource);
+  batch = rasqal_new_row_batch(world, expected_size, 1);
+  if(!batch) {
+    fprintf(stderr, "%s: failed to create row batch\n", program);
+    failures++;
+    goto tidy;
+  }
+  count = 0;
+  while(rasqal_rowsource_read_batch(rowsource, batch) > 0) {
+    rasqal_row* row = (rasqal_row*)raptor_sequence_get_at(seq, count);
+
+    for(i = 0; i < expected_size; i++) {
+      rasqal_literal* value = RASQAL_ROW_BATCH_COLUMN(batch, i)[0];
+      if(!row || !value ||
+         rasqal_literal_compare(value, row->values[i], 0, NULL)) {
+        fprintf(stderr,
+                "%s: read_batch row #%d column #%d differs from read_rows\n",
+                program, count, i);
+        failures++;
+        goto tidy;
+      }
+    }
+    count++;
+  }
+  if(count != expected_count) {
+    fprintf(stderr,
+            "%s: read_batch returned %d rows for a project rowsource, expected %d\n",
+            program, count, expected_count);
+    failures++;
+    goto tidy;
+  }
+
+  /* explain statistics count the rows of both reads */
+  if(rowsource->rows_out != 2 * expected_count) {
+    fprintf(stderr,
+            "%s: project rowsource counted %d rows out, expected %d\n",
+            program, rowsource->rows_out, 2 * expected_count);
+    failures++;
+    goto tidy;
+  }
+
   tidy:
+  if(batch)
+    rasqal_free_row_batch(batch);
   if(seq)
     raptor_free_sequence(seq);
   if(projection_seq)
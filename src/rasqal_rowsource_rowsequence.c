@@ -175,6 +175,36 @@ rasqal_rowsequence_rowsource_read_all_rows(rasqal_rowsource* rowsource,
 }
 
 
+static int
+rasqal_rowsequence_rowsource_read_batch(rasqal_rowsource* rowsource,
+                                        void *user_data,
+                                        rasqal_row_batch* batch)
+{
+  rasqal_rowsequence_rowsource_context* con;
+  
+  con = (rasqal_rowsequence_rowsource_context*)user_data;
+  if(con->failed || con->offset < 0)
+    return 0;
+
+  while(batch->count < batch->capacity) {
+    rasqal_row* row;
+
+    row = (rasqal_row*)raptor_sequence_get_at(con->seq, con->offset);
+    if(!row) {
+      /* finished */
+      con->offset = -1;
+      break;
+    }
+
+    /* row is shared with the sequence so the values are copied */
+    rasqal_row_batch_add_row(batch, rasqal_new_row_from_row(row));
+    con->offset++;
+  }
+
+  return batch->count;
+}
+
+
 static int
 rasqal_rowsequence_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 {
@@ -189,7 +219,7 @@ rasqal_rowsequence_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 
 
 static const rasqal_rowsource_handler rasqal_rowsequence_rowsource_handler = {
-  /* .version = */ 1,
+  /* .version = */ 2,
   "rowsequence",
   /* .init = */ rasqal_rowsequence_rowsource_init,
   /* .finish = */ rasqal_rowsequence_rowsource_finish,
@@ -200,6 +230,7 @@ static const rasqal_rowsource_handler rasqal_rowsequence_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
   /* .set_origin = */ NULL,
+  /* .read_batch = */ rasqal_rowsequence_rowsource_read_batch,
 };
 
 
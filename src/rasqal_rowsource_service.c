@@ -219,6 +219,668 @@ rasqal_new_service_rowsource(rasqal_world *world, rasqal_query* query,
 }
 
 
+
+static int
+rasqal_rowsource_visitor_find_services(rasqal_rowsource* rowsource,
+                                       void *user_data)
+{
+  raptor_sequence* services = (raptor_sequence*)user_data;
+
+  if(rowsource->handler == &rasqal_service_rowsource_handler) {
+    rasqal_service_rowsource_context* con;
+
+    con = (rasqal_service_rowsource_context*)rowsource->user_data;
+    /* not yet read */
+    if(con->svc && !con->rowsource)
+      raptor_sequence_push(services, con->svc);
+
+    return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_rowsource_start_services:
+ * @rowsource: query execution rowsource
+ * @max_requests: maximum number of requests in flight to one endpoint
+ *
+ * INTERNAL - Start the SERVICE requests of a rowsource tree concurrently
+ *
+ * Only done when there are several SERVICE rowsources; a single one
+ * is streamed when it is read.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_rowsource_start_services(rasqal_rowsource* rowsource, int max_requests)
+{
+  raptor_sequence* services;
+  int rc = 0;
+
+  /* sequence of shared #rasqal_service */
+  services = raptor_new_sequence(NULL, NULL);
+  if(!services)
+    return 1;
+
+  rasqal_rowsource_visit(rowsource, rasqal_rowsource_visitor_find_services,
+                         services);
+
+  if(raptor_sequence_size(services) > 1)
+    rc = rasqal_service_start_services(services, max_requests);
+
+  raptor_free_sequence(services);
+
+  return rc;
+}
+
+
+
+/*
+ * SERVICE bind join
+ *
+ * Joins a local rowsource with a SERVICE pattern by reading the local
+ * rows a batch at a time and sending the distinct values of the join
+ * variables in each batch to the endpoint as a VALUES block appended
+ * to the SERVICE query.  Each batch response is joined locally with
+ * its batch rows so the join expression and left join semantics are
+ * those of the nested loop join.
+ */
+
+typedef struct 
+{
+  rasqal_query* query;
+
+  /* local (left) rowsource */
+  rasqal_rowsource* left;
+
+  /* service to run with VALUES appended to its query string */
+  raptor_uri* service_uri;
+  const unsigned char* query_string;
+  raptor_sequence* data_graphs;
+
+  /* variables the SERVICE pattern may bind (shared) */
+  raptor_sequence* service_vars;
+
+  /* offsets into the left rows of the variables sent as VALUES */
+  int* join_offsets;
+  int join_offsets_count;
+
+  rasqal_join_type join_type;
+  rasqal_expression* expr;
+
+  /* bit flags; currently using RASQAL_ENGINE_BITFLAG_SILENT */
+  unsigned int flags;
+
+  /* maximum number of left rows per request */
+  int batch_size;
+
+  /* join of the current batch rows with its service response */
+  rasqal_rowsource* batch_rowsource;
+
+  /* array to map batch join variables into output rows */
+  int* batch_map;
+
+  int left_finished;
+
+  int failed;
+
+  /* row offset for read_row() */
+  int offset;
+} rasqal_bindjoin_rowsource_context;
+
+
+static int
+rasqal_bindjoin_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
+{
+  rowsource->algorithm = "bind join";
+
+  return 0;
+}
+
+
+static int
+rasqal_bindjoin_rowsource_free_batch(rasqal_bindjoin_rowsource_context* con)
+{
+  if(con->batch_rowsource) {
+    rasqal_free_rowsource(con->batch_rowsource);
+    con->batch_rowsource = NULL;
+  }
+
+  if(con->batch_map) {
+    RASQAL_FREE(int, con->batch_map);
+    con->batch_map = NULL;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_bindjoin_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
+{
+  rasqal_bindjoin_rowsource_context* con;
+
+  con = (rasqal_bindjoin_rowsource_context*)user_data;
+
+  rasqal_bindjoin_rowsource_free_batch(con);
+
+  if(con->left)
+    rasqal_free_rowsource(con->left);
+
+  if(con->service_uri)
+    raptor_free_uri(con->service_uri);
+
+  if(con->query_string)
+    RASQAL_FREE(cstring, con->query_string);
+
+  if(con->data_graphs)
+    raptor_free_sequence(con->data_graphs);
+
+  if(con->join_offsets)
+    RASQAL_FREE(int, con->join_offsets);
+
+  if(con->expr)
+    rasqal_free_expression(con->expr);
+
+  RASQAL_FREE(rasqal_bindjoin_rowsource_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_bindjoin_rowsource_ensure_variables(rasqal_rowsource* rowsource,
+                                           void *user_data)
+{
+  rasqal_bindjoin_rowsource_context* con;
+  int size;
+  int i;
+
+  con = (rasqal_bindjoin_rowsource_context*)user_data;
+
+  if(rasqal_rowsource_ensure_variables(con->left))
+    return 1;
+
+  rowsource->size = 0;
+
+  /* copy in variables from left rowsource */
+  if(rasqal_rowsource_copy_variables(rowsource, con->left))
+    return 1;
+
+  size = raptor_sequence_size(con->service_vars);
+  con->join_offsets = RASQAL_CALLOC(int*, RASQAL_GOOD_CAST(size_t, size + 1),
+                                    sizeof(int));
+  if(!con->join_offsets)
+    return 1;
+
+  /* add the service variables and note those shared with the left */
+  for(i = 0; i < size; i++) {
+    rasqal_variable* v;
+    int offset;
+
+    v = (rasqal_variable*)raptor_sequence_get_at(con->service_vars, i);
+
+    offset = rasqal_rowsource_get_variable_offset_by_name(con->left, v->name);
+    if(offset >= 0)
+      con->join_offsets[con->join_offsets_count++] = offset;
+
+    if(rasqal_rowsource_add_variable(rowsource, v) < 0)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_bindjoin_rowsource_new_values_query:
+ * @con: bind join context
+ * @rows_seq: sequence of left #rasqal_row in the batch
+ *
+ * INTERNAL - Build the SERVICE query string for a batch of left rows
+ *
+ * Unbound and blank node values are sent as UNDEF since a blank node
+ * cannot match a remote term; duplicate value rows are sent once.
+ *
+ * Return value: new query string or NULL on failure
+ */
+static unsigned char*
+rasqal_bindjoin_rowsource_new_values_query(rasqal_bindjoin_rowsource_context* con,
+                                           raptor_sequence* rows_seq)
+{
+  rasqal_query* query = con->query;
+  raptor_sequence* vars_seq = NULL;
+  raptor_sequence* values_seq = NULL;
+  rasqal_bindings* bindings = NULL;
+  raptor_iostream* iostr = NULL;
+  unsigned char* string = NULL;
+  int count;
+  int i;
+
+  vars_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                 (raptor_data_print_handler)rasqal_variable_print);
+  values_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                   (raptor_data_print_handler)rasqal_row_print);
+  if(!vars_seq || !values_seq)
+    goto tidy;
+
+  for(i = 0; i < con->join_offsets_count; i++) {
+    rasqal_variable* v;
+
+    v = rasqal_rowsource_get_variable_by_offset(con->left,
+                                                con->join_offsets[i]);
+    if(raptor_sequence_push(vars_seq, rasqal_new_variable_from_variable(v)))
+      goto tidy;
+  }
+
+  count = raptor_sequence_size(rows_seq);
+  for(i = 0; i < count; i++) {
+    rasqal_row* left_row = (rasqal_row*)raptor_sequence_get_at(rows_seq, i);
+    rasqal_row* values_row;
+    int values_count;
+    int j;
+
+    values_row = rasqal_new_row_for_size(query->world,
+                                         con->join_offsets_count);
+    if(!values_row)
+      goto tidy;
+
+    for(j = 0; j < con->join_offsets_count; j++) {
+      rasqal_literal* l = left_row->values[con->join_offsets[j]];
+
+      if(l && l->type != RASQAL_LITERAL_BLANK)
+        rasqal_row_set_value_at(values_row, j, l);
+    }
+
+    /* skip rows already being sent */
+    values_count = raptor_sequence_size(values_seq);
+    for(j = 0; j < values_count; j++) {
+      rasqal_row* seen_row;
+      int k;
+
+      seen_row = (rasqal_row*)raptor_sequence_get_at(values_seq, j);
+      for(k = 0; k < con->join_offsets_count; k++) {
+        rasqal_literal* l1 = seen_row->values[k];
+        rasqal_literal* l2 = values_row->values[k];
+
+        if(l1 != l2 && (!l1 || !l2 || !rasqal_literal_same_term(l1, l2)))
+          break;
+      }
+
+      if(k == con->join_offsets_count)
+        break;
+    }
+
+    if(j < values_count) {
+      rasqal_free_row(values_row);
+      continue;
+    }
+
+    if(raptor_sequence_push(values_seq, values_row))
+      goto tidy;
+  }
+
+  bindings = rasqal_new_bindings(query, vars_seq, values_seq);
+  if(!bindings)
+    goto tidy;
+  vars_seq = NULL;
+  values_seq = NULL;
+
+  iostr = raptor_new_iostream_to_string(query->world->raptor_world_ptr,
+                                        (void**)&string, NULL,
+                                        rasqal_alloc_memory);
+  if(!iostr)
+    goto tidy;
+
+  raptor_iostream_string_write(con->query_string, iostr);
+  raptor_iostream_write_byte('\n', iostr);
+  rasqal_query_write_sparql_20060406_values(bindings, iostr);
+  /* string is set when the iostream is freed */
+  raptor_free_iostream(iostr);
+
+  RASQAL_DEBUG2("bind join query string is '%s'", string);
+
+  tidy:
+  if(bindings)
+    rasqal_free_bindings(bindings);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(values_seq)
+    raptor_free_sequence(values_seq);
+
+  return string;
+}
+
+
+/*
+ * rasqal_bindjoin_rowsource_start_batch:
+ * @rowsource: bind join rowsource
+ * @con: bind join context
+ *
+ * INTERNAL - Read the next batch of left rows and start its service request
+ *
+ * Return value: non-0 on failure or when the left rowsource is finished
+ */
+static int
+rasqal_bindjoin_rowsource_start_batch(rasqal_rowsource* rowsource,
+                                      rasqal_bindjoin_rowsource_context* con)
+{
+  rasqal_query* query = con->query;
+  raptor_sequence* rows_seq = NULL;
+  raptor_sequence* vars_seq = NULL;
+  rasqal_rowsource* left_rs = NULL;
+  rasqal_rowsource* service_rs = NULL;
+  rasqal_service* svc = NULL;
+  unsigned char* string = NULL;
+  const unsigned char* service_query_string;
+  int map_size;
+  int i;
+
+  rows_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                 (raptor_data_print_handler)rasqal_row_print);
+  if(!rows_seq)
+    goto failed;
+
+  /* With no shared variables a VALUES block cannot narrow the
+   * request so all the left rows are joined with a single request.
+   */
+  while(!con->join_offsets_count ||
+        raptor_sequence_size(rows_seq) < con->batch_size) {
+    rasqal_row* row = rasqal_rowsource_read_row(con->left);
+
+    if(!row) {
+      con->left_finished = 1;
+      break;
+    }
+
+    if(raptor_sequence_push(rows_seq, row))
+      goto failed;
+  }
+
+  if(!raptor_sequence_size(rows_seq)) {
+    raptor_free_sequence(rows_seq);
+    return 1;
+  }
+
+  if(con->join_offsets_count) {
+    string = rasqal_bindjoin_rowsource_new_values_query(con, rows_seq);
+    if(!string)
+      goto failed;
+    service_query_string = string;
+  } else
+    service_query_string = con->query_string;
+
+  svc = rasqal_new_service(query->world, con->service_uri,
+                           service_query_string, con->data_graphs);
+  if(string) {
+    RASQAL_FREE(char*, string);
+    string = NULL;
+  }
+
+  if(svc) {
+    service_rs = rasqal_service_execute_as_rowsource(svc, query->vars_table);
+    rasqal_free_service(svc);
+  }
+
+  if(!service_rs) {
+    if(!(con->flags & RASQAL_ENGINE_BITFLAG_SILENT))
+      goto failed;
+
+    /* Silent errors give an empty service response */
+    service_rs = rasqal_new_empty_rowsource(query->world, query);
+    if(!service_rs)
+      goto failed;
+  }
+
+  vars_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                 (raptor_data_print_handler)rasqal_variable_print);
+  if(!vars_seq)
+    goto failed;
+
+  for(i = 0; i < con->left->size; i++) {
+    rasqal_variable* v = rasqal_rowsource_get_variable_by_offset(con->left, i);
+    if(raptor_sequence_push(vars_seq, rasqal_new_variable_from_variable(v)))
+      goto failed;
+  }
+
+  /* rows_seq and vars_seq become owned by left_rs */
+  left_rs = rasqal_new_rowsequence_rowsource(query->world, query,
+                                            query->vars_table,
+                                            rows_seq, vars_seq);
+  rows_seq = NULL;
+  vars_seq = NULL;
+  if(!left_rs)
+    goto failed;
+
+  /* left_rs and service_rs become owned by the join */
+  con->batch_rowsource = rasqal_new_join_rowsource(query->world, query,
+                                                   left_rs, service_rs,
+                                                   con->join_type, con->expr);
+  left_rs = NULL;
+  service_rs = NULL;
+  if(!con->batch_rowsource)
+    goto failed;
+
+  rasqal_rowsource_set_evaluation_context(con->batch_rowsource,
+                                          rowsource->eval_context);
+
+  if(rasqal_rowsource_ensure_variables(con->batch_rowsource))
+    goto failed;
+
+  map_size = rasqal_rowsource_get_size(con->batch_rowsource);
+  con->batch_map = RASQAL_MALLOC(int*, sizeof(int) * RASQAL_GOOD_CAST(size_t, map_size + 1));
+  if(!con->batch_map)
+    goto failed;
+
+  /* map by name as each response may order its variables differently */
+  for(i = 0; i < map_size; i++) {
+    rasqal_variable* v;
+
+    v = rasqal_rowsource_get_variable_by_offset(con->batch_rowsource, i);
+    con->batch_map[i] = v ?
+      rasqal_rowsource_get_variable_offset_by_name(rowsource, v->name) : -1;
+  }
+
+  return 0;
+
+  failed:
+  con->failed = 1;
+  if(rows_seq)
+    raptor_free_sequence(rows_seq);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(service_rs)
+    rasqal_free_rowsource(service_rs);
+  rasqal_bindjoin_rowsource_free_batch(con);
+
+  return 1;
+}
+
+
+static rasqal_row*
+rasqal_bindjoin_rowsource_read_row(rasqal_rowsource* rowsource,
+                                   void *user_data)
+{
+  rasqal_bindjoin_rowsource_context* con;
+  rasqal_row* batch_row = NULL;
+  rasqal_row* row;
+  int i;
+
+  con = (rasqal_bindjoin_rowsource_context*)user_data;
+
+  while(!con->failed) {
+    if(con->batch_rowsource) {
+      batch_row = rasqal_rowsource_read_row(con->batch_rowsource);
+      if(batch_row)
+        break;
+
+      rasqal_bindjoin_rowsource_free_batch(con);
+    }
+
+    if(con->left_finished ||
+       rasqal_bindjoin_rowsource_start_batch(rowsource, con))
+      return NULL;
+  }
+
+  if(!batch_row)
+    return NULL;
+
+  row = rasqal_new_row_for_size(rowsource->world, rowsource->size);
+  if(!row) {
+    rasqal_free_row(batch_row);
+    con->failed = 1;
+    return NULL;
+  }
+
+  for(i = 0; i < batch_row->size; i++) {
+    int dest_i = con->batch_map[i];
+
+    if(dest_i >= 0 && !row->values[dest_i])
+      row->values[dest_i] = rasqal_new_literal_from_literal(batch_row->values[i]);
+  }
+  rasqal_free_row(batch_row);
+
+  row->rowsource = rowsource;
+  row->offset = con->offset++;
+
+  rasqal_row_bind_variables(row, rowsource->eval_context);
+
+  return row;
+}
+
+
+static rasqal_rowsource*
+rasqal_bindjoin_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
+                                              void *user_data, int offset)
+{
+  rasqal_bindjoin_rowsource_context *con;
+  con = (rasqal_bindjoin_rowsource_context*)user_data;
+
+  if(offset == 0)
+    return con->left;
+  return NULL;
+}
+
+
+static const rasqal_rowsource_handler rasqal_bindjoin_rowsource_handler = {
+  /* .version = */ 1,
+  "bind join",
+  /* .init = */ rasqal_bindjoin_rowsource_init,
+  /* .finish = */ rasqal_bindjoin_rowsource_finish,
+  /* .ensure_variables = */ rasqal_bindjoin_rowsource_ensure_variables,
+  /* .read_row = */ rasqal_bindjoin_rowsource_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ NULL,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ rasqal_bindjoin_rowsource_get_inner_rowsource,
+  /* .set_origin = */ NULL,
+};
+
+
+/**
+ * rasqal_new_service_bindjoin_rowsource:
+ * @world: world object
+ * @query: query object
+ * @left: input left (local) rowsource
+ * @service_uri: service URI
+ * @query_string: SERVICE pattern query to send to service
+ * @data_graphs: sequence of data graphs (or NULL)
+ * @service_vars: sequence of #rasqal_variable the SERVICE pattern may bind
+ * @rs_flags: service rowsource flags
+ * @join_type: join type - natural or left
+ * @expr: join expression to filter result rows (or NULL)
+ * @batch_size: maximum number of left rows per service request
+ *
+ * INTERNAL - create a new rowsource joining @left with a SERVICE pattern
+ *
+ * The @left rowsource becomes owned by the new rowsource.  The other
+ * arguments are copied except @service_vars which is shared and must
+ * outlive the rowsource.
+ *
+ * Return value: new rowsource or NULL on failure
+ */
+rasqal_rowsource*
+rasqal_new_service_bindjoin_rowsource(rasqal_world *world,
+                                      rasqal_query* query,
+                                      rasqal_rowsource* left,
+                                      raptor_uri* service_uri,
+                                      const unsigned char* query_string,
+                                      raptor_sequence* data_graphs,
+                                      raptor_sequence* service_vars,
+                                      unsigned int rs_flags,
+                                      rasqal_join_type join_type,
+                                      rasqal_expression* expr,
+                                      int batch_size)
+{
+  rasqal_bindjoin_rowsource_context* con = NULL;
+  size_t len;
+  int flags = 0;
+
+  if(!world || !query || !left || !service_uri || !query_string ||
+     !service_vars || batch_size <= 0)
+    goto fail;
+
+  if(join_type != RASQAL_JOIN_TYPE_NATURAL &&
+     join_type != RASQAL_JOIN_TYPE_LEFT)
+    goto fail;
+
+  con = RASQAL_CALLOC(rasqal_bindjoin_rowsource_context*, 1, sizeof(*con));
+  if(!con)
+    goto fail;
+
+  con->query = query;
+  con->left = left;
+  con->service_uri = raptor_uri_copy(service_uri);
+
+  len = strlen(RASQAL_GOOD_CAST(const char*, query_string));
+  con->query_string = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!con->query_string) {
+    rasqal_bindjoin_rowsource_finish(NULL, con);
+    return NULL;
+  }
+  memcpy(RASQAL_GOOD_CAST(char*, con->query_string), query_string, len + 1);
+
+  if(data_graphs) {
+    rasqal_data_graph* dg;
+    int i;
+
+    con->data_graphs = raptor_new_sequence((raptor_data_free_handler)rasqal_free_data_graph,
+                                           NULL);
+    if(!con->data_graphs) {
+      rasqal_bindjoin_rowsource_finish(NULL, con);
+      return NULL;
+    }
+
+    for(i = 0;
+        (dg = (rasqal_data_graph*)raptor_sequence_get_at(data_graphs, i));
+        i++) {
+      raptor_sequence_push(con->data_graphs,
+                           rasqal_new_data_graph_from_data_graph(dg));
+    }
+  }
+
+  con->service_vars = service_vars;
+  con->flags = rs_flags;
+  con->join_type = join_type;
+  con->expr = rasqal_new_expression_from_expression(expr);
+  con->batch_size = batch_size;
+
+  return rasqal_new_rowsource_from_handler(world, query,
+                                           con,
+                                           &rasqal_bindjoin_rowsource_handler,
+                                           query->vars_table,
+                                           flags);
+
+  fail:
+  if(left)
+    rasqal_free_rowsource(left);
+
+  return NULL;
+}
+
+
 #endif /* not STANDALONE */
 
 
@@ -44,6 +44,8 @@
 #define DEBUG_FH stderr
 
 
+#ifndef STANDALONE
+
 typedef struct 
 {
   /* inner rowsource to slice */
@@ -89,6 +91,12 @@ rasqal_slice_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
   con->input_offset = 1;
   con->output_offset = 1;
 
+  /* at most offset + limit input rows are needed */
+  if(con->row_limit >= 0)
+    rasqal_rowsource_set_limit_hint(con->rowsource,
+                                    (con->row_offset > 0 ? con->row_offset : 0) +
+                                    con->row_limit);
+
   return 0;
 }
 
@@ -120,25 +128,27 @@ rasqal_slice_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
   while(1) {
     int check;
 
+    check = rasqal_query_check_limit_offset_core(con->input_offset,
+                                                 con->row_limit, con->row_offset);
+
+    /* finished if beyond result range; do not read another input row
+     * since finding it may need as much work as all the rows so far */
+    if(check > 0) {
+      RASQAL_DEBUG3("slice rowsource %p reached end of range at row #%d\n",
+                    rowsource, con->input_offset);
+      break;
+    }
+
     row = rasqal_rowsource_read_row(con->rowsource);
     if(!row)
       break;
 
-    check = rasqal_query_check_limit_offset_core(con->input_offset,
-                                                 con->row_limit, con->row_offset);
-
     RASQAL_DEBUG4("slice rowsource %p found row #%d %s\n",
                   rowsource, con->input_offset,
-                  (check > 0) ? "beyond range" : (!check ? "in range" : "before range"));
+                  !check ? "in range" : "before range");
 
     con->input_offset++;
 
-    /* finished if beyond result range */
-    if(check > 0) {
-      rasqal_free_row(row); row = NULL;
-      break;
-    }
-
     /* in range, return row */
     if(!check)
       break;
@@ -168,6 +178,26 @@ rasqal_slice_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 }
 
 
+static int
+rasqal_slice_rowsource_set_limit_hint(rasqal_rowsource* rowsource,
+                                      void *user_data, int limit)
+{
+  rasqal_slice_rowsource_context *con;
+  int offset;
+
+  con = (rasqal_slice_rowsource_context*)user_data;
+
+  if(con->row_limit >= 0 && (limit < 0 || con->row_limit < limit))
+    limit = con->row_limit;
+
+  if(limit < 0)
+    return rasqal_rowsource_set_limit_hint(con->rowsource, -1);
+
+  offset = (con->row_offset > 0) ? con->row_offset : 0;
+  return rasqal_rowsource_set_limit_hint(con->rowsource, offset + limit);
+}
+
+
 static rasqal_rowsource*
 rasqal_slice_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
                                             void *user_data, int offset)
@@ -183,7 +213,7 @@ rasqal_slice_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
 
 
 static const rasqal_rowsource_handler rasqal_slice_rowsource_handler = {
-  /* .version =          */ 1,
+  /* .version =          */ 2,
   "slice",
   /* .init =             */ rasqal_slice_rowsource_init,
   /* .finish =           */ rasqal_slice_rowsource_finish,
@@ -194,6 +224,8 @@ static const rasqal_rowsource_handler rasqal_slice_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_slice_rowsource_get_inner_rowsource,
   /* .set_origin =       */ NULL,
+  /* .read_batch =       */ NULL,
+  /* .set_limit_hint =   */ rasqal_slice_rowsource_set_limit_hint,
 };
 
 
@@ -243,3 +275,169 @@ rasqal_new_slice_rowsource(rasqal_world *world,
     rasqal_free_rowsource(rowsource);
   return NULL;
 }
+
+#endif /* not STANDALONE */
+
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+const char* const slice_1_data_1x10_rows[] =
+{
+  /* 1 variable name and 10 rows */
+  "x",  NULL,
+  "1",  NULL,
+  "2",  NULL,
+  "3",  NULL,
+  "4",  NULL,
+  "5",  NULL,
+  "6",  NULL,
+  "7",  NULL,
+  "8",  NULL,
+  "9",  NULL,
+  "10", NULL,
+  /* end of data */
+  NULL, NULL
+};
+
+#define SLICE_LIMIT 2
+#define SLICE_OFFSET 3
+/* input rows needed to return OFFSET 3 LIMIT 2 */
+#define EXPECTED_INPUT_ROWS_COUNT (SLICE_OFFSET + SLICE_LIMIT)
+
+
+int
+main(int argc, char *argv[]) 
+{
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_rowsource *rowsource = NULL;
+  rasqal_rowsource *input_rs = NULL;
+  rasqal_rowsource *inner_rs;
+  rasqal_world* world = NULL;
+  rasqal_query* query = NULL;
+  raptor_sequence* seq = NULL;
+  raptor_sequence* vars_seq = NULL;
+  rasqal_row_batch* batch = NULL;
+  rasqal_row* row;
+  int failures = 0;
+  int count;
+  
+  world = rasqal_new_world(); rasqal_world_open(world);
+  
+  query = rasqal_new_query(world, "sparql", NULL);
+  
+  seq = rasqal_new_row_sequence(world, query->vars_table,
+                                slice_1_data_1x10_rows, 1, &vars_seq);
+  if(!seq) {
+    fprintf(stderr, "%s: failed to create sequence of rows\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  input_rs = rasqal_new_rowsequence_rowsource(world, query, query->vars_table,
+                                              seq, vars_seq);
+  if(!input_rs) {
+    fprintf(stderr, "%s: failed to create input rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+  /* vars_seq and seq are now owned by input_rs */
+  vars_seq = seq = NULL;
+
+  /* input_rs is owned by rowsource from here on but kept for checks */
+  inner_rs = input_rs;
+  rowsource = rasqal_new_slice_rowsource(world, query, input_rs,
+                                         SLICE_LIMIT, SLICE_OFFSET);
+  input_rs = NULL;
+  if(!rowsource) {
+    fprintf(stderr, "%s: failed to create slice rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  /* all rows of the slice */
+  seq = rasqal_rowsource_read_all_rows(rowsource);
+  if(!seq || raptor_sequence_size(seq) != SLICE_LIMIT) {
+    fprintf(stderr, "%s: slice returned %d rows, expected %d\n", program,
+            seq ? raptor_sequence_size(seq) : -1, SLICE_LIMIT);
+    failures++;
+    goto tidy;
+  }
+  row = (rasqal_row*)raptor_sequence_get_at(seq, 0);
+  if(!row->values[0] ||
+     strcmp(RASQAL_GOOD_CAST(const char*, row->values[0]->string), "4")) {
+    fprintf(stderr, "%s: slice first row is %s, expected 4\n", program,
+            row->values[0] ? RASQAL_GOOD_CAST(const char*, row->values[0]->string) : "unbound");
+    failures++;
+    goto tidy;
+  }
+  raptor_free_sequence(seq);
+  seq = NULL;
+
+  if(rasqal_rowsource_get_rows_count(inner_rs) != EXPECTED_INPUT_ROWS_COUNT) {
+    fprintf(stderr,
+            "%s: slice read %d input rows, expected %d\n", program,
+            rasqal_rowsource_get_rows_count(inner_rs),
+            EXPECTED_INPUT_ROWS_COUNT);
+    failures++;
+    goto tidy;
+  }
+
+  /* the eager reads of the input stop at the limit hint too */
+  rasqal_rowsource_reset(rowsource);
+  seq = rasqal_rowsource_read_all_rows(inner_rs);
+  count = seq ? raptor_sequence_size(seq) : -1;
+  if(count != EXPECTED_INPUT_ROWS_COUNT) {
+    fprintf(stderr, "%s: input read_all_rows returned %d rows, expected %d\n",
+            program, count, EXPECTED_INPUT_ROWS_COUNT);
+    failures++;
+    goto tidy;
+  }
+  raptor_free_sequence(seq);
+  seq = NULL;
+
+  rasqal_rowsource_reset(rowsource);
+  batch = rasqal_new_row_batch(world, rasqal_rowsource_get_size(inner_rs), 0);
+  if(!batch) {
+    fprintf(stderr, "%s: failed to create row batch\n", program);
+    failures++;
+    goto tidy;
+  }
+  count = 0;
+  while(1) {
+    int batch_count = rasqal_rowsource_read_batch(inner_rs, batch);
+    if(batch_count <= 0)
+      break;
+    count += batch_count;
+  }
+  if(count != EXPECTED_INPUT_ROWS_COUNT) {
+    fprintf(stderr, "%s: input read_batch returned %d rows, expected %d\n",
+            program, count, EXPECTED_INPUT_ROWS_COUNT);
+    failures++;
+    goto tidy;
+  }
+
+  tidy:
+  if(batch)
+    rasqal_free_row_batch(batch);
+  if(seq)
+    raptor_free_sequence(seq);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(input_rs)
+    rasqal_free_rowsource(input_rs);
+  if(rowsource)
+    rasqal_free_rowsource(rowsource);
+  if(query)
+    rasqal_free_query(query);
+  if(world)
+    rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
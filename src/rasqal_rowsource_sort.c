@@ -63,6 +63,9 @@ typedef struct
 
   /* sequence of rows (owned here) */
   raptor_sequence* seq;
+
+  /* memory of the rows held here charged to the query execution */
+  size_t memory_size;
 } rasqal_sort_rowsource_context;
 
 
@@ -104,7 +107,13 @@ static int
 rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
                               rasqal_sort_rowsource_context* con)
 {
+  rasqal_query* query = rowsource->query;
   int offset = 0;
+  /* rows collected to try sorting on the task pool (else NULL) */
+  rasqal_row** rows = NULL;
+  int rows_size = 0;
+  int collect;
+  int i;
 
   /* already processed */
   if(con->seq)
@@ -114,9 +123,13 @@ rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
                                  (raptor_data_print_handler)rasqal_row_print);
   if(!con->seq)
     return 1;
+
+  /* DISTINCT needs the map to find duplicates */
+  collect = (!con->distinct && rasqal_query_get_parallelism(query) > 1);
   
   while(1) {
     rasqal_row* row;
+    size_t size;
 
     row = rasqal_rowsource_read_row(con->rowsource);
     if(!row)
@@ -124,16 +137,77 @@ rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
 
     if(rasqal_row_set_order_size(row, con->order_size)) {
       rasqal_free_row(row);
-      return 1;
+      goto failed;
     }
 
-    rasqal_engine_rowsort_calculate_order_values(rowsource->query, con->order_seq, row);
+    rasqal_engine_rowsort_calculate_order_values(rowsource->eval_context, con->order_seq, row);
 
     row->offset = offset;
 
+    size = rasqal_row_get_memory_size(row);
+    con->memory_size += size;
+    rasqal_rowsource_charge_memory(rowsource, size);
+
+    if(collect) {
+      if(offset == rows_size) {
+        rasqal_row** new_rows;
+        int new_size = rows_size ? rows_size * 2 : 64;
+
+        new_rows = RASQAL_MALLOC(rasqal_row**,
+                                 RASQAL_GOOD_CAST(size_t, new_size) * sizeof(rasqal_row*));
+        if(!new_rows) {
+          rasqal_free_row(row);
+          goto failed;
+        }
+        if(rows) {
+          memcpy(new_rows, rows,
+                 RASQAL_GOOD_CAST(size_t, offset) * sizeof(rasqal_row*));
+          RASQAL_FREE(rasqal_row**, rows);
+        }
+        rows = new_rows;
+        rows_size = new_size;
+      }
+      rows[offset++] = row;
+      continue;
+    }
+
     /* after this, row is owned by map */
     if(!rasqal_engine_rowsort_map_add_row(con->map, row))
       offset++;
+    else {
+      /* duplicate was freed */
+      con->memory_size -= size;
+      rasqal_rowsource_release_memory(rowsource, size);
+    }
+  }
+
+  /* do not sort the rows read before a cancel or timeout */
+  if(rasqal_evaluation_context_is_interrupted(rowsource->eval_context))
+    goto failed;
+
+  if(rows) {
+    if(!rasqal_engine_rowsort_sort_rows(query, rows, offset,
+                                        query->compare_flags, con->order_seq)) {
+      /* sorted: rows become owned by seq */
+      for(i = 0; i < offset; i++) {
+        if(raptor_sequence_push(con->seq, rows[i])) {
+          /* the failed row was freed by the push */
+          for(i++; i < offset; i++)
+            rasqal_free_row(rows[i]);
+          RASQAL_FREE(rasqal_row**, rows);
+          return 1;
+        }
+      }
+      RASQAL_FREE(rasqal_row**, rows);
+      rasqal_free_map(con->map); con->map = NULL;
+      rowsource->algorithm = "parallel merge sort";
+      return 0;
+    }
+
+    /* too few rows or values that need promotion; sort with the map */
+    for(i = 0; i < offset; i++)
+      rasqal_engine_rowsort_map_add_row(con->map, rows[i]);
+    RASQAL_FREE(rasqal_row**, rows);
   }
   
 #ifdef RASQAL_DEBUG
@@ -146,9 +220,18 @@ rasqal_sort_rowsource_process(rasqal_rowsource* rowsource,
   
   /* do sort/distinct: walk map in order, adding rows to sequence */
   rasqal_engine_rowsort_map_to_sequence(con->map, con->seq);
+  rowsource->algorithm = "ordered map";
   rasqal_free_map(con->map); con->map = NULL;
 
   return 0;
+
+  failed:
+  if(rows) {
+    for(i = 0; i < offset; i++)
+      rasqal_free_row(rows[i]);
+    RASQAL_FREE(rasqal_row**, rows);
+  }
+  return 1;
 }
 
 
@@ -184,6 +267,8 @@ rasqal_sort_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->seq)
     raptor_free_sequence(con->seq);
 
+  rasqal_rowsource_release_memory(rowsource, con->memory_size);
+
   RASQAL_FREE(rasqal_sort_rowsource_context, con);
 
   return 0;
@@ -212,6 +297,10 @@ rasqal_sort_rowsource_read_all_rows(rasqal_rowsource* rowsource,
     /* pass ownership of seq back to caller */
     seq = con->seq;
     con->seq = NULL;
+
+    /* the caller accounts for any rows it keeps */
+    rasqal_rowsource_release_memory(rowsource, con->memory_size);
+    con->memory_size = 0;
   }
   
   return seq;
@@ -43,12 +43,21 @@
 
 #ifndef STANDALONE
 
-typedef struct 
+/* first triple pattern matches per morsel of a parallel scan */
+#define RASQAL_TRIPLES_MORSEL_SIZE 64
+
+/* morsels in flight per worker thread of a parallel scan */
+#define RASQAL_TRIPLES_MORSELS_PER_THREAD 2
+
+typedef struct rasqal_triples_morsel_s rasqal_triples_morsel;
+
+typedef struct rasqal_triples_rowsource_context_s
 {
   /* source of triple pattern matches */
   rasqal_triples_source* triples_source;
 
-  /* sequence of triple SHARED with query */
+  /* sequence of triples: SHARED with query until init replaces it
+   * with copies of the triple patterns used */
   raptor_sequence* triples;
 
   /* current column being iterated */
@@ -75,9 +84,276 @@ typedef struct
   
   /* GRAPH origin to use */
   rasqal_literal *origin;
+
+  /* copies of the variables of the triple patterns that matching
+   * binds, so that executions of one query do not share bindings, and
+   * rowsource variable offset to index in @variables */
+  rasqal_variables_table* vars_table;
+  rasqal_variable** variables;
+  int variables_count;
+  int* row_map;
+
+  /* non-0 when @triples holds the copies */
+  int triples_copied;
+
+  /* FILTER expressions that matches must pass or NULL */
+  raptor_sequence* filters;
+
+  /* Parallel scan: 0 not decided yet, 1 sequential or 2 parallel */
+  int scan_mode;
+
+  /* Parallel scan: context that reads first triple pattern matches
+   * and ring of morsels in flight */
+  struct rasqal_triples_rowsource_context_s* first;
+  int first_finished;
+  rasqal_triples_morsel** morsels;
+  int morsels_size;
+  int morsels_head;
+  int morsels_count;
+
+  /* Parallel scan: non-0 when running morsels should stop */
+  int stop;
+
+  /* Morsel worker contexts: the context that submitted the morsel
+   * and the countdown to the next clock read */
+  struct rasqal_triples_rowsource_context_s* parent;
+  int countdown;
 } rasqal_triples_rowsource_context;
 
 
+/*
+ * rasqal_triples_morsel:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ * @group: task group running the morsel
+ * @matches_count: number of first triple pattern matches
+ * @values: values of the variables for each match
+ * @rows: rows found
+ *
+ * INTERNAL - Matches of the first triple pattern whose remaining
+ * triple patterns are matched by a worker thread
+ */
+struct rasqal_triples_morsel_s {
+  rasqal_rowsource* rowsource;
+  rasqal_triples_rowsource_context* con;
+  rasqal_task_group* group;
+  int matches_count;
+  rasqal_literal** values;
+  raptor_sequence* rows;
+};
+
+
+static void rasqal_triples_rowsource_parallel_finish(rasqal_triples_rowsource_context* con);
+
+
+/* index of a variable in an array of @count variables or <0 */
+static int
+rasqal_triples_rowsource_variable_index(rasqal_variable** variables,
+                                        int count, rasqal_variable* v)
+{
+  int i;
+
+  for(i = 0; i < count; i++) {
+    if(variables[i] == v)
+      return i;
+  }
+
+  return -1;
+}
+
+
+/* add the variable of a triple pattern part to an array if missing */
+static void
+rasqal_triples_rowsource_add_variable(rasqal_variable** variables,
+                                      int* count_p, rasqal_literal* l)
+{
+  rasqal_variable* v = rasqal_literal_as_variable(l);
+
+  if(v && rasqal_triples_rowsource_variable_index(variables, *count_p, v) < 0)
+    variables[(*count_p)++] = v;
+}
+
+
+/* copy a triple pattern part using variable @to[i] in place of @from[i] */
+static rasqal_literal*
+rasqal_triples_rowsource_copy_part(rasqal_variable** from,
+                                   rasqal_variable** to, int count,
+                                   rasqal_literal* l)
+{
+  rasqal_variable* v;
+
+  if(!l)
+    return NULL;
+
+  v = rasqal_literal_as_variable(l);
+  if(!v)
+    return rasqal_new_literal_from_literal(l);
+
+  v = to[rasqal_triples_rowsource_variable_index(from, count, v)];
+  return rasqal_new_variable_literal(l->world,
+                                     rasqal_new_variable_from_variable(v));
+}
+
+
+/*
+ * rasqal_triples_rowsource_copy_triples:
+ * @triples: sequence of triple patterns
+ * @start_column: first triple pattern to copy
+ * @end_column: last triple pattern to copy
+ * @from: variables of the triple patterns
+ * @to: variables to use in the copies in place of @from
+ * @count: number of variables in @from and @to
+ *
+ * INTERNAL - Copy a range of triple patterns using other variables
+ *
+ * Return value: new sequence of triple patterns or NULL on failure
+ */
+static raptor_sequence*
+rasqal_triples_rowsource_copy_triples(raptor_sequence* triples,
+                                      int start_column, int end_column,
+                                      rasqal_variable** from,
+                                      rasqal_variable** to, int count)
+{
+  raptor_sequence* seq;
+  int column;
+
+  seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_triple,
+                            (raptor_data_print_handler)rasqal_triple_print);
+  if(!seq)
+    return NULL;
+
+  for(column = start_column; column <= end_column; column++) {
+    rasqal_triple *t;
+    rasqal_triple *nt;
+
+    t = (rasqal_triple*)raptor_sequence_get_at(triples, column);
+    nt = rasqal_new_triple(rasqal_triples_rowsource_copy_part(from, to, count, t->subject),
+                           rasqal_triples_rowsource_copy_part(from, to, count, t->predicate),
+                           rasqal_triples_rowsource_copy_part(from, to, count, t->object));
+    if(!nt || raptor_sequence_push(seq, nt))
+      goto failed;
+
+    nt->origin = rasqal_triples_rowsource_copy_part(from, to, count, t->origin);
+    nt->flags = t->flags;
+    if(!nt->subject || !nt->predicate || !nt->object ||
+       (t->origin && !nt->origin))
+      goto failed;
+  }
+
+  return seq;
+
+  failed:
+  raptor_free_sequence(seq);
+  return NULL;
+}
+
+
+/*
+ * rasqal_triples_rowsource_init_variables:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ *
+ * INTERNAL - Give the rowsource its own copies of the triple patterns and their variables
+ *
+ * Matching binds the copied variables so that the #rasqal_variable
+ * objects of the query are never written and several executions of
+ * one query can be read at the same time.  A parameter variable that
+ * triple patterns match gets its value in the copy, which is freed
+ * with the rowsource.  The columns are renumbered from 0.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_triples_rowsource_init_variables(rasqal_rowsource* rowsource,
+                                        rasqal_triples_rowsource_context* con)
+{
+  rasqal_query* query = rowsource->query;
+  rasqal_variable** query_variables;
+  raptor_sequence* triples;
+  int column;
+  int rc = 1;
+  int i;
+
+  query_variables = RASQAL_CALLOC(rasqal_variable**,
+                                  RASQAL_GOOD_CAST(size_t, 4 * con->triples_count),
+                                  sizeof(rasqal_variable*));
+  con->variables = RASQAL_CALLOC(rasqal_variable**,
+                                 RASQAL_GOOD_CAST(size_t, 4 * con->triples_count),
+                                 sizeof(rasqal_variable*));
+  con->row_map = RASQAL_CALLOC(int*, RASQAL_GOOD_CAST(size_t, con->size + 1),
+                               sizeof(int));
+  con->vars_table = rasqal_new_variables_table(rowsource->world);
+  if(!query_variables || !con->variables || !con->row_map || !con->vars_table)
+    goto tidy;
+
+  for(column = con->start_column; column <= con->end_column; column++) {
+    rasqal_triple *t;
+
+    t = (rasqal_triple*)raptor_sequence_get_at(con->triples, column);
+    rasqal_triples_rowsource_add_variable(query_variables,
+                                          &con->variables_count, t->subject);
+    rasqal_triples_rowsource_add_variable(query_variables,
+                                          &con->variables_count, t->predicate);
+    rasqal_triples_rowsource_add_variable(query_variables,
+                                          &con->variables_count, t->object);
+    rasqal_triples_rowsource_add_variable(query_variables,
+                                          &con->variables_count, t->origin);
+  }
+
+  for(i = 0; i < con->variables_count; i++) {
+    rasqal_variable* v = query_variables[i];
+    size_t len = strlen(RASQAL_GOOD_CAST(const char*, v->name));
+    unsigned char* name;
+    rasqal_literal* value;
+
+    name = RASQAL_MALLOC(unsigned char*, len + 1);
+    if(!name)
+      goto tidy;
+    memcpy(name, v->name, len + 1);
+
+    value = rasqal_query_get_parameter_binding(query, v);
+    if(value)
+      value = rasqal_new_literal_from_literal(value);
+
+    con->variables[i] = rasqal_variables_table_add(con->vars_table, v->type,
+                                                   name, value);
+    if(!con->variables[i])
+      goto tidy;
+  }
+
+  for(i = 0; i < con->size; i++) {
+    rasqal_variable* v;
+
+    v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
+    con->row_map[i] = rasqal_triples_rowsource_variable_index(query_variables,
+                                                              con->variables_count,
+                                                              v);
+  }
+
+  triples = rasqal_triples_rowsource_copy_triples(con->triples,
+                                                  con->start_column,
+                                                  con->end_column,
+                                                  query_variables,
+                                                  con->variables,
+                                                  con->variables_count);
+  if(!triples)
+    goto tidy;
+
+  con->triples = triples;
+  con->triples_copied = 1;
+  con->end_column -= con->start_column;
+  con->start_column = 0;
+  con->column = 0;
+  rc = 0;
+
+  tidy:
+  if(query_variables)
+    RASQAL_FREE(rasqal_variable**, query_variables);
+
+  return rc;
+}
+
+
 static int
 rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 {
@@ -92,12 +368,23 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 
   size = rasqal_variables_table_get_total_variables_count(query->vars_table);
   
-  /* Construct the ordered projection of the variables set by these triples */
+  /* Construct the ordered projection of the variables set by these
+   * triples.  Variables that nothing outside these triples uses are
+   * still bound while matching but are not copied into rows.
+   */
   con->size = 0;
   for(i = 0; i < size; i++) {
     rasqal_variable *v;
     v = rasqal_variables_table_get(rowsource->vars_table, i);
     
+    if(!rasqal_query_variable_needed_outside_triples(query, v,
+                                                     con->start_column,
+                                                     con->end_column)) {
+      RASQAL_DEBUG2("Variable %s is not needed outside triples - not returning it in rows\n",
+                    v->name);
+      continue;
+    }
+
     for(column = con->start_column; column <= con->end_column; column++) {
       if(rasqal_query_variable_bound_in_triple(query, v, column)) {
           v = rasqal_new_variable_from_variable(v);
@@ -123,14 +410,17 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
     t = (rasqal_triple*)raptor_sequence_get_at(con->triples, column);
     
     if((v = rasqal_literal_as_variable(t->subject)) &&
+       !rasqal_query_get_parameter_binding(query, v) &&
        rasqal_query_variable_bound_in_triple(query, v, column) & RASQAL_TRIPLE_SUBJECT)
       m->parts = (rasqal_triple_parts)(m->parts | RASQAL_TRIPLE_SUBJECT);
     
     if((v = rasqal_literal_as_variable(t->predicate)) &&
+       !rasqal_query_get_parameter_binding(query, v) &&
        rasqal_query_variable_bound_in_triple(query, v, column) & RASQAL_TRIPLE_PREDICATE)
       m->parts = (rasqal_triple_parts)(m->parts | RASQAL_TRIPLE_PREDICATE);
     
     if((v = rasqal_literal_as_variable(t->object)) &&
+       !rasqal_query_get_parameter_binding(query, v) &&
        rasqal_query_variable_bound_in_triple(query, v, column) & RASQAL_TRIPLE_OBJECT)
       m->parts = (rasqal_triple_parts)(m->parts | RASQAL_TRIPLE_OBJECT);
 
@@ -139,6 +429,9 @@ rasqal_triples_rowsource_init(rasqal_rowsource* rowsource, void *user_data)
 
   }
   
+  if(!rc)
+    rc = rasqal_triples_rowsource_init_variables(rowsource, con);
+
   return rc;
 }
 
@@ -164,6 +457,8 @@ rasqal_triples_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   
   con = (rasqal_triples_rowsource_context*)user_data;
 
+  rasqal_triples_rowsource_parallel_finish(con);
+
   if(con->triple_meta) {
     for(i = con->start_column; i <= con->end_column; i++) {
       rasqal_triple_meta *m;
@@ -177,12 +472,117 @@ rasqal_triples_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
   if(con->origin)
     rasqal_free_literal(con->origin);
 
+  if(con->triples_copied)
+    raptor_free_sequence(con->triples);
+
+  if(con->variables) {
+    for(i = 0; i < con->variables_count; i++) {
+      if(con->variables[i])
+        rasqal_free_variable(con->variables[i]);
+    }
+    RASQAL_FREE(rasqal_variable**, con->variables);
+  }
+
+  if(con->row_map)
+    RASQAL_FREE(int*, con->row_map);
+
+  if(con->vars_table)
+    rasqal_free_variables_table(con->vars_table);
+
+  if(con->filters)
+    raptor_free_sequence(con->filters);
+
   RASQAL_FREE(rasqal_triples_rowsource_context, con);
 
   return 0;
 }
 
 
+/* value of the rowsource variable at @offset in the current match */
+static rasqal_literal*
+rasqal_triples_rowsource_get_value(rasqal_triples_rowsource_context* con,
+                                   int offset)
+{
+  int index = con->row_map[offset];
+
+  if(index < 0)
+    return NULL;
+
+  return con->variables[index]->value;
+}
+
+
+/*
+ * rasqal_triples_rowsource_filter_row:
+ * @con: rowsource context
+ * @row: row of a match
+ * @eval_context: evaluation context to bind the row values in
+ *
+ * INTERNAL - Check a match passes the FILTER expressions of the scan
+ *
+ * Return value: non-0 if the row passes
+ */
+static int
+rasqal_triples_rowsource_filter_row(rasqal_triples_rowsource_context* con,
+                                    rasqal_row* row,
+                                    rasqal_evaluation_context* eval_context)
+{
+  int i;
+
+  if(!con->filters)
+    return 1;
+
+  if(rasqal_row_bind_variables(row, eval_context))
+    return 0;
+
+  for(i = 0; i < raptor_sequence_size(con->filters); i++) {
+    rasqal_expression* expr;
+    rasqal_literal* result;
+    int error = 0;
+    int bresult;
+
+    expr = (rasqal_expression*)raptor_sequence_get_at(con->filters, i);
+    result = rasqal_expression_evaluate2(expr, eval_context, &error);
+    if(error)
+      return 0;
+
+    bresult = rasqal_literal_as_boolean(result, &error);
+    rasqal_free_literal(result);
+    if(error || !bresult)
+      return 0;
+  }
+
+  return 1;
+}
+
+
+/* new row with the values of the current match */
+static rasqal_row*
+rasqal_triples_rowsource_new_match_row(rasqal_rowsource* rowsource,
+                                       rasqal_triples_rowsource_context* con,
+                                       rasqal_variable** variables)
+{
+  rasqal_row* row;
+  int i;
+
+  row = rasqal_new_row(rowsource);
+  if(!row)
+    return NULL;
+
+  for(i = 0; i < row->size; i++) {
+    int index = con->row_map[i];
+
+    if(row->values[i])
+      rasqal_free_literal(row->values[i]);
+    row->values[i] = NULL;
+    if(index >= 0)
+      row->values[i] = rasqal_new_literal_from_literal(variables[index]->value);
+  }
+
+  return row;
+}
+
+
 static rasqal_engine_error
 rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource, 
                                       rasqal_triples_rowsource_context *con)
@@ -194,6 +594,19 @@ rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource,
     rasqal_triple_meta *m;
     rasqal_triple *t;
 
+    /* stop a long run of non-matching triples promptly */
+    if(con->parent) {
+      if(con->parent->stop ||
+         rasqal_evaluation_context_is_interrupted_count(rowsource->eval_context,
+                                                        &con->countdown)) {
+        error = RASQAL_ENGINE_FAILED;
+        break;
+      }
+    } else if(rasqal_evaluation_context_is_interrupted(rowsource->eval_context)) {
+      error = RASQAL_ENGINE_FAILED;
+      break;
+    }
+
     m = &con->triple_meta[con->column - con->start_column];
     t = (rasqal_triple*)raptor_sequence_get_at(con->triples, con->column);
 
@@ -257,62 +670,587 @@ rasqal_triples_rowsource_get_next_row(rasqal_rowsource* rowsource,
 }
 
 
+/*
+ * Parallel scan
+ *
+ * The matches of the first triple pattern are read in morsels by the
+ * thread reading the rowsource.  Each morsel is matched against the
+ * remaining triple patterns by a task in the query task pool using
+ * its own copies of the triple patterns and variables, so that the
+ * rowsource variables are only bound by the reading thread.  The
+ * rows of each morsel are returned in morsel order which is the
+ * order of a sequential scan.
+ */
+
+
+/*
+ * rasqal_triples_rowsource_parallel_init:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ *
+ * INTERNAL - Decide if the triple patterns are matched in parallel and set up the scan
+ *
+ * A parallel scan needs more than one triple pattern, more than one
+ * thread for the query, a triples source that supports
+ * #RASQAL_TRIPLES_SOURCE_FEATURE_CONCURRENT_MATCH and atomic literal
+ * reference counts.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_triples_rowsource_parallel_init(rasqal_rowsource* rowsource,
+                                       rasqal_triples_rowsource_context* con)
+{
+#ifdef RASQAL_ATOMIC_USAGE
+  int parallelism;
+#endif
+
+  con->scan_mode = 1;
+
+#ifdef RASQAL_ATOMIC_USAGE
+  if(con->triples_count < 2)
+    return 0;
+
+  parallelism = rasqal_query_get_parallelism(rowsource->query);
+  if(parallelism <= 1 ||
+     !rasqal_triples_source_support_feature(con->triples_source,
+                                            RASQAL_TRIPLES_SOURCE_FEATURE_CONCURRENT_MATCH))
+    return 0;
+
+  con->morsels_size = parallelism * RASQAL_TRIPLES_MORSELS_PER_THREAD;
+  con->morsels = RASQAL_CALLOC(rasqal_triples_morsel**,
+                               RASQAL_GOOD_CAST(size_t, con->morsels_size),
+                               sizeof(rasqal_triples_morsel*));
+  con->first = RASQAL_CALLOC(rasqal_triples_rowsource_context*, 1,
+                             sizeof(*con->first));
+  if(!con->morsels || !con->first)
+    return 1;
+
+  /* the first triple pattern is matched by the reading thread */
+  con->first->triples_source = con->triples_source;
+  con->first->triples = con->triples;
+  con->first->start_column = con->start_column;
+  con->first->end_column = con->start_column;
+  con->first->column = con->start_column;
+  con->first->triples_count = 1;
+  con->first->triple_meta = con->triple_meta;
+
+  con->scan_mode = 2;
+#endif
+
+  return 0;
+}
+
+
+static void
+rasqal_free_triples_morsel(rasqal_triples_morsel* morsel)
+{
+  int i;
+
+  /* waits for the task */
+  if(morsel->group)
+    rasqal_free_task_group(morsel->group);
+
+  if(morsel->values) {
+    for(i = 0; i < morsel->matches_count * morsel->con->variables_count; i++) {
+      if(morsel->values[i])
+        rasqal_free_literal(morsel->values[i]);
+    }
+    RASQAL_FREE(rasqal_literal**, morsel->values);
+  }
+
+  if(morsel->rows)
+    raptor_free_sequence(morsel->rows);
+
+  RASQAL_FREE(rasqal_triples_morsel, morsel);
+}
+
+
+/* stop and free all morsels in flight */
+static void
+rasqal_triples_rowsource_parallel_reset(rasqal_triples_rowsource_context* con)
+{
+  con->stop = 1;
+  while(con->morsels_count) {
+    rasqal_free_triples_morsel(con->morsels[con->morsels_head]);
+    con->morsels_head = (con->morsels_head + 1) % con->morsels_size;
+    con->morsels_count--;
+  }
+  con->morsels_head = 0;
+  con->stop = 0;
+
+  con->first_finished = 0;
+  if(con->first)
+    con->first->column = con->start_column;
+}
+
+
+static void
+rasqal_triples_rowsource_parallel_finish(rasqal_triples_rowsource_context* con)
+{
+  if(con->morsels) {
+    rasqal_triples_rowsource_parallel_reset(con);
+    RASQAL_FREE(rasqal_triples_morsel**, con->morsels);
+    con->morsels = NULL;
+  }
+
+  /* the first context shares the triple meta of @con */
+  if(con->first) {
+    RASQAL_FREE(rasqal_triples_rowsource_context, con->first);
+    con->first = NULL;
+  }
+
+  con->scan_mode = 0;
+}
+
+
+/*
+ * rasqal_triples_morsel_task:
+ * @user_data: #rasqal_triples_morsel
+ *
+ * INTERNAL - Match a morsel against the triple patterns after the first
+ *
+ * Run in a worker thread.  The triple patterns and variables are
+ * copied so that nothing shared with the query is bound; only the
+ * triples source, literal reference counts and the world pools are
+ * shared.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_triples_morsel_task(void* user_data)
+{
+  rasqal_triples_morsel* morsel = (rasqal_triples_morsel*)user_data;
+  rasqal_rowsource* rowsource = morsel->rowsource;
+  rasqal_triples_rowsource_context* con = morsel->con;
+  rasqal_triples_rowsource_context wcon;
+  rasqal_variables_table* vt = NULL;
+  rasqal_variable** variables = NULL;
+  rasqal_evaluation_context* eval_context = NULL;
+  int variables_count = con->variables_count;
+  int failed = 0;
+  int column;
+  int match;
+  int i;
+
+  memset(&wcon, '\0', sizeof(wcon));
+  wcon.triples_source = con->triples_source;
+  wcon.start_column = 0;
+  wcon.end_column = con->triples_count - 2;
+  wcon.triples_count = con->triples_count - 1;
+  wcon.parent = con;
+
+  vt = rasqal_new_variables_table(rowsource->world);
+  variables = RASQAL_CALLOC(rasqal_variable**,
+                            RASQAL_GOOD_CAST(size_t, variables_count + 1),
+                            sizeof(rasqal_variable*));
+  wcon.triple_meta = RASQAL_CALLOC(rasqal_triple_meta*,
+                                   RASQAL_GOOD_CAST(size_t, wcon.triples_count),
+                                   sizeof(rasqal_triple_meta));
+  if(!vt || !variables || !wcon.triple_meta) {
+    failed = 1;
+    goto tidy;
+  }
+
+  /* FILTERs bind the row values in a context of this task */
+  if(con->filters) {
+    eval_context = rasqal_query_new_execution_context(rowsource->query);
+    if(!eval_context) {
+      failed = 1;
+      goto tidy;
+    }
+  }
+
+  for(i = 0; i < variables_count; i++) {
+    rasqal_variable* v = con->variables[i];
+    size_t len = strlen(RASQAL_GOOD_CAST(const char*, v->name));
+    unsigned char* name;
+
+    name = RASQAL_MALLOC(unsigned char*, len + 1);
+    if(!name) {
+      failed = 1;
+      goto tidy;
+    }
+    memcpy(name, v->name, len + 1);
+
+    variables[i] = rasqal_variables_table_add(vt, v->type, name, NULL);
+    if(!variables[i]) {
+      failed = 1;
+      goto tidy;
+    }
+  }
+
+  wcon.triples = rasqal_triples_rowsource_copy_triples(con->triples,
+                                                       con->start_column + 1,
+                                                       con->end_column,
+                                                       con->variables,
+                                                       variables,
+                                                       variables_count);
+  if(!wcon.triples) {
+    failed = 1;
+    goto tidy;
+  }
+
+  for(column = con->start_column + 1; column <= con->end_column; column++)
+    wcon.triple_meta[column - con->start_column - 1].parts = con->triple_meta[column - con->start_column].parts;
+
+  for(match = 0; match < morsel->matches_count && !failed; match++) {
+    rasqal_literal** values = &morsel->values[match * variables_count];
+
+    /* bindings made by the first triple pattern and any constants */
+    for(i = 0; i < variables_count; i++)
+      rasqal_variable_set_value(variables[i],
+                                rasqal_new_literal_from_literal(values[i]));
+
+    wcon.column = wcon.start_column;
+    while(1) {
+      rasqal_engine_error error;
+      rasqal_row* row;
+
+      error = rasqal_triples_rowsource_get_next_row(rowsource, &wcon);
+      if(error == RASQAL_ENGINE_FINISHED)
+        break;
+      if(error != RASQAL_ENGINE_OK) {
+        failed = 1;
+        break;
+      }
+
+      row = rasqal_triples_rowsource_new_match_row(rowsource, con, variables);
+      if(!row) {
+        failed = 1;
+        break;
+      }
+
+      if(!rasqal_triples_rowsource_filter_row(con, row, eval_context)) {
+        rasqal_free_row(row);
+        continue;
+      }
+
+      if(raptor_sequence_push(morsel->rows, row)) {
+        failed = 1;
+        break;
+      }
+    }
+
+    for(column = 0; column < wcon.triples_count; column++)
+      rasqal_reset_triple_meta(&wcon.triple_meta[column]);
+  }
+
+  tidy:
+  if(wcon.triple_meta) {
+    for(column = 0; column < wcon.triples_count; column++)
+      rasqal_reset_triple_meta(&wcon.triple_meta[column]);
+    RASQAL_FREE(rasqal_triple_meta, wcon.triple_meta);
+  }
+
+  if(wcon.triples)
+    raptor_free_sequence(wcon.triples);
+
+  if(variables) {
+    for(i = 0; i < variables_count; i++) {
+      if(variables[i])
+        rasqal_free_variable(variables[i]);
+    }
+    RASQAL_FREE(rasqal_variable**, variables);
+  }
+
+  if(vt)
+    rasqal_free_variables_table(vt);
+
+  if(eval_context)
+    rasqal_free_evaluation_context(eval_context);
+
+  return failed;
+}
+
+
+/*
+ * rasqal_triples_rowsource_submit_morsel:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ *
+ * INTERNAL - Read the next morsel of first triple pattern matches and submit it to the task pool
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_triples_rowsource_submit_morsel(rasqal_rowsource* rowsource,
+                                       rasqal_triples_rowsource_context* con)
+{
+  rasqal_triples_morsel* morsel;
+  int variables_count = con->variables_count;
+  int i;
+
+  morsel = RASQAL_CALLOC(rasqal_triples_morsel*, 1, sizeof(*morsel));
+  if(!morsel)
+    return 1;
+
+  morsel->rowsource = rowsource;
+  morsel->con = con;
+  morsel->values = RASQAL_CALLOC(rasqal_literal**,
+                                 RASQAL_GOOD_CAST(size_t, RASQAL_TRIPLES_MORSEL_SIZE * variables_count + 1),
+                                 sizeof(rasqal_literal*));
+  if(!morsel->values)
+    goto failed;
+
+  while(morsel->matches_count < RASQAL_TRIPLES_MORSEL_SIZE) {
+    rasqal_engine_error error;
+    rasqal_literal** values;
+
+    error = rasqal_triples_rowsource_get_next_row(rowsource, con->first);
+    if(error == RASQAL_ENGINE_FINISHED) {
+      con->first_finished = 1;
+      break;
+    }
+    if(error != RASQAL_ENGINE_OK)
+      goto failed;
+
+    values = &morsel->values[morsel->matches_count * variables_count];
+    for(i = 0; i < variables_count; i++)
+      values[i] = rasqal_new_literal_from_literal(con->variables[i]->value);
+    morsel->matches_count++;
+  }
+
+  if(!morsel->matches_count) {
+    rasqal_free_triples_morsel(morsel);
+    return 0;
+  }
+
+  morsel->rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                     (raptor_data_print_handler)rasqal_row_print);
+  morsel->group = rasqal_new_task_group(rasqal_query_get_task_pool(rowsource->query));
+  if(!morsel->rows || !morsel->group)
+    goto failed;
+
+  con->morsels[(con->morsels_head + con->morsels_count) % con->morsels_size] = morsel;
+  con->morsels_count++;
+
+  return rasqal_task_group_submit(morsel->group, rasqal_triples_morsel_task,
+                                  morsel);
+
+  failed:
+  rasqal_free_triples_morsel(morsel);
+  return 1;
+}
+
+
+/*
+ * rasqal_triples_rowsource_parallel_read_row:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ *
+ * @error_p: pointer to store error
+ *
+ * INTERNAL - Get the next row of a parallel scan
+ *
+ * Return value: row or NULL when finished or on failure
+ */
+static rasqal_row*
+rasqal_triples_rowsource_parallel_read_row(rasqal_rowsource* rowsource,
+                                           rasqal_triples_rowsource_context* con,
+                                           rasqal_engine_error* error_p)
+{
+  *error_p = RASQAL_ENGINE_OK;
+
+  while(1) {
+    rasqal_triples_morsel* morsel;
+    rasqal_row* row;
+
+    /* keep the workers busy */
+    while(!con->first_finished && con->morsels_count < con->morsels_size) {
+      if(rasqal_triples_rowsource_submit_morsel(rowsource, con))
+        goto failed;
+    }
+
+    if(!con->morsels_count) {
+      *error_p = RASQAL_ENGINE_FINISHED;
+      return NULL;
+    }
+
+    morsel = con->morsels[con->morsels_head];
+    if(rasqal_task_group_wait(morsel->group))
+      goto failed;
+
+    row = (rasqal_row*)raptor_sequence_unshift(morsel->rows);
+    if(row) {
+      row->offset = con->offset++;
+      return row;
+    }
+
+    rasqal_free_triples_morsel(morsel);
+    con->morsels_head = (con->morsels_head + 1) % con->morsels_size;
+    con->morsels_count--;
+  }
+
+  failed:
+  /* no more rows after a failure */
+  rasqal_triples_rowsource_parallel_reset(con);
+  con->first_finished = 1;
+  *error_p = RASQAL_ENGINE_FAILED;
+  return NULL;
+}
+
+
+/*
+ * rasqal_triples_rowsource_read_match_row:
+ * @rowsource: triples rowsource
+ * @con: rowsource context
+ * @error_p: pointer to store error
+ *
+ * INTERNAL - Get a row for the next match of a sequential scan that passes the FILTERs
+ *
+ * Return value: row without an offset or NULL when finished or on failure
+ */
+static rasqal_row*
+rasqal_triples_rowsource_read_match_row(rasqal_rowsource* rowsource,
+                                        rasqal_triples_rowsource_context* con,
+                                        rasqal_engine_error* error_p)
+{
+  rasqal_row* row = NULL;
+
+  while(1) {
+    *error_p = rasqal_triples_rowsource_get_next_row(rowsource, con);
+    RASQAL_DEBUG2("rasqal_triples_rowsource_get_next_row() returned error %s\n",
+                  rasqal_engine_error_as_string(*error_p));
+
+    if(*error_p != RASQAL_ENGINE_OK)
+      return NULL;
+
+#ifdef RASQAL_DEBUG
+    if(1) {
+      int values_returned = 0;
+      int i;
+      /* Count actual bound values */
+      for(i = 0; i < con->size; i++) {
+        if(rasqal_triples_rowsource_get_value(con, i))
+          values_returned++;
+      }
+      RASQAL_DEBUG2("Solution binds %d values\n", values_returned);
+    }
+#endif
+
+    row = rasqal_triples_rowsource_new_match_row(rowsource, con,
+                                                 con->variables);
+    if(!row) {
+      *error_p = RASQAL_ENGINE_FAILED;
+      return NULL;
+    }
+
+    if(rasqal_triples_rowsource_filter_row(con, row, rowsource->eval_context))
+      return row;
+
+    rasqal_free_row(row);
+  }
+}
+
+
 static rasqal_row*
 rasqal_triples_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_triples_rowsource_context *con;
-  int i;
   rasqal_row* row = NULL;
   rasqal_engine_error error = RASQAL_ENGINE_OK;
   
   con = (rasqal_triples_rowsource_context*)user_data;
 
-  error = rasqal_triples_rowsource_get_next_row(rowsource, con);
-  RASQAL_DEBUG2("rasqal_triples_rowsource_get_next_row() returned error %s\n",
-                rasqal_engine_error_as_string(error));
+  if(!con->scan_mode &&
+     rasqal_triples_rowsource_parallel_init(rowsource, con))
+    return NULL;
+
+  if(con->scan_mode == 2)
+    return rasqal_triples_rowsource_parallel_read_row(rowsource, con, &error);
 
-  if(error != RASQAL_ENGINE_OK)
-    goto done;
+  row = rasqal_triples_rowsource_read_match_row(rowsource, con, &error);
+  if(row)
+    row->offset = con->offset++;
+
+  return row;
+}
+
+
+/*
+ * rasqal_triples_rowsource_read_batch:
+ *
+ * Read a morsel of matches of the triple patterns into a column batch
+ *
+ * The binding values of each match are copied straight into the
+ * batch columns so no #rasqal_row is made per match.  A parallel
+ * scan moves the values of the rows made by the workers instead.
+ */
+static int
+rasqal_triples_rowsource_read_batch(rasqal_rowsource* rowsource,
+                                    void *user_data,
+                                    rasqal_row_batch* batch)
+{
+  rasqal_triples_rowsource_context *con;
+  rasqal_engine_error error = RASQAL_ENGINE_OK;
+  
+  con = (rasqal_triples_rowsource_context*)user_data;
+
+  if(!con->scan_mode &&
+     rasqal_triples_rowsource_parallel_init(rowsource, con))
+    return -1;
+
+  while(con->scan_mode == 2 && batch->count < batch->capacity) {
+    int index = batch->count;
+    rasqal_row* row;
+    int i;
+
+    row = rasqal_triples_rowsource_parallel_read_row(rowsource, con, &error);
+    if(!row)
+      break;
 
-#ifdef RASQAL_DEBUG
-  if(1) {
-    int values_returned = 0;
-    /* Count actual bound values */
     for(i = 0; i < con->size; i++) {
-      rasqal_variable* v;
-      v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
-      if(v->value)
-        values_returned++;
+      RASQAL_ROW_BATCH_COLUMN(batch, i)[index] = row->values[i];
+      row->values[i] = NULL;
     }
-    RASQAL_DEBUG2("Solution binds %d values\n", values_returned);
+    batch->offsets[index] = row->offset;
+    batch->group_ids[index] = -1;
+    batch->count++;
+    rasqal_free_row(row);
   }
-#endif
 
-  row = rasqal_new_row(rowsource);
-  if(!row) {
-    error = RASQAL_ENGINE_FAILED;
-    goto done;
-  }
+  while(con->scan_mode == 1 && batch->count < batch->capacity) {
+    int index = batch->count;
+    int i;
 
-  for(i = 0; i < row->size; i++) {
-    rasqal_variable* v;
-    v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
-    if(row->values[i])
-      rasqal_free_literal(row->values[i]);
-    row->values[i] = rasqal_new_literal_from_literal(v->value);
-  }
+    /* all columns finished by an earlier partial batch */
+    if(con->column < con->start_column)
+      break;
 
-  row->offset = con->offset++;
+    if(con->filters) {
+      /* FILTERs evaluate on rows */
+      rasqal_row* row;
 
-  done:
-  if(error != RASQAL_ENGINE_OK) {
-    if(row) {
+      row = rasqal_triples_rowsource_read_match_row(rowsource, con, &error);
+      if(!row)
+        break;
+
+      for(i = 0; i < con->size; i++) {
+        RASQAL_ROW_BATCH_COLUMN(batch, i)[index] = row->values[i];
+        row->values[i] = NULL;
+      }
       rasqal_free_row(row);
-      row = NULL;
+    } else {
+      error = rasqal_triples_rowsource_get_next_row(rowsource, con);
+      if(error != RASQAL_ENGINE_OK)
+        break;
+
+      for(i = 0; i < con->size; i++) {
+        rasqal_literal* value = rasqal_triples_rowsource_get_value(con, i);
+        RASQAL_ROW_BATCH_COLUMN(batch, i)[index] = rasqal_new_literal_from_literal(value);
+      }
     }
+
+    batch->offsets[index] = con->offset++;
+    batch->group_ids[index] = -1;
+    batch->count++;
   }
 
-  return row;
+  if(error == RASQAL_ENGINE_FAILED)
+    return -1;
+
+  return batch->count;
 }
 
 
@@ -334,6 +1272,9 @@ rasqal_triples_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
   
   con = (rasqal_triples_rowsource_context*)user_data;
 
+  if(con->scan_mode == 2)
+    rasqal_triples_rowsource_parallel_reset(con);
+
   con->column = con->start_column;
   for(column = con->start_column; column <= con->end_column; column++) {
     rasqal_triple_meta *m;
@@ -359,6 +1300,9 @@ rasqal_triples_rowsource_set_origin(rasqal_rowsource *rowsource,
     rasqal_free_literal(con->origin);
   con->origin = rasqal_new_literal_from_literal(origin);
 
+  /* the scan variables may change */
+  rasqal_triples_rowsource_parallel_finish(con);
+
   for(column = con->start_column; column <= con->end_column; column++) {
     rasqal_triple *t;
     t = (rasqal_triple*)raptor_sequence_get_at(con->triples, column);
@@ -372,7 +1316,7 @@ rasqal_triples_rowsource_set_origin(rasqal_rowsource *rowsource,
 
 
 static const rasqal_rowsource_handler rasqal_triples_rowsource_handler = {
-  /* .version = */ 1,
+  /* .version = */ 2,
   "triple pattern",
   /* .init = */ rasqal_triples_rowsource_init,
   /* .finish = */ rasqal_triples_rowsource_finish,
@@ -382,7 +1326,8 @@ static const rasqal_rowsource_handler rasqal_triples_rowsource_handler = {
   /* .reset = */ rasqal_triples_rowsource_reset,
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ NULL,
-  /* .set_origin = */ rasqal_triples_rowsource_set_origin
+  /* .set_origin = */ rasqal_triples_rowsource_set_origin,
+  /* .read_batch = */ rasqal_triples_rowsource_read_batch,
 };
 
 
@@ -442,6 +1387,43 @@ rasqal_new_triples_rowsource(rasqal_world *world,
 }
 
 
+/**
+ * rasqal_triples_rowsource_add_filter:
+ * @rowsource: triples rowsource
+ * @expr: FILTER expression over the triple patterns
+ *
+ * INTERNAL - Make a triples rowsource only return matches that pass a FILTER
+ *
+ * A parallel scan evaluates @expr on the worker threads, each with
+ * its own evaluation context, so only passing rows reach the reading
+ * thread.  The @expr is not owned by the rowsource.
+ *
+ * Return value: non-0 if @rowsource is not a triples rowsource or on failure
+ */
+int
+rasqal_triples_rowsource_add_filter(rasqal_rowsource* rowsource,
+                                    rasqal_expression* expr)
+{
+  rasqal_triples_rowsource_context *con;
+
+  if(!rowsource || !expr ||
+     rowsource->handler != &rasqal_triples_rowsource_handler)
+    return 1;
+
+  con = (rasqal_triples_rowsource_context*)rowsource->user_data;
+
+  if(!con->filters) {
+    con->filters = raptor_new_sequence((raptor_data_free_handler)rasqal_free_expression,
+                                       (raptor_data_print_handler)rasqal_expression_print);
+    if(!con->filters)
+      return 1;
+  }
+
+  return raptor_sequence_push(con->filters,
+                              rasqal_new_expression_from_expression(expr));
+}
+
+
 #endif /* not STANDALONE */
 
 
@@ -451,6 +1433,173 @@ rasqal_new_triples_rowsource(rasqal_world *world,
 /* one more prototype */
 int main(int argc, char *argv[]);
 
+
+#define PARALLEL_SUBJECTS 200
+#define PARALLEL_ROWS (PARALLEL_SUBJECTS + PARALLEL_SUBJECTS / 2)
+#define PARALLEL_QUERY "\
+SELECT ?s ?a ?b \
+WHERE { ?s <http://example.org/p1> ?a . ?s <http://example.org/p2> ?b \
+        FILTER(STRSTARTS(?b, \"b\")) }\
+"
+
+/*
+ * Read all rows of the two triple patterns of PARALLEL_QUERY over
+ * generated data, with the query limited to @threads threads.  With
+ * @filter the scan also evaluates the FILTER of the query.
+ */
+static raptor_sequence*
+read_parallel_test_rows(rasqal_world* world, raptor_uri* base_uri,
+                        int threads, int filter)
+{
+  raptor_sequence* rows = NULL;
+  rasqal_query* query = NULL;
+  rasqal_triples_source* triples_source = NULL;
+  rasqal_rowsource* rowsource = NULL;
+  rasqal_data_graph* dg;
+  raptor_iostream* iostr = NULL;
+  char* data;
+  size_t len = 0;
+  int i;
+
+  /* every subject has one p1 and even subjects have two p2 values */
+  data = RASQAL_MALLOC(char*, PARALLEL_SUBJECTS * 200);
+  if(!data)
+    return NULL;
+  for(i = 0; i < PARALLEL_SUBJECTS; i++) {
+    len += RASQAL_GOOD_CAST(size_t, sprintf(data + len,
+      "<http://example.org/s%d> <http://example.org/p1> \"a%d\" .\n"
+      "<http://example.org/s%d> <http://example.org/p2> \"b%d\" .\n",
+      i, i, i, i));
+    if(!(i % 2))
+      len += RASQAL_GOOD_CAST(size_t, sprintf(data + len,
+        "<http://example.org/s%d> <http://example.org/p2> \"c%d\" .\n",
+        i, i));
+  }
+
+  iostr = raptor_new_iostream_from_string(world->raptor_world_ptr, data, len);
+  query = rasqal_new_query(world, "sparql", NULL);
+  if(!iostr || !query ||
+     rasqal_query_prepare(query,
+                          RASQAL_GOOD_CAST(const unsigned char*, PARALLEL_QUERY),
+                          base_uri))
+    goto tidy;
+
+  dg = rasqal_new_data_graph_from_iostream(world, iostr, base_uri, NULL,
+                                           RASQAL_DATA_GRAPH_BACKGROUND,
+                                           NULL, "ntriples", NULL);
+  if(!dg || rasqal_query_add_data_graph(query, dg))
+    goto tidy;
+
+  rasqal_query_set_feature(query, RASQAL_FEATURE_THREADS, threads);
+
+  triples_source = rasqal_new_triples_source(query);
+  if(!triples_source)
+    goto tidy;
+
+  rowsource = rasqal_new_triples_rowsource(world, query, triples_source,
+                                           rasqal_query_get_triple_sequence(query),
+                                           0, 1);
+  if(!rowsource)
+    goto tidy;
+
+  if(filter) {
+    rasqal_graph_pattern* gp = rasqal_query_get_query_graph_pattern(query);
+    rasqal_expression* expr = NULL;
+
+    for(i = 0; !expr && rasqal_graph_pattern_get_sub_graph_pattern(gp, i); i++)
+      expr = rasqal_graph_pattern_get_filter_expression(rasqal_graph_pattern_get_sub_graph_pattern(gp, i));
+
+    if(!expr || rasqal_triples_rowsource_add_filter(rowsource, expr))
+      goto tidy;
+  }
+
+  rows = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                             (raptor_data_print_handler)rasqal_row_print);
+  while(rows) {
+    rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+    if(!row)
+      break;
+    raptor_sequence_push(rows, row);
+  }
+
+  tidy:
+  if(rowsource)
+    rasqal_free_rowsource(rowsource);
+  if(triples_source)
+    rasqal_free_triples_source(triples_source);
+  if(query)
+    rasqal_free_query(query);
+  if(iostr)
+    raptor_free_iostream(iostr);
+  RASQAL_FREE(char*, data);
+
+  return rows;
+}
+
+
+/*
+ * Check a parallel scan returns the rows of a sequential scan in the
+ * same order, with and without a FILTER evaluated by the morsel
+ * workers.  Return value: number of failures
+ */
+static int
+test_parallel_scan(rasqal_world* world, raptor_uri* base_uri,
+                   const char* program, int filter)
+{
+  raptor_sequence* expected;
+  raptor_sequence* got;
+  int expected_rows = filter ? PARALLEL_SUBJECTS : PARALLEL_ROWS;
+  int failures = 0;
+  int i;
+
+  rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 4);
+
+  expected = read_parallel_test_rows(world, base_uri, 1, filter);
+  got = read_parallel_test_rows(world, base_uri, 0, filter);
+  if(!expected || !got) {
+    fprintf(stderr, "%s: parallel scan test setup failed\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(raptor_sequence_size(expected) != expected_rows ||
+     raptor_sequence_size(got) != expected_rows) {
+    fprintf(stderr,
+            "%s: parallel scan with filter %d returned %d rows and sequential %d, expected %d\n",
+            program, filter, raptor_sequence_size(got),
+            raptor_sequence_size(expected), expected_rows);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < expected_rows; i++) {
+    rasqal_row* erow = (rasqal_row*)raptor_sequence_get_at(expected, i);
+    rasqal_row* grow = (rasqal_row*)raptor_sequence_get_at(got, i);
+    int j;
+
+    for(j = 0; j < erow->size; j++) {
+      if(!rasqal_literal_equals(erow->values[j], grow->values[j])) {
+        fprintf(stderr, "%s: parallel scan row %d value %d is %s not %s\n",
+                program, i, j, rasqal_literal_as_string(grow->values[j]),
+                rasqal_literal_as_string(erow->values[j]));
+        failures++;
+        break;
+      }
+    }
+    if(failures)
+      break;
+  }
+
+  tidy:
+  if(expected)
+    raptor_free_sequence(expected);
+  if(got)
+    raptor_free_sequence(got);
+  rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 0);
+
+  return failures;
+}
+
 #define QUERY_LANGUAGE "sparql"
 #define QUERY_FORMAT "\
 SELECT ?s ?p ?o \
@@ -472,6 +1621,9 @@ main(int argc, char *argv[])
   int start_column;
   int end_column;
   int rc;
+  int rows_count = 0;
+  int batch_rows_count = 0;
+  rasqal_row_batch* batch = NULL;
   raptor_sequence* triples;
   rasqal_triples_source* triples_source = NULL;
   raptor_uri *base_uri = NULL;
@@ -593,11 +1745,44 @@ main(int argc, char *argv[])
     }
 
     rasqal_free_row(row);
+    rows_count++;
     if(failures)
       break;
   }
 
+  /* read the same matches again as column batches */
+  rasqal_rowsource_reset(rowsource);
+  batch = rasqal_new_row_batch(world, rasqal_rowsource_get_size(rowsource), 0);
+  if(!batch) {
+    fprintf(stderr, "%s: failed to create row batch\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  while(1) {
+    int count = rasqal_rowsource_read_batch(rowsource, batch);
+    if(count < 0) {
+      fprintf(stderr, "%s: read_batch failed\n", program);
+      failures++;
+      break;
+    }
+    if(!count)
+      break;
+    batch_rows_count += count;
+  }
+
+  if(batch_rows_count != rows_count) {
+    fprintf(stderr, "%s: read_batch returned %d rows, expected %d\n", program,
+            batch_rows_count, rows_count);
+    failures++;
+  }
+
+  failures += test_parallel_scan(world, base_uri, program, 0);
+  failures += test_parallel_scan(world, base_uri, program, 1);
+
   tidy:
+  if(batch)
+    rasqal_free_row_batch(batch);
   raptor_free_uri(base_uri);
   if(s_uri)
     raptor_free_uri(s_uri);
@@ -35,6 +35,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #include <raptor.h>
 
 #include "rasqal.h"
@@ -43,42 +47,152 @@
 
 #define DEBUG_FH stderr
 
+/* Branches are read concurrently only when rows and literals may be
+ * shared between threads */
+#if defined(HAVE_PTHREAD_H) && defined(RASQAL_ATOMIC_USAGE)
+#define RASQAL_UNION_CONCURRENT 1
+#endif
+
+/* rows read ahead by the branch tasks before they wait for the reader */
+#define RASQAL_UNION_QUEUE_SIZE 256
+
 #ifndef STANDALONE
 
+#ifdef RASQAL_UNION_CONCURRENT
+/* state of a branch read concurrently */
+#define RASQAL_UNION_BRANCH_WAITING  0
+#define RASQAL_UNION_BRANCH_READING  1
+#define RASQAL_UNION_BRANCH_FINISHED 2
+
+/*
+ * rasqal_union_branch_task:
+ * @rowsource: union rowsource
+ * @branch: branch index
+ *
+ * INTERNAL - Task reading one branch of a union into its row queue
+ */
+typedef struct {
+  rasqal_rowsource* rowsource;
+  int branch;
+} rasqal_union_branch_task;
+
+
+/*
+ * rasqal_union_branch_queue:
+ * @lock: lock for all the following fields
+ * @not_empty: signalled when a row is added or a branch finishes
+ * @not_full: signalled when a row is taken or the tasks must stop
+ * @rows: ring buffer of rows read by the branch tasks
+ * @head: index of the next row to take from @rows
+ * @count: number of rows in @rows
+ * @branch_states: array of #RASQAL_UNION_BRANCH_WAITING etc. per branch
+ * @finished_count: number of branches in state #RASQAL_UNION_BRANCH_FINISHED
+ * @reader_branch: branch read by the reader itself or -1
+ * @stop: non-0 when the tasks must stop reading
+ * @failed: non-0 if a branch task failed
+ * @contexts: evaluation context per branch
+ * @tasks: task data per branch
+ * @group: task group of the branch tasks or NULL when not started
+ *
+ * INTERNAL - Rows of the branches of a union read on the query task pool
+ *
+ * Each branch is read by one task with its own evaluation context so
+ * branches never share variable bindings.  The tasks add the rows to
+ * a queue of at most #RASQAL_UNION_QUEUE_SIZE rows, so they wait
+ * while the reader is slower than them.
+ *
+ * The reader takes rows from the queue and, while it is empty, reads
+ * a branch no task has started yet itself.  It only waits for rows
+ * when every branch is being read by a running task, so it makes
+ * progress when there are fewer pool threads than branches or when
+ * it runs on a pool thread itself.
+ */
+typedef struct rasqal_union_branch_queue_s {
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+
+  rasqal_row* rows[RASQAL_UNION_QUEUE_SIZE];
+  int head;
+  int count;
+
+  int* branch_states;
+  int finished_count;
+  int reader_branch;
+  int stop;
+  int failed;
+
+  rasqal_evaluation_context** contexts;
+  rasqal_union_branch_task* tasks;
+  rasqal_task_group* group;
+} rasqal_union_branch_queue;
+#endif
+
+/*
+ * A UNION of any number of branch rowsources.  Nested unions are
+ * flattened into one rowsource on construction so that each row
+ * passes through a single union however many branches there are.
+ */
 typedef struct 
 {
-  rasqal_rowsource* left;
+  /* number of branches */
+  int branches_count;
 
-  rasqal_rowsource* right;
+  /* array of branch rowsources in order */
+  rasqal_rowsource** branches;
 
-  /* array of size (number of variables in @right) with this row offset value */
-  int* right_map;
+  /* array per branch of size (number of variables in branch) with
+   * this row offset value */
+  int** maps;
 
-  /* array of size (number of variables in @right) holding right row temporarily */
-  rasqal_literal** right_tmp_values;
+  /* array of size (number of variables) holding a row temporarily */
+  rasqal_literal** tmp_values;
 
-  /* 0 = reading from left rs, 1 = reading from right rs, 2 = finished */
+  /* index of branch being read; @branches_count when finished */
   int state;
 
   int failed;
 
   /* row offset for read_row() */
   int offset;
+
+#ifdef RASQAL_UNION_CONCURRENT
+  /* non-0 to read the branches concurrently on the query task pool */
+  int concurrent;
+
+  /* rows of the branches read concurrently; made by the first read */
+  rasqal_union_branch_queue* queue;
+#endif
 } rasqal_union_rowsource_context;
 
 
+static const rasqal_rowsource_handler rasqal_union_rowsource_handler;
+
+#ifdef RASQAL_UNION_CONCURRENT
+static void rasqal_free_union_branch_queue(rasqal_union_branch_queue* queue, int branches_count);
+static void rasqal_union_branch_queue_stop(rasqal_union_branch_queue* queue);
+#endif
+
+
 static int
 rasqal_union_rowsource_init(rasqal_rowsource* rowsource, void *user_data) 
 {
   rasqal_union_rowsource_context* con;
+  int i;
 
   con = (rasqal_union_rowsource_context*)user_data;
   con->state = 0;
 
   con->failed = 0;
 
-  rasqal_rowsource_set_requirements(con->left, RASQAL_ROWSOURCE_REQUIRE_RESET);
-  rasqal_rowsource_set_requirements(con->right, RASQAL_ROWSOURCE_REQUIRE_RESET);
+  for(i = 0; i < con->branches_count; i++)
+    rasqal_rowsource_set_requirements(con->branches[i],
+                                      RASQAL_ROWSOURCE_REQUIRE_RESET);
+
+#ifdef RASQAL_UNION_CONCURRENT
+  con->concurrent = (con->branches_count > 1 &&
+                     rasqal_query_get_parallelism(rowsource->query) > 1);
+#endif
 
   return 0;
 }
@@ -88,18 +202,39 @@ static int
 rasqal_union_rowsource_finish(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_union_rowsource_context* con;
+  int i;
+
   con = (rasqal_union_rowsource_context*)user_data;
-  if(con->left)
-    rasqal_free_rowsource(con->left);
-  
-  if(con->right)
-    rasqal_free_rowsource(con->right);
+
+#ifdef RASQAL_UNION_CONCURRENT
+  /* the branch tasks must end before the branches are freed */
+  if(con->queue)
+    rasqal_union_branch_queue_stop(con->queue);
+#endif
+
+  if(con->branches) {
+    for(i = 0; i < con->branches_count; i++) {
+      if(con->branches[i])
+        rasqal_free_rowsource(con->branches[i]);
+    }
+    RASQAL_FREE(ptrarray, con->branches);
+  }
+
+#ifdef RASQAL_UNION_CONCURRENT
+  if(con->queue)
+    rasqal_free_union_branch_queue(con->queue, con->branches_count);
+#endif
   
-  if(con->right_map)
-    RASQAL_FREE(int, con->right_map);
+  if(con->maps) {
+    for(i = 0; i < con->branches_count; i++) {
+      if(con->maps[i])
+        RASQAL_FREE(int*, con->maps[i]);
+    }
+    RASQAL_FREE(ptrarray, con->maps);
+  }
   
-  if(con->right_tmp_values)
-    RASQAL_FREE(ptrarray, con->right_tmp_values);
+  if(con->tmp_values)
+    RASQAL_FREE(ptrarray, con->tmp_values);
   
   RASQAL_FREE(rasqal_union_rowsource_context, con);
 
@@ -112,74 +247,455 @@ rasqal_union_rowsource_ensure_variables(rasqal_rowsource* rowsource,
                                         void *user_data)
 {
   rasqal_union_rowsource_context* con;
-  int map_size;
-  int i;
+  int branch;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
-  if(rasqal_rowsource_ensure_variables(con->left))
+  con->maps = RASQAL_CALLOC(int**, RASQAL_GOOD_CAST(size_t, con->branches_count),
+                            sizeof(int*));
+  if(!con->maps)
     return 1;
 
-  if(rasqal_rowsource_ensure_variables(con->right))
-    return 1;
+  rowsource->size = 0;
 
-  map_size = rasqal_rowsource_get_size(con->right);
-  con->right_map = RASQAL_MALLOC(int*, sizeof(int) * map_size);
-  if(!con->right_map)
-    return 1;
+  /* add variables from each branch in order, mapping each branch
+   * variable to its offset in the union rows */
+  for(branch = 0; branch < con->branches_count; branch++) {
+    rasqal_rowsource* rs = con->branches[branch];
+    int map_size;
+    int i;
+    
+    if(rasqal_rowsource_ensure_variables(rs))
+      return 1;
 
-  con->right_tmp_values = RASQAL_MALLOC(rasqal_literal**,
-                                        sizeof(rasqal_literal*) * map_size);
-  if(!con->right_tmp_values)
-    return 1;
+    map_size = rasqal_rowsource_get_size(rs);
+    if(map_size <= 0)
+      continue;
+    
+    con->maps[branch] = RASQAL_MALLOC(int*, sizeof(int) * RASQAL_GOOD_CAST(size_t, map_size));
+    if(!con->maps[branch])
+      return 1;
 
-  rowsource->size = 0;
+    for(i = 0; i < map_size; i++) {
+      rasqal_variable* v;
+      int offset;
+    
+      v = rasqal_rowsource_get_variable_by_offset(rs, i);
+      if(!v)
+        break;
+      offset = rasqal_rowsource_add_variable(rowsource, v);
+      if(offset < 0)
+        return 1;
+
+      con->maps[branch][i] = offset;
+    }
+  }
+
+  if(rowsource->size > 0) {
+    con->tmp_values = RASQAL_MALLOC(rasqal_literal**,
+                                    sizeof(rasqal_literal*) * RASQAL_GOOD_CAST(size_t, rowsource->size));
+    if(!con->tmp_values)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * Turn a row from branch @branch into a row of this rowsource.  The
+ * row is changed in place if it is not shared (such as a row saved by
+ * the branch for a reset) otherwise a new row is made.  @tmp_values
+ * is an array of the size of this rowsource used by the caller only.
+ *
+ * Return value: adjusted row or NULL on failure (@row is freed)
+ */
+static rasqal_row*
+rasqal_union_rowsource_adjust_row(rasqal_rowsource *rowsource,
+                                  rasqal_union_rowsource_context* con,
+                                  int branch, rasqal_row *row,
+                                  rasqal_literal** tmp_values)
+{
+  rasqal_rowsource *branch_rowsource = con->branches[branch];
+  int* map = con->maps[branch];
+  int branch_size = branch_rowsource->size;
+  int i;
+
+  if(row->usage > 1) {
+    rasqal_row* nrow;
+
+    nrow = rasqal_new_row_for_size(rowsource->world, rowsource->size);
+    if(!nrow) {
+      rasqal_free_row(row);
+      return NULL;
+    }
+    nrow->offset = row->offset;
+    nrow->group_id = row->group_id;
+
+    for(i = 0; i < branch_size && i < row->size; i++)
+      nrow->values[map[i]] = rasqal_new_literal_from_literal(row->values[i]);
+
+    rasqal_free_row(row);
+    return nrow;
+  }
+
+  if(rasqal_row_expand_size(row, rowsource->size)) {
+    rasqal_free_row(row);
+    return NULL;
+  }
+
+  /* save branch row values */
+  for(i = 0; i < branch_size; i++) {
+    tmp_values[i] = row->values[i];
+    row->values[i] = NULL;
+  }
+
+  /* map them into correct order in result row */
+  for(i = 0; i < branch_size; i++)
+    row->values[map[i]] = tmp_values[i];
+
+  return row;
+}
+
+
+#ifdef RASQAL_UNION_CONCURRENT
+static rasqal_union_branch_queue*
+rasqal_new_union_branch_queue(rasqal_rowsource* rowsource,
+                              rasqal_union_rowsource_context* con)
+{
+  rasqal_union_branch_queue* queue;
+  size_t count = RASQAL_GOOD_CAST(size_t, con->branches_count);
+  int i;
+
+  queue = RASQAL_CALLOC(rasqal_union_branch_queue*, 1, sizeof(*queue));
+  if(!queue)
+    return NULL;
+
+  queue->branch_states = RASQAL_CALLOC(int*, count, sizeof(int));
+  queue->contexts = RASQAL_CALLOC(rasqal_evaluation_context**, count,
+                                  sizeof(rasqal_evaluation_context*));
+  queue->tasks = RASQAL_CALLOC(rasqal_union_branch_task*, count,
+                               sizeof(rasqal_union_branch_task));
+  if(!queue->branch_states || !queue->contexts || !queue->tasks)
+    goto failed;
+
+  for(i = 0; i < con->branches_count; i++) {
+    queue->contexts[i] = rasqal_query_new_execution_context(rowsource->query);
+    if(!queue->contexts[i])
+      goto failed;
+
+    queue->tasks[i].rowsource = rowsource;
+    queue->tasks[i].branch = i;
+  }
+
+  if(pthread_mutex_init(&queue->lock, NULL))
+    goto failed;
+  if(pthread_cond_init(&queue->not_empty, NULL)) {
+    pthread_mutex_destroy(&queue->lock);
+    goto failed;
+  }
+  if(pthread_cond_init(&queue->not_full, NULL)) {
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    goto failed;
+  }
+
+  queue->reader_branch = -1;
+
+  return queue;
+
+  failed:
+  if(queue->contexts) {
+    for(i = 0; i < con->branches_count; i++) {
+      if(queue->contexts[i])
+        rasqal_free_evaluation_context(queue->contexts[i]);
+    }
+    RASQAL_FREE(ptrarray, queue->contexts);
+  }
+  if(queue->branch_states)
+    RASQAL_FREE(int*, queue->branch_states);
+  if(queue->tasks)
+    RASQAL_FREE(rasqal_union_branch_task*, queue->tasks);
+  RASQAL_FREE(rasqal_union_branch_queue, queue);
+  return NULL;
+}
+
+
+/* call after rasqal_union_branch_queue_stop() and after the branches
+ * that use the contexts are freed */
+static void
+rasqal_free_union_branch_queue(rasqal_union_branch_queue* queue,
+                               int branches_count)
+{
+  int i;
+
+  for(i = 0; i < branches_count; i++)
+    rasqal_free_evaluation_context(queue->contexts[i]);
+  RASQAL_FREE(ptrarray, queue->contexts);
+  RASQAL_FREE(int*, queue->branch_states);
+  RASQAL_FREE(rasqal_union_branch_task*, queue->tasks);
+
+  pthread_cond_destroy(&queue->not_full);
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_mutex_destroy(&queue->lock);
+
+  RASQAL_FREE(rasqal_union_branch_queue, queue);
+}
+
+
+/*
+ * Mark branch @branch as finished.  Call with the queue lock held.
+ */
+static void
+rasqal_union_branch_queue_finish_branch(rasqal_union_branch_queue* queue,
+                                        int branch)
+{
+  queue->branch_states[branch] = RASQAL_UNION_BRANCH_FINISHED;
+  queue->finished_count++;
+  pthread_cond_broadcast(&queue->not_empty);
+}
 
-  /* copy in variables from left rowsource */
-  if(rasqal_rowsource_copy_variables(rowsource, con->left))
+
+/*
+ * Add a row to the queue, waiting while it is full.
+ *
+ * Return value: non-0 if the tasks must stop (@row is freed)
+ */
+static int
+rasqal_union_branch_queue_put_row(rasqal_union_branch_queue* queue,
+                                  rasqal_row* row)
+{
+  pthread_mutex_lock(&queue->lock);
+  while(queue->count == RASQAL_UNION_QUEUE_SIZE && !queue->stop)
+    pthread_cond_wait(&queue->not_full, &queue->lock);
+
+  if(queue->stop) {
+    pthread_mutex_unlock(&queue->lock);
+    rasqal_free_row(row);
     return 1;
-  
-  /* add any new variables not already seen from right rowsource */
-  for(i = 0; i < map_size; i++) {
-    rasqal_variable* v;
-    int offset;
-    
-    v = rasqal_rowsource_get_variable_by_offset(con->right, i);
-    if(!v)
+  }
+
+  queue->rows[(queue->head + queue->count) % RASQAL_UNION_QUEUE_SIZE] = row;
+  queue->count++;
+  pthread_cond_signal(&queue->not_empty);
+  pthread_mutex_unlock(&queue->lock);
+
+  return 0;
+}
+
+
+/*
+ * Task reading all the rows of one branch into the queue.  A branch
+ * already taken by the reader is skipped.
+ */
+static int
+rasqal_union_branch_task_run(void* user_data)
+{
+  rasqal_union_branch_task* task = (rasqal_union_branch_task*)user_data;
+  rasqal_rowsource* rowsource = task->rowsource;
+  rasqal_union_rowsource_context* con;
+  rasqal_union_branch_queue* queue;
+  rasqal_literal** tmp_values = NULL;
+  int branch = task->branch;
+  int failed = 0;
+
+  con = (rasqal_union_rowsource_context*)rowsource->user_data;
+  queue = con->queue;
+
+  pthread_mutex_lock(&queue->lock);
+  if(queue->stop ||
+     queue->branch_states[branch] != RASQAL_UNION_BRANCH_WAITING) {
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+  }
+  queue->branch_states[branch] = RASQAL_UNION_BRANCH_READING;
+  pthread_mutex_unlock(&queue->lock);
+
+  if(rowsource->size > 0) {
+    tmp_values = RASQAL_MALLOC(rasqal_literal**,
+                               sizeof(rasqal_literal*) * RASQAL_GOOD_CAST(size_t, rowsource->size));
+    if(!tmp_values)
+      failed = 1;
+  }
+
+  while(!failed) {
+    rasqal_row* row;
+
+    row = rasqal_rowsource_read_row(con->branches[branch]);
+    if(!row)
       break;
-    offset = rasqal_rowsource_add_variable(rowsource, v);
-    if(offset < 0)
-      return 1;
 
-    con->right_map[i] = offset;
+    row = rasqal_union_rowsource_adjust_row(rowsource, con, branch, row,
+                                            tmp_values);
+    if(!row) {
+      failed = 1;
+      break;
+    }
+
+    if(rasqal_union_branch_queue_put_row(queue, row))
+      break;
+  }
+
+  if(tmp_values)
+    RASQAL_FREE(ptrarray, tmp_values);
+
+  pthread_mutex_lock(&queue->lock);
+  if(failed)
+    queue->failed = 1;
+  rasqal_union_branch_queue_finish_branch(queue, branch);
+  pthread_mutex_unlock(&queue->lock);
+
+  return failed;
+}
+
+
+/*
+ * Give each branch its evaluation context and submit a task per
+ * branch to the query task pool.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_union_branch_queue_start(rasqal_rowsource* rowsource,
+                                rasqal_union_rowsource_context* con)
+{
+  rasqal_union_branch_queue* queue = con->queue;
+  rasqal_execution_control* control = NULL;
+  int i;
+
+  /* the branches share the cancellation, deadline and memory limit
+   * of the execution */
+  if(rowsource->eval_context)
+    control = RASQAL_EVALUATION_CONTEXT_CONTROL(rowsource->eval_context);
+
+  for(i = 0; i < con->branches_count; i++) {
+    RASQAL_EVALUATION_CONTEXT_CONTROL(queue->contexts[i]) = control;
+    rasqal_rowsource_set_evaluation_context(con->branches[i],
+                                            queue->contexts[i]);
+    queue->branch_states[i] = RASQAL_UNION_BRANCH_WAITING;
+  }
+  queue->finished_count = 0;
+  queue->reader_branch = -1;
+  queue->stop = 0;
+  queue->failed = 0;
+
+  queue->group = rasqal_new_task_group(rasqal_query_get_task_pool(rowsource->query));
+  if(!queue->group)
+    return 1;
+
+  for(i = 0; i < con->branches_count; i++) {
+    if(rasqal_task_group_submit(queue->group, rasqal_union_branch_task_run,
+                                &queue->tasks[i]))
+      return 1;
   }
 
   return 0;
 }
 
 
+/*
+ * Stop the branch tasks, wait for them to end and free the rows left
+ * in the queue.  The branches may be reset or freed afterwards.
+ */
 static void
-rasqal_union_rowsource_adjust_right_row(rasqal_rowsource *rowsource,
-                                        rasqal_union_rowsource_context* con,
-                                        rasqal_row *row)
+rasqal_union_branch_queue_stop(rasqal_union_branch_queue* queue)
+{
+  if(!queue->group)
+    return;
+
+  pthread_mutex_lock(&queue->lock);
+  queue->stop = 1;
+  pthread_cond_broadcast(&queue->not_full);
+  pthread_mutex_unlock(&queue->lock);
+
+  rasqal_free_task_group(queue->group);
+  queue->group = NULL;
+
+  while(queue->count) {
+    rasqal_free_row(queue->rows[queue->head]);
+    queue->head = (queue->head + 1) % RASQAL_UNION_QUEUE_SIZE;
+    queue->count--;
+  }
+  queue->head = 0;
+}
+
+
+/*
+ * Read the next row of any branch from the queue, or from a branch
+ * no task has started reading yet.
+ *
+ * Return value: row or NULL when all branches are finished or on failure
+ */
+static rasqal_row*
+rasqal_union_branch_queue_read_row(rasqal_rowsource* rowsource,
+                                   rasqal_union_rowsource_context* con)
 {
-  rasqal_rowsource *right_rowsource = con->right;
+  rasqal_union_branch_queue* queue = con->queue;
+  rasqal_row* row = NULL;
   int i;
 
-  /* save right row values */
-  for(i = 0; i < right_rowsource->size; i++)
-    con->right_tmp_values[i] = row->values[i];
+  if(!queue->group && rasqal_union_branch_queue_start(rowsource, con)) {
+    con->failed = 1;
+    return NULL;
+  }
 
-  /* NULL out other pointers */
-  for(i = 0; i < rowsource->size; i++)
-    row->values[i] = NULL;
+  pthread_mutex_lock(&queue->lock);
+  while(1) {
+    int branch;
 
-  /* map them into correct order in result row */
-  for(i = 0; i < right_rowsource->size; i++) {
-    int offset = con->right_map[i];
-    row->values[offset] = con->right_tmp_values[i];
+    if(queue->count) {
+      row = queue->rows[queue->head];
+      queue->head = (queue->head + 1) % RASQAL_UNION_QUEUE_SIZE;
+      queue->count--;
+      pthread_cond_signal(&queue->not_full);
+      break;
+    }
+
+    if(queue->failed) {
+      con->failed = 1;
+      break;
+    }
+
+    if(queue->reader_branch < 0) {
+      for(i = 0; i < con->branches_count; i++) {
+        if(queue->branch_states[i] == RASQAL_UNION_BRANCH_WAITING) {
+          queue->branch_states[i] = RASQAL_UNION_BRANCH_READING;
+          queue->reader_branch = i;
+          break;
+        }
+      }
+    }
+
+    branch = queue->reader_branch;
+    if(branch < 0) {
+      if(queue->finished_count == con->branches_count)
+        break;
+
+      /* every unfinished branch is being read by a running task */
+      pthread_cond_wait(&queue->not_empty, &queue->lock);
+      continue;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    row = rasqal_rowsource_read_row(con->branches[branch]);
+    if(row) {
+      row = rasqal_union_rowsource_adjust_row(rowsource, con, branch, row,
+                                              con->tmp_values);
+      if(!row)
+        con->failed = 1;
+      pthread_mutex_lock(&queue->lock);
+      break;
+    }
+    pthread_mutex_lock(&queue->lock);
+
+    queue->reader_branch = -1;
+    rasqal_union_branch_queue_finish_branch(queue, branch);
   }
+  pthread_mutex_unlock(&queue->lock);
+
+  return row;
 }
+#endif
 
 
 static rasqal_row*
@@ -190,34 +706,32 @@ rasqal_union_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
 
   con = (rasqal_union_rowsource_context*)user_data;
   
-  if(con->failed || con->state > 1)
+  if(con->failed)
     return NULL;
 
-  if(con->state == 0) {
-    row = rasqal_rowsource_read_row(con->left);
-#ifdef RASQAL_DEBUG
-    RASQAL_DEBUG2("rowsource %p read left row : ", rowsource);
-    if(row)
-      rasqal_row_print(row, stderr);
-    else
-      fputs("NONE", stderr);
-    fputs("\n", stderr);
-#endif
-
-    if(!row)
-      con->state = 1;
-    else {
-      /* otherwise: rows from left are correct order but wrong size */
-      if(rasqal_row_expand_size(row, rowsource->size)) {
-        rasqal_free_row(row);
+#ifdef RASQAL_UNION_CONCURRENT
+  if(con->concurrent) {
+    if(!con->queue) {
+      con->queue = rasqal_new_union_branch_queue(rowsource, con);
+      if(!con->queue) {
+        con->failed = 1;
         return NULL;
       }
     }
+
+    row = rasqal_union_branch_queue_read_row(rowsource, con);
+    if(row) {
+      row->rowsource = rowsource;
+      row->offset = con->offset++;
+    }
+    return row;
   }
-  if(!row && con->state == 1) {
-    row = rasqal_rowsource_read_row(con->right);
+#endif
+
+  while(con->state < con->branches_count) {
+    row = rasqal_rowsource_read_row(con->branches[con->state]);
 #ifdef RASQAL_DEBUG
-    RASQAL_DEBUG2("rowsource %p read right row : ", rowsource);
+    RASQAL_DEBUG3("rowsource %p read branch %d row : ", rowsource, con->state);
     if(row)
       rasqal_row_print(row, stderr);
     else
@@ -225,20 +739,20 @@ rasqal_union_rowsource_read_row(rasqal_rowsource* rowsource, void *user_data)
     fputs("\n", stderr);
 #endif
 
-    if(!row)
-      /* finished */
-      con->state = 2;
-    else {
-      if(rasqal_row_expand_size(row, rowsource->size)) {
-        rasqal_free_row(row);
-        return NULL;
-      }
-      /* transform row from right to match new projection */
-      rasqal_union_rowsource_adjust_right_row(rowsource, con, row);
-    }
+    if(row)
+      break;
+
+    /* branch finished; go on to the next */
+    con->state++;
   }
 
   if(row) {
+    row = rasqal_union_rowsource_adjust_row(rowsource, con, con->state, row,
+                                            con->tmp_values);
+    if(!row) {
+      con->failed = 1;
+      return NULL;
+    }
     row->rowsource = rowsource;
     row->offset = con->offset++;
   }
@@ -252,67 +766,94 @@ rasqal_union_rowsource_read_all_rows(rasqal_rowsource* rowsource,
                                      void *user_data)
 {
   rasqal_union_rowsource_context* con;
-  raptor_sequence* seq1 = NULL;
-  raptor_sequence* seq2 = NULL;
-  int left_size;
-  int right_size;
-  int i;
+  raptor_sequence* seq = NULL;
+  int branch;
+  int offset = 0;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
   if(con->failed)
     return NULL;
-  
-  seq1 = rasqal_rowsource_read_all_rows(con->left);
-  if(!seq1) {
-    con->failed = 1;
-    return NULL;
-  }
 
-  seq2 = rasqal_rowsource_read_all_rows(con->right);
-  if(!seq2) {
-    con->failed = 1;
-    raptor_free_sequence(seq1);
-    return NULL;
+#ifdef RASQAL_UNION_CONCURRENT
+  if(con->concurrent) {
+    /* rows in the order the branch tasks return them */
+    seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                              (raptor_data_print_handler)rasqal_row_print);
+    if(!seq)
+      return NULL;
+
+    while(1) {
+      rasqal_row* row;
+
+      row = rasqal_union_rowsource_read_row(rowsource, user_data);
+      if(!row)
+        break;
+      raptor_sequence_push(seq, row);
+    }
+
+    if(con->failed)
+      goto failed;
+
+    return seq;
   }
+#endif
+  
+  for(branch = 0; branch < con->branches_count; branch++) {
+    raptor_sequence* branch_seq;
+    int size;
+    int i;
+
+    branch_seq = rasqal_rowsource_read_all_rows(con->branches[branch]);
+    if(!branch_seq) {
+      con->failed = 1;
+      goto failed;
+    }
 
 #ifdef RASQAL_DEBUG
-  fprintf(DEBUG_FH, "left rowsource (%d vars):\n",
-          rasqal_rowsource_get_size(con->left));
-  rasqal_rowsource_print_row_sequence(con->left, seq1, DEBUG_FH);
-
-  fprintf(DEBUG_FH, "right rowsource (%d vars):\n",
-          rasqal_rowsource_get_size(con->right));
-  rasqal_rowsource_print_row_sequence(con->right, seq2, DEBUG_FH);
+    fprintf(DEBUG_FH, "branch %d rowsource (%d vars):\n", branch,
+            rasqal_rowsource_get_size(con->branches[branch]));
+    rasqal_rowsource_print_row_sequence(con->branches[branch], branch_seq,
+                                        DEBUG_FH);
 #endif
 
-  /* transform rows from left to match new projection */
-  left_size = raptor_sequence_size(seq1);
-  for(i = 0; i < left_size; i++) {
-    rasqal_row *row = (rasqal_row*)raptor_sequence_get_at(seq1, i);
-    /* rows from left are correct order but wrong size */
-    rasqal_row_expand_size(row, rowsource->size);
-    row->rowsource = rowsource;
-  }
-  /* transform rows from right to match new projection */
-  right_size = raptor_sequence_size(seq2);
-  for(i = 0; i < right_size; i++) {
-    rasqal_row *row = (rasqal_row*)raptor_sequence_get_at(seq2, i);
-    /* rows from right need resizing and adjusting by offset */
-    rasqal_row_expand_size(row, rowsource->size);
-    rasqal_union_rowsource_adjust_right_row(rowsource, con, row);
-    row->offset += left_size;
-    row->rowsource = rowsource;
-  }
+    /* transform rows from branch to match new projection */
+    size = raptor_sequence_size(branch_seq);
+    for(i = 0; i < size; i++) {
+      rasqal_row *row;
+
+      row = (rasqal_row*)raptor_sequence_delete_at(branch_seq, i);
+      row = rasqal_union_rowsource_adjust_row(rowsource, con, branch, row,
+                                              con->tmp_values);
+      if(!row) {
+        raptor_free_sequence(branch_seq);
+        con->failed = 1;
+        goto failed;
+      }
+      row->offset = offset++;
+      row->rowsource = rowsource;
+      raptor_sequence_set_at(branch_seq, i, row);
+    }
 
-  if(raptor_sequence_join(seq1, seq2)) {
-    raptor_free_sequence(seq1);
-    seq1 = NULL;
+    if(!seq)
+      seq = branch_seq;
+    else {
+      int rc = raptor_sequence_join(seq, branch_seq);
+      raptor_free_sequence(branch_seq);
+      if(rc) {
+        con->failed = 1;
+        goto failed;
+      }
+    }
   }
-  raptor_free_sequence(seq2);
-  
-  con->state = 2;
-  return seq1;
+
+  con->state = con->branches_count;
+  return seq;
+
+  failed:
+  if(seq)
+    raptor_free_sequence(seq);
+  return NULL;
 }
 
 
@@ -320,18 +861,46 @@ static int
 rasqal_union_rowsource_reset(rasqal_rowsource* rowsource, void *user_data)
 {
   rasqal_union_rowsource_context* con;
-  int rc;
+  int i;
   
   con = (rasqal_union_rowsource_context*)user_data;
 
+#ifdef RASQAL_UNION_CONCURRENT
+  /* the tasks are started again by the next read */
+  if(con->queue)
+    rasqal_union_branch_queue_stop(con->queue);
+#endif
+
   con->state = 0;
   con->failed = 0;
+  con->offset = 0;
+
+  for(i = 0; i < con->branches_count; i++) {
+    int rc = rasqal_rowsource_reset(con->branches[i]);
+    if(rc)
+      return rc;
+  }
+
+  return 0;
+}
+
+
+static int
+rasqal_union_rowsource_set_limit_hint(rasqal_rowsource* rowsource,
+                                      void *user_data, int limit)
+{
+  rasqal_union_rowsource_context *con;
+  int i;
 
-  rc = rasqal_rowsource_reset(con->left);
-  if(rc)
-    return rc;
+  con = (rasqal_union_rowsource_context*)user_data;
+
+  /* any branch may provide all the rows */
+  for(i = 0; i < con->branches_count; i++) {
+    if(rasqal_rowsource_set_limit_hint(con->branches[i], limit))
+      return 1;
+  }
 
-  return rasqal_rowsource_reset(con->right);
+  return 0;
 }
 
 
@@ -342,17 +911,15 @@ rasqal_union_rowsource_get_inner_rowsource(rasqal_rowsource* rowsource,
   rasqal_union_rowsource_context *con;
   con = (rasqal_union_rowsource_context*)user_data;
 
-  if(offset == 0)
-    return con->left;
-  else if(offset == 1)
-    return con->right;
-  else
-    return NULL;
+  if(offset >= 0 && offset < con->branches_count)
+    return con->branches[offset];
+
+  return NULL;
 }
 
 
 static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
-  /* .version = */ 1,
+  /* .version = */ 2,
   "union",
   /* .init = */ rasqal_union_rowsource_init,
   /* .finish = */ rasqal_union_rowsource_finish,
@@ -363,9 +930,55 @@ static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
   /* .set_requirements = */ NULL,
   /* .get_inner_rowsource = */ rasqal_union_rowsource_get_inner_rowsource,
   /* .set_origin = */ NULL,
+  /* .read_batch = */ NULL,
+  /* .set_limit_hint = */ rasqal_union_rowsource_set_limit_hint,
 };
 
 
+/*
+ * Append the branches of @rs to @branches, taking ownership of @rs.
+ * A union rowsource that has not been used yet is replaced by its
+ * own branches and freed.
+ */
+static int
+rasqal_union_rowsource_add_branches(rasqal_rowsource** branches, int* count_p,
+                                    rasqal_rowsource* rs)
+{
+  rasqal_union_rowsource_context* con;
+  int i;
+
+  if(rs->handler != &rasqal_union_rowsource_handler ||
+     rs->updated_variables || rs->flags) {
+    branches[(*count_p)++] = rs;
+    return 0;
+  }
+
+  con = (rasqal_union_rowsource_context*)rs->user_data;
+  for(i = 0; i < con->branches_count; i++)
+    branches[(*count_p)++] = con->branches[i];
+
+  /* branches now owned by caller */
+  con->branches_count = 0;
+  rasqal_free_rowsource(rs);
+
+  return 0;
+}
+
+
+static int
+rasqal_union_rowsource_count_branches(rasqal_rowsource* rs)
+{
+  rasqal_union_rowsource_context* con;
+
+  if(rs->handler != &rasqal_union_rowsource_handler ||
+     rs->updated_variables || rs->flags)
+    return 1;
+
+  con = (rasqal_union_rowsource_context*)rs->user_data;
+  return con->branches_count;
+}
+
+
 /**
  * rasqal_new_union_rowsource:
  * @world: world object
@@ -375,10 +988,12 @@ static const rasqal_rowsource_handler rasqal_union_rowsource_handler = {
  *
  * INTERNAL - create a new UNION over two rowsources
  *
- * This uses the number of variables in @vt to set the rowsource size
- * (order size is always 0) and then checks that all the rows in the
- * sequence are the same.  If not, construction fails and NULL is
- * returned.
+ * If @left or @right are themselves unused UNION rowsources, their
+ * branches are taken over so that a chain of UNIONs becomes one
+ * rowsource with many branches.  The branches are read in order or,
+ * when the query has a task pool of more than one thread, each by a
+ * task on the pool and the rows are returned in the order they are
+ * read.
  *
  * The @left and @right rowsources become owned by the new rowsource.
  *
@@ -392,6 +1007,7 @@ rasqal_new_union_rowsource(rasqal_world *world,
 {
   rasqal_union_rowsource_context* con;
   int flags = 0;
+  int count;
 
   if(!world || !query || !left || !right)
     goto fail;
@@ -400,8 +1016,20 @@ rasqal_new_union_rowsource(rasqal_world *world,
   if(!con)
     goto fail;
 
-  con->left = left;
-  con->right = right;
+  count = rasqal_union_rowsource_count_branches(left) +
+          rasqal_union_rowsource_count_branches(right);
+  con->branches = RASQAL_CALLOC(rasqal_rowsource**,
+                                RASQAL_GOOD_CAST(size_t, count),
+                                sizeof(rasqal_rowsource*));
+  if(!con->branches) {
+    RASQAL_FREE(rasqal_union_rowsource_context, con);
+    goto fail;
+  }
+
+  rasqal_union_rowsource_add_branches(con->branches, &con->branches_count,
+                                      left);
+  rasqal_union_rowsource_add_branches(con->branches, &con->branches_count,
+                                      right);
   
   return rasqal_new_rowsource_from_handler(world, query,
                                            con,
@@ -467,6 +1095,246 @@ const char* const union_2_data_3x4_rows[] =
 const char* const union_result_vars[] = { "a" , "b" , "c", "d" };
 
 
+const char* const union_3_data_1x2_rows[] =
+{
+  /* 1 variable name and 2 rows */
+  "e",     NULL,
+  /* row 1 data */
+  "north", NULL,
+  /* row 2 data */
+  "south", NULL,
+  /* end of data */
+  NULL, NULL
+};
+
+/* union of union with a third rowsource flattens to 3 branches */
+#define EXPECTED_BRANCHES_COUNT 3
+#define EXPECTED_ROWS_COUNT_3 (3 + 4 + 2)
+#define EXPECTED_COLUMNS_COUNT_3 (EXPECTED_COLUMNS_COUNT + 1)
+
+
+static rasqal_rowsource*
+union_test_make_rowsource(rasqal_world* world, rasqal_query* query,
+                          const char* const data[], int vars_count)
+{
+  raptor_sequence* seq;
+  raptor_sequence* vars_seq = NULL;
+
+  seq = rasqal_new_row_sequence(world, query->vars_table, data, vars_count,
+                                &vars_seq);
+  if(!seq)
+    return NULL;
+
+  /* vars_seq and seq are owned by rowsource */
+  return rasqal_new_rowsequence_rowsource(world, query, query->vars_table,
+                                          seq, vars_seq);
+}
+
+
+/* wide union read in the calling thread and on the task pool */
+#define CONCURRENT_BRANCHES_COUNT 8
+/* more rows in all than fit in the union row queue */
+#define CONCURRENT_BRANCH_ROWS 100
+#define CONCURRENT_ROWS_COUNT (CONCURRENT_BRANCHES_COUNT * CONCURRENT_BRANCH_ROWS)
+/* rows read before a reset */
+#define CONCURRENT_RESET_ROWS 10
+#define ROW_STRING_SIZE 32
+
+typedef char union_test_row_string[ROW_STRING_SIZE];
+
+
+static rasqal_rowsource*
+union_test_make_wide_union(rasqal_world* world, rasqal_query* query)
+{
+  static const char* const names[3] = { "a", "b", "c" };
+  rasqal_rowsource* rowsource = NULL;
+  int branch;
+
+  for(branch = 0; branch < CONCURRENT_BRANCHES_COUNT; branch++) {
+    const char* data[(CONCURRENT_BRANCH_ROWS + 2) * 4];
+    char strings[CONCURRENT_BRANCH_ROWS * 2][ROW_STRING_SIZE];
+    rasqal_rowsource* rs;
+    int i;
+
+    memset(data, 0, sizeof(data));
+
+    /* even branches bind ?a ?b and odd branches ?b ?c */
+    data[0] = names[branch & 1];
+    data[2] = names[(branch & 1) + 1];
+    for(i = 0; i < CONCURRENT_BRANCH_ROWS; i++) {
+      sprintf(strings[i * 2], "x%d_%d", branch, i);
+      sprintf(strings[i * 2 + 1], "y%d", i % 10);
+      data[(i + 1) * 4] = strings[i * 2];
+      data[(i + 1) * 4 + 2] = strings[i * 2 + 1];
+    }
+
+    rs = union_test_make_rowsource(world, query, data, 2);
+    if(!rs) {
+      if(rowsource)
+        rasqal_free_rowsource(rowsource);
+      return NULL;
+    }
+
+    if(!rowsource)
+      rowsource = rs;
+    else {
+      rowsource = rasqal_new_union_rowsource(world, query, rowsource, rs);
+      if(!rowsource)
+        return NULL;
+    }
+  }
+
+  return rowsource;
+}
+
+
+static int
+union_test_compare_strings(const void *a, const void *b)
+{
+  return strcmp((const char*)a, (const char*)b);
+}
+
+
+/*
+ * Read the rows of @rowsource into @strings, one string per row,
+ * sorted so that the branch order does not matter.
+ *
+ * Return value: number of rows or <0 on failure
+ */
+static int
+union_test_read_sorted(rasqal_rowsource* rowsource,
+                       union_test_row_string* strings, int max_count)
+{
+  int count = 0;
+
+  while(1) {
+    rasqal_row* row;
+    char* p;
+    int i;
+
+    row = rasqal_rowsource_read_row(rowsource);
+    if(!row)
+      break;
+
+    if(count == max_count || row->offset != count) {
+      rasqal_free_row(row);
+      return -1;
+    }
+
+    p = strings[count];
+    *p = '\0';
+    for(i = 0; i < row->size; i++) {
+      const unsigned char* str = NULL;
+
+      if(row->values[i])
+        str = rasqal_literal_as_string(row->values[i]);
+      sprintf(p + strlen(p), "%s ", str ? (const char*)str : "-");
+    }
+
+    rasqal_free_row(row);
+    count++;
+  }
+
+  qsort(strings, RASQAL_GOOD_CAST(size_t, count), sizeof(*strings),
+        union_test_compare_strings);
+
+  return count;
+}
+
+
+/*
+ * Check that a union read concurrently on the task pool returns the
+ * same rows as read in order, also after a reset part way through.
+ */
+static int
+union_test_concurrent(const char* program, rasqal_world* world)
+{
+  union_test_row_string* strings[2] = { NULL, NULL };
+  int counts[2] = { 0, 0 };
+  int failures = 0;
+  int run;
+
+#ifndef HAVE_PTHREAD_H
+  fprintf(stderr, "%s: no worker threads, skipping concurrent union test\n",
+          program);
+  return 0;
+#endif
+
+  if(rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 4)) {
+    fprintf(stderr, "%s: setting world threads FAILED\n", program);
+    return 1;
+  }
+
+  for(run = 0; run < 2; run++) {
+    rasqal_query* query;
+    rasqal_rowsource* rowsource = NULL;
+
+    query = rasqal_new_query(world, "sparql", NULL);
+    if(!query) {
+      failures++;
+      break;
+    }
+
+    /* first run is read in the calling thread */
+    if(!run)
+      rasqal_query_set_feature(query, RASQAL_FEATURE_THREADS, 1);
+
+    strings[run] = RASQAL_CALLOC(union_test_row_string*,
+                                 CONCURRENT_ROWS_COUNT,
+                                 sizeof(union_test_row_string));
+    if(strings[run])
+      rowsource = union_test_make_wide_union(world, query);
+    if(!rowsource) {
+      fprintf(stderr, "%s: failed to create wide union rowsource\n", program);
+      rasqal_free_query(query);
+      failures++;
+      break;
+    }
+
+    if(run) {
+      int i;
+
+      for(i = 0; i < CONCURRENT_RESET_ROWS; i++) {
+        rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+        if(row)
+          rasqal_free_row(row);
+      }
+      rasqal_rowsource_reset(rowsource);
+    }
+
+    counts[run] = union_test_read_sorted(rowsource, strings[run],
+                                         CONCURRENT_ROWS_COUNT);
+    if(counts[run] != CONCURRENT_ROWS_COUNT) {
+      fprintf(stderr,
+              "%s: wide union %s returned %d rows, expected %d\n",
+              program, (run ? "read concurrently" : "read in order"),
+              counts[run], CONCURRENT_ROWS_COUNT);
+      failures++;
+    }
+
+    rasqal_free_rowsource(rowsource);
+    rasqal_free_query(query);
+  }
+
+  if(!failures && memcmp(strings[0], strings[1],
+                         sizeof(union_test_row_string) * CONCURRENT_ROWS_COUNT)) {
+    fprintf(stderr,
+            "%s: wide union read concurrently returned different rows\n",
+            program);
+    failures++;
+  }
+
+  for(run = 0; run < 2; run++) {
+    if(strings[run])
+      RASQAL_FREE(union_test_row_string*, strings[run]);
+  }
+
+  rasqal_world_set_feature(world, RASQAL_FEATURE_THREADS, 0);
+
+  return failures;
+}
+
+
 int
 main(int argc, char *argv[]) 
 {
@@ -596,6 +1464,85 @@ main(int argc, char *argv[])
   rasqal_rowsource_print_row_sequence(rowsource, seq, DEBUG_FH);
 #endif
 
+  raptor_free_sequence(seq); seq = NULL;
+  rasqal_free_rowsource(rowsource); rowsource = NULL;
+
+  /* (1 UNION 2) UNION 3 */
+  left_rs = union_test_make_rowsource(world, query, union_1_data_2x3_rows, 2);
+  right_rs = union_test_make_rowsource(world, query, union_2_data_3x4_rows, 3);
+  if(!left_rs || !right_rs) {
+    fprintf(stderr, "%s: failed to create inner union rowsources\n", program);
+    failures++;
+    goto tidy;
+  }
+  rowsource = rasqal_new_union_rowsource(world, query, left_rs, right_rs);
+  left_rs = right_rs = NULL;
+  if(!rowsource) {
+    fprintf(stderr, "%s: failed to create inner union rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  left_rs = rowsource;
+  rowsource = NULL;
+  right_rs = union_test_make_rowsource(world, query, union_3_data_1x2_rows, 1);
+  if(!right_rs) {
+    fprintf(stderr, "%s: failed to create third rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+  rowsource = rasqal_new_union_rowsource(world, query, left_rs, right_rs);
+  left_rs = right_rs = NULL;
+  if(!rowsource) {
+    fprintf(stderr, "%s: failed to create outer union rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; rasqal_rowsource_get_inner_rowsource(rowsource, i); i++)
+    ;
+  if(i != EXPECTED_BRANCHES_COUNT) {
+    fprintf(stderr,
+            "%s: nested union rowsource has %d branches, expected %d\n",
+            program, i, EXPECTED_BRANCHES_COUNT);
+    failures++;
+    goto tidy;
+  }
+
+  /* read row by row to check the ordering across branches */
+  count = 0;
+  while(1) {
+    rasqal_row* row = rasqal_rowsource_read_row(rowsource);
+    if(!row)
+      break;
+    if(row->offset != count) {
+      fprintf(stderr,
+              "%s: nested union row has offset %d, expected %d\n",
+              program, row->offset, count);
+      failures++;
+    }
+    rasqal_free_row(row);
+    count++;
+  }
+  if(count != EXPECTED_ROWS_COUNT_3) {
+    fprintf(stderr,
+            "%s: nested union rowsource returned %d rows, expected %d\n",
+            program, count, EXPECTED_ROWS_COUNT_3);
+    failures++;
+    goto tidy;
+  }
+
+  size = rasqal_rowsource_get_size(rowsource);
+  if(size != EXPECTED_COLUMNS_COUNT_3) {
+    fprintf(stderr,
+            "%s: nested union rowsource has %d columns, expected %d\n",
+            program, size, EXPECTED_COLUMNS_COUNT_3);
+    failures++;
+    goto tidy;
+  }
+
+  failures += union_test_concurrent(program, world);
+
   tidy:
   if(seq)
     raptor_free_sequence(seq);
@@ -38,6 +38,19 @@
 #include <unistd.h>
 #endif
 #include <stdarg.h>
+#ifdef TIME_WITH_SYS_TIME
+# include <sys/time.h>
+# include <time.h>
+#else
+# ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+# else
+#  include <time.h>
+# endif
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include "rasqal.h"
 #include "rasqal_internal.h"
@@ -45,6 +58,115 @@
 
 #define DEFAULT_FORMAT "application/sparql-results+xml"
 
+/* bytes of a response handed from the fetch to the results reader at once */
+#define RASQAL_SERVICE_STREAM_CHUNK_SIZE 65536
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * rasqal_service_stream:
+ * @svc: service being fetched (a reference)
+ * @retrieval_uri: URI being fetched (a reference)
+ * @thread: thread running raptor_www_fetch()
+ * @lock: lock for @fetching
+ * @turn_changed: signalled when @fetching changes
+ * @fetching: non-0 when it is the turn of the fetch thread, else of the reader
+ * @buffer: response bytes not yet read
+ * @capacity: size of @buffer
+ * @length: number of bytes in @buffer
+ * @offset: number of bytes of @buffer already read
+ * @finished: non-0 when the fetch has returned
+ * @failed: non-0 if the fetch failed
+ * @cancelled: non-0 if the reader stopped before the end of the response
+ *
+ * INTERNAL - Service response passed from a fetch thread to a reader
+ *
+ * The fetch thread and the reading thread take turns so only one of
+ * them runs at a time and the raptor and rasqal world objects are
+ * never used by both at once.  The fetch thread buffers a chunk of
+ * the response and waits while the results reader parses it, so rows
+ * are returned while the response is arriving and at most a chunk is
+ * held in memory.
+ */
+typedef struct {
+  rasqal_service* svc;
+  raptor_uri* retrieval_uri;
+
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t turn_changed;
+  int fetching;
+
+  unsigned char* buffer;
+  size_t capacity;
+  size_t length;
+  size_t offset;
+
+  int finished;
+  int failed;
+  int cancelled;
+} rasqal_service_stream;
+
+
+/*
+ * rasqal_service_prefetch_group:
+ * @lock: lock for @in_flight and @in_flight_count
+ * @request_finished: signalled when a request ends
+ * @max_requests: maximum number of requests in flight to one endpoint
+ * @in_flight: endpoint URI strings of the requests in flight (shared)
+ * @in_flight_count: number of requests in flight
+ * @usage: reference count; one per prefetch
+ *
+ * INTERNAL - Services of one query execution fetched concurrently
+ */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t request_finished;
+  int max_requests;
+  const char** in_flight;
+  int in_flight_count;
+  int usage;
+} rasqal_service_prefetch_group;
+
+
+/*
+ * rasqal_service_prefetch:
+ * @group: group limiting the requests in flight (a reference)
+ * @thread: thread running raptor_www_fetch()
+ * @endpoint: service URI string
+ * @retrieval_uri: URI string to fetch
+ * @accept: HTTP Accept: value
+ * @sb: response bytes
+ * @content_type: response content type or NULL
+ * @final_uri: response URI after redirects or NULL
+ * @error: first error message of the fetch or NULL
+ * @failed: non-0 if the fetch failed
+ * @cancelled: non-0 if the response is no longer needed; set and read
+ *   with the @group lock held
+ *
+ * INTERNAL - Service response fetched in a thread before it is read
+ *
+ * The fetch thread uses its own raptor world and only strings so it
+ * shares no raptor or rasqal objects with the query execution.
+ */
+typedef struct {
+  rasqal_service_prefetch_group* group;
+  pthread_t thread;
+
+  char* endpoint;
+  char* retrieval_uri;
+  char* accept;
+
+  raptor_stringbuffer* sb;
+  char* content_type;
+  char* final_uri;
+  char* error;
+
+  int failed;
+  int cancelled;
+} rasqal_service_prefetch;
+#endif
+
 
 struct rasqal_service_s
 {
@@ -66,10 +188,25 @@ struct rasqal_service_s
   raptor_stringbuffer* sb;
   char* content_type;
 
+#ifdef HAVE_PTHREAD_H
+  /* response stream being fetched or NULL if buffering in @sb */
+  rasqal_service_stream* stream;
+
+  /* response being fetched concurrently or NULL */
+  rasqal_service_prefetch* prefetch;
+#endif
+
   int usage;
 };
 
 
+#ifdef HAVE_PTHREAD_H
+static void rasqal_service_cancel_prefetch(rasqal_service* svc);
+static int rasqal_service_finish_prefetch(rasqal_service* svc);
+#endif
+static char* rasqal_service_cache_key(rasqal_service* svc, raptor_uri* retrieval_uri);
+static int rasqal_service_cache_has(rasqal_world* world, const char* key);
+
 
 /**
  * rasqal_new_service:
@@ -189,6 +326,13 @@ rasqal_free_service(rasqal_service* svc)
   if(svc->data_graphs)
     raptor_free_sequence(svc->data_graphs);
   
+#ifdef HAVE_PTHREAD_H
+  if(svc->prefetch) {
+    rasqal_service_cancel_prefetch(svc);
+    rasqal_service_finish_prefetch(svc);
+  }
+#endif
+
   rasqal_service_set_www(svc, NULL);
 
   RASQAL_FREE(rasqal_service, svc);
@@ -249,101 +393,21 @@ rasqal_service_set_format(rasqal_service* svc, const char *format)
 }
 
 
-static void
-rasqal_service_write_bytes(raptor_www* www,
-                           void *userdata, const void *ptr, 
-                           size_t size, size_t nmemb)
-{
-  rasqal_service* svc = (rasqal_service*)userdata;
-  size_t len = size * nmemb;
-
-  if(!svc->started) {
-    svc->final_uri = raptor_www_get_final_uri(www);
-    svc->started = 1;
-  }
-
-  raptor_stringbuffer_append_counted_string(svc->sb,
-                                            RASQAL_GOOD_CAST(const unsigned char*, ptr),
-                                            len, 1);
-}
-
-
-static void
-rasqal_service_content_type_handler(raptor_www* www, void* userdata, 
-                                    const char* content_type)
-{
-  rasqal_service* svc = (rasqal_service*)userdata;
-  size_t len;
-  
-  if(svc->content_type)
-    RASQAL_FREE(char*, svc->content_type);
-
-  len = strlen(content_type);
-  svc->content_type = RASQAL_MALLOC(char*, len + 1);
-
-  if(svc->content_type) {
-    char* p;
-
-    memcpy(svc->content_type, content_type, len + 1);
-
-    for(p = svc->content_type; *p; p++) {
-      if(*p == ';' || *p == ' ') {
-        *p = '\0';
-        break;
-      }
-    }
-  }
-
-}
-
-
-/**
- * rasqal_service_execute_as_rowsource:
+/*
+ * rasqal_service_new_retrieval_uri:
  * @svc: rasqal service
  *
- * INTERNAL - Execute a rasqal sparql protocol service to a rowsurce
+ * INTERNAL - Build the SPARQL protocol URI to fetch for a service
  *
- * Return value: query results or NULL on failure
+ * Return value: new URI or NULL on failure
  */
-rasqal_rowsource*
-rasqal_service_execute_as_rowsource(rasqal_service* svc,
-                                    rasqal_variables_table* vars_table)
+static raptor_uri*
+rasqal_service_new_retrieval_uri(rasqal_service* svc)
 {
-  raptor_iostream* read_iostr = NULL;
-  raptor_uri* read_base_uri = NULL;
-  rasqal_query_results_formatter* read_formatter = NULL;
-  raptor_uri* retrieval_uri = NULL;
-  raptor_stringbuffer* uri_sb = NULL;
+  raptor_uri* retrieval_uri;
+  raptor_stringbuffer* uri_sb;
   size_t len;
   unsigned char* str;
-  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(svc->world);
-  rasqal_rowsource* rowsource = NULL;
-  
-  if(!svc->www) {
-    svc->www = raptor_new_www(raptor_world_ptr);
-
-    if(!svc->www) {
-      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                              "Failed to create WWW");
-      goto error;
-    }
-  }
-    
-  svc->started = 0;
-  svc->final_uri = NULL;
-  svc->sb = raptor_new_stringbuffer();
-  svc->content_type = NULL;
-  
-  if(svc->format)
-    raptor_www_set_http_accept(svc->www, svc->format);
-  else
-    raptor_www_set_http_accept(svc->www, DEFAULT_FORMAT);
-
-  raptor_www_set_write_bytes_handler(svc->www,
-                                     rasqal_service_write_bytes, svc);
-  raptor_www_set_content_type_handler(svc->www,
-                                      rasqal_service_content_type_handler, svc);
-
 
   /* Construct a URI to retrieve following SPARQL protocol HTTP
    *  binding from concatenation of
@@ -360,7 +424,7 @@ rasqal_service_execute_as_rowsource(rasqal_service* svc,
   if(!uri_sb) {
     rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
                             "Failed to create stringbuffer");
-    goto error;
+    return NULL;
   }
 
   str = raptor_uri_as_counted_string(svc->service_uri, &len);
@@ -423,132 +487,2045 @@ rasqal_service_execute_as_rowsource(rasqal_service* svc,
 
   str = raptor_stringbuffer_as_string(uri_sb);
 
-  retrieval_uri = raptor_new_uri(raptor_world_ptr, str);
-  if(!retrieval_uri) {
+  retrieval_uri = raptor_new_uri(rasqal_world_get_raptor(svc->world), str);
+  if(!retrieval_uri)
     rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to create retrieval URI %s",
-                            raptor_uri_as_string(retrieval_uri));
-    goto error;
-  }
+                            "Failed to create retrieval URI %s", str);
 
-  raptor_free_stringbuffer(uri_sb); uri_sb = NULL;
-  
-  if(raptor_www_fetch(svc->www, retrieval_uri)) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to fetch retrieval URI %s",
-                            raptor_uri_as_string(retrieval_uri));
-    goto error;
-  }
+  raptor_free_stringbuffer(uri_sb);
 
-  /* Takes ownership of svc->sb */
-  read_iostr = rasqal_new_iostream_from_stringbuffer(raptor_world_ptr,
-                                                     svc->sb);
-  svc->sb = NULL;
-  if(!read_iostr) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to create iostream from string");
-    goto error;
-  }
-    
-  read_base_uri = svc->final_uri ? svc->final_uri : svc->service_uri;
-  read_formatter = rasqal_new_query_results_formatter(svc->world,
-                                                      /* format name */ NULL,
-                                                      svc->content_type,
-                                                      /* format URI */ NULL);
-  if(!read_formatter) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to find query results reader for content type %s returned from %s",
-                            svc->content_type,
-                            raptor_uri_as_string(read_base_uri));
-    goto error;
+  return retrieval_uri;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * rasqal_service_stream_pass_turn:
+ * @stream: service stream
+ * @fetching: non-0 to pass the turn to the fetch thread, 0 to the reader
+ *
+ * INTERNAL - Let the other thread run and wait for the turn to come back
+ */
+static void
+rasqal_service_stream_pass_turn(rasqal_service_stream* stream, int fetching)
+{
+  pthread_mutex_lock(&stream->lock);
+  stream->fetching = fetching;
+  pthread_cond_broadcast(&stream->turn_changed);
+  while(stream->fetching == fetching)
+    pthread_cond_wait(&stream->turn_changed, &stream->lock);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+
+/*
+ * rasqal_service_stream_write:
+ * @stream: service stream
+ * @ptr: response bytes
+ * @len: number of bytes
+ *
+ * INTERNAL - Add response bytes to the stream in the fetch thread
+ *
+ * When a chunk is buffered, the reader gets the turn.
+ */
+static void
+rasqal_service_stream_write(rasqal_service_stream* stream,
+                            const void* ptr, size_t len)
+{
+  if(stream->cancelled) {
+    raptor_www_abort(stream->svc->www, "Service results no longer needed");
+    return;
   }
 
-  /* Takes ownership of read_iostr with flags = 1 */
-  rowsource = rasqal_query_results_formatter_get_read_rowsource(svc->world,
-                                                                read_iostr,
-                                                                read_formatter,
-                                                                vars_table,
-                                                                read_base_uri,
-                                                                /* flags */ 1);
-  read_iostr = NULL;
-  if(!rowsource) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to decode %s query results data returned from %s",
-                            svc->content_type,
-                            raptor_uri_as_string(read_base_uri));
-    goto error;
+  if(stream->length + len > stream->capacity) {
+    size_t new_capacity = stream->capacity ? stream->capacity * 2 : RASQAL_SERVICE_STREAM_CHUNK_SIZE;
+    unsigned char* new_buffer;
+
+    if(new_capacity < stream->length + len)
+      new_capacity = stream->length + len;
+
+    new_buffer = RASQAL_MALLOC(unsigned char*, new_capacity);
+    if(!new_buffer) {
+      stream->failed = 1;
+      raptor_www_abort(stream->svc->www, "Out of memory");
+      return;
+    }
+    if(stream->length)
+      memcpy(new_buffer, stream->buffer, stream->length);
+    if(stream->buffer)
+      RASQAL_FREE(unsigned char*, stream->buffer);
+    stream->buffer = new_buffer;
+    stream->capacity = new_capacity;
   }
 
+  memcpy(stream->buffer + stream->length, ptr, len);
+  stream->length += len;
 
-  error:
-  if(retrieval_uri)
-    raptor_free_uri(retrieval_uri);
+  if(stream->length >= RASQAL_SERVICE_STREAM_CHUNK_SIZE)
+    rasqal_service_stream_pass_turn(stream, 0);
+}
 
-  if(uri_sb)
-    raptor_free_stringbuffer(uri_sb);
 
-  if(read_formatter)
-    rasqal_free_query_results_formatter(read_formatter);
+static void*
+rasqal_service_stream_fetch(void* arg)
+{
+  rasqal_service_stream* stream = (rasqal_service_stream*)arg;
 
-  if(read_iostr)
-    raptor_free_iostream(read_iostr);
+  if(raptor_www_fetch(stream->svc->www, stream->retrieval_uri))
+    stream->failed = 1;
 
-  if(svc->final_uri) {
-    raptor_free_uri(svc->final_uri);
-    svc->final_uri = NULL;
-  }
+  /* the reader has the turn from here on */
+  pthread_mutex_lock(&stream->lock);
+  stream->finished = 1;
+  stream->fetching = 0;
+  pthread_cond_broadcast(&stream->turn_changed);
+  pthread_mutex_unlock(&stream->lock);
 
-  if(svc->content_type) {
-    RASQAL_FREE(char*, svc->content_type);
-    svc->content_type = NULL;
+  return NULL;
+}
+
+
+static void
+rasqal_service_stream_finish(void* user_data)
+{
+  rasqal_service_stream* stream = (rasqal_service_stream*)user_data;
+
+  if(!stream->finished) {
+    /* stop the fetch at its next write and wait for it to return */
+    stream->cancelled = 1;
+    stream->length = stream->offset = 0;
+    rasqal_service_stream_pass_turn(stream, 1);
   }
 
-  if(svc->sb) {
-    raptor_free_stringbuffer(svc->sb);
-    svc->sb = NULL;
+  pthread_join(stream->thread, NULL);
+
+  stream->svc->stream = NULL;
+  rasqal_free_service(stream->svc);
+  raptor_free_uri(stream->retrieval_uri);
+
+  if(stream->buffer)
+    RASQAL_FREE(unsigned char*, stream->buffer);
+
+  pthread_cond_destroy(&stream->turn_changed);
+  pthread_mutex_destroy(&stream->lock);
+
+  RASQAL_FREE(rasqal_service_stream, stream);
+}
+
+
+static int
+rasqal_service_stream_read_bytes(void *user_data, void *ptr,
+                                 size_t size, size_t nmemb)
+{
+  rasqal_service_stream* stream = (rasqal_service_stream*)user_data;
+  size_t wanted;
+  size_t copied = 0;
+
+  if(!ptr || size <= 0 || !nmemb)
+    return -1;
+
+  wanted = size * nmemb;
+
+  /* results readers take a short read as the end of the response */
+  while(copied < wanted) {
+    size_t avail = stream->length - stream->offset;
+
+    if(avail) {
+      if(avail > wanted - copied)
+        avail = wanted - copied;
+      memcpy(RASQAL_GOOD_CAST(unsigned char*, ptr) + copied,
+             stream->buffer + stream->offset, avail);
+      stream->offset += avail;
+      copied += avail;
+      continue;
+    }
+
+    if(stream->finished)
+      break;
+
+    /* all bytes read: let the fetch thread refill the buffer */
+    stream->length = stream->offset = 0;
+    rasqal_service_stream_pass_turn(stream, 1);
   }
-  
-  return rowsource;
+
+  return RASQAL_BAD_CAST(int, copied / size);
 }
 
 
-/**
- * rasqal_service_execute:
+static int
+rasqal_service_stream_read_eof(void *user_data)
+{
+  rasqal_service_stream* stream = (rasqal_service_stream*)user_data;
+
+  return (stream->finished && stream->offset >= stream->length);
+}
+
+
+static const raptor_iostream_handler rasqal_service_stream_iostream_handler = {
+  /* .version     = */ 2,
+  /* .init        = */ NULL,
+  /* .finish      = */ rasqal_service_stream_finish,
+  /* .write_byte  = */ NULL,
+  /* .write_bytes = */ NULL,
+  /* .write_end   = */ NULL,
+  /* .read_bytes  = */ rasqal_service_stream_read_bytes,
+  /* .read_eof    = */ rasqal_service_stream_read_eof
+};
+
+
+/*
+ * rasqal_service_start_stream:
  * @svc: rasqal service
+ * @retrieval_uri: URI to fetch
  *
- * Execute a rasqal sparql protocol service
+ * INTERNAL - Start fetching the service response in a thread
  *
- * Return value: query results or NULL on failure
+ * Returns when the first chunk of the response is buffered or the
+ * fetch has ended, so the response content type is known.
+ *
+ * Return value: new stream or NULL if a thread could not be started
  */
-rasqal_query_results*
-rasqal_service_execute(rasqal_service* svc)
+static rasqal_service_stream*
+rasqal_service_start_stream(rasqal_service* svc, raptor_uri* retrieval_uri)
 {
-  rasqal_query_results* results = NULL;
-  rasqal_variables_table* vars_table = NULL;
-  rasqal_rowsource* rowsource = NULL;
+  rasqal_service_stream* stream;
 
-  vars_table = rasqal_new_variables_table(svc->world);
-  if(!vars_table) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to create variables table");
-    goto error;
+  stream = RASQAL_CALLOC(rasqal_service_stream*, 1, sizeof(*stream));
+  if(!stream)
+    return NULL;
+
+  if(pthread_mutex_init(&stream->lock, NULL)) {
+    RASQAL_FREE(rasqal_service_stream, stream);
+    return NULL;
+  }
+  if(pthread_cond_init(&stream->turn_changed, NULL)) {
+    pthread_mutex_destroy(&stream->lock);
+    RASQAL_FREE(rasqal_service_stream, stream);
+    return NULL;
   }
-  
-  results = rasqal_new_query_results(svc->world, NULL, 
-                                     RASQAL_QUERY_RESULTS_BINDINGS, 
-                                     vars_table);
-  /* (results takes a reference/copy to vars_table) */
-  rasqal_free_variables_table(vars_table); vars_table = NULL;
 
-  if(!results) {
-    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
-                            "Failed to create query results");
-    goto error;
+  stream->svc = rasqal_new_service_from_service(svc);
+  stream->retrieval_uri = raptor_uri_copy(retrieval_uri);
+  stream->fetching = 1;
+  svc->stream = stream;
+
+  if(pthread_create(&stream->thread, NULL, rasqal_service_stream_fetch,
+                    stream)) {
+    svc->stream = NULL;
+    rasqal_free_service(stream->svc);
+    raptor_free_uri(stream->retrieval_uri);
+    pthread_cond_destroy(&stream->turn_changed);
+    pthread_mutex_destroy(&stream->lock);
+    RASQAL_FREE(rasqal_service_stream, stream);
+    return NULL;
   }
-  
-  vars_table = rasqal_query_results_get_variables_table(results);
 
-  rowsource = rasqal_service_execute_as_rowsource(svc, vars_table);
+  /* wait for the first turn of the reader */
+  pthread_mutex_lock(&stream->lock);
+  while(stream->fetching)
+    pthread_cond_wait(&stream->turn_changed, &stream->lock);
+  pthread_mutex_unlock(&stream->lock);
+
+  return stream;
+}
+
+/*
+ * rasqal_service_copy_string:
+ * @string: string (or NULL)
+ *
+ * INTERNAL - Copy a string for a fetch thread
+ *
+ * Return value: new string or NULL if @string is NULL or on failure
+ */
+static char*
+rasqal_service_copy_string(const char* string)
+{
+  size_t len;
+  char* copy;
+
+  if(!string)
+    return NULL;
+
+  len = strlen(string);
+  copy = RASQAL_MALLOC(char*, len + 1);
+  if(copy)
+    memcpy(copy, string, len + 1);
+
+  return copy;
+}
+
+
+static void
+rasqal_service_free_prefetch_group(rasqal_service_prefetch_group* group)
+{
+  int usage;
+
+  pthread_mutex_lock(&group->lock);
+  usage = --group->usage;
+  pthread_mutex_unlock(&group->lock);
+
+  if(usage)
+    return;
+
+  if(group->in_flight)
+    RASQAL_FREE(char**, group->in_flight);
+
+  pthread_cond_destroy(&group->request_finished);
+  pthread_mutex_destroy(&group->lock);
+
+  RASQAL_FREE(rasqal_service_prefetch_group, group);
+}
+
+
+static int
+rasqal_service_prefetch_is_cancelled(rasqal_service_prefetch* prefetch)
+{
+  int cancelled;
+
+  pthread_mutex_lock(&prefetch->group->lock);
+  cancelled = prefetch->cancelled;
+  pthread_mutex_unlock(&prefetch->group->lock);
+
+  return cancelled;
+}
+
+
+static void
+rasqal_service_prefetch_log_handler(void *user_data,
+                                    raptor_log_message *message)
+{
+  rasqal_service_prefetch* prefetch = (rasqal_service_prefetch*)user_data;
+
+  if(message->level >= RAPTOR_LOG_LEVEL_ERROR && !prefetch->error)
+    prefetch->error = rasqal_service_copy_string(message->text);
+}
+
+
+static void
+rasqal_service_prefetch_write_bytes(raptor_www* www,
+                                    void *userdata, const void *ptr,
+                                    size_t size, size_t nmemb)
+{
+  rasqal_service_prefetch* prefetch = (rasqal_service_prefetch*)userdata;
+
+  if(rasqal_service_prefetch_is_cancelled(prefetch)) {
+    raptor_www_abort(www, "Service results no longer needed");
+    return;
+  }
+
+  raptor_stringbuffer_append_counted_string(prefetch->sb,
+                                            RASQAL_GOOD_CAST(const unsigned char*, ptr),
+                                            size * nmemb, 1);
+}
+
+
+static void
+rasqal_service_prefetch_content_type_handler(raptor_www* www, void* userdata,
+                                             const char* content_type)
+{
+  rasqal_service_prefetch* prefetch = (rasqal_service_prefetch*)userdata;
+  char* p;
+
+  if(prefetch->content_type)
+    RASQAL_FREE(char*, prefetch->content_type);
+
+  prefetch->content_type = rasqal_service_copy_string(content_type);
+  if(!prefetch->content_type)
+    return;
+
+  for(p = prefetch->content_type; *p; p++) {
+    if(*p == ';' || *p == ' ') {
+      *p = '\0';
+      break;
+    }
+  }
+}
+
+
+/*
+ * rasqal_service_prefetch_wait_for_slot:
+ * @prefetch: service prefetch
+ *
+ * INTERNAL - Wait until the endpoint has fewer requests in flight than the maximum
+ */
+static void
+rasqal_service_prefetch_wait_for_slot(rasqal_service_prefetch* prefetch)
+{
+  rasqal_service_prefetch_group* group = prefetch->group;
+
+  pthread_mutex_lock(&group->lock);
+  while(1) {
+    int count = 0;
+    int i;
+
+    for(i = 0; i < group->in_flight_count; i++) {
+      if(!strcmp(group->in_flight[i], prefetch->endpoint))
+        count++;
+    }
+
+    if(count < group->max_requests)
+      break;
+
+    pthread_cond_wait(&group->request_finished, &group->lock);
+  }
+  group->in_flight[group->in_flight_count++] = prefetch->endpoint;
+  pthread_mutex_unlock(&group->lock);
+}
+
+
+static void
+rasqal_service_prefetch_release_slot(rasqal_service_prefetch* prefetch)
+{
+  rasqal_service_prefetch_group* group = prefetch->group;
+  int i;
+
+  pthread_mutex_lock(&group->lock);
+  for(i = 0; i < group->in_flight_count; i++) {
+    if(group->in_flight[i] == prefetch->endpoint) {
+      group->in_flight[i] = group->in_flight[--group->in_flight_count];
+      break;
+    }
+  }
+  pthread_cond_broadcast(&group->request_finished);
+  pthread_mutex_unlock(&group->lock);
+}
+
+
+static void*
+rasqal_service_prefetch_fetch(void* arg)
+{
+  rasqal_service_prefetch* prefetch = (rasqal_service_prefetch*)arg;
+  raptor_world* world = NULL;
+  raptor_www* www = NULL;
+  raptor_uri* uri = NULL;
+
+  rasqal_service_prefetch_wait_for_slot(prefetch);
+
+  if(rasqal_service_prefetch_is_cancelled(prefetch))
+    goto tidy;
+
+  /* The query execution world stays with the execution thread; libcurl
+   * and libxml2 were set up when that world was opened. */
+  world = raptor_new_world();
+  if(!world)
+    goto tidy;
+  raptor_world_set_flag(world, RAPTOR_WORLD_FLAG_WWW_SKIP_INIT_FINISH, 1);
+  raptor_world_set_flag(world, RAPTOR_WORLD_FLAG_LIBXML_GENERIC_ERROR_SAVE, 0);
+  raptor_world_set_flag(world, RAPTOR_WORLD_FLAG_LIBXML_STRUCTURED_ERROR_SAVE, 0);
+  if(raptor_world_open(world))
+    goto tidy;
+  raptor_world_set_log_handler(world, prefetch,
+                               rasqal_service_prefetch_log_handler);
+
+  www = raptor_new_www(world);
+  uri = raptor_new_uri(world,
+                       RASQAL_GOOD_CAST(const unsigned char*, prefetch->retrieval_uri));
+  if(!www || !uri)
+    goto tidy;
+
+  raptor_www_set_http_accept(www, prefetch->accept);
+  raptor_www_set_write_bytes_handler(www,
+                                     rasqal_service_prefetch_write_bytes,
+                                     prefetch);
+  raptor_www_set_content_type_handler(www,
+                                      rasqal_service_prefetch_content_type_handler,
+                                      prefetch);
+
+  if(!raptor_www_fetch(www, uri)) {
+    raptor_uri* final_uri = raptor_www_get_final_uri(www);
+
+    if(final_uri) {
+      prefetch->final_uri = rasqal_service_copy_string(RASQAL_GOOD_CAST(const char*, raptor_uri_as_string(final_uri)));
+      raptor_free_uri(final_uri);
+    }
+
+    prefetch->failed = 0;
+  }
+
+  tidy:
+  if(uri)
+    raptor_free_uri(uri);
+  if(www)
+    raptor_free_www(www);
+  if(world)
+    raptor_free_world(world);
+
+  rasqal_service_prefetch_release_slot(prefetch);
+
+  return NULL;
+}
+
+
+/*
+ * rasqal_service_start_prefetch:
+ * @svc: rasqal service
+ * @group: group of the services fetched concurrently
+ *
+ * INTERNAL - Start fetching the service response in a thread
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_service_start_prefetch(rasqal_service* svc,
+                              rasqal_service_prefetch_group* group)
+{
+  rasqal_service_prefetch* prefetch;
+  raptor_uri* retrieval_uri;
+  char* cache_key;
+
+  retrieval_uri = rasqal_service_new_retrieval_uri(svc);
+  if(!retrieval_uri)
+    return 1;
+
+  /* a cached response is read without fetching */
+  cache_key = rasqal_service_cache_key(svc, retrieval_uri);
+  if(cache_key) {
+    int cached = rasqal_service_cache_has(svc->world, cache_key);
+
+    RASQAL_FREE(char*, cache_key);
+    if(cached) {
+      raptor_free_uri(retrieval_uri);
+      return 0;
+    }
+  }
+
+  prefetch = RASQAL_CALLOC(rasqal_service_prefetch*, 1, sizeof(*prefetch));
+  if(!prefetch) {
+    raptor_free_uri(retrieval_uri);
+    return 1;
+  }
+
+  prefetch->endpoint = rasqal_service_copy_string(RASQAL_GOOD_CAST(const char*, raptor_uri_as_string(svc->service_uri)));
+  prefetch->retrieval_uri = rasqal_service_copy_string(RASQAL_GOOD_CAST(const char*, raptor_uri_as_string(retrieval_uri)));
+  prefetch->accept = rasqal_service_copy_string(svc->format ? svc->format : DEFAULT_FORMAT);
+  prefetch->sb = raptor_new_stringbuffer();
+  /* until the fetch returns */
+  prefetch->failed = 1;
+  raptor_free_uri(retrieval_uri);
+
+  if(!prefetch->endpoint || !prefetch->retrieval_uri || !prefetch->accept ||
+     !prefetch->sb)
+    goto failed;
+
+  pthread_mutex_lock(&group->lock);
+  group->usage++;
+  pthread_mutex_unlock(&group->lock);
+  prefetch->group = group;
+
+  if(pthread_create(&prefetch->thread, NULL, rasqal_service_prefetch_fetch,
+                    prefetch)) {
+    rasqal_service_free_prefetch_group(group);
+    goto failed;
+  }
+
+  svc->prefetch = prefetch;
+
+  return 0;
+
+  failed:
+  if(prefetch->endpoint)
+    RASQAL_FREE(char*, prefetch->endpoint);
+  if(prefetch->retrieval_uri)
+    RASQAL_FREE(char*, prefetch->retrieval_uri);
+  if(prefetch->accept)
+    RASQAL_FREE(char*, prefetch->accept);
+  if(prefetch->sb)
+    raptor_free_stringbuffer(prefetch->sb);
+  RASQAL_FREE(rasqal_service_prefetch, prefetch);
+
+  return 1;
+}
+
+
+/*
+ * rasqal_service_cancel_prefetch:
+ * @svc: rasqal service
+ *
+ * INTERNAL - Tell the fetch thread the prefetched response is no longer needed
+ */
+static void
+rasqal_service_cancel_prefetch(rasqal_service* svc)
+{
+  rasqal_service_prefetch* prefetch = svc->prefetch;
+
+  pthread_mutex_lock(&prefetch->group->lock);
+  prefetch->cancelled = 1;
+  pthread_mutex_unlock(&prefetch->group->lock);
+}
+
+
+/*
+ * rasqal_service_finish_prefetch:
+ * @svc: rasqal service
+ *
+ * INTERNAL - Wait for the service response fetched in a thread
+ *
+ * On success the response is moved into the @svc response fields
+ * as if it had been fetched by rasqal_service_execute_as_rowsource().
+ *
+ * Return value: non-0 if the fetch failed
+ */
+static int
+rasqal_service_finish_prefetch(rasqal_service* svc)
+{
+  rasqal_service_prefetch* prefetch = svc->prefetch;
+  int rc;
+
+  svc->prefetch = NULL;
+
+  pthread_join(prefetch->thread, NULL);
+  rasqal_service_free_prefetch_group(prefetch->group);
+
+  rc = prefetch->failed;
+  if(rc) {
+    if(prefetch->error && !prefetch->cancelled)
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "%s", prefetch->error);
+  } else {
+    svc->sb = prefetch->sb;
+    prefetch->sb = NULL;
+    svc->content_type = prefetch->content_type;
+    prefetch->content_type = NULL;
+    if(prefetch->final_uri)
+      svc->final_uri = raptor_new_uri(rasqal_world_get_raptor(svc->world),
+                                      RASQAL_GOOD_CAST(const unsigned char*, prefetch->final_uri));
+  }
+
+  RASQAL_FREE(char*, prefetch->endpoint);
+  RASQAL_FREE(char*, prefetch->retrieval_uri);
+  RASQAL_FREE(char*, prefetch->accept);
+  if(prefetch->sb)
+    raptor_free_stringbuffer(prefetch->sb);
+  if(prefetch->content_type)
+    RASQAL_FREE(char*, prefetch->content_type);
+  if(prefetch->final_uri)
+    RASQAL_FREE(char*, prefetch->final_uri);
+  if(prefetch->error)
+    RASQAL_FREE(char*, prefetch->error);
+  RASQAL_FREE(rasqal_service_prefetch, prefetch);
+
+  return rc;
+}
+#endif
+
+
+/*
+ * rasqal_service_start_services:
+ * @services: sequence of #rasqal_service (shared)
+ * @max_requests: maximum number of requests in flight to one endpoint
+ *
+ * INTERNAL - Start fetching the responses of several services concurrently
+ *
+ * Each service response is fetched in its own thread and buffered
+ * until rasqal_service_execute_as_rowsource() reads it, so the time
+ * to get all the responses is that of the slowest endpoint rather
+ * than the sum.  Services with a user WWW object set are fetched
+ * when read as before.
+ *
+ * Return value: non-0 if the services cannot be fetched concurrently
+ */
+int
+rasqal_service_start_services(raptor_sequence* services, int max_requests)
+{
+#ifdef HAVE_PTHREAD_H
+  rasqal_service_prefetch_group* group;
+  rasqal_service* svc;
+  int size;
+  int i;
+
+  if(!services || max_requests <= 0)
+    return 1;
+
+  size = raptor_sequence_size(services);
+
+  group = RASQAL_CALLOC(rasqal_service_prefetch_group*, 1, sizeof(*group));
+  if(!group)
+    return 1;
+
+  group->in_flight = RASQAL_CALLOC(const char**,
+                                   RASQAL_GOOD_CAST(size_t, size + 1),
+                                   sizeof(char*));
+  if(!group->in_flight) {
+    RASQAL_FREE(rasqal_service_prefetch_group, group);
+    return 1;
+  }
+  if(pthread_mutex_init(&group->lock, NULL)) {
+    RASQAL_FREE(char**, group->in_flight);
+    RASQAL_FREE(rasqal_service_prefetch_group, group);
+    return 1;
+  }
+  pthread_cond_init(&group->request_finished, NULL);
+  group->max_requests = max_requests;
+  group->usage = 1;
+
+  for(i = 0; (svc = (rasqal_service*)raptor_sequence_get_at(services, i)); i++) {
+    if(svc->www || svc->prefetch)
+      continue;
+
+    /* a service that cannot be prefetched is fetched when read */
+    rasqal_service_start_prefetch(svc, group);
+  }
+
+  rasqal_service_free_prefetch_group(group);
+
+  return 0;
+#else
+  return 1;
+#endif
+}
+
+
+static void
+rasqal_service_write_bytes(raptor_www* www,
+                           void *userdata, const void *ptr, 
+                           size_t size, size_t nmemb)
+{
+  rasqal_service* svc = (rasqal_service*)userdata;
+  size_t len = size * nmemb;
+
+  if(!svc->started) {
+    svc->final_uri = raptor_www_get_final_uri(www);
+    svc->started = 1;
+  }
+
+#ifdef HAVE_PTHREAD_H
+  if(svc->stream) {
+    rasqal_service_stream_write(svc->stream, ptr, len);
+    return;
+  }
+#endif
+
+  raptor_stringbuffer_append_counted_string(svc->sb,
+                                            RASQAL_GOOD_CAST(const unsigned char*, ptr),
+                                            len, 1);
+}
+
+
+static void
+rasqal_service_content_type_handler(raptor_www* www, void* userdata, 
+                                    const char* content_type)
+{
+  rasqal_service* svc = (rasqal_service*)userdata;
+  size_t len;
+  
+  if(svc->content_type)
+    RASQAL_FREE(char*, svc->content_type);
+
+  len = strlen(content_type);
+  svc->content_type = RASQAL_MALLOC(char*, len + 1);
+
+  if(svc->content_type) {
+    char* p;
+
+    memcpy(svc->content_type, content_type, len + 1);
+
+    for(p = svc->content_type; *p; p++) {
+      if(*p == ';' || *p == ' ') {
+        *p = '\0';
+        break;
+      }
+    }
+  }
+
+}
+
+
+
+/*
+ * SERVICE response cache
+ *
+ * Decoded response rows are kept in the world, keyed by the
+ * retrieval URI (service URI, query and dataset parameters) and the
+ * requested format, in a compact form: a count of variables and
+ * their names then for each row, a row byte and each value as a tag
+ * byte and counted strings.  Counts are written 7 bits per byte.
+ */
+
+/* start of a row */
+#define RASQAL_SERVICE_CACHE_ROW     0x52
+
+/* value tags */
+#define RASQAL_SERVICE_CACHE_UNBOUND 0
+#define RASQAL_SERVICE_CACHE_URI     1
+#define RASQAL_SERVICE_CACHE_BLANK   2
+#define RASQAL_SERVICE_CACHE_LITERAL 3
+
+
+/*
+ * rasqal_service_cache_entry:
+ * @key: cache key from rasqal_service_cache_key()
+ * @hash: hash of @key
+ * @data: encoded rows
+ * @length: length of @data
+ * @expires: time the entry expires or 0 to never expire
+ * @next: next entry in the same hash bucket
+ * @older: next less recently used entry
+ * @newer: next more recently used entry
+ *
+ * INTERNAL - An entry in the world SERVICE response cache
+ */
+typedef struct rasqal_service_cache_entry_s {
+  char* key;
+  size_t hash;
+  unsigned char* data;
+  size_t length;
+  time_t expires;
+  struct rasqal_service_cache_entry_s* next;
+  struct rasqal_service_cache_entry_s* older;
+  struct rasqal_service_cache_entry_s* newer;
+} rasqal_service_cache_entry;
+
+
+/*
+ * rasqal_service_cache_buffer:
+ * @data: bytes written
+ * @length: number of bytes written
+ * @capacity: size of @data
+ * @failed: non-0 if a write failed
+ *
+ * INTERNAL - Growing buffer for encoding response rows
+ */
+typedef struct {
+  unsigned char* data;
+  size_t length;
+  size_t capacity;
+  int failed;
+} rasqal_service_cache_buffer;
+
+
+static void
+rasqal_free_service_cache_entry(rasqal_service_cache_entry* entry)
+{
+  if(entry->key)
+    RASQAL_FREE(char*, entry->key);
+
+  if(entry->data)
+    RASQAL_FREE(unsigned char*, entry->data);
+
+  RASQAL_FREE(rasqal_service_cache_entry, entry);
+}
+
+
+static void
+rasqal_service_cache_buffer_write(rasqal_service_cache_buffer* buf,
+                                  const void* ptr, size_t len)
+{
+  if(buf->failed)
+    return;
+
+  if(buf->length + len > buf->capacity) {
+    size_t new_capacity = buf->capacity ? buf->capacity * 2 : 1024;
+    unsigned char* new_data;
+
+    while(new_capacity < buf->length + len)
+      new_capacity *= 2;
+
+    new_data = RASQAL_MALLOC(unsigned char*, new_capacity);
+    if(!new_data) {
+      buf->failed = 1;
+      return;
+    }
+    if(buf->length)
+      memcpy(new_data, buf->data, buf->length);
+    if(buf->data)
+      RASQAL_FREE(unsigned char*, buf->data);
+    buf->data = new_data;
+    buf->capacity = new_capacity;
+  }
+
+  memcpy(buf->data + buf->length, ptr, len);
+  buf->length += len;
+}
+
+
+static void
+rasqal_service_cache_buffer_write_count(rasqal_service_cache_buffer* buf,
+                                        size_t count)
+{
+  unsigned char bytes[10];
+  size_t len = 0;
+
+  do {
+    unsigned char byte = RASQAL_GOOD_CAST(unsigned char, count & 0x7f);
+
+    count >>= 7;
+    if(count)
+      byte |= 0x80;
+    bytes[len++] = byte;
+  } while(count);
+
+  rasqal_service_cache_buffer_write(buf, bytes, len);
+}
+
+
+static void
+rasqal_service_cache_buffer_write_string(rasqal_service_cache_buffer* buf,
+                                         const unsigned char* string,
+                                         size_t len)
+{
+  rasqal_service_cache_buffer_write_count(buf, len);
+  if(len)
+    rasqal_service_cache_buffer_write(buf, string, len);
+}
+
+
+/*
+ * rasqal_service_cache_buffer_write_literal:
+ * @buf: buffer
+ * @l: literal or NULL for an unbound value
+ *
+ * INTERNAL - Encode a response value
+ *
+ * Return value: non-0 if the value cannot be encoded
+ */
+static int
+rasqal_service_cache_buffer_write_literal(rasqal_service_cache_buffer* buf,
+                                          rasqal_literal* l)
+{
+  unsigned char tag;
+  const unsigned char* str;
+  size_t len;
+
+  if(!l) {
+    tag = RASQAL_SERVICE_CACHE_UNBOUND;
+    rasqal_service_cache_buffer_write(buf, &tag, 1);
+    return 0;
+  }
+
+  switch(l->type) {
+    case RASQAL_LITERAL_URI:
+      tag = RASQAL_SERVICE_CACHE_URI;
+      rasqal_service_cache_buffer_write(buf, &tag, 1);
+      str = raptor_uri_as_counted_string(l->value.uri, &len);
+      rasqal_service_cache_buffer_write_string(buf, str, len);
+      break;
+
+    case RASQAL_LITERAL_BLANK:
+      tag = RASQAL_SERVICE_CACHE_BLANK;
+      rasqal_service_cache_buffer_write(buf, &tag, 1);
+      rasqal_service_cache_buffer_write_string(buf, l->string, l->string_len);
+      break;
+
+    case RASQAL_LITERAL_STRING:
+    case RASQAL_LITERAL_XSD_STRING:
+    case RASQAL_LITERAL_BOOLEAN:
+    case RASQAL_LITERAL_INTEGER:
+    case RASQAL_LITERAL_FLOAT:
+    case RASQAL_LITERAL_DOUBLE:
+    case RASQAL_LITERAL_DECIMAL:
+    case RASQAL_LITERAL_DATETIME:
+    case RASQAL_LITERAL_UDT:
+    case RASQAL_LITERAL_INTEGER_SUBTYPE:
+    case RASQAL_LITERAL_DATE:
+      if(!l->string)
+        return 1;
+
+      tag = RASQAL_SERVICE_CACHE_LITERAL;
+      rasqal_service_cache_buffer_write(buf, &tag, 1);
+      rasqal_service_cache_buffer_write_string(buf, l->string, l->string_len);
+      /* empty language and datatype mean none */
+      str = RASQAL_GOOD_CAST(const unsigned char*, l->language);
+      rasqal_service_cache_buffer_write_string(buf, str,
+                                               str ? strlen(l->language) : 0);
+      len = 0;
+      str = l->datatype ? raptor_uri_as_counted_string(l->datatype, &len) : NULL;
+      rasqal_service_cache_buffer_write_string(buf, str, len);
+      break;
+
+    case RASQAL_LITERAL_UNKNOWN:
+    case RASQAL_LITERAL_PATTERN:
+    case RASQAL_LITERAL_QNAME:
+    case RASQAL_LITERAL_VARIABLE:
+    default:
+      return 1;
+  }
+
+  return 0;
+}
+
+
+/*
+ * rasqal_service_cache_read_count:
+ * @ptr_p: pointer to the read position; advanced
+ * @end: end of data
+ * @count_p: pointer to store the count
+ *
+ * INTERNAL - Decode a count
+ *
+ * Return value: non-0 on truncated data
+ */
+static int
+rasqal_service_cache_read_count(const unsigned char** ptr_p,
+                                const unsigned char* end, size_t* count_p)
+{
+  const unsigned char* ptr = *ptr_p;
+  size_t count = 0;
+  unsigned int shift = 0;
+
+  while(1) {
+    if(ptr >= end || shift > 63)
+      return 1;
+
+    count |= RASQAL_GOOD_CAST(size_t, *ptr & 0x7f) << shift;
+    shift += 7;
+    if(!(*ptr++ & 0x80))
+      break;
+  }
+
+  *ptr_p = ptr;
+  *count_p = count;
+  return 0;
+}
+
+
+/*
+ * rasqal_service_cache_read_string:
+ * @ptr_p: pointer to the read position; advanced
+ * @end: end of data
+ * @len_p: pointer to store the string length
+ *
+ * INTERNAL - Decode a counted string into a new NUL terminated string
+ *
+ * Return value: new string or NULL on truncated data or failure
+ */
+static unsigned char*
+rasqal_service_cache_read_string(const unsigned char** ptr_p,
+                                 const unsigned char* end, size_t* len_p)
+{
+  unsigned char* string;
+  size_t len;
+
+  if(rasqal_service_cache_read_count(ptr_p, end, &len))
+    return NULL;
+
+  if(len > RASQAL_GOOD_CAST(size_t, end - *ptr_p))
+    return NULL;
+
+  string = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!string)
+    return NULL;
+
+  if(len)
+    memcpy(string, *ptr_p, len);
+  string[len] = '\0';
+  *ptr_p += len;
+
+  if(len_p)
+    *len_p = len;
+
+  return string;
+}
+
+
+/*
+ * rasqal_service_cache_read_literal:
+ * @world: world
+ * @ptr_p: pointer to the read position; advanced
+ * @end: end of data
+ * @error_p: pointer to error flag set on truncated data or failure
+ *
+ * INTERNAL - Decode a response value
+ *
+ * Return value: new literal or NULL for an unbound value or on failure
+ */
+static rasqal_literal*
+rasqal_service_cache_read_literal(rasqal_world* world,
+                                  const unsigned char** ptr_p,
+                                  const unsigned char* end,
+                                  int* error_p)
+{
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(world);
+  rasqal_literal* l = NULL;
+  unsigned char* string;
+  unsigned char tag;
+  size_t len;
+
+  if(*ptr_p >= end) {
+    *error_p = 1;
+    return NULL;
+  }
+  tag = *(*ptr_p)++;
+
+  if(tag == RASQAL_SERVICE_CACHE_UNBOUND)
+    return NULL;
+
+  string = rasqal_service_cache_read_string(ptr_p, end, &len);
+  if(!string) {
+    *error_p = 1;
+    return NULL;
+  }
+
+  if(tag == RASQAL_SERVICE_CACHE_URI) {
+    raptor_uri* uri = raptor_new_uri(raptor_world_ptr, string);
+
+    RASQAL_FREE(char*, string);
+    if(uri)
+      l = rasqal_new_uri_literal(world, uri);
+  } else if(tag == RASQAL_SERVICE_CACHE_BLANK) {
+    l = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK, string);
+  } else if(tag == RASQAL_SERVICE_CACHE_LITERAL) {
+    unsigned char* language;
+    unsigned char* datatype_str;
+    raptor_uri* datatype = NULL;
+    size_t language_len = 0;
+    size_t datatype_len = 0;
+
+    language = rasqal_service_cache_read_string(ptr_p, end, &language_len);
+    datatype_str = rasqal_service_cache_read_string(ptr_p, end, &datatype_len);
+    if(!language || !datatype_str) {
+      RASQAL_FREE(char*, string);
+      if(language)
+        RASQAL_FREE(char*, language);
+      if(datatype_str)
+        RASQAL_FREE(char*, datatype_str);
+      *error_p = 1;
+      return NULL;
+    }
+
+    if(!language_len) {
+      RASQAL_FREE(char*, language);
+      language = NULL;
+    }
+    if(datatype_len)
+      datatype = raptor_new_uri(raptor_world_ptr, datatype_str);
+    RASQAL_FREE(char*, datatype_str);
+
+    l = rasqal_new_string_literal_node(world, string,
+                                       RASQAL_GOOD_CAST(const char*, language),
+                                       datatype);
+  } else
+    RASQAL_FREE(char*, string);
+
+  if(!l)
+    *error_p = 1;
+
+  return l;
+}
+
+
+/*
+ * rasqal_service_cache_key:
+ * @svc: rasqal service
+ * @retrieval_uri: URI the service fetches
+ *
+ * INTERNAL - Make the SERVICE response cache key for a service request
+ *
+ * The retrieval URI holds the service URI, the query and the dataset
+ * graphs; the requested format is added since it changes the response.
+ *
+ * Return value: new key or NULL if the cache is disabled or on failure
+ */
+static char*
+rasqal_service_cache_key(rasqal_service* svc, raptor_uri* retrieval_uri)
+{
+  const char* format = svc->format ? svc->format : DEFAULT_FORMAT;
+  unsigned char* uri_str;
+  size_t uri_len;
+  size_t format_len;
+  char* key;
+
+  if(!svc->world->service_cache_size)
+    return NULL;
+
+  uri_str = raptor_uri_as_counted_string(retrieval_uri, &uri_len);
+  format_len = strlen(format);
+
+  key = RASQAL_MALLOC(char*, uri_len + format_len + 2);
+  if(!key)
+    return NULL;
+
+  memcpy(key, uri_str, uri_len);
+  key[uri_len] = '\n';
+  memcpy(key + uri_len + 1, format, format_len + 1);
+
+  return key;
+}
+
+
+/* remove an entry from the recently used list */
+static void
+rasqal_service_cache_unlink(rasqal_world* world,
+                            rasqal_service_cache_entry* entry)
+{
+  if(entry->older)
+    entry->older->newer = entry->newer;
+  else
+    world->service_cache_oldest = entry->newer;
+
+  if(entry->newer)
+    entry->newer->older = entry->older;
+  else
+    world->service_cache_newest = entry->older;
+
+  entry->older = entry->newer = NULL;
+}
+
+
+/* add an entry to the recently used list as the newest */
+static void
+rasqal_service_cache_link_newest(rasqal_world* world,
+                                 rasqal_service_cache_entry* entry)
+{
+  entry->older = world->service_cache_newest;
+  entry->newer = NULL;
+  if(world->service_cache_newest)
+    world->service_cache_newest->newer = entry;
+  else
+    world->service_cache_oldest = entry;
+  world->service_cache_newest = entry;
+}
+
+
+/* remove an entry from the cache and free it */
+static void
+rasqal_service_cache_remove(rasqal_world* world,
+                            rasqal_service_cache_entry* entry)
+{
+  rasqal_service_cache_entry** entry_p;
+
+  entry_p = &world->service_cache[entry->hash & RASQAL_GOOD_CAST(size_t, world->service_cache_buckets - 1)];
+  while(*entry_p != entry)
+    entry_p = &(*entry_p)->next;
+  *entry_p = entry->next;
+
+  rasqal_service_cache_unlink(world, entry);
+  world->service_cache_count--;
+  world->service_cache_used -= strlen(entry->key) + entry->length;
+
+  rasqal_free_service_cache_entry(entry);
+}
+
+
+/*
+ * rasqal_service_cache_grow:
+ * @world: world
+ *
+ * INTERNAL - Make room in the SERVICE cache hash table for one more entry
+ *
+ * The table doubles when it holds as many entries as buckets.  Must
+ * be called with the SERVICE cache locked.
+ *
+ * Return value: non-0 on failure
+ */
+static int
+rasqal_service_cache_grow(rasqal_world* world)
+{
+  rasqal_service_cache_entry** buckets;
+  int buckets_count;
+  int i;
+
+  if(world->service_cache_count < world->service_cache_buckets)
+    return 0;
+
+  buckets_count = world->service_cache_buckets ? world->service_cache_buckets * 2 : 8;
+  buckets = RASQAL_CALLOC(rasqal_service_cache_entry**,
+                          RASQAL_GOOD_CAST(size_t, buckets_count),
+                          sizeof(rasqal_service_cache_entry*));
+  if(!buckets)
+    /* a full table still works with longer chains */
+    return !world->service_cache_buckets;
+
+  for(i = 0; i < world->service_cache_buckets; i++) {
+    rasqal_service_cache_entry* entry = world->service_cache[i];
+
+    while(entry) {
+      rasqal_service_cache_entry* next = entry->next;
+      size_t slot = entry->hash & RASQAL_GOOD_CAST(size_t, buckets_count - 1);
+
+      entry->next = buckets[slot];
+      buckets[slot] = entry;
+      entry = next;
+    }
+  }
+
+  if(world->service_cache)
+    RASQAL_FREE(rasqal_service_cache_entry**, world->service_cache);
+  world->service_cache = buckets;
+  world->service_cache_buckets = buckets_count;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_service_cache_trim:
+ * @world: world
+ * @size: maximum bytes of cached responses to keep
+ *
+ * INTERNAL - Remove least recently used SERVICE cache entries down to @size
+ *
+ * Must be called with the SERVICE cache locked.
+ */
+void
+rasqal_service_cache_trim(rasqal_world* world, size_t size)
+{
+  while(world->service_cache_used > size && world->service_cache_oldest)
+    rasqal_service_cache_remove(world, world->service_cache_oldest);
+}
+
+
+/*
+ * rasqal_service_cache_finish:
+ * @world: world
+ *
+ * INTERNAL - Free all cached SERVICE responses
+ */
+void
+rasqal_service_cache_finish(rasqal_world* world)
+{
+  rasqal_service_cache_trim(world, 0);
+
+  if(world->service_cache) {
+    RASQAL_FREE(rasqal_service_cache_entry**, world->service_cache);
+    world->service_cache = NULL;
+  }
+  world->service_cache_buckets = 0;
+}
+
+
+/*
+ * rasqal_service_cache_find:
+ * @world: world
+ * @key: cache key
+ * @hash: hash of @key
+ *
+ * INTERNAL - Find an unexpired SERVICE cache entry and mark it most recently used
+ *
+ * An expired entry for @key is removed.  Must be called with the
+ * SERVICE cache locked.
+ *
+ * Return value: shared entry or NULL if not found
+ */
+static rasqal_service_cache_entry*
+rasqal_service_cache_find(rasqal_world* world, const char* key, size_t hash)
+{
+  rasqal_service_cache_entry* entry;
+
+  if(!world->service_cache)
+    return NULL;
+
+  for(entry = world->service_cache[hash & RASQAL_GOOD_CAST(size_t, world->service_cache_buckets - 1)];
+      entry;
+      entry = entry->next) {
+    if(entry->hash == hash && !strcmp(entry->key, key))
+      break;
+  }
+
+  if(!entry)
+    return NULL;
+
+  if(entry->expires && entry->expires <= time(NULL)) {
+    rasqal_service_cache_remove(world, entry);
+    return NULL;
+  }
+
+  rasqal_service_cache_unlink(world, entry);
+  rasqal_service_cache_link_newest(world, entry);
+
+  return entry;
+}
+
+
+/*
+ * rasqal_service_cache_has:
+ * @world: world
+ * @key: cache key
+ *
+ * INTERNAL - Check if a response is in the SERVICE cache
+ *
+ * Return value: non-0 if an unexpired response is cached for @key
+ */
+static int
+rasqal_service_cache_has(rasqal_world* world, const char* key)
+{
+  size_t hash = rasqal_string_hash(key, strlen(key));
+  int found;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->service_cache_lock);
+#endif
+  found = (rasqal_service_cache_find(world, key, hash) != NULL);
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->service_cache_lock);
+#endif
+
+  return found;
+}
+
+
+/*
+ * rasqal_service_cache_add:
+ * @world: world
+ * @key: cache key (ownership taken)
+ * @data: encoded rows (ownership taken)
+ * @length: length of @data
+ *
+ * INTERNAL - Add an encoded SERVICE response to the cache
+ *
+ * Failing to add the response is not an error for the caller.
+ */
+static void
+rasqal_service_cache_add(rasqal_world* world, char* key,
+                         unsigned char* data, size_t length)
+{
+  rasqal_service_cache_entry* entry;
+  size_t key_len = strlen(key);
+  size_t size = key_len + length;
+  size_t slot;
+
+  entry = RASQAL_CALLOC(rasqal_service_cache_entry*, 1, sizeof(*entry));
+  if(!entry) {
+    RASQAL_FREE(char*, key);
+    RASQAL_FREE(unsigned char*, data);
+    return;
+  }
+  entry->key = key;
+  entry->hash = rasqal_string_hash(key, key_len);
+  entry->data = data;
+  entry->length = length;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->service_cache_lock);
+#endif
+
+  /* too large, already cached by another request or no table */
+  if(size > world->service_cache_size ||
+     rasqal_service_cache_find(world, key, entry->hash) ||
+     rasqal_service_cache_grow(world)) {
+    rasqal_free_service_cache_entry(entry);
+    goto unlock;
+  }
+
+  if(world->service_cache_ttl > 0)
+    entry->expires = time(NULL) + world->service_cache_ttl;
+
+  rasqal_service_cache_trim(world, world->service_cache_size - size);
+
+  slot = entry->hash & RASQAL_GOOD_CAST(size_t, world->service_cache_buckets - 1);
+  entry->next = world->service_cache[slot];
+  world->service_cache[slot] = entry;
+  rasqal_service_cache_link_newest(world, entry);
+  world->service_cache_count++;
+  world->service_cache_used += size;
+
+  unlock:
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->service_cache_lock);
+#endif
+  return;
+}
+
+
+/*
+ * rasqal_service_cache_rowsource_context:
+ * @world: world
+ * @vars_table: variables table to declare the response variables in
+ * @data: copy of the encoded rows
+ * @end: end of @data
+ * @ptr: read position in @data
+ * @offset: row offset for read_row()
+ *
+ * INTERNAL - Rowsource over a cached SERVICE response
+ */
+typedef struct {
+  rasqal_world* world;
+  rasqal_variables_table* vars_table;
+  unsigned char* data;
+  const unsigned char* end;
+  const unsigned char* ptr;
+  int offset;
+} rasqal_service_cache_rowsource_context;
+
+
+static int
+rasqal_service_cache_rowsource_finish(rasqal_rowsource* rowsource,
+                                      void *user_data)
+{
+  rasqal_service_cache_rowsource_context* con;
+
+  con = (rasqal_service_cache_rowsource_context*)user_data;
+
+  if(con->data)
+    RASQAL_FREE(unsigned char*, con->data);
+
+  RASQAL_FREE(rasqal_service_cache_rowsource_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_service_cache_rowsource_ensure_variables(rasqal_rowsource* rowsource,
+                                                void *user_data)
+{
+  rasqal_service_cache_rowsource_context* con;
+  size_t count;
+  size_t i;
+
+  con = (rasqal_service_cache_rowsource_context*)user_data;
+
+  rowsource->size = 0;
+
+  if(rasqal_service_cache_read_count(&con->ptr, con->end, &count))
+    return 1;
+
+  for(i = 0; i < count; i++) {
+    unsigned char* name;
+    rasqal_variable* v;
+
+    name = rasqal_service_cache_read_string(&con->ptr, con->end, NULL);
+    if(!name)
+      return 1;
+
+    v = rasqal_variables_table_add(con->vars_table,
+                                   RASQAL_VARIABLE_TYPE_NORMAL, name, NULL);
+    if(!v)
+      return 1;
+
+    rasqal_rowsource_add_variable(rowsource, v);
+    /* above function takes a reference to v */
+    rasqal_free_variable(v);
+  }
+
+  return 0;
+}
+
+
+static rasqal_row*
+rasqal_service_cache_rowsource_read_row(rasqal_rowsource* rowsource,
+                                        void *user_data)
+{
+  rasqal_service_cache_rowsource_context* con;
+  rasqal_row* row;
+  int error = 0;
+  int i;
+
+  con = (rasqal_service_cache_rowsource_context*)user_data;
+
+  if(con->ptr >= con->end || *con->ptr++ != RASQAL_SERVICE_CACHE_ROW)
+    return NULL;
+
+  row = rasqal_new_row(rowsource);
+  if(!row)
+    return NULL;
+
+  for(i = 0; i < row->size; i++) {
+    row->values[i] = rasqal_service_cache_read_literal(con->world, &con->ptr,
+                                                       con->end, &error);
+    if(error) {
+      rasqal_free_row(row);
+      con->ptr = con->end;
+      return NULL;
+    }
+  }
+
+  row->offset = con->offset++;
+
+  return row;
+}
+
+
+static const rasqal_rowsource_handler rasqal_service_cache_rowsource_handler = {
+  /* .version = */ 1,
+  "service cache",
+  /* .init = */ NULL,
+  /* .finish = */ rasqal_service_cache_rowsource_finish,
+  /* .ensure_variables = */ rasqal_service_cache_rowsource_ensure_variables,
+  /* .read_row = */ rasqal_service_cache_rowsource_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ NULL,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ NULL,
+  /* .set_origin = */ NULL,
+};
+
+
+/*
+ * rasqal_service_cache_lookup:
+ * @svc: rasqal service
+ * @key: cache key
+ * @vars_table: variables table to declare the response variables in
+ *
+ * INTERNAL - Get a rowsource over a cached SERVICE response
+ *
+ * Return value: new rowsource or NULL if not cached or on failure
+ */
+static rasqal_rowsource*
+rasqal_service_cache_lookup(rasqal_service* svc, const char* key,
+                            rasqal_variables_table* vars_table)
+{
+  rasqal_world* world = svc->world;
+  rasqal_service_cache_entry* entry;
+  rasqal_service_cache_rowsource_context* con;
+  size_t hash = rasqal_string_hash(key, strlen(key));
+
+  con = RASQAL_CALLOC(rasqal_service_cache_rowsource_context*, 1,
+                      sizeof(*con));
+  if(!con)
+    return NULL;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_lock(&world->service_cache_lock);
+#endif
+  entry = rasqal_service_cache_find(world, key, hash);
+  if(entry) {
+    /* a copy so the entry may be removed while the rows are read */
+    con->data = RASQAL_MALLOC(unsigned char*, entry->length + 1);
+    if(con->data) {
+      memcpy(con->data, entry->data, entry->length);
+      con->end = con->data + entry->length;
+    }
+  }
+#ifdef HAVE_PTHREAD_H
+  pthread_mutex_unlock(&world->service_cache_lock);
+#endif
+
+  if(!con->data) {
+    RASQAL_FREE(rasqal_service_cache_rowsource_context, con);
+    return NULL;
+  }
+
+  con->world = world;
+  con->vars_table = vars_table;
+  con->ptr = con->data;
+
+  return rasqal_new_rowsource_from_handler(world, NULL,
+                                           con,
+                                           &rasqal_service_cache_rowsource_handler,
+                                           vars_table, 0);
+}
+
+
+/*
+ * rasqal_service_cache_fill_rowsource_context:
+ * @world: world
+ * @rowsource: response reader rowsource
+ * @key: cache key
+ * @buf: rows encoded so far
+ * @header_written: non-0 when the variables are in @buf
+ * @finished: non-0 when the response rows have all been read
+ *
+ * INTERNAL - Rowsource adding a SERVICE response to the cache as it is read
+ *
+ * The response is only cached if it is read to the end and fits in
+ * the cache budget.
+ */
+typedef struct {
+  rasqal_world* world;
+  rasqal_rowsource* rowsource;
+  char* key;
+  rasqal_service_cache_buffer buf;
+  int header_written;
+  int finished;
+} rasqal_service_cache_fill_rowsource_context;
+
+
+static void
+rasqal_service_cache_fill_rowsource_abandon(rasqal_service_cache_fill_rowsource_context* con)
+{
+  if(con->key) {
+    RASQAL_FREE(char*, con->key);
+    con->key = NULL;
+  }
+
+  if(con->buf.data) {
+    RASQAL_FREE(unsigned char*, con->buf.data);
+    con->buf.data = NULL;
+  }
+}
+
+
+static int
+rasqal_service_cache_fill_rowsource_finish(rasqal_rowsource* rowsource,
+                                           void *user_data)
+{
+  rasqal_service_cache_fill_rowsource_context* con;
+
+  con = (rasqal_service_cache_fill_rowsource_context*)user_data;
+
+  rasqal_service_cache_fill_rowsource_abandon(con);
+
+  if(con->rowsource)
+    rasqal_free_rowsource(con->rowsource);
+
+  RASQAL_FREE(rasqal_service_cache_fill_rowsource_context, con);
+
+  return 0;
+}
+
+
+static int
+rasqal_service_cache_fill_rowsource_ensure_variables(rasqal_rowsource* rowsource,
+                                                     void *user_data)
+{
+  rasqal_service_cache_fill_rowsource_context* con;
+
+  con = (rasqal_service_cache_fill_rowsource_context*)user_data;
+
+  if(rasqal_rowsource_ensure_variables(con->rowsource))
+    return 1;
+
+  rowsource->size = 0;
+
+  return rasqal_rowsource_copy_variables(rowsource, con->rowsource);
+}
+
+
+static rasqal_row*
+rasqal_service_cache_fill_rowsource_read_row(rasqal_rowsource* rowsource,
+                                             void *user_data)
+{
+  rasqal_service_cache_fill_rowsource_context* con;
+  rasqal_row* row;
+  int i;
+
+  con = (rasqal_service_cache_fill_rowsource_context*)user_data;
+
+  if(con->finished)
+    return NULL;
+
+  if(con->key && !con->header_written) {
+    rasqal_service_cache_buffer_write_count(&con->buf,
+                                            RASQAL_GOOD_CAST(size_t, rowsource->size));
+    for(i = 0; i < rowsource->size; i++) {
+      rasqal_variable* v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
+      const unsigned char* name = v->name;
+
+      rasqal_service_cache_buffer_write_string(&con->buf, name,
+                                               strlen(RASQAL_GOOD_CAST(const char*, name)));
+    }
+    con->header_written = 1;
+  }
+
+  row = rasqal_rowsource_read_row(con->rowsource);
+  if(!row) {
+    con->finished = 1;
+
+    if(con->key && !con->buf.failed) {
+      rasqal_service_cache_add(con->world, con->key, con->buf.data,
+                               con->buf.length);
+      con->key = NULL;
+      con->buf.data = NULL;
+    }
+    return NULL;
+  }
+
+  if(con->key) {
+    unsigned char row_byte = RASQAL_SERVICE_CACHE_ROW;
+
+    rasqal_service_cache_buffer_write(&con->buf, &row_byte, 1);
+    for(i = 0; i < row->size; i++) {
+      if(rasqal_service_cache_buffer_write_literal(&con->buf,
+                                                   row->values[i])) {
+        con->buf.failed = 1;
+        break;
+      }
+    }
+
+    /* stop encoding once the response cannot fit in the cache */
+    if(con->buf.failed || con->buf.length > con->world->service_cache_size)
+      rasqal_service_cache_fill_rowsource_abandon(con);
+  }
+
+  return row;
+}
+
+
+static const rasqal_rowsource_handler rasqal_service_cache_fill_rowsource_handler = {
+  /* .version = */ 1,
+  "service cache fill",
+  /* .init = */ NULL,
+  /* .finish = */ rasqal_service_cache_fill_rowsource_finish,
+  /* .ensure_variables = */ rasqal_service_cache_fill_rowsource_ensure_variables,
+  /* .read_row = */ rasqal_service_cache_fill_rowsource_read_row,
+  /* .read_all_rows = */ NULL,
+  /* .reset = */ NULL,
+  /* .set_requirements = */ NULL,
+  /* .get_inner_rowsource = */ NULL,
+  /* .set_origin = */ NULL,
+};
+
+
+/*
+ * rasqal_new_service_cache_fill_rowsource:
+ * @svc: rasqal service
+ * @rowsource: response reader rowsource (ownership taken)
+ * @key: cache key (ownership taken)
+ * @vars_table: variables table
+ *
+ * INTERNAL - Wrap a response reader rowsource to cache the rows read
+ *
+ * Return value: new rowsource or NULL on failure
+ */
+static rasqal_rowsource*
+rasqal_new_service_cache_fill_rowsource(rasqal_service* svc,
+                                        rasqal_rowsource* rowsource,
+                                        char* key,
+                                        rasqal_variables_table* vars_table)
+{
+  rasqal_service_cache_fill_rowsource_context* con;
+
+  con = RASQAL_CALLOC(rasqal_service_cache_fill_rowsource_context*, 1,
+                      sizeof(*con));
+  if(!con) {
+    rasqal_free_rowsource(rowsource);
+    RASQAL_FREE(char*, key);
+    return NULL;
+  }
+
+  con->world = svc->world;
+  con->rowsource = rowsource;
+  con->key = key;
+
+  return rasqal_new_rowsource_from_handler(svc->world, NULL,
+                                           con,
+                                           &rasqal_service_cache_fill_rowsource_handler,
+                                           vars_table, 0);
+}
+
+
+/**
+ * rasqal_service_execute_as_rowsource:
+ * @svc: rasqal service
+ *
+ * INTERNAL - Execute a rasqal sparql protocol service to a rowsurce
+ *
+ * Return value: query results or NULL on failure
+ */
+rasqal_rowsource*
+rasqal_service_execute_as_rowsource(rasqal_service* svc,
+                                    rasqal_variables_table* vars_table)
+{
+  raptor_iostream* read_iostr = NULL;
+  raptor_uri* read_base_uri = NULL;
+  rasqal_query_results_formatter* read_formatter = NULL;
+  raptor_uri* retrieval_uri = NULL;
+  raptor_world* raptor_world_ptr = rasqal_world_get_raptor(svc->world);
+  rasqal_rowsource* rowsource = NULL;
+  char* cache_key = NULL;
+#ifdef HAVE_PTHREAD_H
+  rasqal_service_stream* stream;
+#endif
+  
+  retrieval_uri = rasqal_service_new_retrieval_uri(svc);
+  if(!retrieval_uri)
+    goto error;
+
+  cache_key = rasqal_service_cache_key(svc, retrieval_uri);
+  if(cache_key) {
+    rowsource = rasqal_service_cache_lookup(svc, cache_key, vars_table);
+    if(rowsource) {
+#ifdef HAVE_PTHREAD_H
+      if(svc->prefetch) {
+        rasqal_service_cancel_prefetch(svc);
+        rasqal_service_finish_prefetch(svc);
+      }
+#endif
+      goto error;
+    }
+  }
+
+#ifdef HAVE_PTHREAD_H
+  if(svc->prefetch) {
+    /* Use the response fetched concurrently with other services */
+    if(rasqal_service_finish_prefetch(svc)) {
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Failed to fetch retrieval URI %s",
+                              raptor_uri_as_string(retrieval_uri));
+      goto error;
+    }
+
+    /* Takes ownership of svc->sb */
+    read_iostr = rasqal_new_iostream_from_stringbuffer(raptor_world_ptr,
+                                                       svc->sb);
+    svc->sb = NULL;
+    if(!read_iostr) {
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Failed to create iostream from string");
+      goto error;
+    }
+  }
+#endif
+
+  if(!read_iostr) {
+    if(!svc->www) {
+      svc->www = raptor_new_www(raptor_world_ptr);
+
+      if(!svc->www) {
+        rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                                "Failed to create WWW");
+        goto error;
+      }
+    }
+    
+    svc->started = 0;
+    svc->final_uri = NULL;
+    svc->sb = raptor_new_stringbuffer();
+    svc->content_type = NULL;
+  
+    if(svc->format)
+      raptor_www_set_http_accept(svc->www, svc->format);
+    else
+      raptor_www_set_http_accept(svc->www, DEFAULT_FORMAT);
+
+    raptor_www_set_write_bytes_handler(svc->www,
+                                       rasqal_service_write_bytes, svc);
+    raptor_www_set_content_type_handler(svc->www,
+                                        rasqal_service_content_type_handler, svc);
+  }
+
+#ifdef HAVE_PTHREAD_H
+  /* Read the response while it arrives */
+  stream = read_iostr ? NULL : rasqal_service_start_stream(svc, retrieval_uri);
+  if(stream) {
+    if(stream->failed) {
+      rasqal_service_stream_finish(stream);
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Failed to fetch retrieval URI %s",
+                              raptor_uri_as_string(retrieval_uri));
+      goto error;
+    }
+
+    /* Takes ownership of stream */
+    read_iostr = raptor_new_iostream_from_handler(raptor_world_ptr, stream,
+                                                  &rasqal_service_stream_iostream_handler);
+    if(!read_iostr) {
+      rasqal_service_stream_finish(stream);
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Failed to create iostream from service response");
+      goto error;
+    }
+  }
+#endif
+
+  if(!read_iostr) {
+    /* Without a fetch thread the whole response is buffered */
+    if(raptor_www_fetch(svc->www, retrieval_uri)) {
+      rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                              "Failed to fetch retrieval URI %s",
+                              raptor_uri_as_string(retrieval_uri));
+      goto error;
+    }
+
+    /* Takes ownership of svc->sb */
+    read_iostr = rasqal_new_iostream_from_stringbuffer(raptor_world_ptr,
+                                                       svc->sb);
+    svc->sb = NULL;
+  }
+
+  if(!read_iostr) {
+    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "Failed to create iostream from string");
+    goto error;
+  }
+    
+  read_base_uri = svc->final_uri ? svc->final_uri : svc->service_uri;
+  read_formatter = rasqal_new_query_results_formatter(svc->world,
+                                                      /* format name */ NULL,
+                                                      svc->content_type,
+                                                      /* format URI */ NULL);
+  if(!read_formatter) {
+    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "Failed to find query results reader for content type %s returned from %s",
+                            svc->content_type,
+                            raptor_uri_as_string(read_base_uri));
+    goto error;
+  }
+
+  /* Takes ownership of read_iostr with flags = 1 */
+  rowsource = rasqal_query_results_formatter_get_read_rowsource(svc->world,
+                                                                read_iostr,
+                                                                read_formatter,
+                                                                vars_table,
+                                                                read_base_uri,
+                                                                /* flags */ 1);
+  read_iostr = NULL;
+  if(!rowsource) {
+    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "Failed to decode %s query results data returned from %s",
+                            svc->content_type,
+                            raptor_uri_as_string(read_base_uri));
+    goto error;
+  }
+
+  if(cache_key) {
+    /* Takes ownership of rowsource and cache_key */
+    rowsource = rasqal_new_service_cache_fill_rowsource(svc, rowsource,
+                                                        cache_key,
+                                                        vars_table);
+    cache_key = NULL;
+  }
+
+
+  error:
+  if(retrieval_uri)
+    raptor_free_uri(retrieval_uri);
+
+  if(cache_key)
+    RASQAL_FREE(char*, cache_key);
+
+  if(read_formatter)
+    rasqal_free_query_results_formatter(read_formatter);
+
+  if(read_iostr)
+    raptor_free_iostream(read_iostr);
+
+  if(svc->final_uri) {
+    raptor_free_uri(svc->final_uri);
+    svc->final_uri = NULL;
+  }
+
+  if(svc->content_type) {
+    RASQAL_FREE(char*, svc->content_type);
+    svc->content_type = NULL;
+  }
+
+  if(svc->sb) {
+    raptor_free_stringbuffer(svc->sb);
+    svc->sb = NULL;
+  }
+  
+  return rowsource;
+}
+
+
+/**
+ * rasqal_service_execute:
+ * @svc: rasqal service
+ *
+ * Execute a rasqal sparql protocol service
+ *
+ * Return value: query results or NULL on failure
+ */
+rasqal_query_results*
+rasqal_service_execute(rasqal_service* svc)
+{
+  rasqal_query_results* results = NULL;
+  rasqal_variables_table* vars_table = NULL;
+  rasqal_rowsource* rowsource = NULL;
+
+  vars_table = rasqal_new_variables_table(svc->world);
+  if(!vars_table) {
+    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "Failed to create variables table");
+    goto error;
+  }
+  
+  results = rasqal_new_query_results(svc->world, NULL, 
+                                     RASQAL_QUERY_RESULTS_BINDINGS, 
+                                     vars_table);
+  /* (results takes a reference/copy to vars_table) */
+  rasqal_free_variables_table(vars_table); vars_table = NULL;
+
+  if(!results) {
+    rasqal_log_error_simple(svc->world, RAPTOR_LOG_LEVEL_ERROR, NULL,
+                            "Failed to create query results");
+    goto error;
+  }
+  
+  vars_table = rasqal_query_results_get_variables_table(results);
+
+  rowsource = rasqal_service_execute_as_rowsource(svc, vars_table);
   if(!rowsource)
     goto error;
 
@@ -566,3 +2543,846 @@ rasqal_service_execute(rasqal_service* svc)
 
   return results;
 }
+
+
+#ifdef STANDALONE
+
+/* one more prototype */
+int main(int argc, char *argv[]);
+
+
+const char* const service_cache_data_3x2_rows[] =
+{
+  /* 3 variable names and 2 rows */
+  "s",   NULL, "label", NULL, "count", NULL,
+  /* row 1 data: URI, plain literal and integer */
+  NULL,  "http://example.org/a", "alpha", NULL, "42", NULL,
+  /* row 2 data: URI, unbound and plain literal */
+  NULL,  "http://example.org/b", NULL, NULL, "beta", NULL,
+  /* end of data */
+  NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+#define SERVICE_CACHE_VARS_COUNT 3
+#define SERVICE_CACHE_ROWS_COUNT 3
+
+
+/* make a literal from copies of @string, @language and @datatype */
+static rasqal_literal*
+new_test_literal(rasqal_world* world, const char* string,
+                 const char* language, const char* datatype)
+{
+  unsigned char* new_string;
+  char* new_language = NULL;
+  raptor_uri* dt_uri = NULL;
+  size_t len = strlen(string);
+
+  new_string = RASQAL_MALLOC(unsigned char*, len + 1);
+  if(!new_string)
+    return NULL;
+  memcpy(new_string, string, len + 1);
+
+  if(language) {
+    len = strlen(language);
+    new_language = RASQAL_MALLOC(char*, len + 1);
+    if(!new_language) {
+      RASQAL_FREE(char*, new_string);
+      return NULL;
+    }
+    memcpy(new_language, language, len + 1);
+  }
+
+  if(datatype)
+    dt_uri = raptor_new_uri(rasqal_world_get_raptor(world),
+                            RASQAL_GOOD_CAST(const unsigned char*, datatype));
+
+  return rasqal_new_string_literal_node(world, new_string, new_language,
+                                        dt_uri);
+}
+
+
+/* compare two sequences of rows by RDF term equality */
+static int
+compare_rows(raptor_sequence* expected_seq, raptor_sequence* seq)
+{
+  int i;
+
+  if(raptor_sequence_size(expected_seq) != raptor_sequence_size(seq))
+    return 1;
+
+  for(i = 0; i < raptor_sequence_size(seq); i++) {
+    rasqal_row* expected_row;
+    rasqal_row* row;
+    int j;
+
+    expected_row = (rasqal_row*)raptor_sequence_get_at(expected_seq, i);
+    row = (rasqal_row*)raptor_sequence_get_at(seq, i);
+    if(expected_row->size != row->size)
+      return 1;
+
+    for(j = 0; j < row->size; j++) {
+      rasqal_literal* expected_value = expected_row->values[j];
+      rasqal_literal* value = row->values[j];
+      int error = 0;
+
+      if(!expected_value || !value) {
+        if(expected_value != value)
+          return 1;
+        continue;
+      }
+
+      if(!rasqal_literal_equals_flags(expected_value, value,
+                                      RASQAL_COMPARE_RDF, &error) || error)
+        return 1;
+    }
+  }
+
+  return 0;
+}
+
+
+/* stand-in endpoint response read from a file: URI; 4 rows */
+#define SERVICE_RESPONSE_FILE "rasqal_service_test.srx"
+
+static const char* const service_response =
+  "<?xml version=\"1.0\"?>\n"
+  "<sparql xmlns=\"http://www.w3.org/2005/sparql-results#\">\n"
+  "  <head><variable name=\"s\"/><variable name=\"o\"/></head>\n"
+  "  <results>\n"
+  "    <result><binding name=\"s\"><uri>http://example.org/a</uri></binding>"
+  "<binding name=\"o\"><literal>A</literal></binding></result>\n"
+  "    <result><binding name=\"s\"><uri>http://example.org/b</uri></binding>"
+  "<binding name=\"o\"><literal>B</literal></binding></result>\n"
+  "    <result><binding name=\"s\"><uri>http://example.org/c</uri></binding>"
+  "<binding name=\"o\"><literal>C</literal></binding></result>\n"
+  "    <result><binding name=\"s\"><uri>http://example.org/d</uri></binding>"
+  "<binding name=\"o\"><literal>D</literal></binding></result>\n"
+  "  </results>\n"
+  "</sparql>\n";
+
+#define SERVICE_RESPONSE_ROWS_COUNT 4
+
+
+static int
+write_service_response(const char* program)
+{
+  FILE* fh;
+
+  fh = fopen(SERVICE_RESPONSE_FILE, "w");
+  if(!fh) {
+    fprintf(stderr, "%s: failed to write %s\n", program,
+            SERVICE_RESPONSE_FILE);
+    return 1;
+  }
+  fputs(service_response, fh);
+  fclose(fh);
+
+  return 0;
+}
+
+
+const char* const bind_join_data_2x6_rows[] =
+{
+  /* 2 variable names and 6 rows */
+  "s",   NULL, "x",  NULL,
+  /* batch 1: a duplicate value is sent once */
+  NULL,  "http://example.org/a", "x1", NULL,
+  NULL,  "http://example.org/a", "x2", NULL,
+  NULL,  "http://example.org/b", "x3", NULL,
+  /* batch 2: blank node (set below) and unbound are both sent as UNDEF */
+  NULL,  "http://example.org/blank", "x4", NULL,
+  NULL,  NULL, "x5", NULL,
+  NULL,  "http://example.org/c", "x6", NULL,
+  /* end of data */
+  NULL, NULL, NULL, NULL
+};
+
+#define BIND_JOIN_BATCH_SIZE 3
+#define BIND_JOIN_BLANK_ROW 3
+/* a: 2 rows, b: 1, blank: 0, unbound: 4 (all responses), c: 1 */
+#define BIND_JOIN_ROWS_COUNT 8
+#define BIND_JOIN_REQUESTS_COUNT 2
+
+#define BIND_JOIN_QUERY "SELECT ?s ?o WHERE { ?s <http://example.org/p> ?o }"
+
+static const char* const bind_join_batch_queries[BIND_JOIN_REQUESTS_COUNT] = {
+  BIND_JOIN_QUERY "\n"
+  "VALUES ?s { <http://example.org/a> <http://example.org/b> }\n",
+  BIND_JOIN_QUERY "\n"
+  "VALUES ?s { UNDEF <http://example.org/c> }\n"
+};
+
+
+/* write a single variable VALUES block; rows are separated by spaces */
+static int
+test_values_writer(const char* program, rasqal_world* world,
+                   rasqal_query* query)
+{
+  raptor_sequence* vars_seq;
+  raptor_sequence* rows_seq;
+  rasqal_bindings* bindings = NULL;
+  raptor_iostream* iostr;
+  unsigned char* name;
+  unsigned char* string = NULL;
+  const char* expected = "VALUES ?n { 1 2 UNDEF }\n";
+  int failures = 0;
+  int i;
+
+  vars_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                 (raptor_data_print_handler)rasqal_variable_print);
+  rows_seq = raptor_new_sequence((raptor_data_free_handler)rasqal_free_row,
+                                 (raptor_data_print_handler)rasqal_row_print);
+  name = RASQAL_MALLOC(unsigned char*, 2);
+  if(!vars_seq || !rows_seq || !name)
+    goto tidy;
+  memcpy(name, "n", 2);
+  raptor_sequence_push(vars_seq,
+                       rasqal_variables_table_add(query->vars_table,
+                                                  RASQAL_VARIABLE_TYPE_NORMAL,
+                                                  name, NULL));
+
+  for(i = 1; i <= 3; i++) {
+    rasqal_row* row = rasqal_new_row_for_size(world, 1);
+    if(!row)
+      goto tidy;
+    if(i < 3)
+      row->values[0] = rasqal_new_integer_literal(world,
+                                                  RASQAL_LITERAL_INTEGER, i);
+    raptor_sequence_push(rows_seq, row);
+  }
+
+  bindings = rasqal_new_bindings(query, vars_seq, rows_seq);
+  vars_seq = rows_seq = NULL;
+  if(!bindings)
+    goto tidy;
+
+  iostr = raptor_new_iostream_to_string(rasqal_world_get_raptor(world),
+                                        (void**)&string, NULL,
+                                        rasqal_alloc_memory);
+  if(!iostr)
+    goto tidy;
+  rasqal_query_write_sparql_20060406_values(bindings, iostr);
+  raptor_free_iostream(iostr);
+
+  tidy:
+  if(!string || strcmp(RASQAL_GOOD_CAST(const char*, string), expected)) {
+    fprintf(stderr, "%s: VALUES block is '%s', expected '%s'\n", program,
+            string ? RASQAL_GOOD_CAST(const char*, string) : "NULL",
+            expected);
+    failures++;
+  }
+
+  if(string)
+    rasqal_free_memory(string);
+  if(bindings)
+    rasqal_free_bindings(bindings);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(rows_seq)
+    raptor_free_sequence(rows_seq);
+
+  return failures;
+}
+
+
+/*
+ * Join local rows with a SERVICE through a file: URI stand-in
+ * endpoint.  The stand-in returns the same rows whatever the VALUES
+ * so the request of each batch is checked through the keys of the
+ * responses kept in the service cache.
+ */
+static int
+test_bind_join(const char* program, rasqal_world* world, rasqal_query* query)
+{
+  rasqal_variables_table* vt = query->vars_table;
+  raptor_sequence* seq = NULL;
+  raptor_sequence* vars_seq = NULL;
+  raptor_sequence* service_vars = NULL;
+  rasqal_rowsource* left_rs = NULL;
+  rasqal_rowsource* rowsource = NULL;
+  raptor_uri* service_uri = NULL;
+  unsigned char* uri_string = NULL;
+  unsigned char* name;
+  rasqal_row* row;
+  unsigned char* blank;
+  int failures = 0;
+  int count;
+  int i;
+
+  if(write_service_response(program))
+    return 1;
+
+  rasqal_world_set_service_cache(world, 65536, 0);
+
+  uri_string = raptor_uri_filename_to_uri_string(SERVICE_RESPONSE_FILE);
+  if(uri_string)
+    service_uri = raptor_new_uri(rasqal_world_get_raptor(world), uri_string);
+
+  seq = rasqal_new_row_sequence(world, vt, bind_join_data_2x6_rows, 2,
+                                &vars_seq);
+  service_vars = raptor_new_sequence((raptor_data_free_handler)rasqal_free_variable,
+                                     (raptor_data_print_handler)rasqal_variable_print);
+  name = RASQAL_MALLOC(unsigned char*, 2);
+  blank = RASQAL_MALLOC(unsigned char*, 3);
+  if(!service_uri || !seq || !service_vars || !name || !blank) {
+    fprintf(stderr, "%s: failed to create bind join data\n", program);
+    if(name)
+      RASQAL_FREE(char*, name);
+    if(blank)
+      RASQAL_FREE(char*, blank);
+    failures++;
+    goto tidy;
+  }
+
+  row = (rasqal_row*)raptor_sequence_get_at(seq, BIND_JOIN_BLANK_ROW);
+  memcpy(blank, "b1", 3);
+  rasqal_free_literal(row->values[0]);
+  row->values[0] = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK,
+                                             blank);
+
+  raptor_sequence_push(service_vars,
+                       rasqal_new_variable_from_variable(rasqal_variables_table_get_by_name(vt, RASQAL_VARIABLE_TYPE_NORMAL, RASQAL_GOOD_CAST(const unsigned char*, "s"))));
+  memcpy(name, "o", 2);
+  raptor_sequence_push(service_vars,
+                       rasqal_variables_table_add(vt,
+                                                  RASQAL_VARIABLE_TYPE_NORMAL,
+                                                  name, NULL));
+
+  left_rs = rasqal_new_rowsequence_rowsource(world, query, vt, seq, vars_seq);
+  /* vars_seq and seq are now owned by left_rs */
+  vars_seq = seq = NULL;
+  if(!left_rs) {
+    failures++;
+    goto tidy;
+  }
+
+  rowsource = rasqal_new_service_bindjoin_rowsource(world, query, left_rs,
+                                                    service_uri,
+                                                    RASQAL_GOOD_CAST(const unsigned char*, BIND_JOIN_QUERY),
+                                                    NULL, service_vars, 0,
+                                                    RASQAL_JOIN_TYPE_NATURAL,
+                                                    NULL,
+                                                    BIND_JOIN_BATCH_SIZE);
+  /* left_rs is now owned by rowsource */
+  left_rs = NULL;
+  if(!rowsource) {
+    fprintf(stderr, "%s: failed to create bind join rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  count = 0;
+  while((row = rasqal_rowsource_read_row(rowsource))) {
+    rasqal_free_row(row);
+    count++;
+  }
+  if(count != BIND_JOIN_ROWS_COUNT) {
+    fprintf(stderr, "%s: bind join returned %d rows, expected %d\n",
+            program, count, BIND_JOIN_ROWS_COUNT);
+    failures++;
+  }
+
+  if(world->service_cache_count != BIND_JOIN_REQUESTS_COUNT) {
+    fprintf(stderr, "%s: bind join sent %d requests, expected %d\n",
+            program, world->service_cache_count, BIND_JOIN_REQUESTS_COUNT);
+    failures++;
+  }
+
+  for(i = 0; i < BIND_JOIN_REQUESTS_COUNT; i++) {
+    rasqal_service* svc;
+    raptor_uri* retrieval_uri = NULL;
+    rasqal_rowsource* cached_rs = NULL;
+    char* key = NULL;
+
+    svc = rasqal_new_service(world, service_uri,
+                             RASQAL_GOOD_CAST(const unsigned char*, bind_join_batch_queries[i]),
+                             NULL);
+    if(svc)
+      retrieval_uri = rasqal_service_new_retrieval_uri(svc);
+    if(retrieval_uri)
+      key = rasqal_service_cache_key(svc, retrieval_uri);
+    if(key)
+      cached_rs = rasqal_service_cache_lookup(svc, key, vt);
+
+    if(!cached_rs) {
+      fprintf(stderr, "%s: bind join batch %d did not send query '%s'\n",
+              program, i + 1, bind_join_batch_queries[i]);
+      failures++;
+    } else
+      rasqal_free_rowsource(cached_rs);
+
+    if(key)
+      RASQAL_FREE(char*, key);
+    if(retrieval_uri)
+      raptor_free_uri(retrieval_uri);
+    if(svc)
+      rasqal_free_service(svc);
+  }
+
+  tidy:
+  if(rowsource)
+    rasqal_free_rowsource(rowsource);
+  if(left_rs)
+    rasqal_free_rowsource(left_rs);
+  if(seq)
+    raptor_free_sequence(seq);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(service_vars)
+    raptor_free_sequence(service_vars);
+  if(service_uri)
+    raptor_free_uri(service_uri);
+  if(uri_string)
+    raptor_free_memory(uri_string);
+
+  rasqal_world_set_service_cache(world, 0, 0);
+  remove(SERVICE_RESPONSE_FILE);
+
+  return failures;
+}
+
+
+#ifdef HAVE_PTHREAD_H
+#define PREFETCH_ENDPOINTS_COUNT 2
+#define PREFETCH_REQUESTS_COUNT 8
+#define PREFETCH_MAX_REQUESTS 2
+
+/*
+ * Mock fetch of one request: holds an endpoint slot for a moment and
+ * counts the requests in flight to its endpoint.
+ */
+typedef struct {
+  rasqal_service_prefetch prefetch;
+  char endpoint[32];
+  pthread_mutex_t* lock;
+  int* active;
+  int* peak;
+} test_prefetch_request;
+
+
+static void*
+test_prefetch_request_thread(void* arg)
+{
+  test_prefetch_request* request = (test_prefetch_request*)arg;
+
+  rasqal_service_prefetch_wait_for_slot(&request->prefetch);
+
+  pthread_mutex_lock(request->lock);
+  if(++(*request->active) > *request->peak)
+    *request->peak = *request->active;
+  pthread_mutex_unlock(request->lock);
+
+  usleep(2000);
+
+  pthread_mutex_lock(request->lock);
+  (*request->active)--;
+  pthread_mutex_unlock(request->lock);
+
+  rasqal_service_prefetch_release_slot(&request->prefetch);
+
+  return NULL;
+}
+
+
+/*
+ * Start many mock requests to two endpoints at once and check no
+ * endpoint ever has more than the maximum requests in flight.
+ */
+static int
+test_prefetch_endpoint_cap(const char* program)
+{
+  rasqal_service_prefetch_group* group;
+  test_prefetch_request* requests;
+  pthread_t* threads;
+  pthread_mutex_t lock;
+  int active[PREFETCH_ENDPOINTS_COUNT] = { 0, 0 };
+  int peak[PREFETCH_ENDPOINTS_COUNT] = { 0, 0 };
+  int count = PREFETCH_ENDPOINTS_COUNT * PREFETCH_REQUESTS_COUNT;
+  int started;
+  int failures = 0;
+  int i;
+
+  group = RASQAL_CALLOC(rasqal_service_prefetch_group*, 1, sizeof(*group));
+  requests = RASQAL_CALLOC(test_prefetch_request*,
+                           RASQAL_GOOD_CAST(size_t, count),
+                           sizeof(*requests));
+  threads = RASQAL_CALLOC(pthread_t*, RASQAL_GOOD_CAST(size_t, count),
+                          sizeof(pthread_t));
+  if(group)
+    group->in_flight = RASQAL_CALLOC(const char**,
+                                     RASQAL_GOOD_CAST(size_t, count + 1),
+                                     sizeof(char*));
+  if(!group || !group->in_flight || !requests || !threads) {
+    fprintf(stderr, "%s: failed to create prefetch requests\n", program);
+    if(group) {
+      if(group->in_flight)
+        RASQAL_FREE(char**, group->in_flight);
+      RASQAL_FREE(rasqal_service_prefetch_group, group);
+    }
+    failures++;
+    goto tidy;
+  }
+
+  pthread_mutex_init(&lock, NULL);
+  pthread_mutex_init(&group->lock, NULL);
+  pthread_cond_init(&group->request_finished, NULL);
+  group->max_requests = PREFETCH_MAX_REQUESTS;
+  group->usage = 1;
+
+  for(i = 0; i < count; i++) {
+    int endpoint = i % PREFETCH_ENDPOINTS_COUNT;
+
+    /* each request has its own copy of the endpoint string */
+    sprintf(requests[i].endpoint, "http://example.org/sparql%d", endpoint);
+    requests[i].prefetch.group = group;
+    requests[i].prefetch.endpoint = requests[i].endpoint;
+    requests[i].lock = &lock;
+    requests[i].active = &active[endpoint];
+    requests[i].peak = &peak[endpoint];
+  }
+
+  for(started = 0; started < count; started++) {
+    if(pthread_create(&threads[started], NULL, test_prefetch_request_thread,
+                      &requests[started]))
+      break;
+  }
+  for(i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+
+  if(started != count) {
+    fprintf(stderr, "%s: started %d prefetch threads, expected %d\n",
+            program, started, count);
+    failures++;
+  }
+
+  for(i = 0; i < PREFETCH_ENDPOINTS_COUNT; i++) {
+    if(peak[i] < 1 || peak[i] > PREFETCH_MAX_REQUESTS) {
+      fprintf(stderr,
+              "%s: endpoint %d had %d requests in flight, expected 1 to %d\n",
+              program, i, peak[i], PREFETCH_MAX_REQUESTS);
+      failures++;
+    }
+  }
+
+  if(group->in_flight_count) {
+    fprintf(stderr, "%s: %d prefetch requests left in flight\n", program,
+            group->in_flight_count);
+    failures++;
+  }
+
+  pthread_mutex_destroy(&lock);
+  rasqal_service_free_prefetch_group(group);
+
+  tidy:
+  if(requests)
+    RASQAL_FREE(test_prefetch_request*, requests);
+  if(threads)
+    RASQAL_FREE(pthread_t*, threads);
+
+  return failures;
+}
+
+
+/* services fetched concurrently; the last one is never read */
+#define PREFETCH_SERVICES_COUNT 3
+#define PREFETCH_READ_COUNT 2
+
+/*
+ * Start fetching several services of a file: URI stand-in endpoint
+ * with one request at a time, then read the responses handed over
+ * from the fetch threads and free a service whose response was not
+ * read.
+ */
+static int
+test_prefetch_handoff(const char* program, rasqal_world* world,
+                      rasqal_query* query)
+{
+  raptor_sequence* services = NULL;
+  raptor_uri* service_uri = NULL;
+  unsigned char* uri_string = NULL;
+  int failures = 0;
+  int i;
+
+  if(write_service_response(program))
+    return 1;
+
+  uri_string = raptor_uri_filename_to_uri_string(SERVICE_RESPONSE_FILE);
+  if(uri_string)
+    service_uri = raptor_new_uri(rasqal_world_get_raptor(world), uri_string);
+  services = raptor_new_sequence((raptor_data_free_handler)rasqal_free_service,
+                                 NULL);
+  if(!service_uri || !services) {
+    fprintf(stderr, "%s: failed to create prefetch services\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < PREFETCH_SERVICES_COUNT; i++) {
+    char query_string[64];
+
+    /* a different query string each so the requests differ */
+    sprintf(query_string, "SELECT * WHERE { ?s ?p ?o } LIMIT %d", i + 1);
+    raptor_sequence_push(services,
+                         rasqal_new_service(world, service_uri,
+                                            RASQAL_GOOD_CAST(const unsigned char*, query_string),
+                                            NULL));
+  }
+
+  if(raptor_sequence_size(services) != PREFETCH_SERVICES_COUNT ||
+     rasqal_service_start_services(services, 1)) {
+    fprintf(stderr, "%s: starting the service prefetches FAILED\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < PREFETCH_SERVICES_COUNT; i++) {
+    rasqal_service* svc = (rasqal_service*)raptor_sequence_get_at(services, i);
+
+    if(!svc->prefetch) {
+      fprintf(stderr, "%s: service %d was not prefetched\n", program, i);
+      failures++;
+    }
+  }
+  if(failures)
+    goto tidy;
+
+  for(i = 0; i < PREFETCH_READ_COUNT; i++) {
+    rasqal_service* svc = (rasqal_service*)raptor_sequence_get_at(services, i);
+    rasqal_rowsource* rowsource;
+    rasqal_row* row;
+    int count = 0;
+
+    rowsource = rasqal_service_execute_as_rowsource(svc, query->vars_table);
+    if(svc->prefetch) {
+      fprintf(stderr, "%s: service %d prefetch was not handed over\n",
+              program, i);
+      failures++;
+    }
+    if(!rowsource) {
+      fprintf(stderr, "%s: reading prefetched service %d FAILED\n",
+              program, i);
+      failures++;
+      continue;
+    }
+
+    while((row = rasqal_rowsource_read_row(rowsource))) {
+      rasqal_free_row(row);
+      count++;
+    }
+    rasqal_free_rowsource(rowsource);
+
+    if(count != SERVICE_RESPONSE_ROWS_COUNT) {
+      fprintf(stderr,
+              "%s: prefetched service %d returned %d rows, expected %d\n",
+              program, i, count, SERVICE_RESPONSE_ROWS_COUNT);
+      failures++;
+    }
+  }
+
+  tidy:
+  /* frees the unread service, cancelling its prefetch */
+  if(services)
+    raptor_free_sequence(services);
+  if(service_uri)
+    raptor_free_uri(service_uri);
+  if(uri_string)
+    raptor_free_memory(uri_string);
+
+  remove(SERVICE_RESPONSE_FILE);
+
+  return failures;
+}
+#endif
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world* world = NULL;
+  rasqal_query* query = NULL;
+  rasqal_variables_table* vt;
+  rasqal_service* svc = NULL;
+  raptor_uri* service_uri = NULL;
+  raptor_uri* retrieval_uri = NULL;
+  rasqal_rowsource* rowsource = NULL;
+  raptor_sequence* seq = NULL;
+  raptor_sequence* vars_seq = NULL;
+  raptor_sequence* expected_seq = NULL;
+  rasqal_row* row;
+  unsigned char* blank;
+  char* key = NULL;
+  int failures = 0;
+  int i;
+
+  world = rasqal_new_world(); rasqal_world_open(world);
+
+  query = rasqal_new_query(world, "sparql", NULL);
+  vt = query->vars_table;
+
+  if(rasqal_world_set_service_cache(world, 4096, 0)) {
+    fprintf(stderr, "%s: failed to enable the service cache\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  service_uri = raptor_new_uri(rasqal_world_get_raptor(world),
+                               RASQAL_GOOD_CAST(const unsigned char*, "http://example.org/sparql"));
+  svc = rasqal_new_service(world, service_uri,
+                           RASQAL_GOOD_CAST(const unsigned char*, "SELECT * WHERE { ?s ?p ?o }"),
+                           NULL);
+  if(!svc) {
+    fprintf(stderr, "%s: failed to create service\n", program);
+    failures++;
+    goto tidy;
+  }
+  retrieval_uri = rasqal_service_new_retrieval_uri(svc);
+
+  seq = rasqal_new_row_sequence(world, vt, service_cache_data_3x2_rows,
+                                SERVICE_CACHE_VARS_COUNT, &vars_seq);
+  if(!seq) {
+    fprintf(stderr, "%s: failed to create sequence of %d vars\n", program,
+            SERVICE_CACHE_VARS_COUNT);
+    failures++;
+    goto tidy;
+  }
+
+  /* row 3 data: blank node, language literal and typed literal */
+  row = rasqal_new_row_for_size(world, SERVICE_CACHE_VARS_COUNT);
+  blank = RASQAL_MALLOC(unsigned char*, 3);
+  if(!row || !blank) {
+    fprintf(stderr, "%s: failed to create row\n", program);
+    failures++;
+    goto tidy;
+  }
+  memcpy(blank, "b1", 3);
+  row->values[0] = rasqal_new_simple_literal(world, RASQAL_LITERAL_BLANK,
+                                             blank);
+  row->values[1] = new_test_literal(world, "chat", "fr", NULL);
+  row->values[2] = new_test_literal(world, "x\n\"y\"", NULL,
+                                    "http://example.org/datatype");
+  raptor_sequence_push(seq, row);
+
+  rowsource = rasqal_new_rowsequence_rowsource(world, query, vt, seq,
+                                               vars_seq);
+  /* vars_seq and seq are now owned by rowsource */
+  vars_seq = seq = NULL;
+  key = rasqal_service_cache_key(svc, retrieval_uri);
+  if(!rowsource || !key) {
+    fprintf(stderr, "%s: failed to create response rowsource\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  /* encode the response rows into the cache as they are read */
+  rowsource = rasqal_new_service_cache_fill_rowsource(svc, rowsource,
+                                                      key, vt);
+  key = NULL;
+  if(rowsource)
+    expected_seq = rasqal_rowsource_read_all_rows(rowsource);
+  if(!expected_seq ||
+     raptor_sequence_size(expected_seq) != SERVICE_CACHE_ROWS_COUNT) {
+    fprintf(stderr, "%s: reading the response rows FAILED\n", program);
+    failures++;
+    goto tidy;
+  }
+  rasqal_free_rowsource(rowsource);
+  rowsource = NULL;
+
+  /* decode them again from the cache */
+  key = rasqal_service_cache_key(svc, retrieval_uri);
+  rowsource = rasqal_service_cache_lookup(svc, key, vt);
+  if(!rowsource) {
+    fprintf(stderr, "%s: response was not cached\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  if(rasqal_rowsource_get_size(rowsource) != SERVICE_CACHE_VARS_COUNT) {
+    fprintf(stderr, "%s: cached response has %d variables, expected %d\n",
+            program, rasqal_rowsource_get_size(rowsource),
+            SERVICE_CACHE_VARS_COUNT);
+    failures++;
+    goto tidy;
+  }
+  for(i = 0; i < SERVICE_CACHE_VARS_COUNT; i++) {
+    rasqal_variable* v = rasqal_rowsource_get_variable_by_offset(rowsource, i);
+    const char* expected_name = service_cache_data_3x2_rows[i << 1];
+
+    if(!v || strcmp(RASQAL_GOOD_CAST(const char*, v->name), expected_name)) {
+      fprintf(stderr, "%s: cached response variable #%d is not %s\n",
+              program, i, expected_name);
+      failures++;
+      goto tidy;
+    }
+  }
+
+  seq = rasqal_rowsource_read_all_rows(rowsource);
+  if(!seq || compare_rows(expected_seq, seq)) {
+    fprintf(stderr, "%s: cached response rows differ from the response\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+  raptor_free_sequence(seq);
+  seq = NULL;
+  rasqal_free_rowsource(rowsource);
+  rowsource = NULL;
+  RASQAL_FREE(char*, key);
+
+  /* the format is part of the key */
+  rasqal_service_set_format(svc, "application/sparql-results+json");
+  key = rasqal_service_cache_key(svc, retrieval_uri);
+  rowsource = rasqal_service_cache_lookup(svc, key, vt);
+  if(rowsource) {
+    fprintf(stderr, "%s: response was found for another format\n", program);
+    failures++;
+    goto tidy;
+  }
+  RASQAL_FREE(char*, key);
+  rasqal_service_set_format(svc, NULL);
+
+  /* shrinking the budget removes the response */
+  rasqal_world_set_service_cache(world, 1, 0);
+  key = rasqal_service_cache_key(svc, retrieval_uri);
+  rowsource = rasqal_service_cache_lookup(svc, key, vt);
+  if(rowsource || world->service_cache_count || world->service_cache_used) {
+    fprintf(stderr, "%s: response was kept beyond the cache budget\n",
+            program);
+    failures++;
+    goto tidy;
+  }
+
+  failures += test_values_writer(program, world, query);
+  failures += test_bind_join(program, world, query);
+#ifdef HAVE_PTHREAD_H
+  failures += test_prefetch_endpoint_cap(program);
+  failures += test_prefetch_handoff(program, world, query);
+#endif
+
+  tidy:
+  if(key)
+    RASQAL_FREE(char*, key);
+  if(seq)
+    raptor_free_sequence(seq);
+  if(vars_seq)
+    raptor_free_sequence(vars_seq);
+  if(expected_seq)
+    raptor_free_sequence(expected_seq);
+  if(rowsource)
+    rasqal_free_rowsource(rowsource);
+  if(retrieval_uri)
+    raptor_free_uri(retrieval_uri);
+  if(service_uri)
+    raptor_free_uri(service_uri);
+  if(svc)
+    rasqal_free_service(svc);
+  if(query)
+    rasqal_free_query(query);
+  if(world)
+    rasqal_free_world(world);
+
+  return failures;
+}
+
+#endif /* STANDALONE */
@@ -0,0 +1,859 @@
+/* -*- Mode: c; c-basic-offset: 2 -*-
+ *
+ * rasqal_task.c - Rasqal work-stealing task pool
+ *
+ * Copyright (C) 2014, David Beckett http://www.dajobe.org/
+ *
+ * This package is Free Software and part of Redland http://librdf.org/
+ *
+ * It is licensed under the following three licenses as alternatives:
+ *   1. GNU Lesser General Public License (LGPL) V2.1 or any newer version
+ *   2. GNU General Public License (GPL) V2 or any newer version
+ *   3. Apache License, V2.0 or any newer version
+ *
+ * You may not use this file except in compliance with at least one of
+ * the above three licenses.
+ *
+ * See LICENSE.html or LICENSE.txt at the top of this package for the
+ * complete terms and further detail along with the license texts for
+ * the licenses in COPYING.LIB, COPYING and LICENSE-2.0.txt respectively.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <rasqal_config.h>
+#endif
+
+#ifdef WIN32
+#include <win32_rasqal_config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+#include "rasqal.h"
+#include "rasqal_internal.h"
+
+
+/*
+ * The pool has one double-ended queue of tasks per worker thread.  A
+ * worker pushes and pops tasks at the bottom of its own queue so
+ * that nested tasks run depth first on the thread that made them and
+ * steals from the top of the other queues when its own is empty.
+ * Threads outside the pool push tasks to the queues in turn and
+ * help run tasks while waiting for a task group.
+ *
+ * All queues are protected by one pool lock; tasks are expected to
+ * be coarse (a morsel of rows or a partition of a sort) so the lock
+ * is not held for long compared to the work done.
+ *
+ * Without thread support or with no worker threads, tasks are run
+ * when they are submitted.
+ */
+
+typedef struct rasqal_task_s {
+  rasqal_task_handler handler;
+  void* user_data;
+  rasqal_task_group* group;
+} rasqal_task;
+
+
+#ifdef HAVE_PTHREAD_H
+typedef struct {
+  /* ring buffer of tasks */
+  rasqal_task* tasks;
+  int capacity;
+  /* index of the top (oldest) task */
+  int head;
+  int count;
+} rasqal_task_queue;
+#endif
+
+
+struct rasqal_task_pool_s {
+  rasqal_world* world;
+
+  /* number of worker threads */
+  int threads;
+
+#ifdef HAVE_PTHREAD_H
+  pthread_t* workers;
+  int workers_started;
+
+  /* one queue per worker */
+  rasqal_task_queue* queues;
+
+  /* number of tasks in all queues */
+  int queued;
+
+  /* next queue for a task submitted from outside the pool */
+  int next_queue;
+
+  /* non-0 when the workers should exit */
+  int stop;
+
+  /* lock for all fields above and all task group counts */
+  pthread_mutex_t lock;
+
+  /* signalled when a task is queued or the pool is stopping */
+  pthread_cond_t task_ready;
+
+  /* signalled when a task group has no more pending tasks */
+  pthread_cond_t group_done;
+
+  /* worker index + 1 of the current thread */
+  pthread_key_t worker_key;
+#endif
+};
+
+
+struct rasqal_task_group_s {
+  rasqal_task_pool* pool;
+
+  /* tasks submitted and not yet finished */
+  int pending;
+
+  /* non-0 if any task returned failure */
+  int failed;
+};
+
+
+static int
+rasqal_task_run(rasqal_task* task)
+{
+  return task->handler(task->user_data);
+}
+
+
+#ifdef HAVE_PTHREAD_H
+static int
+rasqal_task_queue_push(rasqal_task_queue* queue, rasqal_task* task)
+{
+  if(queue->count == queue->capacity) {
+    int new_capacity = queue->capacity ? queue->capacity * 2 : 16;
+    rasqal_task* new_tasks;
+    int i;
+
+    new_tasks = RASQAL_MALLOC(rasqal_task*,
+                              RASQAL_GOOD_CAST(size_t, new_capacity) * sizeof(*new_tasks));
+    if(!new_tasks)
+      return 1;
+
+    for(i = 0; i < queue->count; i++)
+      new_tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+
+    if(queue->tasks)
+      RASQAL_FREE(rasqal_task*, queue->tasks);
+    queue->tasks = new_tasks;
+    queue->capacity = new_capacity;
+    queue->head = 0;
+  }
+
+  queue->tasks[(queue->head + queue->count) % queue->capacity] = *task;
+  queue->count++;
+
+  return 0;
+}
+
+
+/* take the newest task: used by the worker that owns the queue */
+static int
+rasqal_task_queue_pop_bottom(rasqal_task_queue* queue, rasqal_task* task)
+{
+  if(!queue->count)
+    return 1;
+
+  queue->count--;
+  *task = queue->tasks[(queue->head + queue->count) % queue->capacity];
+
+  return 0;
+}
+
+
+/* take the oldest task: used when stealing from another queue */
+static int
+rasqal_task_queue_pop_top(rasqal_task_queue* queue, rasqal_task* task)
+{
+  if(!queue->count)
+    return 1;
+
+  *task = queue->tasks[queue->head];
+  queue->head = (queue->head + 1) % queue->capacity;
+  queue->count--;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_task_pool_worker_index:
+ * @pool: task pool
+ *
+ * INTERNAL - Get the worker index of the calling thread
+ *
+ * Return value: index or <0 if the thread is not a worker of @pool
+ */
+static int
+rasqal_task_pool_worker_index(rasqal_task_pool* pool)
+{
+  void* value = pthread_getspecific(pool->worker_key);
+
+  return RASQAL_GOOD_CAST(int, RASQAL_GOOD_CAST(size_t, value)) - 1;
+}
+
+
+/*
+ * rasqal_task_pool_take_task:
+ * @pool: task pool
+ * @self: worker index of the calling thread or <0
+ * @task: task to fill in
+ *
+ * INTERNAL - Take a task from the pool queues, pool lock held
+ *
+ * Return value: non-0 if no task was queued
+ */
+static int
+rasqal_task_pool_take_task(rasqal_task_pool* pool, int self,
+                           rasqal_task* task)
+{
+  int i;
+
+  if(!pool->queued)
+    return 1;
+
+  if(self >= 0 && !rasqal_task_queue_pop_bottom(&pool->queues[self], task)) {
+    pool->queued--;
+    return 0;
+  }
+
+  for(i = 1; i <= pool->threads; i++) {
+    int victim = (self + i) % pool->threads;
+    if(victim < 0)
+      victim += pool->threads;
+
+    if(!rasqal_task_queue_pop_top(&pool->queues[victim], task)) {
+      pool->queued--;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+/*
+ * rasqal_task_pool_finish_task:
+ * @pool: task pool
+ * @task: task that was run
+ * @rc: return value of the task handler
+ *
+ * INTERNAL - Record a task finished in its group, pool lock held
+ */
+static void
+rasqal_task_pool_finish_task(rasqal_task_pool* pool, rasqal_task* task,
+                             int rc)
+{
+  rasqal_task_group* group = task->group;
+
+  if(rc)
+    group->failed = 1;
+
+  if(!--group->pending)
+    pthread_cond_broadcast(&pool->group_done);
+}
+
+
+/*
+ * rasqal_task_pool_run_one:
+ * @pool: task pool
+ * @self: worker index of the calling thread or <0
+ *
+ * INTERNAL - Run one queued task if there is one, pool lock held
+ *
+ * The lock is released while the task runs.
+ *
+ * Return value: non-0 if no task was run
+ */
+static int
+rasqal_task_pool_run_one(rasqal_task_pool* pool, int self)
+{
+  rasqal_task task;
+  int rc;
+
+  if(rasqal_task_pool_take_task(pool, self, &task))
+    return 1;
+
+  pthread_mutex_unlock(&pool->lock);
+  rc = rasqal_task_run(&task);
+  pthread_mutex_lock(&pool->lock);
+
+  rasqal_task_pool_finish_task(pool, &task, rc);
+
+  return 0;
+}
+
+
+typedef struct {
+  rasqal_task_pool* pool;
+  int index;
+} rasqal_task_worker_start;
+
+
+static void*
+rasqal_task_pool_worker(void* arg)
+{
+  rasqal_task_pool* pool = ((rasqal_task_worker_start*)arg)->pool;
+  int self = ((rasqal_task_worker_start*)arg)->index;
+
+  RASQAL_FREE(rasqal_task_worker_start, arg);
+
+  pthread_setspecific(pool->worker_key,
+                      RASQAL_GOOD_CAST(void*, RASQAL_GOOD_CAST(size_t, self + 1)));
+
+  pthread_mutex_lock(&pool->lock);
+  while(1) {
+    if(!rasqal_task_pool_run_one(pool, self))
+      continue;
+
+    if(pool->stop)
+      break;
+
+    pthread_cond_wait(&pool->task_ready, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+#endif
+
+
+/*
+ * rasqal_new_task_pool:
+ * @world: world
+ * @threads: number of worker threads
+ *
+ * INTERNAL - Constructor - create a pool of worker threads
+ *
+ * If @threads is 0 or threads are not supported, the pool runs
+ * tasks in the submitting thread.
+ *
+ * Return value: new pool or NULL on failure
+ */
+rasqal_task_pool*
+rasqal_new_task_pool(rasqal_world* world, int threads)
+{
+  rasqal_task_pool* pool;
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  pool = RASQAL_CALLOC(rasqal_task_pool*, 1, sizeof(*pool));
+  if(!pool)
+    return NULL;
+
+  pool->world = world;
+
+#ifdef HAVE_PTHREAD_H
+  if(threads <= 0)
+    return pool;
+
+  if(pthread_key_create(&pool->worker_key, NULL)) {
+    RASQAL_FREE(rasqal_task_pool, pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->task_ready, NULL);
+  pthread_cond_init(&pool->group_done, NULL);
+  pool->threads = threads;
+
+  pool->queues = RASQAL_CALLOC(rasqal_task_queue*,
+                               RASQAL_GOOD_CAST(size_t, threads),
+                               sizeof(*pool->queues));
+  pool->workers = RASQAL_CALLOC(pthread_t*, RASQAL_GOOD_CAST(size_t, threads),
+                                sizeof(*pool->workers));
+  if(!pool->queues || !pool->workers)
+    goto failed;
+
+  for(i = 0; i < threads; i++) {
+    rasqal_task_worker_start* start;
+
+    start = RASQAL_MALLOC(rasqal_task_worker_start*, sizeof(*start));
+    if(!start)
+      goto failed;
+    start->pool = pool;
+    start->index = i;
+
+    if(pthread_create(&pool->workers[i], NULL, rasqal_task_pool_worker,
+                      start)) {
+      RASQAL_FREE(rasqal_task_worker_start, start);
+      goto failed;
+    }
+    pool->workers_started++;
+  }
+
+  return pool;
+
+  failed:
+  rasqal_free_task_pool(pool);
+  return NULL;
+#else
+  return pool;
+#endif
+}
+
+
+/*
+ * rasqal_free_task_pool:
+ * @pool: task pool
+ *
+ * INTERNAL - Destructor - stop the worker threads and free the pool
+ *
+ * There must be no task groups using the pool.
+ */
+void
+rasqal_free_task_pool(rasqal_task_pool* pool)
+{
+#ifdef HAVE_PTHREAD_H
+  int i;
+#endif
+
+  if(!pool)
+    return;
+
+#ifdef HAVE_PTHREAD_H
+  if(pool->threads) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(i = 0; i < pool->workers_started; i++)
+      pthread_join(pool->workers[i], NULL);
+
+    if(pool->queues) {
+      for(i = 0; i < pool->threads; i++) {
+        if(pool->queues[i].tasks)
+          RASQAL_FREE(rasqal_task*, pool->queues[i].tasks);
+      }
+      RASQAL_FREE(rasqal_task_queue*, pool->queues);
+    }
+
+    if(pool->workers)
+      RASQAL_FREE(pthread_t*, pool->workers);
+
+    pthread_cond_destroy(&pool->group_done);
+    pthread_cond_destroy(&pool->task_ready);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_key_delete(pool->worker_key);
+  }
+#endif
+
+  RASQAL_FREE(rasqal_task_pool, pool);
+}
+
+
+/*
+ * rasqal_task_pool_get_threads:
+ * @pool: task pool or NULL
+ *
+ * INTERNAL - Get the number of worker threads of a pool
+ *
+ * Return value: number of threads; 0 if tasks run when submitted
+ */
+int
+rasqal_task_pool_get_threads(rasqal_task_pool* pool)
+{
+  return pool ? pool->threads : 0;
+}
+
+
+/*
+ * rasqal_new_task_group:
+ * @pool: task pool or NULL to run tasks when submitted
+ *
+ * INTERNAL - Constructor - create a group of tasks to wait for together
+ *
+ * Return value: new task group or NULL on failure
+ */
+rasqal_task_group*
+rasqal_new_task_group(rasqal_task_pool* pool)
+{
+  rasqal_task_group* group;
+
+  group = RASQAL_CALLOC(rasqal_task_group*, 1, sizeof(*group));
+  if(!group)
+    return NULL;
+
+  group->pool = pool;
+
+  return group;
+}
+
+
+/*
+ * rasqal_free_task_group:
+ * @group: task group
+ *
+ * INTERNAL - Destructor - wait for any pending tasks and free a task group
+ */
+void
+rasqal_free_task_group(rasqal_task_group* group)
+{
+  if(!group)
+    return;
+
+  rasqal_task_group_wait(group);
+
+  RASQAL_FREE(rasqal_task_group, group);
+}
+
+
+/*
+ * rasqal_task_group_submit:
+ * @group: task group
+ * @handler: task function
+ * @user_data: task data
+ *
+ * INTERNAL - Submit a task to run in the pool of a task group
+ *
+ * Tasks may submit further tasks.  If the task cannot be queued, it
+ * is run before returning.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_task_group_submit(rasqal_task_group* group,
+                         rasqal_task_handler handler, void* user_data)
+{
+  rasqal_task task;
+#ifdef HAVE_PTHREAD_H
+  rasqal_task_pool* pool = group->pool;
+  int queue;
+#endif
+
+  task.handler = handler;
+  task.user_data = user_data;
+  task.group = group;
+
+#ifdef HAVE_PTHREAD_H
+  if(pool && pool->threads) {
+    pthread_mutex_lock(&pool->lock);
+
+    queue = rasqal_task_pool_worker_index(pool);
+    if(queue < 0) {
+      queue = pool->next_queue;
+      pool->next_queue = (pool->next_queue + 1) % pool->threads;
+    }
+
+    if(!rasqal_task_queue_push(&pool->queues[queue], &task)) {
+      group->pending++;
+      pool->queued++;
+      pthread_cond_signal(&pool->task_ready);
+      pthread_mutex_unlock(&pool->lock);
+      return 0;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+  }
+#endif
+
+  if(rasqal_task_run(&task))
+    group->failed = 1;
+
+  return 0;
+}
+
+
+/*
+ * rasqal_task_group_wait:
+ * @group: task group
+ *
+ * INTERNAL - Wait for all tasks submitted to a group to finish
+ *
+ * The calling thread runs queued tasks while it waits.
+ *
+ * Return value: non-0 if any task in the group failed
+ */
+int
+rasqal_task_group_wait(rasqal_task_group* group)
+{
+#ifdef HAVE_PTHREAD_H
+  rasqal_task_pool* pool = group->pool;
+
+  if(pool && pool->threads) {
+    int self = rasqal_task_pool_worker_index(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while(group->pending) {
+      if(rasqal_task_pool_run_one(pool, self))
+        pthread_cond_wait(&pool->group_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+#endif
+
+  return group->failed;
+}
+
+
+/*
+ * rasqal_task_group_is_done:
+ * @group: task group
+ *
+ * INTERNAL - Check without waiting if all tasks of a group have finished
+ *
+ * Return value: non-0 if no submitted task is still pending
+ */
+int
+rasqal_task_group_is_done(rasqal_task_group* group)
+{
+  int done = 1;
+#ifdef HAVE_PTHREAD_H
+  rasqal_task_pool* pool = group->pool;
+
+  if(pool && pool->threads) {
+    pthread_mutex_lock(&pool->lock);
+    done = !group->pending;
+    pthread_mutex_unlock(&pool->lock);
+  }
+#endif
+
+  return done;
+}
+
+
+/*
+ * rasqal_world_get_task_pool:
+ * @world: world
+ *
+ * INTERNAL - Get the world task pool
+ *
+ * The pool has #RASQAL_FEATURE_THREADS worker threads and is created
+ * when that feature is set with rasqal_world_set_feature(), so
+ * concurrent executions never create it.
+ *
+ * Return value: shared pool or NULL if there are no worker threads
+ */
+rasqal_task_pool*
+rasqal_world_get_task_pool(rasqal_world* world)
+{
+  if(!rasqal_task_pool_get_threads(world->task_pool))
+    return NULL;
+
+  return world->task_pool;
+}
+
+
+/*
+ * rasqal_query_get_task_pool:
+ * @query: query
+ *
+ * INTERNAL - Get the task pool to use for evaluating a query
+ *
+ * Return value: shared pool or NULL to evaluate in the calling thread
+ */
+rasqal_task_pool*
+rasqal_query_get_task_pool(rasqal_query* query)
+{
+  if(query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_THREADS)] == 1)
+    return NULL;
+
+  return rasqal_world_get_task_pool(query->world);
+}
+
+
+/*
+ * rasqal_query_get_parallelism:
+ * @query: query
+ *
+ * INTERNAL - Get the number of parts to split parallel work of a query into
+ *
+ * This is the world pool size limited by a non-0 query
+ * #RASQAL_FEATURE_THREADS value.
+ *
+ * Return value: number of parts; 1 to evaluate in the calling thread
+ */
+int
+rasqal_query_get_parallelism(rasqal_query* query)
+{
+  int threads;
+  int limit;
+
+  threads = rasqal_task_pool_get_threads(rasqal_query_get_task_pool(query));
+  if(threads <= 1)
+    return 1;
+
+  limit = query->features[RASQAL_GOOD_CAST(int, RASQAL_FEATURE_THREADS)];
+  if(limit > 0 && limit < threads)
+    threads = limit;
+
+  return threads;
+}
+
+
+
+#ifdef STANDALONE
+#include <stdio.h>
+
+int main(int argc, char *argv[]);
+
+
+#define TASKS_COUNT 1000
+#define NESTED_COUNT 10
+
+typedef struct {
+  rasqal_task_group* group;
+  int value;
+  int result;
+  int children[NESTED_COUNT];
+} test_task_data;
+
+
+static int
+test_leaf_task(void* user_data)
+{
+  int* value = (int*)user_data;
+
+  *value = *value * 2;
+
+  return 0;
+}
+
+
+static int
+test_task(void* user_data)
+{
+  test_task_data* data = (test_task_data*)user_data;
+  rasqal_task_group* group;
+  int i;
+
+  data->result = data->value * data->value;
+
+  /* submit and wait for nested tasks from inside a task */
+  group = rasqal_new_task_group(data->group->pool);
+  if(!group)
+    return 1;
+
+  for(i = 0; i < NESTED_COUNT; i++) {
+    data->children[i] = i;
+    rasqal_task_group_submit(group, test_leaf_task, &data->children[i]);
+  }
+
+  if(rasqal_task_group_wait(group)) {
+    rasqal_free_task_group(group);
+    return 1;
+  }
+  rasqal_free_task_group(group);
+
+  for(i = 0; i < NESTED_COUNT; i++) {
+    if(data->children[i] != i * 2)
+      return 1;
+  }
+
+  return 0;
+}
+
+
+static int
+test_failing_task(void* user_data)
+{
+  return 1;
+}
+
+
+static int
+test_pool(const char* program, rasqal_world* world, int threads)
+{
+  rasqal_task_pool* pool;
+  rasqal_task_group* group;
+  test_task_data* data;
+  int failures = 0;
+  int i;
+
+  pool = rasqal_new_task_pool(world, threads);
+  if(!pool) {
+    fprintf(stderr, "%s: rasqal_new_task_pool(%d) failed\n", program, threads);
+    return 1;
+  }
+
+  data = (test_task_data*)calloc(TASKS_COUNT, sizeof(*data));
+  group = rasqal_new_task_group(pool);
+  if(!data || !group) {
+    fprintf(stderr, "%s: allocation failed\n", program);
+    failures++;
+    goto tidy;
+  }
+
+  for(i = 0; i < TASKS_COUNT; i++) {
+    data[i].group = group;
+    data[i].value = i;
+    rasqal_task_group_submit(group, test_task, &data[i]);
+  }
+
+  if(rasqal_task_group_wait(group)) {
+    fprintf(stderr, "%s: %d threads: task group failed\n", program, threads);
+    failures++;
+  }
+
+  if(!rasqal_task_group_is_done(group)) {
+    fprintf(stderr, "%s: %d threads: task group not done after wait\n",
+            program, threads);
+    failures++;
+  }
+
+  for(i = 0; i < TASKS_COUNT; i++) {
+    if(data[i].result != i * i) {
+      fprintf(stderr, "%s: %d threads: task %d returned %d expected %d\n",
+              program, threads, i, data[i].result, i * i);
+      failures++;
+      break;
+    }
+  }
+
+  rasqal_task_group_submit(group, test_failing_task, NULL);
+  if(!rasqal_task_group_wait(group)) {
+    fprintf(stderr, "%s: %d threads: task failure was not reported\n",
+            program, threads);
+    failures++;
+  }
+
+  tidy:
+  if(group)
+    rasqal_free_task_group(group);
+  if(data)
+    free(data);
+  rasqal_free_task_pool(pool);
+
+  return failures;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  const char *program = rasqal_basename(argv[0]);
+  rasqal_world* world;
+  int failures = 0;
+
+  world = rasqal_new_world();
+  if(!world || rasqal_world_open(world)) {
+    fprintf(stderr, "%s: rasqal_world init failed\n", program);
+    return(1);
+  }
+
+  failures += test_pool(program, world, 0);
+  failures += test_pool(program, world, 1);
+  failures += test_pool(program, world, 4);
+
+  rasqal_free_world(world);
+
+  return failures;
+}
+#endif /* STANDALONE */
@@ -64,7 +64,7 @@ rasqal_new_variable_from_variable(rasqal_variable* v)
   if(!v)
     return NULL;
   
-  v->usage++;
+  RASQAL_USAGE_INCREMENT(&v->usage);
   
 #ifdef RASQAL_DEBUG_VARIABLE_USAGE
   RASQAL_DEBUG3("Variable %s usage increased to %d\n", v->name, v->usage);
@@ -87,12 +87,12 @@ rasqal_free_variable(rasqal_variable* v)
     return;
 
 #ifdef RASQAL_DEBUG_VARIABLE_USAGE
-  v->usage--;
+  RASQAL_USAGE_DECREMENT(&v->usage);
   RASQAL_DEBUG3("Variable %s usage decreased to %d\n", v->name, v->usage);
   if(v->usage)
     return;
 #else
-  if(--v->usage)
+  if(RASQAL_USAGE_DECREMENT(&v->usage))
     return;
 #endif
   
@@ -335,7 +335,7 @@ rasqal_new_variables_table(rasqal_world* world)
 rasqal_variables_table*
 rasqal_new_variables_table_from_variables_table(rasqal_variables_table* vt)
 {
-  vt->usage++;
+  RASQAL_USAGE_INCREMENT(&vt->usage);
   return vt;
 }
 
@@ -352,7 +352,7 @@ rasqal_free_variables_table(rasqal_variables_table* vt)
   if(!vt)
     return;
 
-  if(--vt->usage)
+  if(RASQAL_USAGE_DECREMENT(&vt->usage))
     return;
   
   if(vt->variables)
@@ -698,6 +698,190 @@ rasqal_variable_copy_variable_sequence(raptor_sequence* vars_seq)
 }
 
 
+
+/*
+ * A binding frame holds the values of variables written by one query
+ * execution while evaluating expressions (BIND, projection
+ * expressions, aggregate results, the GRAPH variable and input rows
+ * bound for FILTER, HAVING and ORDER BY), separate from the values in
+ * the shared #rasqal_variable objects.
+ *
+ * Triple pattern matching does not use the frame: each triples
+ * rowsource gives the triples source API its own copies of the
+ * pattern variables to bind and copies their values into rows as
+ * each match is found.
+ *
+ * Slots are indexed by variable offset for each variable type and
+ * grow on demand.  A slot may be set to NULL (unbound) which is
+ * different from not being set at all.
+ */
+typedef struct {
+  rasqal_literal* value;
+
+  /* non-0 if the slot has been set */
+  int is_set;
+} rasqal_binding_frame_slot;
+
+
+/* slots arrays for named and anonymous variables */
+#define RASQAL_BINDING_FRAME_SLOTS_COUNT 2
+
+struct rasqal_binding_frame_s {
+  rasqal_world* world;
+
+  int slots_size[RASQAL_BINDING_FRAME_SLOTS_COUNT];
+
+  rasqal_binding_frame_slot* slots[RASQAL_BINDING_FRAME_SLOTS_COUNT];
+};
+
+
+/*
+ * rasqal_new_binding_frame:
+ * @world: rasqal world
+ *
+ * INTERNAL - Constructor - create a new empty binding frame
+ *
+ * Return value: new binding frame or NULL on failure
+ */
+rasqal_binding_frame*
+rasqal_new_binding_frame(rasqal_world* world)
+{
+  rasqal_binding_frame* frame;
+
+  frame = RASQAL_CALLOC(rasqal_binding_frame*, 1, sizeof(*frame));
+  if(!frame)
+    return NULL;
+
+  frame->world = world;
+
+  return frame;
+}
+
+
+/*
+ * rasqal_free_binding_frame:
+ * @frame: binding frame
+ *
+ * INTERNAL - Destructor - destroy a binding frame and the values it holds
+ */
+void
+rasqal_free_binding_frame(rasqal_binding_frame* frame)
+{
+  int i;
+
+  if(!frame)
+    return;
+
+  for(i = 0; i < RASQAL_BINDING_FRAME_SLOTS_COUNT; i++) {
+    int j;
+
+    if(!frame->slots[i])
+      continue;
+
+    for(j = 0; j < frame->slots_size[i]; j++) {
+      if(frame->slots[i][j].value)
+        rasqal_free_literal(frame->slots[i][j].value);
+    }
+    RASQAL_FREE(rasqal_binding_frame_slot*, frame->slots[i]);
+  }
+
+  RASQAL_FREE(rasqal_binding_frame, frame);
+}
+
+
+static int
+rasqal_binding_frame_slots_index(rasqal_variable* v)
+{
+  return (v->type == RASQAL_VARIABLE_TYPE_ANONYMOUS) ? 1 : 0;
+}
+
+
+/*
+ * rasqal_binding_frame_get_value:
+ * @frame: binding frame
+ * @v: variable
+ * @is_set_p: OUT: set to non-0 if the variable has been set in the frame
+ *
+ * INTERNAL - Get the value of a variable in a binding frame
+ *
+ * Return value: shared pointer to value or NULL if unbound or not set
+ */
+rasqal_literal*
+rasqal_binding_frame_get_value(rasqal_binding_frame* frame, rasqal_variable* v,
+                               int* is_set_p)
+{
+  int idx = rasqal_binding_frame_slots_index(v);
+  rasqal_binding_frame_slot* slot;
+
+  if(v->offset < 0 || v->offset >= frame->slots_size[idx]) {
+    *is_set_p = 0;
+    return NULL;
+  }
+
+  slot = &frame->slots[idx][v->offset];
+  *is_set_p = slot->is_set;
+  return slot->value;
+}
+
+
+/*
+ * rasqal_binding_frame_set_value:
+ * @frame: binding frame
+ * @v: variable
+ * @l: value (or NULL)
+ *
+ * INTERNAL - Set the value of a variable in a binding frame
+ *
+ * The value @l becomes owned by the frame, including on failure.
+ *
+ * Return value: non-0 on failure
+ */
+int
+rasqal_binding_frame_set_value(rasqal_binding_frame* frame, rasqal_variable* v,
+                               rasqal_literal* l)
+{
+  int idx = rasqal_binding_frame_slots_index(v);
+  rasqal_binding_frame_slot* slot;
+
+  if(v->offset < 0)
+    goto failed;
+
+  if(v->offset >= frame->slots_size[idx]) {
+    rasqal_binding_frame_slot* nslots;
+    int nsize = frame->slots_size[idx] ? (frame->slots_size[idx] << 1) : 8;
+
+    while(nsize <= v->offset)
+      nsize <<= 1;
+
+    nslots = RASQAL_CALLOC(rasqal_binding_frame_slot*,
+                           RASQAL_GOOD_CAST(size_t, nsize), sizeof(*nslots));
+    if(!nslots)
+      goto failed;
+
+    if(frame->slots[idx]) {
+      memcpy(nslots, frame->slots[idx],
+             sizeof(*nslots) * RASQAL_GOOD_CAST(size_t, frame->slots_size[idx]));
+      RASQAL_FREE(rasqal_binding_frame_slot*, frame->slots[idx]);
+    }
+    frame->slots[idx] = nslots;
+    frame->slots_size[idx] = nsize;
+  }
+
+  slot = &frame->slots[idx][v->offset];
+  if(slot->value)
+    rasqal_free_literal(slot->value);
+  slot->value = l;
+  slot->is_set = 1;
+
+  return 0;
+
+  failed:
+  if(l)
+    rasqal_free_literal(l);
+  return 1;
+}
+
+
 #endif /* not STANDALONE */
 
 
@@ -787,6 +971,59 @@ main(int argc, char *argv[])
     names[2] = NULL;
   }
   /* vars[2] now owned by vt */
+
+  /* binding frame values shadow variable values without changing them */
+  if(1) {
+    rasqal_binding_frame* frame;
+    rasqal_literal* l;
+    int is_set = 0;
+
+    frame = rasqal_new_binding_frame(world);
+    if(!frame) {
+      fprintf(stderr, "%s: Failed to make binding frame\n", program);
+      rc = 1;
+      goto tidy;
+    }
+
+    l = rasqal_binding_frame_get_value(frame, vars[1], &is_set);
+    if(l || is_set) {
+      fprintf(stderr, "%s: Empty binding frame returned a value\n", program);
+      rc = 1;
+    }
+
+    if(rasqal_binding_frame_set_value(frame, vars[1],
+                                      rasqal_new_integer_literal(world, RASQAL_LITERAL_INTEGER, 1)) ||
+       rasqal_binding_frame_set_value(frame, vars[2], NULL)) {
+      fprintf(stderr, "%s: Failed to set binding frame values\n", program);
+      rc = 1;
+    } else {
+      l = rasqal_binding_frame_get_value(frame, vars[1], &is_set);
+      if(!is_set || !l || l->type != RASQAL_LITERAL_INTEGER) {
+        fprintf(stderr, "%s: Binding frame returned wrong value for %s\n",
+                program, vars[1]->name);
+        rc = 1;
+      }
+      l = rasqal_binding_frame_get_value(frame, vars[2], &is_set);
+      if(!is_set || l) {
+        fprintf(stderr, "%s: Binding frame returned wrong value for %s\n",
+                program, vars[2]->name);
+        rc = 1;
+      }
+      l = rasqal_binding_frame_get_value(frame, vars[0], &is_set);
+      if(is_set) {
+        fprintf(stderr, "%s: Binding frame has unset variable %s set\n",
+                program, vars[0]->name);
+        rc = 1;
+      }
+      if(!vars[1]->value || vars[1]->value->type != RASQAL_LITERAL_DOUBLE) {
+        fprintf(stderr, "%s: Binding frame changed variable %s value\n",
+                program, vars[1]->name);
+        rc = 1;
+      }
+    }
+
+    rasqal_free_binding_frame(frame);
+  }
   
   tidy:
   for(i = 0; i < NUM_VARS; i++) {
@@ -324,6 +324,25 @@ rasqal_xsd_check_integer_format(const unsigned char* string, int flags)
 }
 
 
+/**
+ * rasqal_xsd_format_integer_buffer:
+ * @i: integer
+ * @buffer: buffer to write to
+ * @size: size of @buffer including NUL - at least #RASQAL_XSD_INTEGER_BUFFER_SIZE + 1
+ *
+ * INTERNAL - Format a C integer into a buffer in XSD decimal integer format.
+ *
+ * Return value: length of formatted string
+ */
+size_t
+rasqal_xsd_format_integer_buffer(int i, unsigned char* buffer, size_t size)
+{
+  /* snprintf() takes as length the buffer size including NUL */
+  snprintf(RASQAL_GOOD_CAST(char*, buffer), size, "%d", i);
+  return strlen(RASQAL_GOOD_CAST(const char*, buffer));
+}
+
+
 /**
  * rasqal_xsd_format_integer:
  * @i: integer
@@ -342,22 +361,15 @@ unsigned char*
 rasqal_xsd_format_integer(int i, size_t *len_p)
 {
   unsigned char* string;
+  size_t len;
   
-  /* Buffer sizes need to format:
-   *   4:  8 bit decimal integers (xsd:byte)  "-128" to "127"
-   *   6: 16 bit decimal integers (xsd:short) "-32768" to "32767" 
-   *  11: 32 bit decimal integers (xsd:int)   "-2147483648" to "2147483647"
-   *  20: 64 bit decimal integers (xsd:long)  "-9223372036854775808" to "9223372036854775807"
-   * (the lexical form may have leading 0s in non-canonical representations)
-   */
-#define INTEGER_BUFFER_SIZE 20
-  string = RASQAL_MALLOC(unsigned char*, INTEGER_BUFFER_SIZE + 1);
+  string = RASQAL_MALLOC(unsigned char*, RASQAL_XSD_INTEGER_BUFFER_SIZE + 1);
   if(!string)
     return NULL;
-  /* snprintf() takes as length the buffer size including NUL */
-  snprintf(RASQAL_GOOD_CAST(char*, string), INTEGER_BUFFER_SIZE + 1, "%d", i);
+  len = rasqal_xsd_format_integer_buffer(i, string,
+                                         RASQAL_XSD_INTEGER_BUFFER_SIZE + 1);
   if(len_p)
-    *len_p = strlen(RASQAL_GOOD_CAST(const char*, string));
+    *len_p = len;
 
   return string;
 }
@@ -393,29 +405,23 @@ rasqal_xsd_format_float(float f, size_t *len_p)
 
 
 /**
- * rasqal_xsd_format_double:
+ * rasqal_xsd_format_double_buffer:
  * @d: double
- * @len_p: pointer to length of result or NULL
+ * @buf: buffer to write to - at least #RASQAL_XSD_DOUBLE_BUFFER_SIZE + 1 bytes
  *
- * INTERNAL - Format a new an xsd:double correctly
+ * INTERNAL - Format an xsd:double correctly into a buffer
  *
- * Return value: new string or NULL on failure
+ * Return value: length of formatted string
  */
-unsigned char*
-rasqal_xsd_format_double(double d, size_t *len_p)
+size_t
+rasqal_xsd_format_double_buffer(double d, unsigned char* buf)
 {
   unsigned int e_index = 0;
   char have_trailing_zero = 0;
   size_t trailing_zero_start = 0;
   unsigned int exponent_start;
-  size_t len = 0;
-  unsigned char* buf = NULL;
+  size_t len = RASQAL_XSD_DOUBLE_BUFFER_SIZE;
 
-  len = 20;
-  buf = RASQAL_MALLOC(unsigned char*, len + 1);
-  if(!buf)
-    return NULL;
-  
   /* snprintf needs the length + 1 because it writes a \0 too */
   snprintf(RASQAL_GOOD_CAST(char*, buf), len + 1, "%1.14E", d);
 
@@ -465,6 +471,30 @@ rasqal_xsd_format_double(double d, size_t *len_p)
     }
   }
   
+  return len;
+}
+
+
+/**
+ * rasqal_xsd_format_double:
+ * @d: double
+ * @len_p: pointer to length of result or NULL
+ *
+ * INTERNAL - Format a new an xsd:double correctly
+ *
+ * Return value: new string or NULL on failure
+ */
+unsigned char*
+rasqal_xsd_format_double(double d, size_t *len_p)
+{
+  unsigned char* buf;
+  size_t len;
+
+  buf = RASQAL_MALLOC(unsigned char*, RASQAL_XSD_DOUBLE_BUFFER_SIZE + 1);
+  if(!buf)
+    return NULL;
+  
+  len = rasqal_xsd_format_double_buffer(d, buf);
   if(len_p)
     *len_p = len;
 
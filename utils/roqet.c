@@ -87,9 +87,9 @@ static char *program=NULL;
 
 #ifdef RASQAL_INTERNAL
 /* add 'g:' */
-#define GETOPT_STRING "cd:D:e:Ef:F:g:G:hi:np:qr:R:s:t:vW:"
+#define GETOPT_STRING "cd:D:e:Ef:F:g:G:hi:np:qr:R:s:t:vW:x:"
 #else
-#define GETOPT_STRING "cd:D:e:Ef:F:G:hi:np:qr:R:s:t:vW:"
+#define GETOPT_STRING "cd:D:e:Ef:F:G:hi:np:qr:R:s:t:vW:x:"
 #endif
 
 #ifdef HAVE_GETOPT_LONG
@@ -120,6 +120,7 @@ static struct option long_options[] =
   {"results-input", 1, 0, 't'},
   {"version", 0, 0, 'v'},
   {"warnings", 1, 0, 'W'},
+  {"explain", 1, 0, 'x'},
 #ifdef STORE_RESULTS_FLAG
   {"store-results", 1, 0, STORE_RESULTS_FLAG},
 #endif
@@ -594,6 +595,45 @@ print_formatted_query_results(rasqal_world* world,
 
 
 
+/* Read all the results then print the executed query plan */
+static int
+roqet_explain_query_results(rasqal_query_results* results,
+                            raptor_world* raptor_world_ptr,
+                            FILE* output,
+                            const char* explain_format_name)
+{
+  raptor_iostream *iostr;
+  int rc;
+
+  if(rasqal_query_results_is_bindings(results)) {
+    while(!rasqal_query_results_finished(results)) {
+      if(rasqal_query_results_next(results))
+        break;
+    }
+  } else if(rasqal_query_results_is_boolean(results)) {
+    (void)rasqal_query_results_get_boolean(results);
+  } else if(rasqal_query_results_is_graph(results)) {
+    while(rasqal_query_results_get_triple(results)) {
+      if(rasqal_query_results_next_triple(results))
+        break;
+    }
+  }
+
+  iostr = raptor_new_iostream_to_file_handle(raptor_world_ptr, output);
+  if(!iostr)
+    return 1;
+
+  rc = rasqal_query_results_explain(results, iostr, explain_format_name);
+  raptor_free_iostream(iostr);
+
+  if(rc)
+    fprintf(stderr, "%s: No query plan to explain\n", program);
+
+  return rc;
+}
+
+
+
 static rasqal_query_results*
 roqet_call_sparql_service(rasqal_world* world, raptor_uri* service_uri,
                           const unsigned char* query_string,
@@ -837,6 +877,7 @@ print_help(rasqal_world* world, raptor_world* raptor_world_ptr)
   puts(HELP_TEXT("s URI", "source URI  ", "Same as `-G URI'"));
   puts(HELP_TEXT("v", "version         ", "Print the Rasqal version"));
   puts(HELP_TEXT("W LEVEL", "warnings LEVEL", HELP_PAD "Set warning message LEVEL from 0: none to 100: all"));
+  puts(HELP_TEXT("x FORMAT", "explain FORMAT", HELP_PAD "Run the query and print the executed query plan with" HELP_PAD "per-operator statistics instead of the results" HELP_PAD "in FORMAT 'text' or 'json'"));
 #ifdef STORE_RESULTS_FLAG
   puts("\nDEBUG options:");
   puts(HELP_TEXT_LONG("store-results BOOL", "Set store results yes/no BOOL"));
@@ -894,6 +935,7 @@ main(int argc, char *argv[])
   const char* result_filename = NULL;
   const char *result_input_format_name = NULL;
   roqet_mode mode = MODE_EXEC_UNKNOWN;
+  const char* explain_format_name = NULL;
   
   program = argv[0];
   if((p = strrchr(program, '/')))
@@ -1244,6 +1286,18 @@ main(int argc, char *argv[])
         }
         break;
 
+      case 'x':
+        if(optarg) {
+          if(strcmp(optarg, "text") && strcmp(optarg, "json")) {
+            fprintf(stderr,
+                    "%s: invalid explain format `%s' for `" HELP_ARG(x, explain) "'\nValid formats are 'text' or 'json'\n",
+                    program, optarg);
+            usage = 1;
+          } else
+            explain_format_name = optarg;
+        }
+        break;
+
       case 'v':
         fputs(rasqal_version_string, stdout);
         fputc('\n', stdout);
@@ -1439,6 +1493,10 @@ main(int argc, char *argv[])
         rc = 1;
         goto tidy_query;
       }
+
+      /* time each operator for the executed plan */
+      if(explain_format_name)
+        rasqal_query_set_feature(rq, RASQAL_FEATURE_PROFILE, 1);
       
       if(output_format != QUERY_OUTPUT_NONE && !quiet)
         roqet_print_query(rq, raptor_world_ptr, output_format, base_uri);
@@ -1503,7 +1561,10 @@ main(int argc, char *argv[])
     goto tidy_query;
   }
 
-  if(rasqal_query_results_is_bindings(results)) {
+  if(explain_format_name) {
+    rc = roqet_explain_query_results(results, raptor_world_ptr, stdout,
+                                     explain_format_name);
+  } else if(rasqal_query_results_is_bindings(results)) {
     if(result_format_name)
       rc = print_formatted_query_results(world, results,
                                          raptor_world_ptr, stdout,